@@ -0,0 +1,471 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+
+#include "basicfp.h"
+#include "electron.h"
+#include "cpu.h"
+
+/* Native versions of some of the floating point routines in the
+   BASIC ROM along with a way to run the ROM's own code for the same
+   routines so that the two can be compared. The native versions work
+   on the same unpacked accumulators in zero page as the ROM and only
+   give a result when it is an ordinary number. Anything that would
+   make BASIC report an error, such as dividing by zero, is left to
+   the 6502 code. Only the routines whose result can be worked out
+   exactly with integer arithmetic are included */
+
+/* The offsets of the parts of an accumulator */
+#define BASIC_FP_SIGN     0
+#define BASIC_FP_OVERFLOW 1
+#define BASIC_FP_EXPONENT 2
+#define BASIC_FP_MANTISSA 3
+
+/* The bias of the exponent byte */
+#define BASIC_FP_EXPONENT_BIAS 128
+
+/* The emulated routines return to a JMP to itself in the unmapped
+   FRED page so that the cpu can be run in large steps and stopped
+   once it gets there */
+#define BASIC_FP_RETURN_ADDRESS 0xFC00
+#define BASIC_FP_STEP_CYCLES    1024
+/* The emulated routine is given up on if it hasn't returned after
+   this many cycles */
+#define BASIC_FP_MAX_CYCLES     (1 << 20)
+
+static const char *
+basic_fp_routine_names[BASIC_FP_ROUTINE_COUNT] =
+  {
+    "multiply", "divide", "sqr"
+  };
+
+/* A number read from an accumulator. The value is
+   mantissa / 2^40 * 2^exponent */
+typedef struct
+{
+  gboolean negative;
+  int exponent;
+  /* The 32 bits of the mantissa and the 8 bits of the rounding
+     byte. This is zero if the number is zero */
+  guint64 mantissa;
+} BasicFpValue;
+
+guint32
+basic_fp_checksum (const guint8 *rom)
+{
+  guint32 crc = 0xffffffff;
+  int i, bit;
+
+  /* CRC-32 of the whole ROM, the same as zlib and most ROM
+     catalogues use */
+  for (i = 0; i < ELECTRON_PAGED_ROM_LENGTH; i++)
+  {
+    crc ^= rom[i];
+    for (bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+
+  return crc ^ 0xffffffff;
+}
+
+const char *
+basic_fp_routine_name (BasicFpRoutine routine)
+{
+  g_return_val_if_fail (routine >= 0 && routine < BASIC_FP_ROUTINE_COUNT,
+                        NULL);
+
+  return basic_fp_routine_names[routine];
+}
+
+static void
+basic_fp_read (const guint8 *accumulator, BasicFpValue *value)
+{
+  int i;
+
+  value->negative = (accumulator[BASIC_FP_SIGN] & 0x80) ? TRUE : FALSE;
+  value->exponent = (accumulator[BASIC_FP_EXPONENT]
+                     - BASIC_FP_EXPONENT_BIAS);
+  value->mantissa = 0;
+  for (i = 0; i < 5; i++)
+    value->mantissa = ((value->mantissa << 8)
+                       | accumulator[BASIC_FP_MANTISSA + i]);
+
+  /* Make sure the top bit is set so that the routines can rely on
+     the range of the mantissa */
+  if (value->mantissa)
+    while ((value->mantissa & G_GUINT64_CONSTANT (0x8000000000)) == 0)
+    {
+      value->mantissa <<= 1;
+      value->exponent--;
+    }
+}
+
+static void
+basic_fp_store_zero (guint8 *accumulator)
+{
+  memset (accumulator, 0, BASIC_FP_ACCUMULATOR_SIZE);
+}
+
+/* Stores the value mantissa / 2^64 * 2^exponent, truncated to the 40
+   bits that fit in the accumulator. Returns FALSE without changing
+   the accumulator if the number is too big */
+static gboolean
+basic_fp_store (guint8 *accumulator, gboolean negative, int exponent,
+                guint64 mantissa)
+{
+  int i;
+
+  if (mantissa == 0)
+  {
+    basic_fp_store_zero (accumulator);
+    return TRUE;
+  }
+
+  while ((mantissa & G_GUINT64_CONSTANT (0x8000000000000000)) == 0)
+  {
+    mantissa <<= 1;
+    exponent--;
+  }
+
+  exponent += BASIC_FP_EXPONENT_BIAS;
+
+  if (exponent > 255)
+    return FALSE;
+  /* Numbers that are too small to represent become zero */
+  if (exponent < 1)
+  {
+    basic_fp_store_zero (accumulator);
+    return TRUE;
+  }
+
+  accumulator[BASIC_FP_SIGN] = negative ? 0x80 : 0x00;
+  accumulator[BASIC_FP_OVERFLOW] = 0;
+  accumulator[BASIC_FP_EXPONENT] = exponent;
+  for (i = 0; i < 5; i++)
+    accumulator[BASIC_FP_MANTISSA + i] = mantissa >> (56 - i * 8);
+
+  return TRUE;
+}
+
+static gboolean
+basic_fp_multiply (guint8 *fwa, const BasicFpValue *a, const BasicFpValue *b)
+{
+  guint64 a_high = a->mantissa >> 32, a_low = a->mantissa & 0xffffffff;
+  guint64 b_high = b->mantissa >> 32, b_low = b->mantissa & 0xffffffff;
+  guint64 high, middle, low;
+
+  if (a->mantissa == 0 || b->mantissa == 0)
+  {
+    basic_fp_store_zero (fwa);
+    return TRUE;
+  }
+
+  /* The exact 80-bit product split into the bits above and below bit
+     32. The high halves of the mantissas are only 8 bits so none of
+     the partial products can overflow */
+  low = a_low * b_low;
+  middle = a_high * b_low + a_low * b_high + (low >> 32);
+  high = a_high * b_high + (middle >> 32);
+
+  /* Keep the top 64 bits of the product */
+  return basic_fp_store (fwa, a->negative != b->negative,
+                         a->exponent + b->exponent,
+                         (high << 48)
+                         | ((middle & 0xffffffff) << 16)
+                         | ((low & 0xffffffff) >> 16));
+}
+
+static gboolean
+basic_fp_divide (guint8 *fwa, const BasicFpValue *a, const BasicFpValue *b)
+{
+  guint64 remainder = a->mantissa, quotient = 0;
+  int i;
+
+  /* Leave division by zero to BASIC to report */
+  if (b->mantissa == 0)
+    return FALSE;
+
+  if (a->mantissa == 0)
+  {
+    basic_fp_store_zero (fwa);
+    return TRUE;
+  }
+
+  /* Long division giving a / b * 2^63. Both mantissas are normalised
+     so the quotient is less than 2 and fits. The remainder is always
+     less than twice b so it never needs more than 41 bits */
+  for (i = 0; i < 64; i++)
+  {
+    quotient <<= 1;
+    if (remainder >= b->mantissa)
+    {
+      remainder -= b->mantissa;
+      quotient |= 1;
+    }
+    remainder <<= 1;
+  }
+
+  return basic_fp_store (fwa, a->negative != b->negative,
+                         a->exponent - b->exponent + 1,
+                         quotient);
+}
+
+static gboolean
+basic_fp_sqr (guint8 *fwa, const BasicFpValue *a)
+{
+  guint64 mantissa = a->mantissa, high, low, root = 0, remainder = 0;
+  int exponent = a->exponent, i;
+
+  if (mantissa == 0)
+  {
+    basic_fp_store_zero (fwa);
+    return TRUE;
+  }
+
+  /* Leave the error for negative numbers to BASIC */
+  if (a->negative)
+    return FALSE;
+
+  /* Make the exponent even so that it can be halved */
+  if ((exponent & 1))
+  {
+    mantissa <<= 1;
+    exponent--;
+  }
+
+  /* Take the integer square root of mantissa * 2^82 two bits at a
+     time. The mantissa has at most 41 bits so the root is less than
+     2^62 and the remainder never overflows */
+  high = mantissa << 18;
+  low = 0;
+  for (i = 63; i >= 0; i--)
+  {
+    guint64 trial;
+
+    remainder = ((remainder << 2)
+                 | ((i >= 32 ? high >> ((i - 32) * 2) : low >> (i * 2))
+                    & 3));
+    trial = (root << 2) | 1;
+    root <<= 1;
+    if (remainder >= trial)
+    {
+      remainder -= trial;
+      root |= 1;
+    }
+  }
+
+  /* root / 2^61 is the square root of mantissa / 2^40 */
+  return basic_fp_store (fwa, FALSE, exponent / 2 + 3, root);
+}
+
+/* Runs the native version of a routine on the accumulators in the
+   given 32k of RAM. Returns FALSE without changing anything if the
+   6502 code needs to handle the inputs */
+gboolean
+basic_fp_run_native (const BasicFpRom *rom, BasicFpRoutine routine,
+                     guint8 *memory)
+{
+  guint8 *fwa = memory + rom->fwa;
+  BasicFpValue a, b;
+
+  g_return_val_if_fail (routine >= 0 && routine < BASIC_FP_ROUTINE_COUNT,
+                        FALSE);
+
+  basic_fp_read (fwa, &a);
+
+  switch (routine)
+  {
+    case BASIC_FP_MULTIPLY:
+      basic_fp_read (memory + rom->fwb, &b);
+      return basic_fp_multiply (fwa, &a, &b);
+
+    case BASIC_FP_DIVIDE:
+      basic_fp_read (memory + rom->fwb, &b);
+      return basic_fp_divide (fwa, &a, &b);
+
+    case BASIC_FP_SQR:
+      return basic_fp_sqr (fwa, &a);
+
+    default:
+      g_return_val_if_reached (FALSE);
+  }
+}
+
+static guint8
+basic_fp_read_func (void *data, guint16 address)
+{
+  switch (address)
+  {
+    case BASIC_FP_RETURN_ADDRESS:
+      return 0x4c; /* JMP */
+    case BASIC_FP_RETURN_ADDRESS + 1:
+      return BASIC_FP_RETURN_ADDRESS & 0xff;
+    case BASIC_FP_RETURN_ADDRESS + 2:
+      return BASIC_FP_RETURN_ADDRESS >> 8;
+    default:
+      return 0xff;
+  }
+}
+
+static void
+basic_fp_write_func (void *data, guint16 address, guint8 val)
+{
+}
+
+/* Runs the 6502 code of a routine from the BASIC ROM on the
+   accumulators in the given 32k of RAM using a cpu of its own. Only
+   the RAM and the BASIC ROM are mapped. Returns FALSE if the routine
+   doesn't return, for example because it raised an error */
+gboolean
+basic_fp_run_emulated (const BasicFpRom *rom, BasicFpRoutine routine,
+                       const guint8 *basic_rom, guint8 *memory)
+{
+  guint16 return_address = BASIC_FP_RETURN_ADDRESS - 1;
+  gboolean ret;
+  Cpu cpu;
+
+  g_return_val_if_fail (routine >= 0 && routine < BASIC_FP_ROUTINE_COUNT,
+                        FALSE);
+  g_return_val_if_fail (rom->routines[routine] != 0, FALSE);
+
+  cpu_init (&cpu, memory, basic_fp_read_func, basic_fp_write_func, NULL);
+  cpu_map_pages (&cpu,
+                 ELECTRON_PAGED_ROM_ADDRESS / CPU_PAGE_SIZE,
+                 ELECTRON_PAGED_ROM_LENGTH / CPU_PAGE_SIZE,
+                 basic_rom, NULL);
+  cpu_set_rom_bank (&cpu, ELECTRON_BASIC_PAGE);
+
+  /* Call the routine as if with JSR from the top of the stack */
+  memory[0x1ff] = return_address >> 8;
+  memory[0x1fe] = return_address & 0xff;
+  cpu.s = 0xfd;
+  cpu.pc = rom->routines[routine];
+
+  while (cpu.pc != BASIC_FP_RETURN_ADDRESS && cpu.time < BASIC_FP_MAX_CYCLES)
+    cpu_fetch_execute (&cpu, cpu.time + BASIC_FP_STEP_CYCLES);
+
+  ret = cpu.pc == BASIC_FP_RETURN_ADDRESS;
+
+  cpu_destroy (&cpu);
+
+  return ret;
+}
+
+static void
+basic_fp_random_value (GRand *rand, guint8 *accumulator,
+                       gboolean allow_negative,
+                       int min_exponent, int max_exponent,
+                       gboolean rounding)
+{
+  int i;
+
+  basic_fp_store_zero (accumulator);
+
+  /* Test zero now and then */
+  if (g_rand_int_range (rand, 0, 64) == 0)
+    return;
+
+  if (allow_negative && g_rand_boolean (rand))
+    accumulator[BASIC_FP_SIGN] = 0x80;
+  accumulator[BASIC_FP_EXPONENT]
+    = (g_rand_int_range (rand, min_exponent, max_exponent + 1)
+       + BASIC_FP_EXPONENT_BIAS);
+  for (i = 0; i < 4; i++)
+    accumulator[BASIC_FP_MANTISSA + i] = g_rand_int_range (rand, 0, 256);
+  accumulator[BASIC_FP_MANTISSA] |= 0x80;
+  if (rounding)
+    accumulator[BASIC_FP_MANTISSA + 4] = g_rand_int_range (rand, 0, 256);
+}
+
+static void
+basic_fp_random_inputs (GRand *rand, BasicFpRoutine routine,
+                        guint8 *fwa, guint8 *fwb)
+{
+  /* FWA can be the result of an earlier calculation so it gets a
+     rounding byte. FWB is loaded from a variable so it doesn't */
+  switch (routine)
+  {
+    case BASIC_FP_MULTIPLY:
+    case BASIC_FP_DIVIDE:
+      basic_fp_random_value (rand, fwa, TRUE, -60, 60, TRUE);
+      basic_fp_random_value (rand, fwb, TRUE, -60, 60, FALSE);
+      break;
+
+    case BASIC_FP_SQR:
+      basic_fp_random_value (rand, fwa, FALSE, -127, 127, TRUE);
+      basic_fp_random_value (rand, fwb, FALSE, 0, 0, FALSE);
+      break;
+
+    default:
+      g_return_if_reached ();
+  }
+}
+
+/* Runs a routine on random inputs with both the native code and the
+   6502 code and compares the whole of FWA afterwards */
+void
+basic_fp_validate (const BasicFpRom *rom, BasicFpRoutine routine,
+                   const guint8 *basic_rom, GRand *rand, guint n_tests,
+                   BasicFpValidation *validation)
+{
+  guint8 *native = g_malloc0 (CPU_RAM_SIZE);
+  guint8 *emulated = g_malloc0 (CPU_RAM_SIZE);
+  guint8 fwa[BASIC_FP_ACCUMULATOR_SIZE], fwb[BASIC_FP_ACCUMULATOR_SIZE];
+  guint i;
+
+  memset (validation, 0, sizeof (BasicFpValidation));
+
+  for (i = 0; i < n_tests; i++)
+  {
+    basic_fp_random_inputs (rand, routine, fwa, fwb);
+
+    memcpy (native + rom->fwa, fwa, BASIC_FP_ACCUMULATOR_SIZE);
+    memcpy (native + rom->fwb, fwb, BASIC_FP_ACCUMULATOR_SIZE);
+    memcpy (emulated + rom->fwa, fwa, BASIC_FP_ACCUMULATOR_SIZE);
+    memcpy (emulated + rom->fwb, fwb, BASIC_FP_ACCUMULATOR_SIZE);
+
+    validation->n_tests++;
+
+    if (!basic_fp_run_native (rom, routine, native))
+      validation->n_fallbacks++;
+    else if (!basic_fp_run_emulated (rom, routine, basic_rom, emulated))
+      validation->n_timeouts++;
+    else if (!memcmp (native + rom->fwa, emulated + rom->fwa,
+                      BASIC_FP_ACCUMULATOR_SIZE))
+      validation->n_matched++;
+    else if (!validation->has_mismatch)
+    {
+      validation->has_mismatch = TRUE;
+      memcpy (validation->fwa, fwa, BASIC_FP_ACCUMULATOR_SIZE);
+      memcpy (validation->fwb, fwb, BASIC_FP_ACCUMULATOR_SIZE);
+      memcpy (validation->native, native + rom->fwa,
+              BASIC_FP_ACCUMULATOR_SIZE);
+      memcpy (validation->emulated, emulated + rom->fwa,
+              BASIC_FP_ACCUMULATOR_SIZE);
+    }
+  }
+
+  g_free (native);
+  g_free (emulated);
+}
@@ -0,0 +1,79 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BASIC_FP_H
+#define _BASIC_FP_H
+
+#include <glib.h>
+
+/* The floating point routines in the BASIC ROM that have a native
+   version. The binary routines leave the result of FWA op
+   FWB in FWA and SQR replaces FWA with its square root */
+typedef enum
+{
+  BASIC_FP_MULTIPLY,
+  BASIC_FP_DIVIDE,
+  BASIC_FP_SQR,
+  BASIC_FP_ROUTINE_COUNT
+} BasicFpRoutine;
+
+/* The size of an unpacked floating point accumulator in zero
+   page. It is laid out as the sign in bit 7 of the first byte, an
+   overflow byte, the exponent with a bias of 128, four bytes of
+   mantissa with the most significant byte first and a rounding byte
+   with eight more bits of mantissa */
+#define BASIC_FP_ACCUMULATOR_SIZE 8
+
+/* Where to find the routines in one version of the BASIC ROM */
+typedef struct
+{
+  /* The zero page addresses of the two accumulators */
+  guint8 fwa, fwb;
+  /* The entry point of each routine or 0 if it isn't known */
+  guint16 routines[BASIC_FP_ROUTINE_COUNT];
+} BasicFpRom;
+
+/* The outcome of comparing the native version of a routine with the
+   6502 code on random inputs */
+typedef struct
+{
+  guint n_tests;
+  guint n_matched;
+  /* The inputs that the native code leaves to the ROM, for example
+     because they cause a BASIC error */
+  guint n_fallbacks;
+  /* The inputs that the 6502 code didn't return from */
+  guint n_timeouts;
+  /* The first input that gave a different result */
+  gboolean has_mismatch;
+  guint8 fwa[BASIC_FP_ACCUMULATOR_SIZE], fwb[BASIC_FP_ACCUMULATOR_SIZE];
+  guint8 emulated[BASIC_FP_ACCUMULATOR_SIZE];
+  guint8 native[BASIC_FP_ACCUMULATOR_SIZE];
+} BasicFpValidation;
+
+guint32 basic_fp_checksum (const guint8 *rom);
+const char *basic_fp_routine_name (BasicFpRoutine routine);
+gboolean basic_fp_run_native (const BasicFpRom *rom, BasicFpRoutine routine,
+                              guint8 *memory);
+gboolean basic_fp_run_emulated (const BasicFpRom *rom, BasicFpRoutine routine,
+                                const guint8 *basic_rom, guint8 *memory);
+void basic_fp_validate (const BasicFpRom *rom, BasicFpRoutine routine,
+                        const guint8 *basic_rom, GRand *rand, guint n_tests,
+                        BasicFpValidation *validation);
+
+#endif /* _BASIC_FP_H */
@@ -0,0 +1,378 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "cpu.h"
+
+/* Microbenchmark for the cpu cores. Each kernel is a small program
+   that loops forever so that it can be run for any number of cycles.
+   The first one behaves like the inner loop of BBC BASIC: it scans a
+   tokenised line through a zero page pointer and calls a routine doing
+   multi-byte integer arithmetic for each token. Almost every
+   instruction sets the N and Z flags but only a few of them are ever
+   tested */
+
+#define BENCH_CODE_ADDRESS 0x1000
+#define BENCH_TEXT_ADDRESS 0x2000
+#define BENCH_TEXT_POINTER 0x70
+/* The cpu is run for one scanline at a time like the Electron does */
+#define BENCH_CYCLES_PER_CALL 128
+#define BENCH_DEFAULT_MEGACYCLES 100
+/* The number of cycles to run with the profiler to work out the
+   average number of cycles per instruction of each kernel */
+#define BENCH_CPI_CYCLES 1000000
+
+static const guint8
+bench_basic_code[] =
+  {
+    /* 1000 loop: */
+    0xa0, 0x00,             /* LDY #0 */
+    /* 1002 scan: */
+    0xb1, 0x70,             /* LDA (&70),Y */
+    0xc9, 0x0d,             /* CMP #&0D */
+    0xf0, 0x0a,             /* BEQ endline */
+    0xc9, 0x80,             /* CMP #&80 */
+    0x90, 0x03,             /* BCC notoken */
+    0x20, 0x20, 0x10,       /* JSR addint */
+    /* 100F notoken: */
+    0xc8,                   /* INY */
+    0xd0, 0xf0,             /* BNE scan */
+    /* 1012 endline: */
+    0x4c, 0x00, 0x10,       /* JMP loop */
+    0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea, 0xea,
+    /* 1020 addint: */
+    0x18,                   /* CLC */
+    0xa5, 0x2a,             /* LDA &2A */
+    0x65, 0x30,             /* ADC &30 */
+    0x85, 0x2a,             /* STA &2A */
+    0xa5, 0x2b,             /* LDA &2B */
+    0x65, 0x31,             /* ADC &31 */
+    0x85, 0x2b,             /* STA &2B */
+    0xa5, 0x2c,             /* LDA &2C */
+    0x65, 0x32,             /* ADC &32 */
+    0x85, 0x2c,             /* STA &2C */
+    0xa5, 0x2d,             /* LDA &2D */
+    0x65, 0x33,             /* ADC &33 */
+    0x85, 0x2d,             /* STA &2D */
+    0x26, 0x30,             /* ROL &30 */
+    0x26, 0x31,             /* ROL &31 */
+    0x26, 0x32,             /* ROL &32 */
+    0x26, 0x33,             /* ROL &33 */
+    0xa2, 0x03,             /* LDX #3 */
+    /* 1043 compare: */
+    0xb5, 0x2a,             /* LDA &2A,X */
+    0xd5, 0x30,             /* CMP &30,X */
+    0xd0, 0x03,             /* BNE done */
+    0xca,                   /* DEX */
+    0x10, 0xf7,             /* BPL compare */
+    /* 104C done: */
+    0x60                    /* RTS */
+  };
+
+/* A counter in the registers. This is mostly the cost of dispatching
+   the cheapest instructions */
+static const guint8
+bench_loop_code[] =
+  {
+    0xa2, 0x00,             /* LDX #0 */
+    /* 1002 loop: */
+    0xe8,                   /* INX */
+    0xd0, 0xfd,             /* BNE loop */
+    0xc8,                   /* INY */
+    0x4c, 0x02, 0x10        /* JMP loop */
+  };
+
+/* A 24-bit decimal counter counting up alongside a byte counting down
+   so that both ADC and SBC go through the decimal mode paths */
+static const guint8
+bench_bcd_code[] =
+  {
+    0xf8,                   /* SED */
+    /* 1001 loop: */
+    0x18,                   /* CLC */
+    0xa5, 0x40,             /* LDA &40 */
+    0x69, 0x01,             /* ADC #1 */
+    0x85, 0x40,             /* STA &40 */
+    0xa5, 0x41,             /* LDA &41 */
+    0x69, 0x00,             /* ADC #0 */
+    0x85, 0x41,             /* STA &41 */
+    0xa5, 0x42,             /* LDA &42 */
+    0x69, 0x00,             /* ADC #0 */
+    0x85, 0x42,             /* STA &42 */
+    0x38,                   /* SEC */
+    0xa5, 0x43,             /* LDA &43 */
+    0xe9, 0x07,             /* SBC #7 */
+    0x85, 0x43,             /* STA &43 */
+    0x4c, 0x01, 0x10        /* JMP loop */
+  };
+
+/* Copies four pages from &2000 to &3000 through two zero page
+   pointers with the indirect indexed addressing mode */
+static const guint8
+bench_memcpy_code[] =
+  {
+    /* 1000 loop: */
+    0xa9, 0x00,             /* LDA #0 */
+    0x85, 0x70,             /* STA &70 */
+    0x85, 0x72,             /* STA &72 */
+    0xa9, 0x20,             /* LDA #&20 */
+    0x85, 0x71,             /* STA &71 */
+    0xa9, 0x30,             /* LDA #&30 */
+    0x85, 0x73,             /* STA &73 */
+    0xa2, 0x04,             /* LDX #4 */
+    0xa0, 0x00,             /* LDY #0 */
+    /* 1012 copy: */
+    0xb1, 0x70,             /* LDA (&70),Y */
+    0x91, 0x72,             /* STA (&72),Y */
+    0xc8,                   /* INY */
+    0xd0, 0xf9,             /* BNE copy */
+    0xe6, 0x71,             /* INC &71 */
+    0xe6, 0x73,             /* INC &73 */
+    0xca,                   /* DEX */
+    0xd0, 0xf2,             /* BNE copy */
+    0x4c, 0x00, 0x10        /* JMP loop */
+  };
+
+/* Calculates the tenth Fibonacci number the slow way by recursing
+   down to every leaf and counting them */
+static const guint8
+bench_recursion_code[] =
+  {
+    0xa2, 0xff,             /* LDX #&FF */
+    0x9a,                   /* TXS */
+    /* 1003 loop: */
+    0xa9, 0x0a,             /* LDA #10 */
+    0x20, 0x0b, 0x10,       /* JSR fib */
+    0x4c, 0x03, 0x10,       /* JMP loop */
+    /* 100B fib: */
+    0xc9, 0x02,             /* CMP #2 */
+    0x90, 0x0e,             /* BCC leaf */
+    0x48,                   /* PHA */
+    0xe9, 0x01,             /* SBC #1 */
+    0x20, 0x0b, 0x10,       /* JSR fib */
+    0x68,                   /* PLA */
+    0x38,                   /* SEC */
+    0xe9, 0x02,             /* SBC #2 */
+    0x20, 0x0b, 0x10,       /* JSR fib */
+    0x60,                   /* RTS */
+    /* 101D leaf: */
+    0xe6, 0x40,             /* INC &40 */
+    0x60                    /* RTS */
+  };
+
+static void
+bench_basic_setup (guint8 *memory)
+{
+  int i;
+
+  /* Make a line of text with a token every few characters */
+  for (i = 0; i < 200; i++)
+    memory[BENCH_TEXT_ADDRESS + i] = (i % 5) ? 'A' + i % 26 : 0x80 + i % 64;
+  memory[BENCH_TEXT_ADDRESS + i] = 0x0d;
+  memory[BENCH_TEXT_POINTER] = BENCH_TEXT_ADDRESS & 0xff;
+  memory[BENCH_TEXT_POINTER + 1] = BENCH_TEXT_ADDRESS >> 8;
+  memory[0x30] = 0x5a;
+}
+
+static void
+bench_memcpy_setup (guint8 *memory)
+{
+  int i;
+
+  for (i = 0; i < 1024; i++)
+    memory[0x2000 + i] = i * 7;
+}
+
+static const struct
+{
+  const char *name;
+  const guint8 *code;
+  size_t code_size;
+  /* Called to fill in any data that the kernel needs or NULL */
+  void (* setup) (guint8 *memory);
+} bench_kernels[] =
+  {
+    { "basic", bench_basic_code, sizeof (bench_basic_code),
+      bench_basic_setup },
+    { "loop", bench_loop_code, sizeof (bench_loop_code), NULL },
+    { "bcd", bench_bcd_code, sizeof (bench_bcd_code), NULL },
+    { "memcpy", bench_memcpy_code, sizeof (bench_memcpy_code),
+      bench_memcpy_setup },
+    { "recursion", bench_recursion_code, sizeof (bench_recursion_code),
+      NULL }
+  };
+
+static const struct
+{
+  const char *name;
+  CpuCore core;
+} bench_cores[] =
+  {
+    { "jumpblock", CPU_CORE_JUMPBLOCK },
+    { "threaded", CPU_CORE_THREADED },
+    { "predecode", CPU_CORE_PREDECODE },
+    { "jit", CPU_CORE_JIT }
+  };
+
+static guint8
+bench_read_func (void *data, guint16 address)
+{
+  return 0xff;
+}
+
+static void
+bench_write_func (void *data, guint16 address, guint8 val)
+{
+}
+
+static guint8 *
+bench_make_memory (int kernel)
+{
+  guint8 *memory = g_malloc0 (CPU_RAM_SIZE);
+
+  memcpy (memory + BENCH_CODE_ADDRESS, bench_kernels[kernel].code,
+          bench_kernels[kernel].code_size);
+  if (bench_kernels[kernel].setup)
+    bench_kernels[kernel].setup (memory);
+
+  return memory;
+}
+
+/* Works out the average number of cycles taken by each instruction
+   of a kernel by running it for a while with the profiler. The
+   kernels don't depend on anything outside of the cpu so this is the
+   same for every core */
+static double
+bench_cycles_per_instruction (int kernel)
+{
+  guint8 *memory = bench_make_memory (kernel);
+  CpuProfile *profile;
+  guint64 instructions = 0;
+  double cpi;
+  Cpu cpu;
+  int i;
+
+  cpu_init (&cpu, memory, bench_read_func, bench_write_func, NULL);
+  cpu_set_profiling (&cpu, TRUE);
+  cpu.pc = BENCH_CODE_ADDRESS;
+
+  while (cpu.time < BENCH_CPI_CYCLES)
+    cpu_fetch_execute (&cpu, cpu.time + BENCH_CYCLES_PER_CALL);
+
+  profile = cpu_get_profile (&cpu);
+  for (i = 0; i < 256; i++)
+    instructions += profile->opcode_instructions[i];
+
+  cpi = instructions ? cpu.time / (double) instructions : 1.0;
+
+  cpu_destroy (&cpu);
+  g_free (memory);
+
+  return cpi;
+}
+
+static void
+bench_run_core (int kernel, const char *name, CpuCore core,
+                cycles_t cycles, double cpi)
+{
+  guint8 *memory = bench_make_memory (kernel);
+  GTimer *timer;
+  double elapsed;
+  Cpu cpu;
+
+  cpu_init (&cpu, memory, bench_read_func, bench_write_func, NULL);
+
+  if (!cpu_set_core (&cpu, core))
+  {
+    printf ("%-10s %-10s not available\n", bench_kernels[kernel].name, name);
+    cpu_destroy (&cpu);
+    g_free (memory);
+    return;
+  }
+
+  /* Run without the debugger like the emulator normally does */
+  cpu_set_debug (&cpu, FALSE);
+  cpu.pc = BENCH_CODE_ADDRESS;
+
+  timer = g_timer_new ();
+
+  while (cpu.time < cycles)
+    cpu_fetch_execute (&cpu, cpu.time + BENCH_CYCLES_PER_CALL);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  printf ("%-10s %-10s %8.3f s %10.1f MHz %8.2f ns/instruction\n",
+          bench_kernels[kernel].name, name, elapsed,
+          cpu.time / elapsed / 1e6,
+          elapsed * 1e9 / (cpu.time / cpi));
+
+  g_timer_destroy (timer);
+  cpu_destroy (&cpu);
+  g_free (memory);
+}
+
+int
+main (int argc, char **argv)
+{
+  cycles_t cycles = BENCH_DEFAULT_MEGACYCLES * (cycles_t) 1000000;
+  const char *kernel_name = NULL;
+  gboolean found = FALSE;
+  int kernel, i;
+
+  if (argc > 3)
+  {
+    fprintf (stderr, "usage: %s [megacycles [kernel]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (argc > 1)
+    cycles = strtoul (argv[1], NULL, 10) * (cycles_t) 1000000;
+  if (argc > 2)
+    kernel_name = argv[2];
+
+  for (kernel = 0; kernel < G_N_ELEMENTS (bench_kernels); kernel++)
+  {
+    double cpi;
+
+    if (kernel_name && strcmp (kernel_name, bench_kernels[kernel].name))
+      continue;
+
+    found = TRUE;
+    cpi = bench_cycles_per_instruction (kernel);
+
+    for (i = 0; i < G_N_ELEMENTS (bench_cores); i++)
+      bench_run_core (kernel, bench_cores[i].name, bench_cores[i].core,
+                      cycles, cpi);
+  }
+
+  if (!found)
+  {
+    fprintf (stderr, "Unknown kernel \"%s\"\n", kernel_name);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
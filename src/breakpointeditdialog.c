@@ -24,10 +24,16 @@
 #include <gtk/gtkadjustment.h>
 #include <gtk/gtklabel.h>
 #include <gtk/gtkbox.h>
-#include <gtk/gtkcheckbutton.h>
+#include <gtk/gtkhbox.h>
+#include <gtk/gtkbutton.h>
 #include <gtk/gtkcombobox.h>
 #include <gtk/gtkstock.h>
 #include <gtk/gtktable.h>
+#include <gtk/gtkliststore.h>
+#include <gtk/gtktreeview.h>
+#include <gtk/gtktreeselection.h>
+#include <gtk/gtkcellrenderertext.h>
+#include <gtk/gtkscrolledwindow.h>
 
 #include "electronmanager.h"
 #include "hexspinbutton.h"
@@ -36,7 +42,7 @@
 static const struct
 {
   const char *name;
-  int break_type;
+  CpuBreakType break_type;
 } breakpoint_edit_dialog_break_types[] =
   {
     { N_("Break at address"), CPU_BREAK_ADDR },
@@ -47,40 +53,165 @@ static const struct
 #define BREAKPOINT_EDIT_DIALOG_BREAK_TYPE_COUNT \
  (sizeof (breakpoint_edit_dialog_break_types) / sizeof (breakpoint_edit_dialog_break_types[0]))
 
+enum
+  {
+    BREAKPOINT_EDIT_DIALOG_COL_TYPE,
+    BREAKPOINT_EDIT_DIALOG_COL_ADDRESS,
+    BREAKPOINT_EDIT_DIALOG_COL_COUNT
+  };
+
+/* The widgets that the callbacks need. The dialog is modal so this
+   can live on the stack of breakpoint_edit_dialog_run */
+typedef struct
+{
+  ElectronManager *electron;
+  GtkListStore *store;
+  GtkWidget *tree_view;
+  GtkWidget *remove_button, *clear_button;
+  GtkAdjustment *start_adj, *end_adj;
+  GtkWidget *type_combobox;
+} BreakpointEditDialogData;
+
+static void
+breakpoint_edit_dialog_update_list (BreakpointEditDialogData *data)
+{
+  Cpu *cpu = &data->electron->data->cpu;
+  guint i, n_breakpoints = cpu_get_n_breakpoints (cpu);
+
+  gtk_list_store_clear (data->store);
+
+  for (i = 0; i < n_breakpoints; i++)
+  {
+    const CpuBreakpoint *bp = cpu_get_breakpoint (cpu, i);
+    const char *type_name = "";
+    GtkTreeIter iter;
+    char *address;
+    int j;
+
+    for (j = 0; j < BREAKPOINT_EDIT_DIALOG_BREAK_TYPE_COUNT; j++)
+      if (breakpoint_edit_dialog_break_types[j].break_type == bp->type)
+      {
+        type_name = _(breakpoint_edit_dialog_break_types[j].name);
+        break;
+      }
+
+    /* A range is shown as the first and last address */
+    if (bp->start == bp->end)
+      address = g_strdup_printf ("%04X", bp->start);
+    else
+      address = g_strdup_printf ("%04X-%04X", bp->start, bp->end);
+
+    gtk_list_store_append (data->store, &iter);
+    gtk_list_store_set (data->store, &iter,
+                        BREAKPOINT_EDIT_DIALOG_COL_TYPE, type_name,
+                        BREAKPOINT_EDIT_DIALOG_COL_ADDRESS, address,
+                        -1);
+
+    g_free (address);
+  }
+
+  gtk_widget_set_sensitive (data->clear_button, n_breakpoints > 0);
+}
+
+static void
+breakpoint_edit_dialog_on_selection_changed (GtkTreeSelection *selection,
+                                             BreakpointEditDialogData *data)
+{
+  gtk_widget_set_sensitive (data->remove_button,
+                            gtk_tree_selection_get_selected (selection,
+                                                             NULL, NULL));
+}
+
 static void
-breakpoint_edit_dialog_set_sensitive (GtkWidget *widget, gpointer data)
+breakpoint_edit_dialog_on_start_changed (GtkAdjustment *start_adj,
+                                         BreakpointEditDialogData *data)
 {
-  if (widget != GTK_WIDGET (data))
-    gtk_widget_set_sensitive (widget, TRUE);
+  /* Keep the range to a single address until the end is changed */
+  gtk_adjustment_set_value (data->end_adj,
+                            gtk_adjustment_get_value (start_adj));
 }
 
 static void
-breakpoint_edit_dialog_set_insensitive (GtkWidget *widget, gpointer data)
+breakpoint_edit_dialog_on_add (GtkButton *button,
+                               BreakpointEditDialogData *data)
 {
-  if (widget != GTK_WIDGET (data))
-    gtk_widget_set_sensitive (widget, FALSE);
+  int type_num
+    = gtk_combo_box_get_active (GTK_COMBO_BOX (data->type_combobox));
+
+  if (type_num < 0)
+    return;
+
+  cpu_add_breakpoint (&data->electron->data->cpu,
+                      breakpoint_edit_dialog_break_types[type_num].break_type,
+                      (guint16) gtk_adjustment_get_value (data->start_adj),
+                      (guint16) gtk_adjustment_get_value (data->end_adj));
+
+  breakpoint_edit_dialog_update_list (data);
 }
 
 static void
-breakpoint_edit_dialog_update_sensitivity (GtkCheckButton *enabled_checkbox, GtkWidget *table)
+breakpoint_edit_dialog_on_remove (GtkButton *button,
+                                  BreakpointEditDialogData *data)
 {
-  g_return_if_fail (GTK_IS_CHECK_BUTTON (enabled_checkbox));
-  g_return_if_fail (GTK_IS_WIDGET (table));
-
-  gtk_container_foreach (GTK_CONTAINER (table),
-                         gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (enabled_checkbox))
-                         ? breakpoint_edit_dialog_set_sensitive
-                         : breakpoint_edit_dialog_set_insensitive,
-                         enabled_checkbox);
+  GtkTreeSelection *selection
+    = gtk_tree_view_get_selection (GTK_TREE_VIEW (data->tree_view));
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+
+  if (gtk_tree_selection_get_selected (selection, &model, &iter))
+  {
+    GtkTreePath *path = gtk_tree_model_get_path (model, &iter);
+
+    /* The rows are in the same order as the breakpoints in the cpu */
+    cpu_remove_breakpoint (&data->electron->data->cpu,
+                           gtk_tree_path_get_indices (path)[0]);
+    gtk_tree_path_free (path);
+
+    breakpoint_edit_dialog_update_list (data);
+  }
+}
+
+static void
+breakpoint_edit_dialog_on_clear (GtkButton *button,
+                                 BreakpointEditDialogData *data)
+{
+  cpu_clear_breakpoints (&data->electron->data->cpu);
+
+  breakpoint_edit_dialog_update_list (data);
+}
+
+static GtkWidget *
+breakpoint_edit_dialog_add_hexspin (GtkWidget *table, int row,
+                                    const char *label_text,
+                                    GtkAdjustment *adjustment)
+{
+  GtkWidget *label, *hexspin;
+
+  label = gtk_label_new_with_mnemonic (label_text);
+  gtk_misc_set_alignment (GTK_MISC (label), 0.0f, 0.5f);
+  gtk_widget_show (label);
+  gtk_table_attach (GTK_TABLE (table), label, 0, 1, row, row + 1,
+                    GTK_FILL, 0, 0, 0);
+
+  hexspin = hex_spin_button_new ();
+  g_object_set (hexspin, "numeric", TRUE, "adjustment", adjustment,
+                "hex", TRUE, "digits", 4, NULL);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), hexspin);
+  gtk_widget_show (hexspin);
+  gtk_table_attach (GTK_TABLE (table), hexspin, 1, 2, row, row + 1,
+                    GTK_FILL | GTK_EXPAND, 0, 0, 0);
+
+  return hexspin;
 }
 
 void
 breakpoint_edit_dialog_run (GtkWindow *parent, ElectronManager *electron)
 {
   int i;
-  gint response;
-  GtkWidget *dialog, *label, *enabled_checkbox, *type_combobox, *table;
-  GtkAdjustment *address_adj;
+  BreakpointEditDialogData data;
+  GtkWidget *dialog, *label, *table, *scrolled_win, *hbox, *add_button;
+  GtkCellRenderer *cell_renderer;
+  GtkTreeSelection *selection;
 
   g_return_if_fail (GTK_IS_WINDOW (parent));
   g_return_if_fail (IS_ELECTRON_MANAGER (electron));
@@ -88,110 +219,125 @@ breakpoint_edit_dialog_run (GtkWindow *parent, ElectronManager *electron)
   /* Reference the electron manager so that it won't disappear while
      the dialog is running */
   g_object_ref (electron);
+  data.electron = electron;
 
-  dialog = gtk_dialog_new_with_buttons (_("Edit breakpoint"),
+  dialog = gtk_dialog_new_with_buttons (_("Breakpoints"),
                                         parent,
                                         GTK_DIALOG_MODAL,
-                                        GTK_STOCK_CANCEL, GTK_RESPONSE_REJECT,
-                                        GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+                                        GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
                                         NULL);
 
   /* Layout the controls in a table */
-  table = gtk_table_new (3, 2, FALSE);
+  table = gtk_table_new (6, 2, FALSE);
   gtk_table_set_row_spacings (GTK_TABLE (table), 6);
   gtk_table_set_col_spacings (GTK_TABLE (table), 12);
   gtk_container_set_border_width (GTK_CONTAINER (table), 10);
 
-  /* Create a checkbox to enable or disable the breakpoint */
-  enabled_checkbox = gtk_check_button_new_with_mnemonic (_("_Enable breakpoint"));
-  /* Reference it so we can check whether it was enabled after the
-     dialog is destroyed */
-  g_object_ref_sink (enabled_checkbox);
-  g_signal_connect (G_OBJECT (enabled_checkbox), "toggled",
-                    G_CALLBACK (breakpoint_edit_dialog_update_sensitivity),
-                    table);
-  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (enabled_checkbox),
-                                electron->data->cpu.break_type != CPU_BREAK_NONE);
-  gtk_widget_show (enabled_checkbox);
-  gtk_table_attach_defaults (GTK_TABLE (table), enabled_checkbox, 0, 2, 0, 1);
-
-  label = gtk_label_new_with_mnemonic (_("_Address:"));
-  gtk_misc_set_alignment (GTK_MISC (label), 0.0f, 0.5f);
-  gtk_widget_show (label);
-  gtk_table_attach (GTK_TABLE (table), label, 0, 1, 1, 2, GTK_FILL, 0, 0, 0);
-
-  /* Create an adjustment for the breakpoint address */
-  address_adj = GTK_ADJUSTMENT (gtk_adjustment_new
-                                (electron->data->cpu.break_type == CPU_BREAK_NONE ? 0.0
-                                 : (gdouble) electron->data->cpu.break_address,
-                                 0.0, 65535.0, 1.0, 16.0, 0.0));
-  /* Reference it so that it won't go away after the dialog is destroyed */
-  g_object_ref_sink (address_adj);
-
-  /* Create a spin control for the address */
-  GtkWidget *hexspin = hex_spin_button_new ();
-  g_object_set (hexspin, "numeric", TRUE, "adjustment", address_adj, "hex", TRUE,
-                "digits", 4, NULL);
-  gtk_label_set_mnemonic_widget (GTK_LABEL (label), hexspin);
-  gtk_widget_show (hexspin);
-  gtk_table_attach_defaults (GTK_TABLE (table), hexspin, 1, 2, 1, 2);
+  /* Create a list of the current breakpoints */
+  data.store = gtk_list_store_new (BREAKPOINT_EDIT_DIALOG_COL_COUNT,
+                                   G_TYPE_STRING, G_TYPE_STRING);
+  data.tree_view
+    = gtk_tree_view_new_with_model (GTK_TREE_MODEL (data.store));
+  g_object_unref (data.store);
+  cell_renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_insert_column_with_attributes
+    (GTK_TREE_VIEW (data.tree_view), -1, _("Address"), cell_renderer,
+     "text", BREAKPOINT_EDIT_DIALOG_COL_ADDRESS, NULL);
+  cell_renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_insert_column_with_attributes
+    (GTK_TREE_VIEW (data.tree_view), -1, _("Type"), cell_renderer,
+     "text", BREAKPOINT_EDIT_DIALOG_COL_TYPE, NULL);
+  gtk_widget_show (data.tree_view);
+
+  scrolled_win = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_win),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolled_win),
+                                       GTK_SHADOW_IN);
+  gtk_widget_set_size_request (scrolled_win, -1, 150);
+  gtk_container_add (GTK_CONTAINER (scrolled_win), data.tree_view);
+  gtk_widget_show (scrolled_win);
+  gtk_table_attach_defaults (GTK_TABLE (table), scrolled_win, 0, 2, 0, 1);
+
+  /* Buttons to remove breakpoints from the list */
+  hbox = gtk_hbox_new (FALSE, 6);
+  data.remove_button = gtk_button_new_from_stock (GTK_STOCK_REMOVE);
+  g_signal_connect (G_OBJECT (data.remove_button), "clicked",
+                    G_CALLBACK (breakpoint_edit_dialog_on_remove), &data);
+  gtk_widget_show (data.remove_button);
+  gtk_box_pack_end (GTK_BOX (hbox), data.remove_button, FALSE, FALSE, 0);
+  data.clear_button = gtk_button_new_from_stock (GTK_STOCK_CLEAR);
+  g_signal_connect (G_OBJECT (data.clear_button), "clicked",
+                    G_CALLBACK (breakpoint_edit_dialog_on_clear), &data);
+  gtk_widget_show (data.clear_button);
+  gtk_box_pack_end (GTK_BOX (hbox), data.clear_button, FALSE, FALSE, 0);
+  gtk_widget_show (hbox);
+  gtk_table_attach (GTK_TABLE (table), hbox, 0, 2, 1, 2, GTK_FILL, 0, 0, 0);
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (data.tree_view));
+  g_signal_connect (G_OBJECT (selection), "changed",
+                    G_CALLBACK (breakpoint_edit_dialog_on_selection_changed),
+                    &data);
+  breakpoint_edit_dialog_on_selection_changed (selection, &data);
+
+  /* Create adjustments for the range of addresses of a new
+     breakpoint */
+  data.start_adj = GTK_ADJUSTMENT (gtk_adjustment_new (0.0, 0.0, 65535.0,
+                                                       1.0, 16.0, 0.0));
+  data.end_adj = GTK_ADJUSTMENT (gtk_adjustment_new (0.0, 0.0, 65535.0,
+                                                     1.0, 16.0, 0.0));
+  /* Reference them so that they won't go away after the dialog is
+     destroyed */
+  g_object_ref_sink (data.start_adj);
+  g_object_ref_sink (data.end_adj);
+  g_signal_connect (G_OBJECT (data.start_adj), "value-changed",
+                    G_CALLBACK (breakpoint_edit_dialog_on_start_changed),
+                    &data);
+
+  breakpoint_edit_dialog_add_hexspin (table, 2, _("_Address:"),
+                                      data.start_adj);
+  breakpoint_edit_dialog_add_hexspin (table, 3, _("_End address:"),
+                                      data.end_adj);
 
   label = gtk_label_new_with_mnemonic (_("Break _type:"));
   gtk_misc_set_alignment (GTK_MISC (label), 0.0f, 0.5f);
   gtk_widget_show (label);
-  gtk_table_attach (GTK_TABLE (table), label, 0, 1, 2, 3, GTK_FILL, 0, 0, 0);
+  gtk_table_attach (GTK_TABLE (table), label, 0, 1, 4, 5, GTK_FILL, 0, 0, 0);
 
   /* Create a combo box for the breakpoint type */
-  type_combobox = gtk_combo_box_new_text ();
-  /* Reference it so we can check the type after the dialog is destroyed */
-  g_object_ref_sink (type_combobox);
+  data.type_combobox = gtk_combo_box_new_text ();
   /* Add all of the break point type strings */
   for (i = 0; i < BREAKPOINT_EDIT_DIALOG_BREAK_TYPE_COUNT; i++)
-    gtk_combo_box_append_text (GTK_COMBO_BOX (type_combobox),
-                               breakpoint_edit_dialog_break_types[i].name);
-  /* Select the current breakpoint type */
-  for (i = 0; i < BREAKPOINT_EDIT_DIALOG_BREAK_TYPE_COUNT; i++)
-    if (breakpoint_edit_dialog_break_types[i].break_type
-        == electron->data->cpu.break_type)
-    {
-      gtk_combo_box_set_active (GTK_COMBO_BOX (type_combobox), i);
-      break;
-    }
-  /* If no type matches then just assume the first type */
-  if (i >= BREAKPOINT_EDIT_DIALOG_BREAK_TYPE_COUNT)
-    gtk_combo_box_set_active (GTK_COMBO_BOX (type_combobox), 0);
-  gtk_label_set_mnemonic_widget (GTK_LABEL (label), type_combobox);
-  gtk_widget_show (type_combobox);
-  gtk_table_attach_defaults (GTK_TABLE (table), type_combobox, 1, 2, 2, 3);
+    gtk_combo_box_append_text (GTK_COMBO_BOX (data.type_combobox),
+                               _(breakpoint_edit_dialog_break_types[i].name));
+  gtk_combo_box_set_active (GTK_COMBO_BOX (data.type_combobox), 0);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), data.type_combobox);
+  gtk_widget_show (data.type_combobox);
+  gtk_table_attach_defaults (GTK_TABLE (table), data.type_combobox,
+                             1, 2, 4, 5);
+
+  /* Button to add a breakpoint with the settings above */
+  add_button = gtk_button_new_from_stock (GTK_STOCK_ADD);
+  g_signal_connect (G_OBJECT (add_button), "clicked",
+                    G_CALLBACK (breakpoint_edit_dialog_on_add), &data);
+  gtk_widget_show (add_button);
+  gtk_table_attach (GTK_TABLE (table), add_button, 1, 2, 5, 6,
+                    GTK_FILL, 0, 0, 0);
 
   gtk_widget_show (table);
   gtk_box_pack_start (GTK_BOX (GTK_DIALOG (dialog)->vbox), table,
-                      FALSE, FALSE, 0);
+                      TRUE, TRUE, 0);
 
-  breakpoint_edit_dialog_update_sensitivity (GTK_CHECK_BUTTON (enabled_checkbox), table);
+  breakpoint_edit_dialog_update_list (&data);
 
-  /* Make the OK button the default button */
-  gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_ACCEPT);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_CLOSE);
 
-  response = gtk_dialog_run (GTK_DIALOG (dialog));
+  /* The breakpoints are changed as soon as the buttons are clicked
+     so there's nothing to do after the dialog is closed */
+  gtk_dialog_run (GTK_DIALOG (dialog));
   gtk_widget_destroy (dialog);
 
-  if (response == GTK_RESPONSE_ACCEPT)
-  {
-    int break_type;
-
-    if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (enabled_checkbox)))
-      break_type = breakpoint_edit_dialog_break_types
-        [gtk_combo_box_get_active (GTK_COMBO_BOX (type_combobox))].break_type;
-    else
-      break_type = CPU_BREAK_NONE;
-
-    cpu_set_break (&electron->data->cpu, break_type,
-                   (guint16) gtk_adjustment_get_value (address_adj));
-  }
-
-  g_object_unref (type_combobox);
-  g_object_unref (address_adj);
-  g_object_unref (enabled_checkbox);
+  g_object_unref (data.start_adj);
+  g_object_unref (data.end_adj);
   g_object_unref (electron);
 }
@@ -25,121 +25,89 @@
 #include <glib.h>
 
 #include "cpu.h"
+#include "cpupredecode.h"
+#include "cpujit.h"
+#include "cputrace.h"
 
-/* Macros to check the flags */
-#define CPU_FLAG_N 128
-#define CPU_FLAG_V 64
-#define CPU_FLAG_U 32
-#define CPU_FLAG_B 16
-#define CPU_FLAG_D 8
-#define CPU_FLAG_I 4
-#define CPU_FLAG_Z 2
-#define CPU_FLAG_C 1
-#define CPU_CHECK_FLAG(f) (cpu_state.p & (f))
-#define CPU_SET_FLAG(f, v) \
- do { if ((v)) cpu_state.p |= (f); else cpu_state.p &= ~(f); } while (0)
-#define CPU_IS_N() CPU_CHECK_FLAG (CPU_FLAG_N)
-#define CPU_IS_V() CPU_CHECK_FLAG (CPU_FLAG_V)
-#define CPU_IS_U() CPU_CHECK_FLAG (CPU_FLAG_U)
-#define CPU_IS_B() CPU_CHECK_FLAG (CPU_FLAG_B)
-#define CPU_IS_D() CPU_CHECK_FLAG (CPU_FLAG_D)
-#define CPU_IS_I() CPU_CHECK_FLAG (CPU_FLAG_I)
-#define CPU_IS_Z() CPU_CHECK_FLAG (CPU_FLAG_Z)
-#define CPU_IS_C() CPU_CHECK_FLAG (CPU_FLAG_C)
-#define CPU_SET_N(v) CPU_SET_FLAG (CPU_FLAG_N, v)
-#define CPU_SET_V(v) CPU_SET_FLAG (CPU_FLAG_V, v)
-#define CPU_SET_U(v) CPU_SET_FLAG (CPU_FLAG_U, v)
-#define CPU_SET_B(v) CPU_SET_FLAG (CPU_FLAG_B, v)
-#define CPU_SET_D(v) CPU_SET_FLAG (CPU_FLAG_D, v)
-#define CPU_SET_I(v) CPU_SET_FLAG (CPU_FLAG_I, v)
-#define CPU_SET_Z(v) CPU_SET_FLAG (CPU_FLAG_Z, v)
-#define CPU_SET_C(v) CPU_SET_FLAG (CPU_FLAG_C, v)
-
-/* The entire state of the cpu gets copied into this struct before a
-   fetch execute cycle so that we can have the speed of accessing
-   global variables but still be able to emulate more than one cpu if
-   need be. */
-static Cpu cpu_state;
-
-/* Macros to operate on the cpu's memory */
-#define CPU_WRITE(addr, v) \
-                            do { guint16 _taddr = (addr); \
-                                 guint8 _v = (v); \
-                                 if (cpu_state.break_type == CPU_BREAK_WRITE \
-                                     && cpu_state.break_address == _taddr) \
-                                   cpu_state.got_break = 1; \
-                                 if (_taddr < CPU_RAM_SIZE) \
-                                   cpu_state.memory[_taddr] = _v; \
-                                 else cpu_state.write_func (cpu_state.memory_data, \
-                                                         _taddr, _v); } while (0)
-/* Zero page macro should be faster because we don't need to test if
-   the address is in RAM */
-#define CPU_WRITE_ZERO(addr, v) \
-                            do { guint16 _taddr = (addr); \
-                                 guint8 _v = (v); \
-                                 if (cpu_state.break_type == CPU_BREAK_WRITE \
-                                     && cpu_state.break_address == _taddr) \
-                                   cpu_state.got_break = 1; \
-                                 cpu_state.memory[_taddr] = _v; } while (0)
-#define CPU_WRITE_WORD(addr, v) \
-                            do { guint16 _taddr = (addr); \
-                                 guint16 _v = (v); \
-                                 if (cpu_state.break_type == CPU_BREAK_WRITE \
-                                     && (cpu_state.break_address == _taddr \
-                                         || cpu_state.break_address == _taddr + 1)) \
-                                   cpu_state.got_break = 1; \
-                                 if (_taddr < CPU_RAM_SIZE - 1) \
-                                  (*(guint16 *) (cpu_state.memory + (_taddr))) \
-                                   = GUINT16_TO_LE (_v); \
-                                 else \
-                                 { cpu_state.write_func (cpu_state.memory_data, _taddr, _v); \
-                                   cpu_state.write_func (cpu_state.memory_data, \
-                                   _taddr + 1, _v >> 8); \
-                                 } } while (0)
-#define CPU_READ(addr)        ({ guint16 _taddr = (addr); \
-                               if (cpu_state.break_type == CPU_BREAK_READ \
-                                   && cpu_state.break_address == _taddr) \
-                                 cpu_state.got_break = 1; \
-                               _taddr < CPU_RAM_SIZE ? cpu_state.memory[_taddr] \
-                               : cpu_state.read_func (cpu_state.memory_data, _taddr); })
-/* Zero page macro should be faster because we don't need to test if
-   the address is in RAM */
-#define CPU_READ_ZERO(addr)   ({ guint16 _taddr = (addr); \
-                               if (cpu_state.break_type == CPU_BREAK_READ \
-                                   && cpu_state.break_address == _taddr) \
-                                 cpu_state.got_break = 1; \
-                               cpu_state.memory[_taddr]; })
-#define CPU_READ_WORD(addr) \
-                            ({ guint16 _taddr = (addr); \
-                               if (cpu_state.break_type == CPU_BREAK_READ \
-                                   && (cpu_state.break_address == _taddr \
-                                       || cpu_state.break_address == _taddr + 1)) \
-                                 cpu_state.got_break = 1; \
-                               (_taddr < CPU_RAM_SIZE - 1) \
-                               ? (GUINT16_FROM_LE (*(guint16 *) (cpu_state.memory + (_taddr)))) \
-                               : (cpu_state.read_func (cpu_state.memory_data, _taddr) \
-                                  | (cpu_state.read_func (cpu_state.memory_data, \
-                                                          _taddr + 1) << 8)); })
-#define CPU_FETCH()        (CPU_READ (cpu_state.pc++))
-#define CPU_PUSH(v)        CPU_WRITE (cpu_state.s-- | 0x100, (v))
-#define CPU_PUSH_WORD(w) \
-                            do { guint16 _w = w; CPU_PUSH (_w >> 8); /* high byte */ \
-                                 CPU_PUSH (_w);                   /* low byte */ \
-                            } while (0)
-#define CPU_PUSH_PC()       CPU_PUSH_WORD (cpu_state.pc)
-#define CPU_POP()           (CPU_READ (++cpu_state.s | 0x100))
-
-#define CPU_DATA_FOR_OP(op) \
-                            (cpu_addressing_modes[((op) >> 2) & 7] ())
-#define CPU_WRITE_FOR_OP(op, v) \
-                            (cpu_addressing_modes_write[((op) >> 2) & 7] (v))
-#define CPU_ADDR_FOR_OP(op) \
-                            (cpu_addressing_modes_addresses[((op) >> 3) & 3] ())
+/* All of the cores work directly on the Cpu struct that is passed
+   in so that there is no global state and any number of cpus can be
+   run at the same time from different threads */
+#define CPU_STATE (*cpu)
+#include "cpucore.h"
 
 static const CpuOpcodeFunc cpu_jumpblock[];
-static const CpuReadFunc cpu_addressing_modes[];
-static const CpuWriteFunc cpu_addressing_modes_write[];
-static const CpuAddressFunc cpu_addressing_modes_addresses[];
+
+static void cpu_update_break_map (Cpu *cpu);
+
+guint8 cpu_decimal_low_table[CPU_DECIMAL_TABLE_SIZE];
+guint16 cpu_decimal_high_table[CPU_DECIMAL_TABLE_SIZE];
+
+/* Fills in the tables used for decimal mode arithmetic. The operand
+   is already inverted for subtraction when the tables are used */
+static void
+cpu_init_decimal_tables (void)
+{
+  static gsize initialised = 0;
+  int subtract, carry, a, b;
+
+  if (!g_once_init_enter (&initialised))
+    return;
+
+  for (subtract = 0; subtract < 2; subtract++)
+    for (carry = 0; carry < 2; carry++)
+      for (a = 0; a < 16; a++)
+        for (b = 0; b < 16; b++)
+        {
+          int index = CPU_DECIMAL_INDEX (subtract, carry, a, b);
+          int l, bl, h, vc, flags = 0;
+
+          /* Add the lower nibbles */
+          l = bl = a + b + carry;
+          /* Correct for BCD */
+          if (subtract)
+          {
+            if (bl < 0x10)
+              l = (bl - 6) & 0x0f;
+          }
+          else if (bl >= 0xa)
+            l = bl + 0x6;
+          /* l can be >= 32, but the 6502 still only carries over
+             one */
+          cpu_decimal_low_table[index] = ((l & 0x0f)
+                                          | ((l >= 0x10) << 4)
+                                          | (((bl & 0x0f) != 0) << 5));
+
+          /* Add the next 3 bits of the high nibbles */
+          h = (carry << 4) + ((a << 4) & 0x70) + ((b << 4) & 0x70);
+          /* Calculate the carry into bit 7 */
+          vc = h & 0x80;
+          /* Add in the sum of the bit-7’s */
+          h += ((a << 4) & 0x80) + ((b << 4) & 0x80);
+          /* Negative, zero and overflow flags don’t take into account
+           * the BCD correction */
+          if ((h & 0x80))
+            flags |= CPU_FLAG_N;
+          if ((h & 0xff) == 0)
+            flags |= CPU_FLAG_Z;
+          /* Overflow is set if the carry from bit 6->7 is different
+           * from the output carry */
+          if (((vc << 1) ^ (h & 0x100)))
+            flags |= CPU_FLAG_V;
+          /* Correct for BCD */
+          if (subtract)
+          {
+            if (h < 256)
+              h -= 0x60;
+          }
+          else if (h >= 0xa0)
+            h += 0x60;
+          if (h > 255)
+            flags |= CPU_FLAG_C;
+          cpu_decimal_high_table[index] = (h & 0xf0) | (flags << 8);
+        }
+
+  g_once_init_leave (&initialised, 1);
+}
 
 /* Initialise the cpu struct */
 void
@@ -147,13 +115,33 @@ cpu_init (Cpu *cpu, guint8 *memory,
           CpuMemReadFunc read_func, CpuMemWriteFunc write_func,
           void *memory_data)
 {
+  cpu_init_decimal_tables ();
+
   /* Initialise the memory access */
   cpu->memory = memory;
   cpu->read_func = read_func;
   cpu->write_func = write_func;
   cpu->memory_data = memory_data;
-
-  cpu->break_type = CPU_BREAK_NONE;
+  memset (cpu->read_pages, 0, sizeof (cpu->read_pages));
+  memset (cpu->write_pages, 0, sizeof (cpu->write_pages));
+  cpu_map_pages (cpu, 0, CPU_RAM_PAGES, memory, memory);
+
+  cpu->break_types = CPU_BREAK_NONE;
+  memset (cpu->break_pages, 0, sizeof (cpu->break_pages));
+  cpu->breakpoints = g_array_new (FALSE, FALSE, sizeof (CpuBreakpoint));
+  cpu->traps = g_array_new (FALSE, FALSE, sizeof (guint16));
+  cpu->trap_func = NULL;
+  cpu->trap_data = NULL;
+
+  cpu->core = CPU_CORE_THREADED;
+  cpu->debug = TRUE;
+  cpu->predecode = NULL;
+  cpu->jit = NULL;
+  cpu->profile = NULL;
+  cpu->coverage = NULL;
+  cpu->trace = NULL;
+  cpu->rom_bank = -1;
+  memset (cpu->undefined_counts, 0, sizeof (cpu->undefined_counts));
 
   cpu_restart (cpu);
 }
@@ -161,88 +149,99 @@ cpu_init (Cpu *cpu, guint8 *memory,
 void
 cpu_restart (Cpu *cpu)
 {
-  /* Copy the cpu state */
-  memcpy (&cpu_state, cpu, sizeof (Cpu));
+  /* The memory has probably been reset so any decoded or translated
+     code can't be trusted */
+  if (cpu->predecode)
+    cpu_predecode_invalidate_ram (cpu->predecode);
+  if (cpu->jit)
+    cpu_jit_invalidate_ram (cpu->jit);
 
   /* Clear the registers */
-  cpu_state.x = cpu_state.y = cpu_state.a = 0;
+  cpu->x = cpu->y = cpu->a = 0;
   /* Disable interrupts */
-  cpu_state.p = CPU_FLAG_I;
+  CPU_SET_P (CPU_FLAG_I);
 
   /* We haven't counted any clock cycles yet */
-  cpu_state.time = 0;
+  cpu->time = 0;
 
   /* Start stack at top */
-  cpu_state.s = 0xff;
+  cpu->s = 0xff;
 
   /* Read start location from memory */
-  cpu_state.pc = CPU_READ_WORD (CPU_START_VECTOR);
+  cpu->pc = CPU_READ_WORD (CPU_START_VECTOR);
 
   /* No interrupts yet */
-  cpu_state.irq = 0;
-  cpu_state.nmi = 0;
+  cpu->irq = 0;
+  cpu->nmi = 0;
 
-  cpu_state.got_break = FALSE;
+  cpu->got_break = FALSE;
 
-  /* Put the cpu state back */
-  memcpy (cpu, &cpu_state, sizeof (Cpu));
+  /* Make sure the threaded core checks for interrupts straight away */
+  cpu->check_time = 0;
 }
 
-/* Execute one instruction from the memory */
-int
-cpu_fetch_execute (Cpu *cpu, cycles_t target_time)
+/* Calls the trap function for the address at the program
+   counter. Returns TRUE if it ran in place of the instruction */
+gboolean
+cpu_run_trap (Cpu *cpu)
 {
-  /* Copy the cpu state */
-  memcpy (&cpu_state, cpu, sizeof (Cpu));
+  return cpu->trap_func && cpu->trap_func (cpu->trap_data, cpu);
+}
+
+static int cpu_fetch_execute_threaded (Cpu *cpu, cycles_t target_time);
+static int cpu_fetch_execute_threaded_fast (Cpu *cpu, cycles_t target_time);
+static int cpu_fetch_execute_threaded_instrumented (Cpu *cpu,
+                                                    cycles_t target_time);
 
-  while (cpu_state.time < target_time
+/* Execute instructions using the jumpblock until the target time is
+   reached */
+static int
+cpu_fetch_execute_jumpblock (Cpu *cpu, cycles_t target_time)
+{
+  while (cpu->time < target_time
          /* Check for a break */
-         && !cpu_state.got_break)
+         && !cpu->got_break)
   {
     /* Check for interrupts */
-    if (cpu_state.nmi)
+    if (cpu->nmi)
     {
-      cpu_state.time += 7;
+      cpu->time += 7;
       /* Store pc */
-      CPU_PUSH_WORD (cpu_state.pc);
+      CPU_PUSH_WORD (cpu->pc);
       /* Store flags, break flag is cleared, unused flag is always one */
-      CPU_PUSH ((cpu_state.p | CPU_FLAG_U) & ~CPU_FLAG_B);
+      CPU_PUSH ((CPU_GET_P () | CPU_FLAG_U) & ~CPU_FLAG_B);
       /* Disable interrupts */
       CPU_SET_I (TRUE);
       /* Jump to nmi handling routine */
-      cpu_state.pc = CPU_READ_WORD (CPU_NMI_VECTOR);
+      cpu->pc = CPU_READ_WORD (CPU_NMI_VECTOR);
       /* Clear the nmi flag */
-      cpu_state.nmi = FALSE;
+      cpu->nmi = FALSE;
     }
-    else if (cpu_state.irq && !CPU_IS_I ())
+    else if (cpu->irq && !CPU_IS_I ())
     {
-      cpu_state.time += 7;
+      cpu->time += 7;
 
       /* Store pc - 1 */
-      CPU_PUSH_WORD (cpu_state.pc);
+      CPU_PUSH_WORD (cpu->pc);
       /* Store flags, break flag is cleared, unused flag is always one */
-      CPU_PUSH ((cpu_state.p | CPU_FLAG_U) & ~CPU_FLAG_B);
+      CPU_PUSH ((CPU_GET_P () | CPU_FLAG_U) & ~CPU_FLAG_B);
       /* Disable interrupts */
       CPU_SET_I (TRUE);
       /* Jump to irq handling routine */
-      cpu_state.pc = CPU_READ_WORD (CPU_IRQ_VECTOR);
+      cpu->pc = CPU_READ_WORD (CPU_IRQ_VECTOR);
     }
     else
     {
-      if (cpu_state.break_type == CPU_BREAK_ADDR
-          && cpu_state.break_address == cpu_state.pc)
-        cpu_state.got_break = TRUE;
-      else
+      if (CPU_IS_BREAK (CPU_BREAK_ADDR, cpu->pc))
+        cpu->got_break = TRUE;
+      else if (!CPU_IS_TRAP (cpu->pc) || !cpu_run_trap (cpu))
         /* Use the jumpblock to call the function that is being pointed to
            by the program counter. Also store the current instruction */
-        cpu_jumpblock[cpu_state.instruction = CPU_FETCH ()] ();
+        cpu_jumpblock[cpu->instruction = CPU_FETCH ()] (cpu);
     }
   }
 
-  /* Put the cpu state back */
-  memcpy (cpu, &cpu_state, sizeof (Cpu));
-
-  if (cpu_state.got_break)
+  if (cpu->got_break)
   {
     cpu->got_break = 0;
     return 1;
@@ -251,1196 +250,829 @@ cpu_fetch_execute (Cpu *cpu, cycles_t target_time)
     return 0;
 }
 
-void
-cpu_set_break (Cpu *cpu, int break_type, guint16 address)
+/* Returns whether anything is enabled that needs every instruction
+   to be run by the instrumented variant of the threaded core */
+static gboolean
+cpu_is_instrumented (Cpu *cpu)
 {
-  cpu->break_address = address;
-  cpu->break_type = break_type;
-  cpu->got_break = FALSE;
+  return cpu->profile || cpu->coverage || cpu->trace;
 }
 
-void
-cpu_set_irq (Cpu *cpu)
+/* Returns whether the debugger needs the accesses of every
+   instruction to be looked up in the breakpoint map. Only the
+   jumpblock core and the threaded core with the checks compiled in
+   can do this. The traps don't count because every core checks for
+   them itself */
+static gboolean
+cpu_needs_break_checks (Cpu *cpu)
 {
-  cpu_state.irq = TRUE;
-  cpu->irq = TRUE;
+  return cpu->debug && (cpu->break_types & ~CPU_BREAK_TRAP);
 }
 
-void
-cpu_reset_irq (Cpu *cpu)
-{
-  cpu_state.irq = FALSE;
-  cpu->irq = FALSE;
-}
-
-void
-cpu_cause_nmi (Cpu *cpu)
-{
-  cpu->nmi = TRUE;
-}
-
-void
-cpu_op_undefined (void)
+/* Execute instructions until the target time is reached or a
+   breakpoint is hit. Returns 1 if a breakpoint was hit */
+int
+cpu_fetch_execute (Cpu *cpu, cycles_t target_time)
 {
-  /* Count two instruction cycles */
-  cpu_state.time += 2;
+  /* Only the threaded core can count, record or trace the
+     instructions so the other cores are bypassed while any of those
+     are enabled */
+  if (G_UNLIKELY (cpu_is_instrumented (cpu)))
+  {
+    if (cpu->core == CPU_CORE_PREDECODE)
+      cpu_predecode_invalidate_ram (cpu->predecode);
+    else if (cpu->core == CPU_CORE_JIT)
+      cpu_jit_invalidate_ram (cpu->jit);
+    return cpu_fetch_execute_threaded_instrumented (cpu, target_time);
+  }
 
-  fprintf (stderr, "Undefined instruction %02X\n", cpu_state.instruction);
+  switch (cpu->core)
+  {
+    case CPU_CORE_JUMPBLOCK:
+      return cpu_fetch_execute_jumpblock (cpu, target_time);
+
+    case CPU_CORE_PREDECODE:
+      if (!cpu_needs_break_checks (cpu))
+        return cpu_predecode_fetch_execute (cpu, target_time);
+      /* The operands are read from the decoded records without
+         checking for breakpoints so fall back to the threaded core in
+         the same way as the JIT */
+      cpu_predecode_invalidate_ram (cpu->predecode);
+      return cpu_fetch_execute_threaded (cpu, target_time);
+
+    case CPU_CORE_JIT:
+      if (!cpu_needs_break_checks (cpu))
+        return cpu_jit_fetch_execute (cpu, target_time);
+      /* The translated code doesn't check for breakpoints so fall
+         back to the interpreter. Anything it writes won't have
+         invalidated the translated code */
+      cpu_jit_invalidate_ram (cpu->jit);
+      return cpu_fetch_execute_threaded (cpu, target_time);
+
+    default:
+      if (cpu->debug)
+        return cpu_fetch_execute_threaded (cpu, target_time);
+      else
+        return cpu_fetch_execute_threaded_fast (cpu, target_time);
+  }
 }
 
-static void
-cpu_op_arithmetic (void)
+/* Selects the core used to run the cpu. Returns FALSE if the core
+   isn't available */
+gboolean
+cpu_set_core (Cpu *cpu, CpuCore core)
 {
-  gboolean subtract = !!(cpu_state.instruction & 0x80);
-  guint8 oa = cpu_state.a, ov = CPU_DATA_FOR_OP (cpu_state.instruction);
-  int c = !!CPU_IS_C ();
-  int bl, l, h, lhc, vc;
-
-  /* A subtraction is the same as doing an addition with the one’s
-   * complement of the operand. The inverted meaning of the carry
-   * effectively means that it will normally add an extra one so it
-   * ends up being like a two’s complement. */
-  if (subtract)
-    ov = ~ov;
-
-  /* Add the lower nibbles */
-  l = bl = (oa & 0x0f) + (ov & 0x0f) + c;
-  /* Correct for BCD */
-  if (CPU_IS_D ())
-  {
-    if (subtract)
-    {
-      if (bl < 0x10)
-        l = (bl - 6) & 0x0f;
-    }
-    else if (bl >= 0xa)
-    {
-      l = bl + 0x6;
-    }
-  }
-  /* Calculate the carry into the next nibble. l can be >= 32, but the
-   * 6502 still only carries over one */
-  if (l >= 0x10)
+  if (core == CPU_CORE_PREDECODE)
   {
-    lhc = 0x10;
-    l &= 0xf;
+    if (cpu->predecode == NULL)
+      cpu->predecode = cpu_predecode_new ();
+    /* The other cores may have modified the memory */
+    cpu_predecode_invalidate_ram (cpu->predecode);
   }
-  else
+  else if (core == CPU_CORE_JIT)
   {
-    lhc = 0;
+    if (cpu->jit == NULL && (cpu->jit = cpu_jit_new ()) == NULL)
+      return FALSE;
+    /* The other cores may have modified the memory */
+    cpu_jit_invalidate_ram (cpu->jit);
   }
 
-  /* Add the next 3 bits */
-  h = (oa & 0x70) + (ov & 0x70) + lhc;
-  /* Calculate the carry into bit 7 */
-  vc = h & 0x80;
-  /* Add in the sum of the bit-7’s */
-  h += (oa & 0x80) + (ov & 0x80);
-  /* Negative, zero and overflow flags don’t take into account the BCD
-   * correction */
-  CPU_SET_N (h & 128);
-  CPU_SET_Z (((h | (bl & 0x0f)) & 0xff) == 0);
-  /* Overflow is set if the carry from bit 6->7 is different from the
-   * output carry */
-  CPU_SET_V ((vc << 1) ^ (h & 0x100));
-  /* Correct for BCD */
-  if (CPU_IS_D ())
-  {
-    if (subtract)
-    {
-      if (h < 256)
-        h -= 0x60;
-    }
-    else if (h >= 0xa0)
-    {
-      h += 0x60;
-    }
-  }
+  cpu->core = core;
 
-  cpu_state.a = h | l;
-  CPU_SET_C (h > 255);
+  return TRUE;
 }
 
+/* Selects whether the threaded core checks for breakpoints. Turning
+   it off avoids the cost of the debugger when nothing is using it */
 void
-cpu_op_cmp (void)
+cpu_set_debug (Cpu *cpu, gboolean debug)
 {
-  guint8 oa = cpu_state.a, ov = CPU_DATA_FOR_OP (cpu_state.instruction);
-  int v = oa - ov;
-  guint8 na = v;
-
-  CPU_SET_C (v >= 0);
-  CPU_SET_Z (!na); /* a could be different from v */
-  CPU_SET_N (na & 128);
+  cpu->debug = debug;
 }
 
+/* Enables or disables counting the instructions and cycles run at
+   each address. Disabling the profiler throws away the counts */
 void
-cpu_op_cpx_immediate (void)
+cpu_set_profiling (Cpu *cpu, gboolean profiling)
 {
-  guint8 oa = cpu_state.x, ov = CPU_FETCH ();
-  int v = oa - ov;
-  guint8 na = v;
-
-  cpu_state.time += 2;
-  CPU_SET_C (v >= 0);
-  CPU_SET_Z (!na); /* a could be different from v */
-  CPU_SET_N (na & 128);
-}
+  if (profiling)
+  {
+    if (cpu->profile == NULL)
+    {
+      CpuProfileNode root;
 
-void
-cpu_op_cpx (void)
-{
-  guint8 oa = cpu_state.x, ov = CPU_DATA_FOR_OP (cpu_state.instruction);
-  int v = oa - ov;
-  guint8 na = v;
+      cpu->profile = g_new0 (CpuProfile, 1);
 
-  CPU_SET_C (v >= 0);
-  CPU_SET_Z (!na); /* a could be different from v */
-  CPU_SET_N (na & 128);
-}
+      root.address = 0;
+      root.call = CPU_PROFILE_CALL_ROOT;
+      root.parent = G_MAXUINT;
+      root.first_child = G_MAXUINT;
+      root.next_sibling = G_MAXUINT;
+      root.calls = 0;
+      root.cycles = 0;
 
-void
-cpu_op_cpy_immediate (void)
-{
-  guint8 oa = cpu_state.y, ov = CPU_FETCH ();
-  int v = oa - ov;
-  guint8 na = v;
-
-  cpu_state.time += 2;
-  CPU_SET_C (v >= 0);
-  CPU_SET_Z (!na); /* a could be different from v */
-  CPU_SET_N (na & 128);
+      cpu->profile->nodes = g_array_new (FALSE, FALSE,
+                                         sizeof (CpuProfileNode));
+      g_array_append_val (cpu->profile->nodes, root);
+    }
+  }
+  else if (cpu->profile)
+  {
+    g_array_free (cpu->profile->nodes, TRUE);
+    g_free (cpu->profile);
+    cpu->profile = NULL;
+  }
 }
 
-void
-cpu_op_cpy (void)
+/* Returns the profile counts or NULL if the profiler is disabled */
+CpuProfile *
+cpu_get_profile (Cpu *cpu)
 {
-  guint8 oa = cpu_state.y, ov = CPU_DATA_FOR_OP (cpu_state.instruction);
-  int v = oa - ov;
-  guint8 na = v;
-
-  CPU_SET_C (v >= 0);
-  CPU_SET_Z (!na); /* a could be different from v */
-  CPU_SET_N (na & 128);
+  return cpu->profile;
 }
 
+/* Resets all of the profile counts to zero. The shape of the call
+   graph is kept so that the calls that are still running can carry
+   on being tracked */
 void
-cpu_op_eor (void)
+cpu_clear_profile (Cpu *cpu)
 {
-  guint8 v = cpu_state.a ^= CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
-}
+  CpuProfile *profile = cpu->profile;
+  guint i;
 
-void
-cpu_op_ora (void)
-{
-  guint8 v = cpu_state.a |= CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
-}
+  if (profile == NULL)
+    return;
 
-void
-cpu_op_and (void)
-{
-  guint8 v = cpu_state.a &= CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
-}
+  memset (profile->instructions, 0, sizeof (profile->instructions));
+  memset (profile->cycles, 0, sizeof (profile->cycles));
+  memset (profile->opcode_instructions, 0,
+          sizeof (profile->opcode_instructions));
+  memset (profile->opcode_cycles, 0, sizeof (profile->opcode_cycles));
 
-void
-cpu_op_bit (void)
-{
-  guint8 v = CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_N (v & 0x80);
-  CPU_SET_V (v & 0x40);
-  CPU_SET_Z (!(v & cpu_state.a));
+  for (i = 0; i < profile->nodes->len; i++)
+  {
+    CpuProfileNode *node = &g_array_index (profile->nodes,
+                                           CpuProfileNode, i);
+    node->calls = 0;
+    node->cycles = 0;
+  }
 }
 
+/* Enables or disables recording which addresses are executed, read
+   and written. Disabling it throws away the map */
 void
-cpu_op_lda (void)
+cpu_set_coverage (Cpu *cpu, gboolean coverage)
 {
-  guint8 v = cpu_state.a = CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
+  if (coverage)
+  {
+    if (cpu->coverage == NULL)
+      cpu->coverage = g_malloc0 (CPU_ADDRESS_SIZE);
+  }
+  else if (cpu->coverage)
+  {
+    g_free (cpu->coverage);
+    cpu->coverage = NULL;
+  }
 }
 
-void
-cpu_op_ldy_immediate (void)
+/* Returns the CpuCoverageType flags for each address or NULL if the
+   coverage isn't being recorded */
+const guint8 *
+cpu_get_coverage (Cpu *cpu)
 {
-  /* This instruction doesn't match the addressing mode pattern for
-     some reason */
-  guint8 v = cpu_state.y = CPU_FETCH ();
-  cpu_state.time += 2;
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
+  return cpu->coverage;
 }
 
+/* Forgets all of the accesses recorded so far */
 void
-cpu_op_ldx_immediate (void)
+cpu_clear_coverage (Cpu *cpu)
 {
-  /* This instruction doesn't match the addressing mode pattern for
-     some reason */
-  guint8 v = cpu_state.x = CPU_FETCH ();
-  cpu_state.time += 2;
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
+  if (cpu->coverage)
+    memset (cpu->coverage, 0, CPU_ADDRESS_SIZE);
 }
 
-void
-cpu_op_ldx (void)
+/* Starts recording the state of the cpu before every instruction in
+   a ring of n_records in the given file. If the instructions are
+   already being traced then the old file is closed first. Returns
+   FALSE and sets error if the file couldn't be created */
+gboolean
+cpu_start_trace (Cpu *cpu, const char *filename, guint64 n_records,
+                 GError **error)
 {
-  guint8 v;
-  /* The addressing modes seems to use x instead of y here somehow, so
-     we can compensate by copying it across */
-  cpu_state.x = cpu_state.y;
-  v = cpu_state.x = CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
-}
+  CpuTrace *trace;
 
-void
-cpu_op_ldy (void)
-{
-  guint8 v = cpu_state.y = CPU_DATA_FOR_OP (cpu_state.instruction);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
-}
+  if ((trace = cpu_trace_new (filename, n_records, error)) == NULL)
+    return FALSE;
 
-void
-cpu_op_sta (void)
-{
-  CPU_WRITE_FOR_OP (cpu_state.instruction, cpu_state.a);
-}
+  cpu_stop_trace (cpu);
+  cpu->trace = trace;
 
-void
-cpu_op_stx (void)
-{
-  /* According to the datasheet this instruction uses y for zero page
-     indexing instead of x which makes sense, but the book says
-     otherwise. I trust the datasheet so we have to copy it over */
-  guint8 t = cpu_state.x;
-  cpu_state.x = cpu_state.y;
-  CPU_WRITE_FOR_OP (cpu_state.instruction, t);
-  cpu_state.x = t;
+  return TRUE;
 }
 
 void
-cpu_op_sty (void)
+cpu_stop_trace (Cpu *cpu)
 {
-  CPU_WRITE_FOR_OP (cpu_state.instruction, cpu_state.y);
+  if (cpu->trace)
+  {
+    cpu_trace_free (cpu->trace);
+    cpu->trace = NULL;
+  }
 }
 
-void
-cpu_op_inc (void)
+/* Removes the calls from the shadow stack that have finished now that
+   the stack pointer is at s. This is done after every return instead
+   of popping just one call so that code which drops its return
+   address or resets the stack pointer doesn't leave calls behind */
+static void
+cpu_profile_return (CpuProfile *profile, guint8 s)
 {
-  guint8 v;
-  guint16 addr = CPU_ADDR_FOR_OP (cpu_state.instruction);
-  CPU_WRITE (addr, v = CPU_READ (addr) + 1);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
-}
+  /* The stack pointer wraps around within the page so it is compared
+     by its distance from the one in the frame. A call whose return
+     address was pushed across the bottom of the page would otherwise
+     look like it had already returned or like it never returns */
+  while (profile->stack_depth > 0
+         && (gint8) (s - profile->stack[profile->stack_depth - 1].s) >= 0)
+    profile->stack_depth--;
 
-void
-cpu_op_dec (void)
-{
-  guint8 v;
-  guint16 addr = CPU_ADDR_FOR_OP (cpu_state.instruction);
-  CPU_WRITE (addr, v = CPU_READ (addr) - 1);
-  CPU_SET_Z (!v);
-  CPU_SET_N (v & 0x80);
+  profile->current_node = (profile->stack_depth > 0
+                           ? profile->stack[profile->stack_depth - 1].node
+                           : 0);
 }
 
-void
-cpu_op_asl (void)
+/* Adds a call to address on to the shadow stack. s is the stack
+   pointer before the return address was pushed */
+static void
+cpu_profile_call (CpuProfile *profile, CpuProfileCall call,
+                  guint16 address, guint8 s)
 {
-  guint16 addr = CPU_ADDR_FOR_OP (cpu_state.instruction);
-  guint8 v = CPU_READ (addr);
+  CpuProfileNode *node;
+  guint child;
 
-  CPU_SET_C (v & 0x80);
-  v <<= 1;
-  CPU_SET_N (v & 0x80);
-  CPU_SET_Z (!v);
+  /* Anything that has left its frame on the stack without returning
+     is no longer running */
+  cpu_profile_return (profile, s);
 
-  CPU_WRITE (addr, v);
-}
+  if (profile->stack_depth >= CPU_PROFILE_STACK_SIZE)
+    return;
 
-void
-cpu_op_asl_a (void)
-{
-  cpu_state.time += 2;
-  CPU_SET_C (cpu_state.a & 0x80);
-  cpu_state.a <<= 1;
-  CPU_SET_N (cpu_state.a & 0x80);
-  CPU_SET_Z (!cpu_state.a);
-}
-
-void
-cpu_op_lsr (void)
-{
-  guint16 addr = CPU_ADDR_FOR_OP (cpu_state.instruction);
-  guint8 v = CPU_READ (addr);
-
-  CPU_SET_C (v & 0x01);
-  v >>= 1;
-  CPU_SET_N (FALSE);
-  CPU_SET_Z (!v);
+  for (child = g_array_index (profile->nodes, CpuProfileNode,
+                              profile->current_node).first_child;
+       child != G_MAXUINT;
+       child = node->next_sibling)
+  {
+    node = &g_array_index (profile->nodes, CpuProfileNode, child);
+    if (node->address == address && node->call == call)
+      break;
+  }
 
-  CPU_WRITE (addr, v);
-}
+  if (child == G_MAXUINT)
+  {
+    CpuProfileNode new_node;
+    CpuProfileNode *parent = &g_array_index (profile->nodes, CpuProfileNode,
+                                             profile->current_node);
+
+    new_node.address = address;
+    new_node.call = call;
+    new_node.parent = profile->current_node;
+    new_node.first_child = G_MAXUINT;
+    new_node.next_sibling = parent->first_child;
+    new_node.calls = 0;
+    new_node.cycles = 0;
+
+    child = parent->first_child = profile->nodes->len;
+    g_array_append_val (profile->nodes, new_node);
+  }
 
-void
-cpu_op_lsr_a (void)
-{
-  cpu_state.time += 2;
-  CPU_SET_C (cpu_state.a & 0x01);
-  cpu_state.a >>= 1;
-  CPU_SET_N (FALSE);
-  CPU_SET_Z (!cpu_state.a);
-}
+  g_array_index (profile->nodes, CpuProfileNode, child).calls++;
 
-void
-cpu_op_rol (void)
-{
-  guint16 addr = CPU_ADDR_FOR_OP (cpu_state.instruction);
-  guint8 v = CPU_READ (addr);
-  int oc = CPU_IS_C ();
-
-  CPU_SET_C (v & 0x80);
-  v <<= 1;
-  if (oc)
-    v |= 1;
-  CPU_SET_N (v & 0x80);
-  CPU_SET_Z (!v);
-
-  CPU_WRITE (addr, v);
+  profile->stack[profile->stack_depth].node = child;
+  profile->stack[profile->stack_depth].s = s;
+  profile->stack_depth++;
+  profile->current_node = child;
 }
 
+/* Makes accesses to n_pages pages starting from first_page use the
+   given memory directly. Either pointer can be NULL to make the
+   accesses go through the memory functions instead */
 void
-cpu_op_rol_a (void)
+cpu_map_pages (Cpu *cpu, int first_page, int n_pages,
+               const guint8 *read_memory, guint8 *write_memory)
 {
-  int oc = CPU_IS_C ();
-  cpu_state.time += 2;
-  CPU_SET_C (cpu_state.a & 0x80);
-  cpu_state.a <<= 1;
-  if (oc)
-    cpu_state.a |= 1;
-  CPU_SET_N (cpu_state.a & 0x80);
-  CPU_SET_Z (!cpu_state.a);
-}
+  int i;
 
-void
-cpu_op_ror (void)
-{
-  guint16 addr = CPU_ADDR_FOR_OP (cpu_state.instruction);
-  guint8 v = CPU_READ (addr);
-  int oc = CPU_IS_C ();
-
-  CPU_SET_C (v & 0x01);
-  v >>= 1;
-  if (oc)
-    v |= 0x80;
-  CPU_SET_N (oc);
-  CPU_SET_Z (!v);
-
-  CPU_WRITE (addr, v);
-}
+  g_return_if_fail (first_page >= 0
+                    && n_pages >= 0
+                    && first_page + n_pages <= CPU_PAGE_COUNT);
 
-void
-cpu_op_ror_a (void)
-{
-  int oc = CPU_IS_C ();
-  cpu_state.time += 2;
-  CPU_SET_C (cpu_state.a & 0x01);
-  cpu_state.a >>= 1;
-  if (oc)
-    cpu_state.a |= 0x80;
-  CPU_SET_N (oc);
-  CPU_SET_Z (!cpu_state.a);
+  for (i = 0; i < n_pages; i++)
+  {
+    cpu->read_pages[first_page + i]
+      = read_memory ? read_memory + i * CPU_PAGE_SIZE : NULL;
+    cpu->write_pages[first_page + i]
+      = write_memory ? write_memory + i * CPU_PAGE_SIZE : NULL;
+  }
 }
 
 void
-cpu_op_clc (void)
+cpu_set_rom_bank (Cpu *cpu, int bank)
 {
-  cpu_state.time += 2;
-  CPU_SET_C (FALSE);
+  if (cpu->rom_bank != bank)
+  {
+    cpu->rom_bank = bank;
+    /* Make sure the JIT doesn't carry on running code from the old
+       bank and that the predecode core looks up the new bank */
+    cpu->check_time = 0;
+  }
 }
 
+/* This must be called whenever memory that might contain code is
+   changed without going through the cpu, such as when a ROM is
+   loaded */
 void
-cpu_op_cld (void)
+cpu_invalidate_code (Cpu *cpu)
 {
-  cpu_state.time += 2;
-  CPU_SET_D (FALSE);
+  if (cpu->predecode)
+    cpu_predecode_invalidate_all (cpu->predecode);
+  if (cpu->jit)
+    cpu_jit_invalidate_all (cpu->jit);
+  cpu->check_time = 0;
 }
 
 void
-cpu_op_cli (void)
+cpu_destroy (Cpu *cpu)
 {
-  cpu_state.time += 2;
-  CPU_SET_I (FALSE);
-}
+  if (cpu->breakpoints)
+  {
+    g_array_set_size (cpu->breakpoints, 0);
+    g_array_set_size (cpu->traps, 0);
+    cpu_update_break_map (cpu);
+    g_array_free (cpu->breakpoints, TRUE);
+    cpu->breakpoints = NULL;
+    g_array_free (cpu->traps, TRUE);
+    cpu->traps = NULL;
+  }
 
-void
-cpu_op_clv (void)
-{
-  cpu_state.time += 2;
-  CPU_SET_V (FALSE);
-}
+  if (cpu->predecode)
+  {
+    cpu_predecode_free (cpu->predecode);
+    cpu->predecode = NULL;
+  }
+  if (cpu->jit)
+  {
+    cpu_jit_free (cpu->jit);
+    cpu->jit = NULL;
+  }
 
-void
-cpu_op_sec (void)
-{
-  cpu_state.time += 2;
-  CPU_SET_C (TRUE);
+  cpu_set_profiling (cpu, FALSE);
+  cpu_set_coverage (cpu, FALSE);
+  cpu_stop_trace (cpu);
 }
 
-void
-cpu_op_sed (void)
+/* Rebuilds the map of breakpoints for each page from the list */
+static void
+cpu_update_break_map (Cpu *cpu)
 {
-  cpu_state.time += 2;
-  CPU_SET_D (TRUE);
-}
+  int page;
+  guint i, address;
 
-void
-cpu_op_sei (void)
-{
-  cpu_state.time += 2;
-  CPU_SET_I (TRUE);
-}
+  for (page = 0; page < CPU_PAGE_COUNT; page++)
+    if (cpu->break_pages[page])
+    {
+      g_free (cpu->break_pages[page]);
+      cpu->break_pages[page] = NULL;
+    }
 
-void
-cpu_op_inx (void)
-{
-  cpu_state.time += 2;
-  cpu_state.x++;
-  CPU_SET_N (cpu_state.x & 0x80);
-  CPU_SET_Z (!cpu_state.x);
-}
+  cpu->break_types = CPU_BREAK_NONE;
 
-void
-cpu_op_iny (void)
-{
-  cpu_state.time += 2;
-  cpu_state.y++;
-  CPU_SET_N (cpu_state.y & 0x80);
-  CPU_SET_Z (!cpu_state.y);
-}
+  for (i = 0; i < cpu->breakpoints->len; i++)
+  {
+    const CpuBreakpoint *bp = &g_array_index (cpu->breakpoints,
+                                              CpuBreakpoint, i);
 
-void
-cpu_op_dex (void)
-{
-  cpu_state.time += 2;
-  cpu_state.x--;
-  CPU_SET_N (cpu_state.x & 0x80);
-  CPU_SET_Z (!cpu_state.x);
-}
+    for (address = bp->start; address <= bp->end; address++)
+    {
+      guint8 **break_page = cpu->break_pages + (address >> 8);
 
-void
-cpu_op_dey (void)
-{
-  cpu_state.time += 2;
-  cpu_state.y--;
-  CPU_SET_N (cpu_state.y & 0x80);
-  CPU_SET_Z (!cpu_state.y);
-}
+      if (*break_page == NULL)
+        *break_page = g_malloc0 (CPU_PAGE_SIZE);
+      (*break_page)[address & 0xff] |= bp->type;
+    }
 
-static const int cpu_branch_tests[4] = { CPU_FLAG_N,
-                                         CPU_FLAG_V,
-                                         CPU_FLAG_C,
-                                         CPU_FLAG_Z };
+    cpu->break_types |= bp->type;
+  }
 
-void
-cpu_op_branch (void)
-{
-  gint8 offset = CPU_FETCH ();
-  guint16 new_addr;
-  int ins;
-  int t = cpu_state.p & cpu_branch_tests[(ins = cpu_state.instruction) >> 6];
-
-  if ((ins & 0x20) == 0)
-    t = !t;
-  if (t)
+  for (i = 0; i < cpu->traps->len; i++)
   {
-    new_addr = cpu_state.pc + offset;
-    if ((new_addr & 0xFF00) != (cpu_state.pc & 0xFF00))
-      cpu_state.time += 4;
-    else
-      cpu_state.time += 3;
-    cpu_state.pc = new_addr;
-  }
-  else
-    cpu_state.time += 2;
-}
+    address = g_array_index (cpu->traps, guint16, i);
 
-void
-cpu_op_nop (void)
-{
-  /* Count two instruction cycles */
-  cpu_state.time += 2;
-}
+    if (cpu->break_pages[address >> 8] == NULL)
+      cpu->break_pages[address >> 8] = g_malloc0 (CPU_PAGE_SIZE);
+    cpu->break_pages[address >> 8][address & 0xff] |= CPU_BREAK_TRAP;
 
-void
-cpu_op_jmp (void)
-{
-  int al = CPU_FETCH ();
-  int ah = CPU_FETCH ();
-  cpu_state.time += 3;
-  cpu_state.pc = (ah << 8) | al;
-}
+    cpu->break_types |= CPU_BREAK_TRAP;
+  }
 
-void
-cpu_op_jmp_ind (void)
-{
-  int al = CPU_FETCH ();
-  int ah = CPU_FETCH ();
-  cpu_state.time += 5;
-  ah <<= 8;
-  /* A bug in the 6502 makes it fail to load the high byte of the
-     address from the following page if the low byte is 0xff */
-  cpu_state.pc = CPU_READ (ah | al) | (CPU_READ (ah | ((al + 1) & 0xff)) << 8);
+  cpu->got_break = FALSE;
+  /* Make sure the threaded core notices the new breakpoints */
+  cpu->check_time = 0;
 }
 
+/* Adds a breakpoint for the addresses from start to end
+   inclusive */
 void
-cpu_op_jsr (void)
+cpu_add_breakpoint (Cpu *cpu, CpuBreakType type, guint16 start, guint16 end)
 {
-  int al = CPU_FETCH ();
+  CpuBreakpoint bp;
 
-  cpu_state.time += 6;
+  bp.type = type;
+  bp.start = MIN (start, end);
+  bp.end = MAX (start, end);
 
-  /* Save the pc before getting the high byte */
-  CPU_PUSH_PC ();
+  g_array_append_val (cpu->breakpoints, bp);
 
-  /* Jump to the new address */
-  cpu_state.pc = (CPU_FETCH () << 8) | al;
+  cpu_update_break_map (cpu);
 }
 
 void
-cpu_op_brk (void)
+cpu_remove_breakpoint (Cpu *cpu, guint index)
 {
-  /* Push the program counter. The byte following the BRK instruction
-     is skipped out */
-  CPU_PUSH_WORD (cpu_state.pc + 1);
+  g_return_if_fail (index < cpu->breakpoints->len);
 
-  /* Push the flags with the break flag set. The unused flag is always one */
-  CPU_PUSH (cpu_state.p | CPU_FLAG_B | CPU_FLAG_U);
+  g_array_remove_index (cpu->breakpoints, index);
 
-  /* Jump to the address in the interrupt vector */
-  cpu_state.pc = CPU_READ_WORD (CPU_IRQ_VECTOR);
-
-  cpu_state.time += 7;
+  cpu_update_break_map (cpu);
 }
 
 void
-cpu_op_rts (void)
+cpu_clear_breakpoints (Cpu *cpu)
 {
-  int al = CPU_POP ();
-  cpu_state.time += 6;
-  cpu_state.pc = ((CPU_POP () << 8) | al) + 1;
-}
+  g_array_set_size (cpu->breakpoints, 0);
 
-void
-cpu_op_rti (void)
-{
-  int al;
-  cpu_state.time += 6;
-  cpu_state.p = CPU_POP ();
-  al = CPU_POP ();
-  cpu_state.pc = (CPU_POP () << 8) | al;
+  cpu_update_break_map (cpu);
 }
 
-void
-cpu_op_pha (void)
-{
-  cpu_state.time += 3;
-  CPU_PUSH (cpu_state.a);
-}
-
-void
-cpu_op_php (void)
+guint
+cpu_get_n_breakpoints (Cpu *cpu)
 {
-  cpu_state.time += 3;
-  /* The unused flag and the break flag are always one */
-  CPU_PUSH (cpu_state.p | CPU_FLAG_B | CPU_FLAG_U);
+  return cpu->breakpoints->len;
 }
 
-void
-cpu_op_pla (void)
+const CpuBreakpoint *
+cpu_get_breakpoint (Cpu *cpu, guint index)
 {
-  cpu_state.time += 4;
-  cpu_state.a = CPU_POP ();
-  CPU_SET_Z (!cpu_state.a);
-  CPU_SET_N (cpu_state.a & 0x80);
-}
+  g_return_val_if_fail (index < cpu->breakpoints->len, NULL);
 
-void
-cpu_op_plp (void)
-{
-  cpu_state.time += 4;
-  cpu_state.p = CPU_POP ();
+  return &g_array_index (cpu->breakpoints, CpuBreakpoint, index);
 }
 
-void
-cpu_op_tax (void)
+/* Returns TRUE if there is a breakpoint of any of the given types at
+   the address */
+gboolean
+cpu_is_breakpoint (Cpu *cpu, CpuBreakType type, guint16 address)
 {
-  cpu_state.time += 2;
-  /* Copy a to x and set z flag */
-  CPU_SET_Z (!(cpu_state.x = cpu_state.a));
-  CPU_SET_N (cpu_state.x & 0x80);
-}
+  const guint8 *break_page = cpu->break_pages[address >> 8];
 
-void
-cpu_op_tay (void)
-{
-  cpu_state.time += 2;
-  /* Copy a to y and set z flag */
-  CPU_SET_Z (!(cpu_state.y = cpu_state.a));
-  CPU_SET_N (cpu_state.y & 0x80);
+  return break_page && (break_page[address & 0xff] & type);
 }
 
+/* Replaces all of the breakpoints with a single breakpoint at one
+   address, or removes them all if the type is CPU_BREAK_NONE */
 void
-cpu_op_tsx (void)
+cpu_set_break (Cpu *cpu, CpuBreakType type, guint16 address)
 {
-  cpu_state.time += 2;
-  /* Copy s to x and set z flag */
-  CPU_SET_Z (!(cpu_state.x = cpu_state.s));
-  CPU_SET_N (cpu_state.x & 0x80);
-}
+  g_array_set_size (cpu->breakpoints, 0);
 
-void
-cpu_op_txs (void)
-{
-  cpu_state.time += 2;
-  /* According to the data sheet this doesn’t affect any flags */
-  cpu_state.s = cpu_state.x;
+  if (type != CPU_BREAK_NONE)
+    cpu_add_breakpoint (cpu, type, address, address);
+  else
+    cpu_update_break_map (cpu);
 }
 
+/* Sets the function that is called when the cpu reaches one of the
+   trapped addresses */
 void
-cpu_op_txa (void)
+cpu_set_trap_func (Cpu *cpu, CpuTrapFunc func, void *data)
 {
-  cpu_state.time += 2;
-  /* Copy x to a and set z flag */
-  CPU_SET_Z (!(cpu_state.a = cpu_state.x));
-  CPU_SET_N (cpu_state.a & 0x80);
+  cpu->trap_func = func;
+  cpu->trap_data = data;
 }
 
+/* Makes the cpu call the trap function whenever it is about to run
+   the instruction at the address. Any pages without traps are
+   skipped with a single test of the page map. A trap can be added
+   more than once and then needs to be removed the same number of
+   times */
 void
-cpu_op_tya (void)
-{
-  cpu_state.time += 2;
-  /* Copy y to a and set z flag */
-  CPU_SET_Z (!(cpu_state.a = cpu_state.y));
-  CPU_SET_N (cpu_state.a & 0x80);
-}
-
-/* Functions to get values using the different addressing modes */
-guint8
-cpu_get_immediate (void)
-{
-  cpu_state.time += 2;
-  return CPU_FETCH ();
-}
-
-guint8
-cpu_get_zero_page (void)
-{
-  cpu_state.time += 3;
-  return CPU_READ_ZERO (CPU_FETCH ());
-}
-
-guint8
-cpu_get_absolute (void)
-{
-  int al = CPU_FETCH ();
-  cpu_state.time += 4;
-  return CPU_READ (al | (CPU_FETCH () << 8));
-}
-
-guint8
-cpu_get_zero_indexed_x (void)
-{
-  cpu_state.time += 4;
-  return CPU_READ_ZERO ((CPU_FETCH () + cpu_state.x) & 0xff);
-}
-
-guint8
-cpu_get_absolute_indexed_x (void)
-{
-  int al = CPU_FETCH () + cpu_state.x;
-  int ah = CPU_FETCH ();
-
-  if (al >= 0x100)
-  {
-    /* count an extra cycle when it goes over the page boundary */
-    cpu_state.time += 5;
-    return CPU_READ ((ah << 8) + al);
-  }
-  else
-  {
-    cpu_state.time += 4;
-    return CPU_READ ((ah << 8) | al);
-  }
-}
-
-guint8
-cpu_get_absolute_indexed_y (void)
+cpu_add_trap (Cpu *cpu, guint16 address)
 {
-  int al = CPU_FETCH () + cpu_state.y;
-  int ah = CPU_FETCH ();
+  g_array_append_val (cpu->traps, address);
 
-  if (al >= 0x100)
-  {
-    cpu_state.time += 5; /* count an extra cycle when it goes over the page
-                       boundary */
-    return CPU_READ ((ah << 8) + al);
-  }
-  else
-  {
-    cpu_state.time += 4;
-    return CPU_READ ((ah << 8) | al);
-  }
+  cpu_update_break_map (cpu);
+  /* The predecode and JIT cores look for the traps when the code is
+     decoded */
+  cpu_invalidate_code (cpu);
 }
 
-guint8
-cpu_get_pre_indexed_x (void)
+void
+cpu_remove_trap (Cpu *cpu, guint16 address)
 {
-  guint8 za = CPU_FETCH () + cpu_state.x;
-  int al = CPU_READ (za++);
-  int ah = CPU_READ (za);
-  cpu_state.time += 6;
-  return CPU_READ ((ah << 8) | al);
-}
+  guint i;
 
-guint8
-cpu_get_post_indexed_y (void)
-{
-  guint8 za = CPU_FETCH ();
-  int al = CPU_READ (za++) + cpu_state.y;
-  int ah = CPU_READ (za);
-  if (al >= 0x100)
-  {
-    /* count an extra cycle when it goes over the page boundary */
-    cpu_state.time += 6;
-    return CPU_READ ((ah << 8) + al);
-  }
-  else
-  {
-    cpu_state.time += 5;
-    return CPU_READ ((ah << 8) | al);
-  }
+  for (i = 0; i < cpu->traps->len; i++)
+    if (g_array_index (cpu->traps, guint16, i) == address)
+    {
+      g_array_remove_index (cpu->traps, i);
+      cpu_update_break_map (cpu);
+      cpu_invalidate_code (cpu);
+      break;
+    }
 }
 
-/* Functions to write using the eight addressing modes */
+/* Does the same as an RTS instruction. This can be used by a trap
+   function that replaces a subroutine to return to the caller */
 void
-cpu_write_zero_page (guint8 v)
+cpu_rts (Cpu *cpu)
 {
-  cpu_state.time += 3;
-  CPU_WRITE_ZERO (CPU_FETCH (), v);
+  CPU_OP_RTS ();
 }
 
 void
-cpu_write_absolute (guint8 v)
+cpu_set_irq (Cpu *cpu)
 {
-  int al = CPU_FETCH ();
-  cpu_state.time += 4;
-  CPU_WRITE (al | (CPU_FETCH () << 8), v);
+  cpu->irq = TRUE;
+  cpu->check_time = 0;
 }
 
 void
-cpu_write_zero_indexed_x (guint8 v)
+cpu_reset_irq (Cpu *cpu)
 {
-  cpu_state.time += 4;
-  CPU_WRITE_ZERO ((CPU_FETCH () + cpu_state.x) & 0xff, v);
+  cpu->irq = FALSE;
 }
 
 void
-cpu_write_absolute_indexed_x (guint8 v)
+cpu_cause_nmi (Cpu *cpu)
 {
-  int al = CPU_FETCH () + cpu_state.x;
-  int ah = CPU_FETCH ();
-
-  if (al >= 0x100)
-  {
-    /* count an extra cycle when it goes over the page boundary */
-    cpu_state.time += 5;
-    CPU_WRITE ((ah << 8) + al, v);
-  }
-  else
-  {
-    cpu_state.time += 4;
-    CPU_WRITE ((ah << 8) | al, v);
-  }
+  cpu->nmi = TRUE;
+  cpu->check_time = 0;
 }
 
 void
-cpu_write_absolute_indexed_y (guint8 v)
+cpu_undefined_instruction (Cpu *cpu)
 {
-  int al = CPU_FETCH () + cpu_state.y;
-  int ah = CPU_FETCH ();
-
-  if (al >= 0x100)
-  {
-    /* count an extra cycle when it goes over the page boundary */
-    cpu_state.time += 5;
-    CPU_WRITE ((ah << 8) + al, v);
-  }
-  else
-  {
-    cpu_state.time += 4;
-    CPU_WRITE ((ah << 8) | al, v);
+  /* Count two instruction cycles */
+  cpu->time += 2;
+
+  /* Only report each opcode once so that a program that keeps
+     running one doesn't spend all of its time writing to stderr */
+  if (cpu->undefined_counts[cpu->instruction] == 0)
+    fprintf (stderr, "Undefined instruction %02X at %04X\n",
+             cpu->instruction, (guint16) (cpu->pc - 1));
+  if (cpu->undefined_counts[cpu->instruction] < G_MAXUINT)
+    cpu->undefined_counts[cpu->instruction]++;
+}
+
+/* Generate a function for each documented instruction with the
+   addressing mode fixed at compile time */
+#define CPU_JUMPBLOCK_FUNC(code, kind, op, mode) \
+  static void \
+  cpu_op_##code (Cpu *cpu) \
+  { \
+    CPU_EXEC (kind, op, mode); \
   }
-}
 
-void
-cpu_write_pre_indexed_x (guint8 v)
-{
-  guint8 za = CPU_FETCH () + cpu_state.x;
-  int al = CPU_READ (za++);
-  int ah = CPU_READ (za);
-  cpu_state.time += 6;
-  CPU_WRITE ((ah << 8) | al, v);
-}
+CPU_OPCODE_LIST (CPU_JUMPBLOCK_FUNC)
 
-void
-cpu_write_post_indexed_y (guint8 v)
-{
-  guint8 za = CPU_FETCH ();
-  int al = CPU_READ (za++) + cpu_state.y;
-  int ah = CPU_READ (za);
-  if (al >= 0x100)
-  {
-    /* count an extra cycle when it goes over the page boundary */
-    cpu_state.time += 6;
-    CPU_WRITE ((ah << 8) + al, v);
-  }
-  else
-  {
-    cpu_state.time += 5;
-    CPU_WRITE ((ah << 8) | al, v);
-  }
-}
+#define CPU_JUMPBLOCK_ENTRY(code, kind, op, mode) [code] = cpu_op_##code,
 
-/* Functions to calculate an address using the addressing modes.
-   Counts the clock cycles for doing some read write operation on the
-   address */
-guint16
-cpu_get_zero_page_a (void)
-{
-  cpu_state.time += 5;
-  return CPU_FETCH ();
-}
+static const CpuOpcodeFunc cpu_jumpblock[256] =
+  {
+    [0 ... 255] = cpu_undefined_instruction,
+    CPU_OPCODE_LIST (CPU_JUMPBLOCK_ENTRY)
+  };
 
-guint16
-cpu_get_absolute_a (void)
+/* Returns the status register with the lazily evaluated flags
+   filled in */
+guint8
+cpu_get_p (Cpu *cpu)
 {
-  int al = CPU_FETCH ();
-  cpu_state.time += 6;
-  return al | (CPU_FETCH () << 8);
+  return CPU_GET_P ();
 }
 
-guint16
-cpu_get_zero_indexed_x_a (void)
+void
+cpu_set_p (Cpu *cpu, guint8 p)
 {
-  cpu_state.time += 6;
-  return (CPU_FETCH () + cpu_state.x) & 0xff;
+  CPU_SET_P (p);
 }
 
-guint16
-cpu_get_absolute_indexed_x_a (void)
-{
-  int al = CPU_FETCH ();
-  int ah = CPU_FETCH ();
+/* The number of instructions to step through when looking for an
+   idle loop before giving up */
+#define CPU_IDLE_LOOP_MAX_INSTRUCTIONS 64
 
-  cpu_state.time += 7;
+/* For each opcode, the number of bytes it pushes on to the stack or
+   -1 if it can write anywhere else. The undefined opcodes are -1 as
+   well so that they never count as part of an idle loop */
+#define CPU_IDLE_WRITES_READ     0
+#define CPU_IDLE_WRITES_WRITE    -1
+#define CPU_IDLE_WRITES_RMW      -1
+#define CPU_IDLE_WRITES_IMPLIED  0
+#define CPU_IDLE_WRITES_ENTRY(code, kind, op, mode) \
+  [code] = CPU_IDLE_WRITES_##kind,
 
-  return (ah << 8) + al + cpu_state.x;
-}
-
-/* Jumpblocks for the 8 different addressing modes */
-static const CpuReadFunc cpu_addressing_modes[8] =
-  {
-    cpu_get_pre_indexed_x,
-    cpu_get_zero_page,
-    cpu_get_immediate,
-    cpu_get_absolute,
-    cpu_get_post_indexed_y,
-    cpu_get_zero_indexed_x,
-    cpu_get_absolute_indexed_y,
-    cpu_get_absolute_indexed_x
-  };
-static const CpuWriteFunc cpu_addressing_modes_write[8] =
+static const gint8 cpu_idle_writes[256] =
   {
-    cpu_write_pre_indexed_x,
-    cpu_write_zero_page,
-    NULL,
-    cpu_write_absolute,
-    cpu_write_post_indexed_y,
-    cpu_write_zero_indexed_x,
-    cpu_write_absolute_indexed_y,
-    cpu_write_absolute_indexed_x
+    [0 ... 255] = -1,
+    CPU_OPCODE_LIST (CPU_IDLE_WRITES_ENTRY)
+    /* BRK */ [0x00] = 3,
+    /* PHP */ [0x08] = 1,
+    /* JSR */ [0x20] = 2,
+    /* PHA */ [0x48] = 1
   };
-static const CpuAddressFunc cpu_addressing_modes_addresses[4] =
+
+/* Steps through the instructions at the program counter to see if
+   they form a loop that comes back to exactly the same state without
+   changing any memory. The only writes allowed are pushes on to the
+   stack that leave the same bytes behind as were there before, such
+   as the return address of a JSR. If a loop is found then repeating
+   it can't change anything until an interrupt happens, so the caller
+   can skip the time forward by any whole number of iterations. The
+   caller must check that none of the reads in the loop had side
+   effects. The instructions are really executed so the cpu is left
+   after the last one that was stepped. Returns the number of cycles
+   in one iteration of the loop or 0 if no loop was found before
+   target_time */
+cycles_t
+cpu_find_idle_loop (Cpu *cpu, cycles_t target_time)
+{
+  struct
   {
-    cpu_get_zero_page_a,
-    cpu_get_absolute_a,
-    cpu_get_zero_indexed_x_a,
-    cpu_get_absolute_indexed_x_a
-  };
+    guint16 address;
+    guint8 value;
+  } pushed[CPU_IDLE_LOOP_MAX_INSTRUCTIONS * 3];
+  int n_pushed = 0, n_instructions, i;
+  cycles_t start_time = cpu->time, loop_time = 0;
+  guint16 start_pc = cpu->pc;
+  guint8 start_a = cpu->a, start_x = cpu->x, start_y = cpu->y;
+  guint8 start_s = cpu->s, start_p = cpu_get_p (cpu);
+
+  /* Stepping would miss the breakpoints and the instrumentation */
+  if (cpu_needs_break_checks (cpu) || cpu_is_instrumented (cpu))
+    return 0;
 
-static const CpuOpcodeFunc cpu_jumpblock[256] =
+  for (n_instructions = 0;
+       n_instructions < CPU_IDLE_LOOP_MAX_INSTRUCTIONS;
+       n_instructions++)
   {
-    cpu_op_brk,           /* 00 */
-    cpu_op_ora,           /* 01 */
-    cpu_op_undefined,     /* 02 */
-    cpu_op_undefined,     /* 03 */
-    cpu_op_undefined,     /* 04 */
-    cpu_op_ora,           /* 05 */
-    cpu_op_asl,           /* 06 */
-    cpu_op_undefined,     /* 07 */
-    cpu_op_php,           /* 08 */
-    cpu_op_ora,           /* 09 */
-    cpu_op_asl_a,         /* 0A */
-    cpu_op_undefined,     /* 0B */
-    cpu_op_undefined,     /* 0C */
-    cpu_op_ora,           /* 0D */
-    cpu_op_asl,           /* 0E */
-    cpu_op_undefined,     /* 0F */
-    cpu_op_branch,        /* 10 */
-    cpu_op_ora,           /* 11 */
-    cpu_op_undefined,     /* 12 */
-    cpu_op_undefined,     /* 13 */
-    cpu_op_undefined,     /* 14 */
-    cpu_op_ora,           /* 15 */
-    cpu_op_asl,           /* 16 */
-    cpu_op_undefined,     /* 17 */
-    cpu_op_clc,           /* 18 */
-    cpu_op_ora,           /* 19 */
-    cpu_op_undefined,     /* 1A */
-    cpu_op_undefined,     /* 1B */
-    cpu_op_undefined,     /* 1C */
-    cpu_op_ora,           /* 1D */
-    cpu_op_asl,           /* 1E */
-    cpu_op_undefined,     /* 1F */
-    cpu_op_jsr,           /* 20 */
-    cpu_op_and,           /* 21 */
-    cpu_op_undefined,     /* 22 */
-    cpu_op_undefined,     /* 23 */
-    cpu_op_bit,           /* 24 */
-    cpu_op_and,           /* 25 */
-    cpu_op_rol,           /* 26 */
-    cpu_op_undefined,     /* 27 */
-    cpu_op_plp,           /* 28 */
-    cpu_op_and,           /* 29 */
-    cpu_op_rol_a,         /* 2A */
-    cpu_op_undefined,     /* 2B */
-    cpu_op_bit,           /* 2C */
-    cpu_op_and,           /* 2D */
-    cpu_op_rol,           /* 2E */
-    cpu_op_undefined,     /* 2F */
-    cpu_op_branch,        /* 30 */
-    cpu_op_and,           /* 31 */
-    cpu_op_undefined,     /* 32 */
-    cpu_op_undefined,     /* 33 */
-    cpu_op_undefined,     /* 34 */
-    cpu_op_and,           /* 35 */
-    cpu_op_rol,           /* 36 */
-    cpu_op_undefined,     /* 37 */
-    cpu_op_sec,           /* 38 */
-    cpu_op_and,           /* 39 */
-    cpu_op_undefined,     /* 3A */
-    cpu_op_undefined,     /* 3B */
-    cpu_op_undefined,     /* 3C */
-    cpu_op_and,           /* 3D */
-    cpu_op_rol,           /* 3E */
-    cpu_op_undefined,     /* 3F */
-    cpu_op_rti,           /* 40 */
-    cpu_op_eor,           /* 41 */
-    cpu_op_undefined,     /* 42 */
-    cpu_op_undefined,     /* 43 */
-    cpu_op_undefined,     /* 44 */
-    cpu_op_eor,           /* 45 */
-    cpu_op_lsr,           /* 46 */
-    cpu_op_undefined,     /* 47 */
-    cpu_op_pha,           /* 48 */
-    cpu_op_eor,           /* 49 */
-    cpu_op_lsr_a,         /* 4A */
-    cpu_op_undefined,     /* 4B */
-    cpu_op_jmp,           /* 4C */
-    cpu_op_eor,           /* 4D */
-    cpu_op_lsr,           /* 4E */
-    cpu_op_undefined,     /* 4F */
-    cpu_op_branch,        /* 50 */
-    cpu_op_eor,           /* 51 */
-    cpu_op_undefined,     /* 52 */
-    cpu_op_undefined,     /* 53 */
-    cpu_op_undefined,     /* 54 */
-    cpu_op_eor,           /* 55 */
-    cpu_op_lsr,           /* 56 */
-    cpu_op_undefined,     /* 57 */
-    cpu_op_cli,           /* 58 */
-    cpu_op_eor,           /* 59 */
-    cpu_op_undefined,     /* 5A */
-    cpu_op_undefined,     /* 5B */
-    cpu_op_undefined,     /* 5C */
-    cpu_op_eor,           /* 5D */
-    cpu_op_lsr,           /* 5E */
-    cpu_op_undefined,     /* 5F */
-    cpu_op_rts,           /* 60 */
-    cpu_op_arithmetic,    /* 61 */
-    cpu_op_undefined,     /* 62 */
-    cpu_op_undefined,     /* 63 */
-    cpu_op_undefined,     /* 64 */
-    cpu_op_arithmetic,    /* 65 */
-    cpu_op_ror,           /* 66 */
-    cpu_op_undefined,     /* 67 */
-    cpu_op_pla,           /* 68 */
-    cpu_op_arithmetic,    /* 69 */
-    cpu_op_ror_a,         /* 6A */
-    cpu_op_undefined,     /* 6B */
-    cpu_op_jmp_ind,       /* 6C */
-    cpu_op_arithmetic,    /* 6D */
-    cpu_op_ror,           /* 6E */
-    cpu_op_undefined,     /* 6F */
-    cpu_op_branch,        /* 70 */
-    cpu_op_arithmetic,    /* 71 */
-    cpu_op_undefined,     /* 72 */
-    cpu_op_undefined,     /* 73 */
-    cpu_op_undefined,     /* 74 */
-    cpu_op_arithmetic,    /* 75 */
-    cpu_op_ror,           /* 76 */
-    cpu_op_undefined,     /* 77 */
-    cpu_op_sei,           /* 78 */
-    cpu_op_arithmetic,    /* 79 */
-    cpu_op_undefined,     /* 7A */
-    cpu_op_undefined,     /* 7B */
-    cpu_op_undefined,     /* 7C */
-    cpu_op_arithmetic,    /* 7D */
-    cpu_op_ror,           /* 7E */
-    cpu_op_undefined,     /* 7F */
-    cpu_op_undefined,     /* 80 */
-    cpu_op_sta,           /* 81 */
-    cpu_op_undefined,     /* 82 */
-    cpu_op_undefined,     /* 83 */
-    cpu_op_sty,           /* 84 */
-    cpu_op_sta,           /* 85 */
-    cpu_op_stx,           /* 86 */
-    cpu_op_undefined,     /* 87 */
-    cpu_op_dey,           /* 88 */
-    cpu_op_undefined,     /* 89 */
-    cpu_op_txa,           /* 8A */
-    cpu_op_undefined,     /* 8B */
-    cpu_op_sty,           /* 8C */
-    cpu_op_sta,           /* 8D */
-    cpu_op_stx,           /* 8E */
-    cpu_op_undefined,     /* 8F */
-    cpu_op_branch,        /* 90 */
-    cpu_op_sta,           /* 91 */
-    cpu_op_undefined,     /* 92 */
-    cpu_op_undefined,     /* 93 */
-    cpu_op_sty,           /* 94 */
-    cpu_op_sta,           /* 95 */
-    cpu_op_stx,           /* 96 */
-    cpu_op_undefined,     /* 97 */
-    cpu_op_tya,           /* 98 */
-    cpu_op_sta,           /* 99 */
-    cpu_op_txs,           /* 9A */
-    cpu_op_undefined,     /* 9B */
-    cpu_op_undefined,     /* 9C */
-    cpu_op_sta,           /* 9D */
-    cpu_op_undefined,     /* 9E */
-    cpu_op_undefined,     /* 9F */
-    cpu_op_ldy_immediate, /* A0 */
-    cpu_op_lda,           /* A1 */
-    cpu_op_ldx_immediate, /* A2 */
-    cpu_op_undefined,     /* A3 */
-    cpu_op_ldy,           /* A4 */
-    cpu_op_lda,           /* A5 */
-    cpu_op_ldx,           /* A6 */
-    cpu_op_undefined,     /* A7 */
-    cpu_op_tay,           /* A8 */
-    cpu_op_lda,           /* A9 */
-    cpu_op_tax,           /* AA */
-    cpu_op_undefined,     /* AB */
-    cpu_op_ldy,           /* AC */
-    cpu_op_lda,           /* AD */
-    cpu_op_ldx,           /* AE */
-    cpu_op_undefined,     /* AF */
-    cpu_op_branch,        /* B0 */
-    cpu_op_lda,           /* B1 */
-    cpu_op_undefined,     /* B2 */
-    cpu_op_undefined,     /* B3 */
-    cpu_op_ldy,           /* B4 */
-    cpu_op_lda,           /* B5 */
-    cpu_op_ldx,           /* B6 */
-    cpu_op_undefined,     /* B7 */
-    cpu_op_clv,           /* B8 */
-    cpu_op_lda,           /* B9 */
-    cpu_op_tsx,           /* BA */
-    cpu_op_undefined,     /* BB */
-    cpu_op_ldy,           /* BC */
-    cpu_op_lda,           /* BD */
-    cpu_op_ldx,           /* BE */
-    cpu_op_undefined,     /* BF */
-    cpu_op_cpy_immediate, /* C0 */
-    cpu_op_cmp,           /* C1 */
-    cpu_op_undefined,     /* C2 */
-    cpu_op_undefined,     /* C3 */
-    cpu_op_cpy,           /* C4 */
-    cpu_op_cmp,           /* C5 */
-    cpu_op_dec,           /* C6 */
-    cpu_op_undefined,     /* C7 */
-    cpu_op_iny,           /* C8 */
-    cpu_op_cmp,           /* C9 */
-    cpu_op_dex,           /* CA */
-    cpu_op_undefined,     /* CB */
-    cpu_op_cpy,           /* CC */
-    cpu_op_cmp,           /* CD */
-    cpu_op_dec,           /* CE */
-    cpu_op_undefined,     /* CF */
-    cpu_op_branch,        /* D0 */
-    cpu_op_cmp,           /* D1 */
-    cpu_op_undefined,     /* D2 */
-    cpu_op_undefined,     /* D3 */
-    cpu_op_undefined,     /* D4 */
-    cpu_op_cmp,           /* D5 */
-    cpu_op_dec,           /* D6 */
-    cpu_op_undefined,     /* D7 */
-    cpu_op_cld,           /* D8 */
-    cpu_op_cmp,           /* D9 */
-    cpu_op_undefined,     /* DA */
-    cpu_op_undefined,     /* DB */
-    cpu_op_undefined,     /* DC */
-    cpu_op_cmp,           /* DD */
-    cpu_op_dec,           /* DE */
-    cpu_op_undefined,     /* DF */
-    cpu_op_cpx_immediate, /* E0 */
-    cpu_op_arithmetic,    /* E1 */
-    cpu_op_undefined,     /* E2 */
-    cpu_op_undefined,     /* E3 */
-    cpu_op_cpx,           /* E4 */
-    cpu_op_arithmetic,    /* E5 */
-    cpu_op_inc,           /* E6 */
-    cpu_op_undefined,     /* E7 */
-    cpu_op_inx,           /* E8 */
-    cpu_op_arithmetic,    /* E9 */
-    cpu_op_nop,           /* EA */
-    cpu_op_undefined,     /* EB */
-    cpu_op_cpx,           /* EC */
-    cpu_op_arithmetic,    /* ED */
-    cpu_op_inc,           /* EE */
-    cpu_op_undefined,     /* EF */
-    cpu_op_branch,        /* F0 */
-    cpu_op_arithmetic,    /* F1 */
-    cpu_op_undefined,     /* F2 */
-    cpu_op_undefined,     /* F3 */
-    cpu_op_undefined,     /* F4 */
-    cpu_op_arithmetic,    /* F5 */
-    cpu_op_inc,           /* F6 */
-    cpu_op_undefined,     /* F7 */
-    cpu_op_sed,           /* F8 */
-    cpu_op_arithmetic,    /* F9 */
-    cpu_op_undefined,     /* FA */
-    cpu_op_undefined,     /* FB */
-    cpu_op_undefined,     /* FC */
-    cpu_op_arithmetic,    /* FD */
-    cpu_op_inc,           /* FE */
-    cpu_op_undefined,     /* FF */
-  };
+    const guint8 *page = cpu->read_pages[cpu->pc >> 8];
+    int writes;
+
+    /* Taking an interrupt would write to the stack */
+    if (cpu->time >= target_time
+        || cpu->nmi || (cpu->irq && !CPU_IS_I ())
+        /* A trap could do anything */
+        || CPU_IS_TRAP (cpu->pc)
+        /* The opcode can't be looked at if reading it could have a
+           side effect */
+        || page == NULL
+        || (writes = cpu_idle_writes[page[cpu->pc & 0xff]]) < 0)
+      break;
+
+    /* Remember what was on the stack before the loop started */
+    while (writes-- > 0)
+    {
+      guint16 address = 0x100 | (guint8) (cpu->s - writes);
+
+      for (i = 0; i < n_pushed; i++)
+        if (pushed[i].address == address)
+          break;
+
+      if (i == n_pushed)
+      {
+        pushed[n_pushed].address = address;
+        pushed[n_pushed].value = cpu->memory[address];
+        n_pushed++;
+      }
+    }
+
+    /* Execute just the one instruction. This always uses the
+       threaded core because the other cores can run more than one
+       instruction at a time */
+    cpu_fetch_execute_threaded_fast (cpu, cpu->time + 1);
+
+    if (cpu->pc == start_pc
+        && cpu->a == start_a && cpu->x == start_x && cpu->y == start_y
+        && cpu->s == start_s && cpu_get_p (cpu) == start_p)
+    {
+      loop_time = cpu->time - start_time;
+      break;
+    }
+  }
+
+  for (i = 0; i < n_pushed; i++)
+    if (cpu->memory[pushed[i].address] != pushed[i].value)
+    {
+      loop_time = 0;
+      /* The threaded core doesn't tell the other cores about the
+         writes so any code they have decoded from the stack has to
+         be thrown away */
+      if (cpu->predecode)
+        cpu_predecode_invalidate_address (cpu->predecode,
+                                          pushed[i].address);
+      if (cpu->jit)
+        cpu_jit_invalidate_address (cpu->jit, pushed[i].address);
+    }
+
+  return loop_time;
+}
+
+/* Starts the instruction at the program counter. The instrumented
+   variant traces it and remembers where and when it started so that
+   it can be counted once it has finished */
+#define CPU_THREADED_DISPATCH_INSTRUCTION() \
+  do { if (CPU_PROFILE) \
+       { if (cpu->trace) \
+           cpu_trace_add (cpu->trace, cpu); \
+         profile_pc = cpu->pc; profile_time = cpu->time; } \
+       goto *dispatch[cpu->instruction = CPU_FETCH ()]; } while (0)
+/* Runs the trap at the program counter if there is one or otherwise
+   starts the instruction */
+#define CPU_THREADED_DISPATCH() \
+  do { if (CPU_IS_TRAP (cpu->pc)) \
+         goto trap; \
+       CPU_THREADED_DISPATCH_INSTRUCTION (); } while (0)
+
+/* Adds the instruction that has just finished to the profile if the
+   profiler is enabled. The cycles are counted in the routine that was
+   running before the instruction and then the shadow stack is updated
+   if it was a call or a return */
+#define CPU_THREADED_PROFILE() \
+  do { if (CPU_PROFILE && cpu->profile) \
+       { CpuProfile *profile = cpu->profile; \
+         cycles_t cycles = cpu->time - profile_time; \
+         profile->instructions[profile_pc]++; \
+         profile->cycles[profile_pc] += cycles; \
+         profile->opcode_instructions[cpu->instruction]++; \
+         profile->opcode_cycles[cpu->instruction] += cycles; \
+         g_array_index (profile->nodes, CpuProfileNode, \
+                        profile->current_node).cycles += cycles; \
+         switch (cpu->instruction) \
+         { \
+           case 0x20: \
+             cpu_profile_call (profile, CPU_PROFILE_CALL_JSR, \
+                               cpu->pc, cpu->s + 2); \
+             break; \
+           case 0x00: \
+             cpu_profile_call (profile, CPU_PROFILE_CALL_BRK, \
+                               cpu->pc, cpu->s + 3); \
+             break; \
+           case 0x40: case 0x60: \
+             cpu_profile_return (profile, cpu->s); \
+             break; \
+         } } \
+  } while (0)
+
+/* Jumps straight to the code for the next instruction unless the
+   time has reached the point where the interrupts, the breakpoint
+   and the target time need to be checked */
+#define CPU_THREADED_NEXT() \
+  do { CPU_THREADED_PROFILE (); \
+       if (G_UNLIKELY (cpu->time >= cpu->check_time)) \
+         goto check; \
+       CPU_THREADED_DISPATCH (); } while (0)
+
+#define CPU_THREADED_LABEL(code, kind, op, mode) [code] = &&op_##code,
+#define CPU_THREADED_CASE(code, kind, op, mode) \
+  op_##code: \
+    CPU_EXEC (kind, op, mode); \
+    CPU_THREADED_NEXT ();
+
+#define CPU_PROFILE 0
+
+/* The debug variant of the threaded core does all of the breakpoint
+   checks */
+#define CPU_THREADED_FUNC cpu_fetch_execute_threaded
+#include "cputhreaded.h"
+#undef CPU_THREADED_FUNC
+
+/* The instrumented variant is the same as the debug variant but also
+   counts every instruction in the profile and records every access in
+   the coverage map. Each of these is skipped if it isn't enabled */
+#undef CPU_PROFILE
+#define CPU_PROFILE 1
+#undef CPU_RECORD_COVERAGE
+#define CPU_RECORD_COVERAGE 1
+#define CPU_THREADED_FUNC cpu_fetch_execute_threaded_instrumented
+#include "cputhreaded.h"
+#undef CPU_THREADED_FUNC
+#undef CPU_PROFILE
+#define CPU_PROFILE 0
+#undef CPU_RECORD_COVERAGE
+#define CPU_RECORD_COVERAGE 0
+
+/* The fast variant is generated from the same source but with all of
+   the breakpoint handling compiled out */
+#undef CPU_CHECK_BREAKPOINTS
+#define CPU_CHECK_BREAKPOINTS 0
+#define CPU_THREADED_FUNC cpu_fetch_execute_threaded_fast
+#include "cputhreaded.h"
+#undef CPU_THREADED_FUNC
@@ -22,40 +22,173 @@
 #include <glib.h>
 
 typedef struct _Cpu Cpu;
+typedef struct _CpuPredecode CpuPredecode;
+typedef struct _CpuJit CpuJit;
+typedef struct _CpuProfile CpuProfile;
+typedef struct _CpuTrace CpuTrace;
 
-typedef unsigned int cycles_t;
+/* The clock is 64-bit so that it never needs to be wrapped */
+typedef guint64 cycles_t;
 
 /* Defines a type to point to a function to perform a particular
    instruction */
-typedef void (*CpuOpcodeFunc) (void);
-
-/* Defines a type to point to a function that gets data using one of
-   the addressing modes */
-typedef guint8 (*CpuReadFunc) (void);
-/* Defines a type to point to a function that writes data using one of
-   the addressing modes */
-typedef void (*CpuWriteFunc) (guint8 v);
-/* Defines a type to point to a function that gets an address using
-   one of the addressing modes */
-typedef guint16 (*CpuAddressFunc) (void);
+typedef void (*CpuOpcodeFunc) (Cpu *cpu);
 
 /* Defines a function that reads from a memory location */
 typedef guint8 (*CpuMemReadFunc) (void *data, guint16 address);
 /* Defines a function that write to a memory location */
 typedef void (*CpuMemWriteFunc) (void *data, guint16 address, guint8 val);
+/* Defines a function that is called instead of running the
+   instruction at a trapped address. It should return TRUE if it has
+   done the work of the code there and moved the program counter on,
+   or FALSE to run the instruction normally */
+typedef gboolean (*CpuTrapFunc) (void *data, Cpu *cpu);
+
+/* Macros that define the accessible memory */
+#define CPU_ADDRESS_SIZE 65536
+#define CPU_RAM_SIZE     32768
+#define CPU_PAGE_SIZE    256
+#define CPU_PAGE_COUNT   (CPU_ADDRESS_SIZE / CPU_PAGE_SIZE)
 
 #define CPU_START_VECTOR 0xFFFC
 #define CPU_IRQ_VECTOR   0xFFFE
 #define CPU_NMI_VECTOR   0xFFFA
 
+/* The cores that can be used to run the cpu. The jumpblock core is
+   the original one that calls a function pointer for each
+   instruction. The threaded core uses computed gotos and works
+   directly on the Cpu struct. The predecode core is like the threaded
+   core but caches the decoded form of each instruction and runs some
+   common sequences of instructions in one go. The JIT core translates
+   basic blocks to native code and is only available on some
+   platforms */
+typedef enum
+{
+  CPU_CORE_JUMPBLOCK,
+  CPU_CORE_THREADED,
+  CPU_CORE_PREDECODE,
+  CPU_CORE_JIT
+} CpuCore;
+
+/* The types of breakpoint. These are flags so that the types of all
+   of the breakpoints at an address can be stored in one byte */
+typedef enum
+{
+  CPU_BREAK_NONE = 0,
+  CPU_BREAK_ADDR = 1 << 0,
+  CPU_BREAK_WRITE = 1 << 1,
+  CPU_BREAK_READ = 1 << 2,
+  /* Marks the addresses added with cpu_add_trap. These aren't
+     breakpoints and are run even when the debugger is disabled */
+  CPU_BREAK_TRAP = 1 << 3
+} CpuBreakType;
+
+/* The types of access recorded in the coverage map. These are flags
+   so that all of the accesses to an address can be stored in one
+   byte. Executing counts every byte of the instruction */
+typedef enum
+{
+  CPU_COVERAGE_EXECUTE = 1 << 0,
+  CPU_COVERAGE_READ = 1 << 1,
+  CPU_COVERAGE_WRITE = 1 << 2
+} CpuCoverageType;
+
+/* A breakpoint covering the addresses from start to end
+   inclusive. Setting a read or write breakpoint on a range makes a
+   watchpoint */
+typedef struct
+{
+  CpuBreakType type;
+  guint16 start, end;
+} CpuBreakpoint;
+
+/* How a routine in the call graph was entered */
+typedef enum
+{
+  /* The root of the graph which covers whatever was running when the
+     profiler was enabled */
+  CPU_PROFILE_CALL_ROOT,
+  CPU_PROFILE_CALL_JSR,
+  CPU_PROFILE_CALL_BRK,
+  CPU_PROFILE_CALL_IRQ,
+  CPU_PROFILE_CALL_NMI
+} CpuProfileCall;
+
+/* One node in the call graph for each distinct chain of calls that
+   has been seen. The nodes are stored in an array and refer to each
+   other by index. A child is always after its parent in the array */
+typedef struct
+{
+  /* The address that was called */
+  guint16 address;
+  CpuProfileCall call;
+  /* The node that made the call, or G_MAXUINT for the root */
+  guint parent;
+  /* The first node that this one called and the next node called by
+     the same parent, or G_MAXUINT if there aren't any */
+  guint first_child, next_sibling;
+  /* The number of times the call was made */
+  guint64 calls;
+  /* The cycles spent in the routine itself, not counting the routines
+     it called */
+  guint64 cycles;
+} CpuProfileNode;
+
+/* A call on the shadow stack */
+typedef struct
+{
+  guint node;
+  /* The stack pointer before the return address was pushed. The call
+     has finished once the stack pointer has gone back to this. It is
+     compared as a distance that wraps around with the stack so a call
+     can be up to 127 bytes deep */
+  guint8 s;
+} CpuProfileFrame;
+
+/* The maximum number of calls to track. Any deeper calls are counted
+   as part of the deepest one */
+#define CPU_PROFILE_STACK_SIZE 128
+
+/* Counts of what the cpu has been doing while the profiler is
+   enabled. The cycles for an instruction include any extra cycles for
+   page crossings and taken branches but not the time spent handling
+   interrupts */
+struct _CpuProfile
+{
+  /* The number of instructions run and the number of cycles they took
+     for each address they started at */
+  guint64 instructions[CPU_ADDRESS_SIZE];
+  guint64 cycles[CPU_ADDRESS_SIZE];
+  /* The same counts for each opcode */
+  guint64 opcode_instructions[256];
+  guint64 opcode_cycles[256];
+
+  /* Array of CpuProfileNodes for the call graph. The root is always
+     the first node */
+  GArray *nodes;
+  /* The node that the cycles are currently being counted in */
+  guint current_node;
+  /* The calls that haven't returned yet */
+  CpuProfileFrame stack[CPU_PROFILE_STACK_SIZE];
+  int stack_depth;
+};
+
 /* Structure to keep track of the state of the CPU */
 struct _Cpu
 {
   /* The main registers */
   guint8 a, x, y;
 
-  /* The status register */
+  /* The status register. The N, V, Z and C flags in here are not
+     used. Instead they are evaluated lazily from the fields below so
+     use cpu_get_p to read the whole register */
   guint8 p;
+  /* The N flag is bit 7 of n_result and the Z flag is set when
+     z_result is zero. Most instructions just store their result in
+     both */
+  guint8 n_result, z_result;
+  /* The C and V flags as either 0 or 1 */
+  guint8 carry, overflow;
 
   /* The stack pointer */
   guint8 s;
@@ -72,6 +205,13 @@ struct _Cpu
   CpuMemWriteFunc write_func;
   /* This is the data to pass to the two functions above */
   void *memory_data;
+  /* Table of the memory for each page of the address space. The
+     addresses outside of the RAM are looked up here so that reading
+     from ROM doesn't need a function call. An entry is NULL if the
+     accesses to the page have to go through the functions above, for
+     example for memory mapped I/O */
+  const guint8 *read_pages[CPU_PAGE_COUNT];
+  guint8 *write_pages[CPU_PAGE_COUNT];
 
   /* The current instruction */
   guint8 instruction;
@@ -79,19 +219,68 @@ struct _Cpu
   /* The number of cycles executed since started */
   cycles_t time;
 
+  /* The threaded core only checks for interrupts and breakpoints
+     once the time reaches this value. It is set to zero whenever
+     something happens that needs the checks to be done before the
+     next instruction */
+  cycles_t check_time;
+
+  /* Which interpreter core to use */
+  CpuCore core;
+  /* Whether the interpreter needs to do the bookkeeping for the
+     debugger. When this is FALSE a variant of the threaded core with
+     all of the breakpoint checks compiled out is used instead, so any
+     breakpoints are ignored. The traps still work either way */
+  gboolean debug;
+
+  /* State for the predecode core or NULL if it has never been used */
+  CpuPredecode *predecode;
+  /* State for the JIT core or NULL if it has never been used */
+  CpuJit *jit;
+  /* The profile counts or NULL if the profiler is disabled */
+  CpuProfile *profile;
+  /* The CpuCoverageType flags for every address that has been
+     accessed since the map was last cleared, or NULL if the coverage
+     isn't being recorded */
+  guint8 *coverage;
+  /* The file that each instruction is recorded in or NULL if the
+     instructions aren't being traced */
+  CpuTrace *trace;
+  /* Identifies the ROM currently paged in between 0x8000 and 0xBFFF
+     so that decoded code can be cached for each bank. A negative
+     value means the memory there can change without being written
+     to */
+  int rom_bank;
+
   /* Whether an interrupt is being requested */
   int irq : 1;
   /* whether a non-maskable interrupt is being requested */
   int nmi : 1;
 
   int got_break : 1;
-  enum { CPU_BREAK_NONE, CPU_BREAK_ADDR, CPU_BREAK_WRITE, CPU_BREAK_READ } break_type;
-  guint16 break_address;
-};
 
-/* Macros that define the accessible memory */
-#define CPU_ADDRESS_SIZE 65536
-#define CPU_RAM_SIZE     32768
+  /* The types of all of the breakpoints or'd together. This is zero
+     when there are no breakpoints so that the checks can be skipped
+     with a single test */
+  guint8 break_types;
+  /* Map of the breakpoints in each page. An entry is NULL if there
+     are no breakpoints in the page, otherwise it points to an array
+     of the CpuBreakType flags for each address in the page */
+  guint8 *break_pages[CPU_PAGE_COUNT];
+  /* Array of CpuBreakpoints */
+  GArray *breakpoints;
+
+  /* Array of guint16 addresses where trap_func is called before
+     running the instruction. They are added to the breakpoint map
+     with the CPU_BREAK_TRAP type */
+  GArray *traps;
+  CpuTrapFunc trap_func;
+  void *trap_data;
+
+  /* The number of times each opcode that isn't emulated has been
+     run. It is only reported the first time */
+  guint undefined_counts[256];
+};
 
 void cpu_init (Cpu *cpu, guint8 *memory,
                CpuMemReadFunc read_func, CpuMemWriteFunc write_func,
@@ -102,6 +291,36 @@ void cpu_set_irq (Cpu *cpu);
 void cpu_reset_irq (Cpu *cpu);
 void cpu_cause_nmi (Cpu *cpu);
 void cpu_restart (Cpu *cpu);
-void cpu_set_break (Cpu *cpu, int break_type, guint16 address);
+void cpu_set_break (Cpu *cpu, CpuBreakType type, guint16 address);
+void cpu_add_breakpoint (Cpu *cpu, CpuBreakType type,
+                         guint16 start, guint16 end);
+void cpu_remove_breakpoint (Cpu *cpu, guint index);
+void cpu_clear_breakpoints (Cpu *cpu);
+guint cpu_get_n_breakpoints (Cpu *cpu);
+const CpuBreakpoint *cpu_get_breakpoint (Cpu *cpu, guint index);
+gboolean cpu_is_breakpoint (Cpu *cpu, CpuBreakType type, guint16 address);
+void cpu_set_trap_func (Cpu *cpu, CpuTrapFunc func, void *data);
+void cpu_add_trap (Cpu *cpu, guint16 address);
+void cpu_remove_trap (Cpu *cpu, guint16 address);
+void cpu_rts (Cpu *cpu);
+gboolean cpu_set_core (Cpu *cpu, CpuCore core);
+void cpu_set_debug (Cpu *cpu, gboolean debug);
+guint8 cpu_get_p (Cpu *cpu);
+void cpu_set_p (Cpu *cpu, guint8 p);
+cycles_t cpu_find_idle_loop (Cpu *cpu, cycles_t target_time);
+void cpu_set_profiling (Cpu *cpu, gboolean profiling);
+CpuProfile *cpu_get_profile (Cpu *cpu);
+void cpu_clear_profile (Cpu *cpu);
+void cpu_set_coverage (Cpu *cpu, gboolean coverage);
+const guint8 *cpu_get_coverage (Cpu *cpu);
+void cpu_clear_coverage (Cpu *cpu);
+gboolean cpu_start_trace (Cpu *cpu, const char *filename, guint64 n_records,
+                          GError **error);
+void cpu_stop_trace (Cpu *cpu);
+void cpu_map_pages (Cpu *cpu, int first_page, int n_pages,
+                    const guint8 *read_memory, guint8 *write_memory);
+void cpu_set_rom_bank (Cpu *cpu, int bank);
+void cpu_invalidate_code (Cpu *cpu);
+void cpu_destroy (Cpu *cpu);
 
 #endif /* _CPU_H */
@@ -0,0 +1,946 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CPU_CORE_H
+#define _CPU_CORE_H
+
+/* Macros shared by the interpreter cores. All of the macros operate
+   on CPU_STATE which must be defined by the file that uses them to be
+   an lvalue of type Cpu. The macros are only expanded where they are
+   used so CPU_STATE can be redefined between the cores */
+
+#include <glib.h>
+
+#include "cpu.h"
+
+/* Macros to check the flags */
+#define CPU_FLAG_N 128
+#define CPU_FLAG_V 64
+#define CPU_FLAG_U 32
+#define CPU_FLAG_B 16
+#define CPU_FLAG_D 8
+#define CPU_FLAG_I 4
+#define CPU_FLAG_Z 2
+#define CPU_FLAG_C 1
+#define CPU_LAZY_FLAGS (CPU_FLAG_N | CPU_FLAG_V | CPU_FLAG_Z | CPU_FLAG_C)
+#define CPU_CHECK_FLAG(f) (CPU_STATE.p & (f))
+#define CPU_SET_FLAG(f, v) \
+ do { if ((v)) CPU_STATE.p |= (f); else CPU_STATE.p &= ~(f); } while (0)
+/* N, V, Z and C are kept in separate fields so that setting them
+   doesn't need a read-modify-write of the status register */
+#define CPU_IS_N() (CPU_STATE.n_result & 0x80)
+#define CPU_IS_V() (CPU_STATE.overflow)
+#define CPU_IS_U() CPU_CHECK_FLAG (CPU_FLAG_U)
+#define CPU_IS_B() CPU_CHECK_FLAG (CPU_FLAG_B)
+#define CPU_IS_D() CPU_CHECK_FLAG (CPU_FLAG_D)
+#define CPU_IS_I() CPU_CHECK_FLAG (CPU_FLAG_I)
+#define CPU_IS_Z() (!CPU_STATE.z_result)
+#define CPU_IS_C() (CPU_STATE.carry)
+#define CPU_SET_N(v) do { CPU_STATE.n_result = (v) ? 0x80 : 0; } while (0)
+#define CPU_SET_V(v) do { CPU_STATE.overflow = !!(v); } while (0)
+#define CPU_SET_U(v) CPU_SET_FLAG (CPU_FLAG_U, v)
+#define CPU_SET_B(v) CPU_SET_FLAG (CPU_FLAG_B, v)
+#define CPU_SET_D(v) CPU_SET_FLAG (CPU_FLAG_D, v)
+#define CPU_SET_I(v) CPU_SET_FLAG (CPU_FLAG_I, v)
+#define CPU_SET_Z(v) do { CPU_STATE.z_result = !(v); } while (0)
+#define CPU_SET_C(v) do { CPU_STATE.carry = !!(v); } while (0)
+
+/* Builds the status register from the lazily evaluated flags. This
+   is only needed when P is pushed or looked at by the debugger */
+#define CPU_GET_P() \
+  ((CPU_STATE.p & ~CPU_LAZY_FLAGS) \
+   | (CPU_STATE.n_result & CPU_FLAG_N) \
+   | (CPU_STATE.overflow << 6) \
+   | (!CPU_STATE.z_result << 1) \
+   | CPU_STATE.carry)
+/* Splits a value for the status register into the lazy flags */
+#define CPU_SET_P(v) \
+  do { guint8 _pv = (v); \
+       CPU_STATE.p = _pv & ~CPU_LAZY_FLAGS; \
+       CPU_STATE.n_result = _pv; \
+       CPU_STATE.z_result = ~_pv & CPU_FLAG_Z; \
+       CPU_STATE.overflow = (_pv >> 6) & 1; \
+       CPU_STATE.carry = _pv & CPU_FLAG_C; } while (0)
+
+/* The checks for breakpoints can be compiled out by defining this to
+   0 before including the header. This is used for the cores that are
+   never run while there are breakpoints */
+#ifndef CPU_CHECK_BREAKPOINTS
+#define CPU_CHECK_BREAKPOINTS 1
+#endif
+
+/* Tests whether there is a breakpoint of the given type at an
+   address. When there are no breakpoints of the type this only needs
+   to test one field of the Cpu */
+#define CPU_IS_BREAK(type, addr) \
+  (CPU_CHECK_BREAKPOINTS \
+   && G_UNLIKELY (CPU_STATE.break_types & (type)) \
+   && ({ guint16 _baddr = (addr); \
+         const guint8 *_bpage = CPU_STATE.break_pages[_baddr >> 8]; \
+         _bpage && (_bpage[_baddr & 0xff] & (type)); }))
+
+/* Tests whether there is a trap at an address. Unlike the breakpoints
+   this is never compiled out. Any page without a breakpoint or a trap
+   is skipped with a single test of the page map */
+#define CPU_IS_TRAP(addr) \
+  ({ guint16 _trap_addr = (addr); \
+     const guint8 *_trap_page = CPU_STATE.break_pages[_trap_addr >> 8]; \
+     G_UNLIKELY (_trap_page != NULL) \
+       && (_trap_page[_trap_addr & 0xff] & CPU_BREAK_TRAP); })
+
+/* Flags a breakpoint. The check time is reset so that the threaded
+   core will notice the break as soon as the instruction finishes */
+#define CPU_BREAK() \
+ do { CPU_STATE.got_break = 1; CPU_STATE.check_time = 0; } while (0)
+/* Makes the threaded core re-examine the interrupt lines before the
+   next instruction */
+#define CPU_CHECK_INTERRUPTS() do { CPU_STATE.check_time = 0; } while (0)
+
+/* Recording the accesses in the coverage map can be compiled in by
+   defining this to 1. Like CPU_CHECK_BREAKPOINTS it is looked at
+   whenever the macros below are expanded */
+#ifndef CPU_RECORD_COVERAGE
+#define CPU_RECORD_COVERAGE 0
+#endif
+
+/* Records an access of the given CpuCoverageType to an address */
+#define CPU_COVER(type, addr) \
+  do { if (CPU_RECORD_COVERAGE && CPU_STATE.coverage) \
+         CPU_STATE.coverage[(addr)] |= (type); } while (0)
+
+/* A core can define this before including the header to be notified
+   of every write to RAM */
+#ifndef CPU_RAM_WRITTEN
+#define CPU_RAM_WRITTEN(addr) do { } while (0)
+#endif
+
+/* Macros to access memory outside of the RAM through the page
+   table. Pages that aren't mapped go through the memory functions */
+#define CPU_READ_PAGED(addr) \
+                            ({ guint16 _paddr = (addr); \
+                               const guint8 *_page \
+                                 = CPU_STATE.read_pages[_paddr >> 8]; \
+                               _page ? _page[_paddr & 0xff] \
+                               : CPU_STATE.read_func (CPU_STATE.memory_data, \
+                                                      _paddr); })
+#define CPU_WRITE_PAGED(addr, v) \
+                            do { guint16 _paddr = (addr); \
+                                 guint8 *_page \
+                                   = CPU_STATE.write_pages[_paddr >> 8]; \
+                                 if (_page) \
+                                   _page[_paddr & 0xff] = (v); \
+                                 else \
+                                   CPU_STATE.write_func (CPU_STATE.memory_data, \
+                                                         _paddr, (v)); \
+                            } while (0)
+
+/* Writes to any address without checking for breakpoints */
+#define CPU_STORE(addr, v) \
+                            do { guint16 _saddr = (addr); \
+                                 guint8 _sv = (v); \
+                                 if (_saddr < CPU_RAM_SIZE) \
+                                 { CPU_STATE.memory[_saddr] = _sv; \
+                                   CPU_RAM_WRITTEN (_saddr); } \
+                                 else CPU_WRITE_PAGED (_saddr, _sv); } while (0)
+
+/* Macros to operate on the cpu's memory */
+#define CPU_WRITE(addr, v) \
+                            do { guint16 _taddr = (addr); \
+                                 guint8 _v = (v); \
+                                 if (CPU_IS_BREAK (CPU_BREAK_WRITE, _taddr)) \
+                                   CPU_BREAK (); \
+                                 CPU_COVER (CPU_COVERAGE_WRITE, _taddr); \
+                                 CPU_STORE (_taddr, _v); } while (0)
+/* Zero page macro should be faster because we don't need to test if
+   the address is in RAM */
+#define CPU_WRITE_ZERO(addr, v) \
+                            do { guint16 _taddr = (addr); \
+                                 guint8 _v = (v); \
+                                 if (CPU_IS_BREAK (CPU_BREAK_WRITE, _taddr)) \
+                                   CPU_BREAK (); \
+                                 CPU_COVER (CPU_COVERAGE_WRITE, _taddr); \
+                                 CPU_STATE.memory[_taddr] = _v; \
+                                 CPU_RAM_WRITTEN (_taddr); } while (0)
+#define CPU_WRITE_WORD(addr, v) \
+                            do { guint16 _taddr = (addr); \
+                                 guint16 _v = (v); \
+                                 if (CPU_IS_BREAK (CPU_BREAK_WRITE, _taddr) \
+                                     || CPU_IS_BREAK (CPU_BREAK_WRITE, _taddr + 1)) \
+                                   CPU_BREAK (); \
+                                 CPU_COVER (CPU_COVERAGE_WRITE, _taddr); \
+                                 CPU_COVER (CPU_COVERAGE_WRITE, \
+                                            (guint16) (_taddr + 1)); \
+                                 if (_taddr < CPU_RAM_SIZE - 1) \
+                                 { (*(guint16 *) (CPU_STATE.memory + (_taddr))) \
+                                     = GUINT16_TO_LE (_v); \
+                                   CPU_RAM_WRITTEN (_taddr); \
+                                   CPU_RAM_WRITTEN (_taddr + 1); } \
+                                 else \
+                                 { CPU_STORE (_taddr, _v); \
+                                   CPU_STORE (_taddr + 1, _v >> 8); \
+                                 } } while (0)
+/* Reads from any address. The access is recorded in the coverage map
+   as the given CpuCoverageType so that fetching the instruction can
+   be told apart from reading data */
+#define CPU_READ_AS(addr, type) \
+                            ({ guint16 _taddr = (addr); \
+                               if (CPU_IS_BREAK (CPU_BREAK_READ, _taddr)) \
+                                 CPU_BREAK (); \
+                               CPU_COVER ((type), _taddr); \
+                               _taddr < CPU_RAM_SIZE ? CPU_STATE.memory[_taddr] \
+                               : CPU_READ_PAGED (_taddr); })
+#define CPU_READ(addr)        CPU_READ_AS ((addr), CPU_COVERAGE_READ)
+/* Zero page macro should be faster because we don't need to test if
+   the address is in RAM */
+#define CPU_READ_ZERO(addr)   ({ guint16 _taddr = (addr); \
+                               if (CPU_IS_BREAK (CPU_BREAK_READ, _taddr)) \
+                                 CPU_BREAK (); \
+                               CPU_COVER (CPU_COVERAGE_READ, _taddr); \
+                               CPU_STATE.memory[_taddr]; })
+#define CPU_READ_WORD(addr) \
+                            ({ guint16 _taddr = (addr); \
+                               if (CPU_IS_BREAK (CPU_BREAK_READ, _taddr) \
+                                   || CPU_IS_BREAK (CPU_BREAK_READ, _taddr + 1)) \
+                                 CPU_BREAK (); \
+                               CPU_COVER (CPU_COVERAGE_READ, _taddr); \
+                               CPU_COVER (CPU_COVERAGE_READ, \
+                                          (guint16) (_taddr + 1)); \
+                               (_taddr < CPU_RAM_SIZE - 1) \
+                               ? (GUINT16_FROM_LE (*(guint16 *) (CPU_STATE.memory + (_taddr)))) \
+                               : (CPU_READ_PAGED (_taddr) \
+                                  | (CPU_READ_PAGED (_taddr + 1) << 8)); })
+/* Reads memory without checking for breakpoints. This is used to
+   read code for the caches */
+#define CPU_PEEK(addr)        ({ guint16 _taddr = (addr); \
+                               _taddr < CPU_RAM_SIZE ? CPU_STATE.memory[_taddr] \
+                               : CPU_READ_PAGED (_taddr); })
+#define CPU_FETCH()        (CPU_READ_AS (CPU_STATE.pc++, CPU_COVERAGE_EXECUTE))
+#define CPU_PUSH(v)        CPU_WRITE (CPU_STATE.s-- | 0x100, (v))
+#define CPU_PUSH_WORD(w) \
+                            do { guint16 _w = w; CPU_PUSH (_w >> 8); /* high byte */ \
+                                 CPU_PUSH (_w);                   /* low byte */ \
+                            } while (0)
+#define CPU_PUSH_PC()       CPU_PUSH_WORD (CPU_STATE.pc)
+#define CPU_POP()           (CPU_READ (++CPU_STATE.s | 0x100))
+
+/* The bytes of an instruction's operand. By default these are
+   fetched from memory as the instruction is executed but a core can
+   define them before including the header to get the operand from
+   somewhere else. The low byte is always used before the high byte */
+#ifndef CPU_OPERAND_LOW
+#define CPU_OPERAND_LOW()   CPU_FETCH ()
+#endif
+#ifndef CPU_OPERAND_HIGH
+#define CPU_OPERAND_HIGH()  CPU_FETCH ()
+#endif
+
+/* Macros to get values using the different addressing modes. These
+   also count the clock cycles for the whole instruction */
+#define CPU_GET_IMMEDIATE() ({ CPU_STATE.time += 2; CPU_OPERAND_LOW (); })
+#define CPU_GET_ZERO_PAGE() \
+  ({ CPU_STATE.time += 3; CPU_READ_ZERO (CPU_OPERAND_LOW ()); })
+#define CPU_GET_ABSOLUTE() \
+  ({ int _al = CPU_OPERAND_LOW (); \
+     CPU_STATE.time += 4; \
+     CPU_READ (_al | (CPU_OPERAND_HIGH () << 8)); })
+#define CPU_GET_ZERO_INDEXED(r) \
+  ({ CPU_STATE.time += 4; \
+     CPU_READ_ZERO ((CPU_OPERAND_LOW () + CPU_STATE.r) & 0xff); })
+#define CPU_GET_ZERO_INDEXED_X() CPU_GET_ZERO_INDEXED (x)
+#define CPU_GET_ZERO_INDEXED_Y() CPU_GET_ZERO_INDEXED (y)
+/* Counts an extra cycle when the index goes over the page boundary */
+#define CPU_GET_ABSOLUTE_INDEXED(r) \
+  ({ int _al = CPU_OPERAND_LOW () + CPU_STATE.r; \
+     int _ah = CPU_OPERAND_HIGH (); \
+     CPU_STATE.time += _al >= 0x100 ? 5 : 4; \
+     CPU_READ ((_ah << 8) + _al); })
+#define CPU_GET_ABSOLUTE_INDEXED_X() CPU_GET_ABSOLUTE_INDEXED (x)
+#define CPU_GET_ABSOLUTE_INDEXED_Y() CPU_GET_ABSOLUTE_INDEXED (y)
+#define CPU_GET_PRE_INDEXED_X() \
+  ({ guint8 _za = CPU_OPERAND_LOW () + CPU_STATE.x; \
+     int _al = CPU_READ (_za++); \
+     int _ah = CPU_READ (_za); \
+     CPU_STATE.time += 6; \
+     CPU_READ ((_ah << 8) | _al); })
+#define CPU_GET_POST_INDEXED_Y() \
+  ({ guint8 _za = CPU_OPERAND_LOW (); \
+     int _al = CPU_READ (_za++) + CPU_STATE.y; \
+     int _ah = CPU_READ (_za); \
+     CPU_STATE.time += _al >= 0x100 ? 6 : 5; \
+     CPU_READ ((_ah << 8) + _al); })
+
+/* Macros to write using the addressing modes */
+#define CPU_PUT_ZERO_PAGE(v) \
+  do { guint8 _pv = (v); \
+       CPU_STATE.time += 3; \
+       CPU_WRITE_ZERO (CPU_OPERAND_LOW (), _pv); } while (0)
+#define CPU_PUT_ABSOLUTE(v) \
+  do { guint8 _pv = (v); \
+       int _al = CPU_OPERAND_LOW (); \
+       CPU_STATE.time += 4; \
+       CPU_WRITE (_al | (CPU_OPERAND_HIGH () << 8), _pv); } while (0)
+#define CPU_PUT_ZERO_INDEXED(r, v) \
+  do { guint8 _pv = (v); \
+       CPU_STATE.time += 4; \
+       CPU_WRITE_ZERO ((CPU_OPERAND_LOW () + CPU_STATE.r) & 0xff, _pv); \
+  } while (0)
+#define CPU_PUT_ZERO_INDEXED_X(v) CPU_PUT_ZERO_INDEXED (x, v)
+#define CPU_PUT_ZERO_INDEXED_Y(v) CPU_PUT_ZERO_INDEXED (y, v)
+#define CPU_PUT_ABSOLUTE_INDEXED(r, v) \
+  do { guint8 _pv = (v); \
+       int _al = CPU_OPERAND_LOW () + CPU_STATE.r; \
+       int _ah = CPU_OPERAND_HIGH (); \
+       CPU_STATE.time += _al >= 0x100 ? 5 : 4; \
+       CPU_WRITE ((_ah << 8) + _al, _pv); } while (0)
+#define CPU_PUT_ABSOLUTE_INDEXED_X(v) CPU_PUT_ABSOLUTE_INDEXED (x, v)
+#define CPU_PUT_ABSOLUTE_INDEXED_Y(v) CPU_PUT_ABSOLUTE_INDEXED (y, v)
+#define CPU_PUT_PRE_INDEXED_X(v) \
+  do { guint8 _pv = (v); \
+       guint8 _za = CPU_OPERAND_LOW () + CPU_STATE.x; \
+       int _al = CPU_READ (_za++); \
+       int _ah = CPU_READ (_za); \
+       CPU_STATE.time += 6; \
+       CPU_WRITE ((_ah << 8) | _al, _pv); } while (0)
+#define CPU_PUT_POST_INDEXED_Y(v) \
+  do { guint8 _pv = (v); \
+       guint8 _za = CPU_OPERAND_LOW (); \
+       int _al = CPU_READ (_za++) + CPU_STATE.y; \
+       int _ah = CPU_READ (_za); \
+       CPU_STATE.time += _al >= 0x100 ? 6 : 5; \
+       CPU_WRITE ((_ah << 8) + _al, _pv); } while (0)
+
+/* Macros to calculate an address for a read-modify-write
+   instruction. These count the clock cycles for the whole
+   instruction */
+#define CPU_ADDR_ZERO_PAGE() \
+  ({ CPU_STATE.time += 5; (guint16) CPU_OPERAND_LOW (); })
+#define CPU_ADDR_ABSOLUTE() \
+  ({ int _al = CPU_OPERAND_LOW (); \
+     CPU_STATE.time += 6; \
+     (guint16) (_al | (CPU_OPERAND_HIGH () << 8)); })
+#define CPU_ADDR_ZERO_INDEXED_X() \
+  ({ CPU_STATE.time += 6; \
+     (guint16) ((CPU_OPERAND_LOW () + CPU_STATE.x) & 0xff); })
+#define CPU_ADDR_ABSOLUTE_INDEXED_X() \
+  ({ int _al = CPU_OPERAND_LOW (); \
+     int _ah = CPU_OPERAND_HIGH (); \
+     CPU_STATE.time += 7; \
+     (guint16) ((_ah << 8) + _al + CPU_STATE.x); })
+/* These modes are only used by undocumented instructions. They never
+   take an extra cycle for crossing a page */
+#define CPU_ADDR_ABSOLUTE_INDEXED_Y() \
+  ({ int _al = CPU_OPERAND_LOW (); \
+     int _ah = CPU_OPERAND_HIGH (); \
+     CPU_STATE.time += 7; \
+     (guint16) ((_ah << 8) + _al + CPU_STATE.y); })
+#define CPU_ADDR_PRE_INDEXED_X() \
+  ({ guint8 _za = CPU_OPERAND_LOW () + CPU_STATE.x; \
+     int _al = CPU_READ (_za++); \
+     int _ah = CPU_READ (_za); \
+     CPU_STATE.time += 8; \
+     (guint16) ((_ah << 8) | _al); })
+#define CPU_ADDR_POST_INDEXED_Y() \
+  ({ guint8 _za = CPU_OPERAND_LOW (); \
+     int _al = CPU_READ (_za++) + CPU_STATE.y; \
+     int _ah = CPU_READ (_za); \
+     CPU_STATE.time += 8; \
+     (guint16) ((_ah << 8) + _al); })
+
+/* Sets the Z and N flags from a result */
+#define CPU_SET_ZN(v) \
+ do { CPU_STATE.n_result = CPU_STATE.z_result = (v); } while (0)
+
+/* The operations. Instructions that read memory take the value as an
+   argument, read-modify-write instructions take the address and
+   store instructions return the value to write */
+#define CPU_OP_ORA(v) CPU_SET_ZN (CPU_STATE.a |= (v))
+#define CPU_OP_AND(v) CPU_SET_ZN (CPU_STATE.a &= (v))
+#define CPU_OP_EOR(v) CPU_SET_ZN (CPU_STATE.a ^= (v))
+#define CPU_OP_LDA(v) CPU_SET_ZN (CPU_STATE.a = (v))
+#define CPU_OP_LDX(v) CPU_SET_ZN (CPU_STATE.x = (v))
+#define CPU_OP_LDY(v) CPU_SET_ZN (CPU_STATE.y = (v))
+#define CPU_OP_BIT(v) \
+  do { guint8 _bv = (v); \
+       CPU_STATE.n_result = _bv; \
+       CPU_STATE.overflow = (_bv >> 6) & 1; \
+       CPU_STATE.z_result = _bv & CPU_STATE.a; } while (0)
+#define CPU_COMPARE(r, v) \
+  do { int _cv = CPU_STATE.r - (v); \
+       CPU_SET_C (_cv >= 0); \
+       CPU_SET_ZN (_cv); } while (0)
+#define CPU_OP_CMP(v) CPU_COMPARE (a, v)
+#define CPU_OP_CPX(v) CPU_COMPARE (x, v)
+#define CPU_OP_CPY(v) CPU_COMPARE (y, v)
+
+/* Decimal mode arithmetic is looked up in tables built by cpu.c. The
+   low nibble table is indexed by the subtract flag, the carry and the
+   two low nibbles. Each entry has the corrected nibble in bits 0-3,
+   the carry into the high nibble in bit 4 and bit 5 set if the
+   uncorrected nibble is non-zero. The high nibble table is indexed in
+   the same way with the carry from the low table. Each entry has the
+   corrected nibble in bits 4-7 and the N, V and C flags in the high
+   byte in the same positions as in the status register. Bit 1 of the
+   high byte is set if the high half of the uncorrected result is
+   zero */
+#define CPU_DECIMAL_TABLE_SIZE 1024
+#define CPU_DECIMAL_INDEX(subtract, carry, a, b) \
+  (((subtract) << 9) | ((carry) << 8) | ((a) << 4) | (b))
+extern guint8 cpu_decimal_low_table[CPU_DECIMAL_TABLE_SIZE];
+extern guint16 cpu_decimal_high_table[CPU_DECIMAL_TABLE_SIZE];
+
+/* A subtraction is the same as doing an addition with the one’s
+ * complement of the operand. The inverted meaning of the carry
+ * effectively means that it will normally add an extra one so it
+ * ends up being like a two’s complement. Binary mode is calculated
+ * directly and decimal mode uses the tables above */
+#define CPU_ARITHMETIC(subtract, v) \
+  do { guint8 _oa = CPU_STATE.a, _ov = (v); \
+       if ((subtract)) \
+         _ov = ~_ov; \
+       if (G_UNLIKELY (CPU_IS_D ())) \
+       { \
+         guint8 _lo = cpu_decimal_low_table \
+           [CPU_DECIMAL_INDEX (!!(subtract), CPU_IS_C (), \
+                               _oa & 0x0f, _ov & 0x0f)]; \
+         guint16 _hi = cpu_decimal_high_table \
+           [CPU_DECIMAL_INDEX (!!(subtract), _lo >> 4 & 1, \
+                               _oa >> 4, _ov >> 4)]; \
+         CPU_STATE.a = (_hi & 0xf0) | (_lo & 0x0f); \
+         CPU_STATE.n_result = _hi >> 8; \
+         CPU_STATE.z_result = (~_hi >> 9 & 1) | (_lo & 0x20); \
+         CPU_STATE.overflow = _hi >> 14 & 1; \
+         CPU_STATE.carry = _hi >> 8 & 1; \
+       } \
+       else \
+       { \
+         int _r = _oa + _ov + CPU_IS_C (); \
+         /* Overflow is set if both inputs have a different sign \
+          * from the result */ \
+         CPU_STATE.overflow = ((_oa ^ _r) & (_ov ^ _r)) >> 7 & 1; \
+         CPU_STATE.carry = _r >> 8; \
+         CPU_SET_ZN (CPU_STATE.a = _r); \
+       } } while (0)
+#define CPU_OP_ADC(v) CPU_ARITHMETIC (FALSE, v)
+#define CPU_OP_SBC(v) CPU_ARITHMETIC (TRUE, v)
+
+#define CPU_OP_STA() (CPU_STATE.a)
+#define CPU_OP_STX() (CPU_STATE.x)
+#define CPU_OP_STY() (CPU_STATE.y)
+
+#define CPU_OP_INC(addr) \
+  do { guint16 _ia = (addr); \
+       guint8 _iv; \
+       CPU_WRITE (_ia, _iv = CPU_READ (_ia) + 1); \
+       CPU_SET_ZN (_iv); } while (0)
+#define CPU_OP_DEC(addr) \
+  do { guint16 _ia = (addr); \
+       guint8 _iv; \
+       CPU_WRITE (_ia, _iv = CPU_READ (_ia) - 1); \
+       CPU_SET_ZN (_iv); } while (0)
+
+/* The shifts are defined in terms of an lvalue so that they can be
+   shared between the accumulator and memory versions */
+#define CPU_SHIFT_ASL(v) \
+  do { CPU_STATE.carry = (v) >> 7; (v) <<= 1; CPU_SET_ZN (v); } while (0)
+#define CPU_SHIFT_LSR(v) \
+  do { CPU_STATE.carry = (v) & 0x01; (v) >>= 1; CPU_SET_ZN (v); } while (0)
+#define CPU_SHIFT_ROL(v) \
+  do { int _oc = CPU_IS_C (); \
+       CPU_STATE.carry = (v) >> 7; \
+       (v) = ((v) << 1) | _oc; \
+       CPU_SET_ZN (v); } while (0)
+#define CPU_SHIFT_ROR(v) \
+  do { int _oc = CPU_IS_C (); \
+       CPU_STATE.carry = (v) & 0x01; \
+       (v) = ((v) >> 1) | (_oc << 7); \
+       CPU_SET_ZN (v); } while (0)
+#define CPU_SHIFT_MEMORY(shift, addr) \
+  do { guint16 _sa = (addr); \
+       guint8 _sv = CPU_READ (_sa); \
+       shift (_sv); \
+       CPU_WRITE (_sa, _sv); } while (0)
+#define CPU_OP_ASL(addr) CPU_SHIFT_MEMORY (CPU_SHIFT_ASL, addr)
+#define CPU_OP_LSR(addr) CPU_SHIFT_MEMORY (CPU_SHIFT_LSR, addr)
+#define CPU_OP_ROL(addr) CPU_SHIFT_MEMORY (CPU_SHIFT_ROL, addr)
+#define CPU_OP_ROR(addr) CPU_SHIFT_MEMORY (CPU_SHIFT_ROR, addr)
+#define CPU_OP_ASL_A() \
+  do { CPU_STATE.time += 2; CPU_SHIFT_ASL (CPU_STATE.a); } while (0)
+#define CPU_OP_LSR_A() \
+  do { CPU_STATE.time += 2; CPU_SHIFT_LSR (CPU_STATE.a); } while (0)
+#define CPU_OP_ROL_A() \
+  do { CPU_STATE.time += 2; CPU_SHIFT_ROL (CPU_STATE.a); } while (0)
+#define CPU_OP_ROR_A() \
+  do { CPU_STATE.time += 2; CPU_SHIFT_ROR (CPU_STATE.a); } while (0)
+
+/* Flag instructions. Clearing the interrupt flag might let a pending
+   interrupt through */
+#define CPU_OP_CLC() do { CPU_STATE.time += 2; CPU_SET_C (FALSE); } while (0)
+#define CPU_OP_CLD() do { CPU_STATE.time += 2; CPU_SET_D (FALSE); } while (0)
+#define CPU_OP_CLI() \
+  do { CPU_STATE.time += 2; CPU_SET_I (FALSE); CPU_CHECK_INTERRUPTS (); } while (0)
+#define CPU_OP_CLV() do { CPU_STATE.time += 2; CPU_SET_V (FALSE); } while (0)
+#define CPU_OP_SEC() do { CPU_STATE.time += 2; CPU_SET_C (TRUE); } while (0)
+#define CPU_OP_SED() do { CPU_STATE.time += 2; CPU_SET_D (TRUE); } while (0)
+#define CPU_OP_SEI() do { CPU_STATE.time += 2; CPU_SET_I (TRUE); } while (0)
+
+#define CPU_OP_INX() do { CPU_STATE.time += 2; CPU_SET_ZN (++CPU_STATE.x); } while (0)
+#define CPU_OP_INY() do { CPU_STATE.time += 2; CPU_SET_ZN (++CPU_STATE.y); } while (0)
+#define CPU_OP_DEX() do { CPU_STATE.time += 2; CPU_SET_ZN (--CPU_STATE.x); } while (0)
+#define CPU_OP_DEY() do { CPU_STATE.time += 2; CPU_SET_ZN (--CPU_STATE.y); } while (0)
+
+#define CPU_BRANCH(cond) \
+  do { gint8 _offset = CPU_OPERAND_LOW (); \
+       if ((cond)) \
+       { \
+         guint16 _new_addr = CPU_STATE.pc + _offset; \
+         if ((_new_addr & 0xFF00) != (CPU_STATE.pc & 0xFF00)) \
+           CPU_STATE.time += 4; \
+         else \
+           CPU_STATE.time += 3; \
+         CPU_STATE.pc = _new_addr; \
+       } \
+       else \
+         CPU_STATE.time += 2; } while (0)
+#define CPU_OP_BPL() CPU_BRANCH (!CPU_IS_N ())
+#define CPU_OP_BMI() CPU_BRANCH (CPU_IS_N ())
+#define CPU_OP_BVC() CPU_BRANCH (!CPU_IS_V ())
+#define CPU_OP_BVS() CPU_BRANCH (CPU_IS_V ())
+#define CPU_OP_BCC() CPU_BRANCH (!CPU_IS_C ())
+#define CPU_OP_BCS() CPU_BRANCH (CPU_IS_C ())
+#define CPU_OP_BNE() CPU_BRANCH (!CPU_IS_Z ())
+#define CPU_OP_BEQ() CPU_BRANCH (CPU_IS_Z ())
+
+#define CPU_OP_NOP() do { CPU_STATE.time += 2; } while (0)
+
+#define CPU_OP_JMP() \
+  do { int _al = CPU_OPERAND_LOW (); \
+       int _ah = CPU_OPERAND_HIGH (); \
+       CPU_STATE.time += 3; \
+       CPU_STATE.pc = (_ah << 8) | _al; } while (0)
+/* A bug in the 6502 makes it fail to load the high byte of the
+   address from the following page if the low byte is 0xff */
+#define CPU_OP_JMP_IND() \
+  do { int _al = CPU_OPERAND_LOW (); \
+       int _ah = CPU_OPERAND_HIGH () << 8; \
+       CPU_STATE.time += 5; \
+       CPU_STATE.pc = CPU_READ (_ah | _al) \
+         | (CPU_READ (_ah | ((_al + 1) & 0xff)) << 8); } while (0)
+/* The pc is saved before getting the high byte */
+#define CPU_OP_JSR() \
+  do { int _al = CPU_OPERAND_LOW (); \
+       CPU_STATE.time += 6; \
+       CPU_PUSH_PC (); \
+       CPU_STATE.pc = (CPU_OPERAND_HIGH () << 8) | _al; } while (0)
+/* The byte following the BRK instruction is skipped out and the
+   flags are pushed with the break flag set */
+#define CPU_OP_BRK() \
+  do { CPU_PUSH_WORD (CPU_STATE.pc + 1); \
+       CPU_PUSH (CPU_GET_P () | CPU_FLAG_B | CPU_FLAG_U); \
+       CPU_STATE.pc = CPU_READ_WORD (CPU_IRQ_VECTOR); \
+       CPU_STATE.time += 7; } while (0)
+#define CPU_OP_RTS() \
+  do { int _al = CPU_POP (); \
+       CPU_STATE.time += 6; \
+       CPU_STATE.pc = ((CPU_POP () << 8) | _al) + 1; } while (0)
+#define CPU_OP_RTI() \
+  do { int _al; \
+       CPU_STATE.time += 6; \
+       CPU_SET_P (CPU_POP ()); \
+       _al = CPU_POP (); \
+       CPU_STATE.pc = (CPU_POP () << 8) | _al; \
+       CPU_CHECK_INTERRUPTS (); } while (0)
+
+/* The unused flag and the break flag are always one when pushed */
+#define CPU_OP_PHA() do { CPU_STATE.time += 3; CPU_PUSH (CPU_STATE.a); } while (0)
+#define CPU_OP_PHP() \
+  do { CPU_STATE.time += 3; \
+       CPU_PUSH (CPU_GET_P () | CPU_FLAG_B | CPU_FLAG_U); } while (0)
+#define CPU_OP_PLA() \
+  do { CPU_STATE.time += 4; CPU_SET_ZN (CPU_STATE.a = CPU_POP ()); } while (0)
+#define CPU_OP_PLP() \
+  do { CPU_STATE.time += 4; \
+       CPU_SET_P (CPU_POP ()); \
+       CPU_CHECK_INTERRUPTS (); } while (0)
+
+#define CPU_OP_TAX() do { CPU_STATE.time += 2; CPU_SET_ZN (CPU_STATE.x = CPU_STATE.a); } while (0)
+#define CPU_OP_TAY() do { CPU_STATE.time += 2; CPU_SET_ZN (CPU_STATE.y = CPU_STATE.a); } while (0)
+#define CPU_OP_TSX() do { CPU_STATE.time += 2; CPU_SET_ZN (CPU_STATE.x = CPU_STATE.s); } while (0)
+#define CPU_OP_TXA() do { CPU_STATE.time += 2; CPU_SET_ZN (CPU_STATE.a = CPU_STATE.x); } while (0)
+#define CPU_OP_TYA() do { CPU_STATE.time += 2; CPU_SET_ZN (CPU_STATE.a = CPU_STATE.y); } while (0)
+/* According to the data sheet this doesn’t affect any flags */
+#define CPU_OP_TXS() do { CPU_STATE.time += 2; CPU_STATE.s = CPU_STATE.x; } while (0)
+
+/* The undocumented instructions of the NMOS 6502. Most of these are
+   side effects of the decoding running two documented instructions
+   at once. The read-modify-write ones write the modified value back
+   and then use it as the operand of an accumulator instruction */
+#define CPU_COMBINED_RMW(modify, operation, addr) \
+  do { guint16 _ua = (addr); \
+       guint8 _uv = CPU_READ (_ua); \
+       modify (_uv); \
+       CPU_WRITE (_ua, _uv); \
+       operation (_uv); } while (0)
+#define CPU_MODIFY_INC(v) ((v)++)
+#define CPU_MODIFY_DEC(v) ((v)--)
+#define CPU_OP_SLO(addr) CPU_COMBINED_RMW (CPU_SHIFT_ASL, CPU_OP_ORA, addr)
+#define CPU_OP_RLA(addr) CPU_COMBINED_RMW (CPU_SHIFT_ROL, CPU_OP_AND, addr)
+#define CPU_OP_SRE(addr) CPU_COMBINED_RMW (CPU_SHIFT_LSR, CPU_OP_EOR, addr)
+#define CPU_OP_RRA(addr) CPU_COMBINED_RMW (CPU_SHIFT_ROR, CPU_OP_ADC, addr)
+#define CPU_OP_DCP(addr) CPU_COMBINED_RMW (CPU_MODIFY_DEC, CPU_OP_CMP, addr)
+#define CPU_OP_ISC(addr) CPU_COMBINED_RMW (CPU_MODIFY_INC, CPU_OP_SBC, addr)
+
+#define CPU_OP_LAX(v) CPU_SET_ZN (CPU_STATE.a = CPU_STATE.x = (v))
+#define CPU_OP_LAS(v) \
+  CPU_SET_ZN (CPU_STATE.a = CPU_STATE.x = CPU_STATE.s &= (v))
+#define CPU_OP_SAX() (CPU_STATE.a & CPU_STATE.x)
+
+#define CPU_OP_ANC(v) \
+  do { CPU_SET_ZN (CPU_STATE.a &= (v)); \
+       CPU_STATE.carry = CPU_STATE.a >> 7; } while (0)
+#define CPU_OP_ALR(v) \
+  do { CPU_STATE.a &= (v); CPU_SHIFT_LSR (CPU_STATE.a); } while (0)
+/* AND followed by ROR but the C and V flags come from bits 6 and 5
+   of the result. In decimal mode the flags are set before the result
+   is corrected as if it were BCD */
+#define CPU_OP_ARR(v) \
+  do { guint8 _rt = CPU_STATE.a & (v); \
+       CPU_STATE.a = (_rt >> 1) | (CPU_IS_C () << 7); \
+       CPU_SET_ZN (CPU_STATE.a); \
+       if (G_UNLIKELY (CPU_IS_D ())) \
+       { \
+         CPU_STATE.overflow = ((_rt ^ CPU_STATE.a) >> 6) & 1; \
+         if ((_rt & 0x0f) + (_rt & 0x01) > 5) \
+           CPU_STATE.a = (CPU_STATE.a & 0xf0) | ((CPU_STATE.a + 6) & 0x0f); \
+         CPU_STATE.carry = (_rt >> 4) + ((_rt >> 4) & 0x01) > 5; \
+         if (CPU_STATE.carry) \
+           CPU_STATE.a += 0x60; \
+       } \
+       else \
+       { \
+         CPU_STATE.carry = (CPU_STATE.a >> 6) & 1; \
+         CPU_STATE.overflow = ((CPU_STATE.a >> 6) ^ (CPU_STATE.a >> 5)) & 1; \
+       } } while (0)
+/* X = (A & X) - operand, setting the flags like CMP */
+#define CPU_OP_SBX(v) \
+  do { int _xv = (CPU_STATE.a & CPU_STATE.x) - (v); \
+       CPU_SET_C (_xv >= 0); \
+       CPU_SET_ZN (CPU_STATE.x = _xv); } while (0)
+/* The NOPs with an operand still do the read */
+#define CPU_OP_NOP_READ(v) ((void) (v))
+
+/* Pushes the state and jumps through a vector to service an
+   interrupt. The break flag is cleared and the unused flag is always
+   one */
+#define CPU_INTERRUPT(vector) \
+  do { CPU_STATE.time += 7; \
+       CPU_PUSH_WORD (CPU_STATE.pc); \
+       CPU_PUSH ((CPU_GET_P () | CPU_FLAG_U) & ~CPU_FLAG_B); \
+       CPU_SET_I (TRUE); \
+       CPU_STATE.pc = CPU_READ_WORD ((vector)); } while (0)
+
+/* Handles an opcode that isn't in the list below. This is defined
+   in cpu.c and shared by all of the cores */
+void cpu_undefined_instruction (Cpu *cpu);
+/* Calls the trap function for the address at the program counter.
+   Returns TRUE if it ran in place of the instruction. This is also
+   shared by all of the cores */
+gboolean cpu_run_trap (Cpu *cpu);
+
+/* Expands one entry of the opcode list according to the kind of
+   instruction */
+#define CPU_EXEC_READ(op, mode)    CPU_OP_##op (CPU_GET_##mode ())
+#define CPU_EXEC_WRITE(op, mode)   CPU_PUT_##mode (CPU_OP_##op ())
+#define CPU_EXEC_RMW(op, mode)     CPU_OP_##op (CPU_ADDR_##mode ())
+#define CPU_EXEC_IMPLIED(op, mode) CPU_OP_##op ()
+#define CPU_EXEC(kind, op, mode)   CPU_EXEC_##kind (op, mode)
+
+/* Length of an instruction from its addressing mode */
+#define CPU_LENGTH_NONE               1
+#define CPU_LENGTH_IMMEDIATE          2
+#define CPU_LENGTH_RELATIVE           2
+#define CPU_LENGTH_ZERO_PAGE          2
+#define CPU_LENGTH_ZERO_INDEXED_X     2
+#define CPU_LENGTH_ZERO_INDEXED_Y     2
+#define CPU_LENGTH_PRE_INDEXED_X      2
+#define CPU_LENGTH_POST_INDEXED_Y     2
+#define CPU_LENGTH_ABSOLUTE           3
+#define CPU_LENGTH_ABSOLUTE_INDEXED_X 3
+#define CPU_LENGTH_ABSOLUTE_INDEXED_Y 3
+#define CPU_LENGTH_INDIRECT           3
+/* Can be passed to CPU_OPCODE_LIST to initialise a table of lengths */
+#define CPU_LENGTH_ENTRY(code, kind, op, mode) [code] = CPU_LENGTH_##mode,
+
+/* Layout of the memory for the cores that cache decoded code. The
+   ROM between 0x8000 and 0xBFFF can be paged so the code there is
+   cached separately for each bank identified by Cpu.rom_bank */
+#define CPU_ROM_BANK_ADDRESS  0x8000
+#define CPU_FIXED_ROM_ADDRESS 0xC000
+#define CPU_ROM_LENGTH        0x4000
+#define CPU_ROM_BANKS         16
+#define CPU_RAM_PAGES         (CPU_RAM_SIZE >> 8)
+/* Pages 0xFC to 0xFE are used for memory mapped I/O so code from
+   there is never cached */
+#define CPU_IS_IO_PAGE(page)  ((page) >= 0xfc && (page) <= 0xfe)
+
+/* List of all of the instructions that are emulated, including the
+   stable undocumented ones. Each entry gives the opcode, the kind of
+   instruction, the operation and the addressing mode. The implied
+   instructions ignore the addressing mode but it is given for the
+   ones that have an operand so that the length of every instruction
+   can be found from the list. The opcodes that are missing either
+   lock up a real 6502 or behave unpredictably */
+#define CPU_OPCODE_LIST(OP) \
+  OP (0x00, IMPLIED, BRK, NONE) \
+  OP (0x01, READ, ORA, PRE_INDEXED_X) \
+  OP (0x03, RMW, SLO, PRE_INDEXED_X) \
+  OP (0x04, READ, NOP_READ, ZERO_PAGE) \
+  OP (0x05, READ, ORA, ZERO_PAGE) \
+  OP (0x06, RMW, ASL, ZERO_PAGE) \
+  OP (0x07, RMW, SLO, ZERO_PAGE) \
+  OP (0x08, IMPLIED, PHP, NONE) \
+  OP (0x09, READ, ORA, IMMEDIATE) \
+  OP (0x0A, IMPLIED, ASL_A, NONE) \
+  OP (0x0B, READ, ANC, IMMEDIATE) \
+  OP (0x0C, READ, NOP_READ, ABSOLUTE) \
+  OP (0x0D, READ, ORA, ABSOLUTE) \
+  OP (0x0E, RMW, ASL, ABSOLUTE) \
+  OP (0x0F, RMW, SLO, ABSOLUTE) \
+  OP (0x10, IMPLIED, BPL, RELATIVE) \
+  OP (0x11, READ, ORA, POST_INDEXED_Y) \
+  OP (0x13, RMW, SLO, POST_INDEXED_Y) \
+  OP (0x14, READ, NOP_READ, ZERO_INDEXED_X) \
+  OP (0x15, READ, ORA, ZERO_INDEXED_X) \
+  OP (0x16, RMW, ASL, ZERO_INDEXED_X) \
+  OP (0x17, RMW, SLO, ZERO_INDEXED_X) \
+  OP (0x18, IMPLIED, CLC, NONE) \
+  OP (0x19, READ, ORA, ABSOLUTE_INDEXED_Y) \
+  OP (0x1A, IMPLIED, NOP, NONE) \
+  OP (0x1B, RMW, SLO, ABSOLUTE_INDEXED_Y) \
+  OP (0x1C, READ, NOP_READ, ABSOLUTE_INDEXED_X) \
+  OP (0x1D, READ, ORA, ABSOLUTE_INDEXED_X) \
+  OP (0x1E, RMW, ASL, ABSOLUTE_INDEXED_X) \
+  OP (0x1F, RMW, SLO, ABSOLUTE_INDEXED_X) \
+  OP (0x20, IMPLIED, JSR, ABSOLUTE) \
+  OP (0x21, READ, AND, PRE_INDEXED_X) \
+  OP (0x23, RMW, RLA, PRE_INDEXED_X) \
+  OP (0x24, READ, BIT, ZERO_PAGE) \
+  OP (0x25, READ, AND, ZERO_PAGE) \
+  OP (0x26, RMW, ROL, ZERO_PAGE) \
+  OP (0x27, RMW, RLA, ZERO_PAGE) \
+  OP (0x28, IMPLIED, PLP, NONE) \
+  OP (0x29, READ, AND, IMMEDIATE) \
+  OP (0x2A, IMPLIED, ROL_A, NONE) \
+  OP (0x2B, READ, ANC, IMMEDIATE) \
+  OP (0x2C, READ, BIT, ABSOLUTE) \
+  OP (0x2D, READ, AND, ABSOLUTE) \
+  OP (0x2E, RMW, ROL, ABSOLUTE) \
+  OP (0x2F, RMW, RLA, ABSOLUTE) \
+  OP (0x30, IMPLIED, BMI, RELATIVE) \
+  OP (0x31, READ, AND, POST_INDEXED_Y) \
+  OP (0x33, RMW, RLA, POST_INDEXED_Y) \
+  OP (0x34, READ, NOP_READ, ZERO_INDEXED_X) \
+  OP (0x35, READ, AND, ZERO_INDEXED_X) \
+  OP (0x36, RMW, ROL, ZERO_INDEXED_X) \
+  OP (0x37, RMW, RLA, ZERO_INDEXED_X) \
+  OP (0x38, IMPLIED, SEC, NONE) \
+  OP (0x39, READ, AND, ABSOLUTE_INDEXED_Y) \
+  OP (0x3A, IMPLIED, NOP, NONE) \
+  OP (0x3B, RMW, RLA, ABSOLUTE_INDEXED_Y) \
+  OP (0x3C, READ, NOP_READ, ABSOLUTE_INDEXED_X) \
+  OP (0x3D, READ, AND, ABSOLUTE_INDEXED_X) \
+  OP (0x3E, RMW, ROL, ABSOLUTE_INDEXED_X) \
+  OP (0x3F, RMW, RLA, ABSOLUTE_INDEXED_X) \
+  OP (0x40, IMPLIED, RTI, NONE) \
+  OP (0x41, READ, EOR, PRE_INDEXED_X) \
+  OP (0x43, RMW, SRE, PRE_INDEXED_X) \
+  OP (0x44, READ, NOP_READ, ZERO_PAGE) \
+  OP (0x45, READ, EOR, ZERO_PAGE) \
+  OP (0x46, RMW, LSR, ZERO_PAGE) \
+  OP (0x47, RMW, SRE, ZERO_PAGE) \
+  OP (0x48, IMPLIED, PHA, NONE) \
+  OP (0x49, READ, EOR, IMMEDIATE) \
+  OP (0x4A, IMPLIED, LSR_A, NONE) \
+  OP (0x4B, READ, ALR, IMMEDIATE) \
+  OP (0x4C, IMPLIED, JMP, ABSOLUTE) \
+  OP (0x4D, READ, EOR, ABSOLUTE) \
+  OP (0x4E, RMW, LSR, ABSOLUTE) \
+  OP (0x4F, RMW, SRE, ABSOLUTE) \
+  OP (0x50, IMPLIED, BVC, RELATIVE) \
+  OP (0x51, READ, EOR, POST_INDEXED_Y) \
+  OP (0x53, RMW, SRE, POST_INDEXED_Y) \
+  OP (0x54, READ, NOP_READ, ZERO_INDEXED_X) \
+  OP (0x55, READ, EOR, ZERO_INDEXED_X) \
+  OP (0x56, RMW, LSR, ZERO_INDEXED_X) \
+  OP (0x57, RMW, SRE, ZERO_INDEXED_X) \
+  OP (0x58, IMPLIED, CLI, NONE) \
+  OP (0x59, READ, EOR, ABSOLUTE_INDEXED_Y) \
+  OP (0x5A, IMPLIED, NOP, NONE) \
+  OP (0x5B, RMW, SRE, ABSOLUTE_INDEXED_Y) \
+  OP (0x5C, READ, NOP_READ, ABSOLUTE_INDEXED_X) \
+  OP (0x5D, READ, EOR, ABSOLUTE_INDEXED_X) \
+  OP (0x5E, RMW, LSR, ABSOLUTE_INDEXED_X) \
+  OP (0x5F, RMW, SRE, ABSOLUTE_INDEXED_X) \
+  OP (0x60, IMPLIED, RTS, NONE) \
+  OP (0x61, READ, ADC, PRE_INDEXED_X) \
+  OP (0x63, RMW, RRA, PRE_INDEXED_X) \
+  OP (0x64, READ, NOP_READ, ZERO_PAGE) \
+  OP (0x65, READ, ADC, ZERO_PAGE) \
+  OP (0x66, RMW, ROR, ZERO_PAGE) \
+  OP (0x67, RMW, RRA, ZERO_PAGE) \
+  OP (0x68, IMPLIED, PLA, NONE) \
+  OP (0x69, READ, ADC, IMMEDIATE) \
+  OP (0x6A, IMPLIED, ROR_A, NONE) \
+  OP (0x6B, READ, ARR, IMMEDIATE) \
+  OP (0x6C, IMPLIED, JMP_IND, INDIRECT) \
+  OP (0x6D, READ, ADC, ABSOLUTE) \
+  OP (0x6E, RMW, ROR, ABSOLUTE) \
+  OP (0x6F, RMW, RRA, ABSOLUTE) \
+  OP (0x70, IMPLIED, BVS, RELATIVE) \
+  OP (0x71, READ, ADC, POST_INDEXED_Y) \
+  OP (0x73, RMW, RRA, POST_INDEXED_Y) \
+  OP (0x74, READ, NOP_READ, ZERO_INDEXED_X) \
+  OP (0x75, READ, ADC, ZERO_INDEXED_X) \
+  OP (0x76, RMW, ROR, ZERO_INDEXED_X) \
+  OP (0x77, RMW, RRA, ZERO_INDEXED_X) \
+  OP (0x78, IMPLIED, SEI, NONE) \
+  OP (0x79, READ, ADC, ABSOLUTE_INDEXED_Y) \
+  OP (0x7A, IMPLIED, NOP, NONE) \
+  OP (0x7B, RMW, RRA, ABSOLUTE_INDEXED_Y) \
+  OP (0x7C, READ, NOP_READ, ABSOLUTE_INDEXED_X) \
+  OP (0x7D, READ, ADC, ABSOLUTE_INDEXED_X) \
+  OP (0x7E, RMW, ROR, ABSOLUTE_INDEXED_X) \
+  OP (0x7F, RMW, RRA, ABSOLUTE_INDEXED_X) \
+  OP (0x80, READ, NOP_READ, IMMEDIATE) \
+  OP (0x81, WRITE, STA, PRE_INDEXED_X) \
+  OP (0x82, READ, NOP_READ, IMMEDIATE) \
+  OP (0x83, WRITE, SAX, PRE_INDEXED_X) \
+  OP (0x84, WRITE, STY, ZERO_PAGE) \
+  OP (0x85, WRITE, STA, ZERO_PAGE) \
+  OP (0x86, WRITE, STX, ZERO_PAGE) \
+  OP (0x87, WRITE, SAX, ZERO_PAGE) \
+  OP (0x88, IMPLIED, DEY, NONE) \
+  OP (0x89, READ, NOP_READ, IMMEDIATE) \
+  OP (0x8A, IMPLIED, TXA, NONE) \
+  OP (0x8C, WRITE, STY, ABSOLUTE) \
+  OP (0x8D, WRITE, STA, ABSOLUTE) \
+  OP (0x8E, WRITE, STX, ABSOLUTE) \
+  OP (0x8F, WRITE, SAX, ABSOLUTE) \
+  OP (0x90, IMPLIED, BCC, RELATIVE) \
+  OP (0x91, WRITE, STA, POST_INDEXED_Y) \
+  OP (0x94, WRITE, STY, ZERO_INDEXED_X) \
+  OP (0x95, WRITE, STA, ZERO_INDEXED_X) \
+  OP (0x96, WRITE, STX, ZERO_INDEXED_Y) \
+  OP (0x97, WRITE, SAX, ZERO_INDEXED_Y) \
+  OP (0x98, IMPLIED, TYA, NONE) \
+  OP (0x99, WRITE, STA, ABSOLUTE_INDEXED_Y) \
+  OP (0x9A, IMPLIED, TXS, NONE) \
+  OP (0x9D, WRITE, STA, ABSOLUTE_INDEXED_X) \
+  OP (0xA0, READ, LDY, IMMEDIATE) \
+  OP (0xA1, READ, LDA, PRE_INDEXED_X) \
+  OP (0xA2, READ, LDX, IMMEDIATE) \
+  OP (0xA3, READ, LAX, PRE_INDEXED_X) \
+  OP (0xA4, READ, LDY, ZERO_PAGE) \
+  OP (0xA5, READ, LDA, ZERO_PAGE) \
+  OP (0xA6, READ, LDX, ZERO_PAGE) \
+  OP (0xA7, READ, LAX, ZERO_PAGE) \
+  OP (0xA8, IMPLIED, TAY, NONE) \
+  OP (0xA9, READ, LDA, IMMEDIATE) \
+  OP (0xAA, IMPLIED, TAX, NONE) \
+  OP (0xAC, READ, LDY, ABSOLUTE) \
+  OP (0xAD, READ, LDA, ABSOLUTE) \
+  OP (0xAE, READ, LDX, ABSOLUTE) \
+  OP (0xAF, READ, LAX, ABSOLUTE) \
+  OP (0xB0, IMPLIED, BCS, RELATIVE) \
+  OP (0xB1, READ, LDA, POST_INDEXED_Y) \
+  OP (0xB3, READ, LAX, POST_INDEXED_Y) \
+  OP (0xB4, READ, LDY, ZERO_INDEXED_X) \
+  OP (0xB5, READ, LDA, ZERO_INDEXED_X) \
+  OP (0xB6, READ, LDX, ZERO_INDEXED_Y) \
+  OP (0xB7, READ, LAX, ZERO_INDEXED_Y) \
+  OP (0xB8, IMPLIED, CLV, NONE) \
+  OP (0xB9, READ, LDA, ABSOLUTE_INDEXED_Y) \
+  OP (0xBA, IMPLIED, TSX, NONE) \
+  OP (0xBB, READ, LAS, ABSOLUTE_INDEXED_Y) \
+  OP (0xBC, READ, LDY, ABSOLUTE_INDEXED_X) \
+  OP (0xBD, READ, LDA, ABSOLUTE_INDEXED_X) \
+  OP (0xBE, READ, LDX, ABSOLUTE_INDEXED_Y) \
+  OP (0xBF, READ, LAX, ABSOLUTE_INDEXED_Y) \
+  OP (0xC0, READ, CPY, IMMEDIATE) \
+  OP (0xC1, READ, CMP, PRE_INDEXED_X) \
+  OP (0xC2, READ, NOP_READ, IMMEDIATE) \
+  OP (0xC3, RMW, DCP, PRE_INDEXED_X) \
+  OP (0xC4, READ, CPY, ZERO_PAGE) \
+  OP (0xC5, READ, CMP, ZERO_PAGE) \
+  OP (0xC6, RMW, DEC, ZERO_PAGE) \
+  OP (0xC7, RMW, DCP, ZERO_PAGE) \
+  OP (0xC8, IMPLIED, INY, NONE) \
+  OP (0xC9, READ, CMP, IMMEDIATE) \
+  OP (0xCA, IMPLIED, DEX, NONE) \
+  OP (0xCB, READ, SBX, IMMEDIATE) \
+  OP (0xCC, READ, CPY, ABSOLUTE) \
+  OP (0xCD, READ, CMP, ABSOLUTE) \
+  OP (0xCE, RMW, DEC, ABSOLUTE) \
+  OP (0xCF, RMW, DCP, ABSOLUTE) \
+  OP (0xD0, IMPLIED, BNE, RELATIVE) \
+  OP (0xD1, READ, CMP, POST_INDEXED_Y) \
+  OP (0xD3, RMW, DCP, POST_INDEXED_Y) \
+  OP (0xD4, READ, NOP_READ, ZERO_INDEXED_X) \
+  OP (0xD5, READ, CMP, ZERO_INDEXED_X) \
+  OP (0xD6, RMW, DEC, ZERO_INDEXED_X) \
+  OP (0xD7, RMW, DCP, ZERO_INDEXED_X) \
+  OP (0xD8, IMPLIED, CLD, NONE) \
+  OP (0xD9, READ, CMP, ABSOLUTE_INDEXED_Y) \
+  OP (0xDA, IMPLIED, NOP, NONE) \
+  OP (0xDB, RMW, DCP, ABSOLUTE_INDEXED_Y) \
+  OP (0xDC, READ, NOP_READ, ABSOLUTE_INDEXED_X) \
+  OP (0xDD, READ, CMP, ABSOLUTE_INDEXED_X) \
+  OP (0xDE, RMW, DEC, ABSOLUTE_INDEXED_X) \
+  OP (0xDF, RMW, DCP, ABSOLUTE_INDEXED_X) \
+  OP (0xE0, READ, CPX, IMMEDIATE) \
+  OP (0xE1, READ, SBC, PRE_INDEXED_X) \
+  OP (0xE2, READ, NOP_READ, IMMEDIATE) \
+  OP (0xE3, RMW, ISC, PRE_INDEXED_X) \
+  OP (0xE4, READ, CPX, ZERO_PAGE) \
+  OP (0xE5, READ, SBC, ZERO_PAGE) \
+  OP (0xE6, RMW, INC, ZERO_PAGE) \
+  OP (0xE7, RMW, ISC, ZERO_PAGE) \
+  OP (0xE8, IMPLIED, INX, NONE) \
+  OP (0xE9, READ, SBC, IMMEDIATE) \
+  OP (0xEA, IMPLIED, NOP, NONE) \
+  OP (0xEB, READ, SBC, IMMEDIATE) \
+  OP (0xEC, READ, CPX, ABSOLUTE) \
+  OP (0xED, READ, SBC, ABSOLUTE) \
+  OP (0xEE, RMW, INC, ABSOLUTE) \
+  OP (0xEF, RMW, ISC, ABSOLUTE) \
+  OP (0xF0, IMPLIED, BEQ, RELATIVE) \
+  OP (0xF1, READ, SBC, POST_INDEXED_Y) \
+  OP (0xF3, RMW, ISC, POST_INDEXED_Y) \
+  OP (0xF4, READ, NOP_READ, ZERO_INDEXED_X) \
+  OP (0xF5, READ, SBC, ZERO_INDEXED_X) \
+  OP (0xF6, RMW, INC, ZERO_INDEXED_X) \
+  OP (0xF7, RMW, ISC, ZERO_INDEXED_X) \
+  OP (0xF8, IMPLIED, SED, NONE) \
+  OP (0xF9, READ, SBC, ABSOLUTE_INDEXED_Y) \
+  OP (0xFA, IMPLIED, NOP, NONE) \
+  OP (0xFB, RMW, ISC, ABSOLUTE_INDEXED_Y) \
+  OP (0xFC, READ, NOP_READ, ABSOLUTE_INDEXED_X) \
+  OP (0xFD, READ, SBC, ABSOLUTE_INDEXED_X) \
+  OP (0xFE, RMW, INC, ABSOLUTE_INDEXED_X) \
+  OP (0xFF, RMW, ISC, ABSOLUTE_INDEXED_X)
+
+#endif /* _CPU_CORE_H */
@@ -0,0 +1,851 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stddef.h>
+#include <string.h>
+#include <glib.h>
+
+#include "cpujit.h"
+
+#if defined (ENABLE_JIT) && defined (__x86_64__) && defined (HAVE_SYS_MMAN_H)
+
+#include <sys/mman.h>
+
+/* The translated code for a basic block. Each block is a sequence of
+   native instructions that either update the Cpu struct directly for
+   simple instructions or call the handler for the instruction. The
+   time is compared with the check time after each instruction so
+   that interrupts and the target time are handled at exactly the
+   same point as in the interpreter. The handlers keep the program
+   counter up to date so a block can be left after any
+   instruction */
+typedef void (* CpuJitCode) (Cpu *cpu);
+
+#define CPU_JIT_CODE_SIZE             (16 * 1024 * 1024)
+#define CPU_JIT_MAX_BLOCK_INSTRUCTIONS 32
+/* Upper bound on the native code generated for one instruction */
+#define CPU_JIT_MAX_INSTRUCTION_SIZE  128
+#define CPU_JIT_MAX_BLOCK_SIZE        (CPU_JIT_MAX_BLOCK_INSTRUCTIONS   \
+                                       * CPU_JIT_MAX_INSTRUCTION_SIZE   \
+                                       + 64)
+
+/* A page of RAM that has had its code thrown away this many times is
+   probably mixing code with data that is written often so it will
+   just be interpreted */
+#define CPU_JIT_MAX_INVALIDATIONS 32
+
+static void cpu_jit_ram_page_written (Cpu *cpu, int page);
+
+/* Every write to RAM is checked to see if it modifies translated
+   code */
+#define CPU_RAM_WRITTEN(addr) \
+  do { if (G_UNLIKELY (cpu->jit->ram_pages[(addr) >> 8])) \
+         cpu_jit_ram_page_written (cpu, (addr) >> 8); } while (0)
+/* The JIT is never used while there are breakpoints. A block never
+   runs into an address with a trap so the traps only need to be
+   checked before running a block */
+#define CPU_CHECK_BREAKPOINTS 0
+#define CPU_STATE (*cpu)
+#include "cpucore.h"
+
+struct _CpuJit
+{
+  /* Executable memory for the translated code */
+  guint8 *code;
+  size_t code_used;
+
+  /* The translated block starting at each address in RAM */
+  CpuJitCode ram_blocks[CPU_RAM_SIZE];
+  /* Non-zero for each page of RAM that has translated code */
+  guint8 ram_pages[CPU_RAM_PAGES];
+  guint8 ram_invalidations[CPU_RAM_PAGES];
+  /* Set when the RAM may have been modified behind our back */
+  gboolean ram_stale;
+
+  /* Tables of blocks for each ROM bank. The last one is for the fixed
+     ROM at 0xC000. These are allocated when first needed */
+  CpuJitCode *rom_blocks[CPU_ROM_BANKS + 1];
+  gboolean rom_has_code[CPU_ROM_BANKS + 1];
+};
+
+/* Handlers for the instructions that aren't translated inline */
+#define CPU_JIT_HANDLER(code, kind, op, mode) \
+  static void \
+  cpu_jit_op_##code (Cpu *cpu) \
+  { \
+    CPU_EXEC (kind, op, mode); \
+  }
+
+CPU_OPCODE_LIST (CPU_JIT_HANDLER)
+
+#define CPU_JIT_HANDLER_ENTRY(code, kind, op, mode) [code] = cpu_jit_op_##code,
+
+static const CpuJitCode cpu_jit_handlers[256] =
+  {
+    [0 ... 255] = cpu_undefined_instruction,
+    CPU_OPCODE_LIST (CPU_JIT_HANDLER_ENTRY)
+  };
+
+static const guint8 cpu_jit_lengths[256] =
+  {
+    [0 ... 255] = 1,
+    CPU_OPCODE_LIST (CPU_LENGTH_ENTRY)
+  };
+
+/* Registers used by the x86-64 encodings */
+#define CPU_JIT_REG_AL  0
+#define CPU_JIT_REG_EAX 0
+
+typedef struct
+{
+  guint8 *p;
+  /* Offsets of the jumps that need to be patched to go to the exit */
+  guint8 *exits[CPU_JIT_MAX_BLOCK_INSTRUCTIONS * 2];
+  int n_exits;
+} CpuJitBuffer;
+
+static void
+cpu_jit_emit_byte (CpuJitBuffer *buf, guint8 b)
+{
+  *(buf->p++) = b;
+}
+
+static void
+cpu_jit_emit_u16 (CpuJitBuffer *buf, guint16 v)
+{
+  cpu_jit_emit_byte (buf, v);
+  cpu_jit_emit_byte (buf, v >> 8);
+}
+
+static void
+cpu_jit_emit_u32 (CpuJitBuffer *buf, guint32 v)
+{
+  cpu_jit_emit_u16 (buf, v);
+  cpu_jit_emit_u16 (buf, v >> 16);
+}
+
+static void
+cpu_jit_emit_u64 (CpuJitBuffer *buf, guint64 v)
+{
+  cpu_jit_emit_u32 (buf, v);
+  cpu_jit_emit_u32 (buf, v >> 32);
+}
+
+/* Emits the ModRM byte and displacement to address a member of the
+   Cpu struct. The struct is always pointed to by rbx */
+static void
+cpu_jit_emit_cpu_operand (CpuJitBuffer *buf, int reg, size_t offset)
+{
+  if (offset < 128)
+  {
+    cpu_jit_emit_byte (buf, 0x43 | (reg << 3));
+    cpu_jit_emit_byte (buf, offset);
+  }
+  else
+  {
+    cpu_jit_emit_byte (buf, 0x83 | (reg << 3));
+    cpu_jit_emit_u32 (buf, offset);
+  }
+}
+
+/* Emits the REX prefix needed to operate on the cycle counter */
+static void
+cpu_jit_emit_cycles_prefix (CpuJitBuffer *buf)
+{
+  if (sizeof (cycles_t) == 8)
+    cpu_jit_emit_byte (buf, 0x48);
+}
+
+/* mov byte [rbx+offset], imm8 */
+static void
+cpu_jit_emit_store_byte (CpuJitBuffer *buf, size_t offset, guint8 v)
+{
+  cpu_jit_emit_byte (buf, 0xc6);
+  cpu_jit_emit_cpu_operand (buf, 0, offset);
+  cpu_jit_emit_byte (buf, v);
+}
+
+/* mov word [rbx+pc], imm16 */
+static void
+cpu_jit_emit_store_pc (CpuJitBuffer *buf, guint16 pc)
+{
+  cpu_jit_emit_byte (buf, 0x66);
+  cpu_jit_emit_byte (buf, 0xc7);
+  cpu_jit_emit_cpu_operand (buf, 0, offsetof (Cpu, pc));
+  cpu_jit_emit_u16 (buf, pc);
+}
+
+/* add [rbx+time], imm8 */
+static void
+cpu_jit_emit_add_time (CpuJitBuffer *buf, int cycles)
+{
+  cpu_jit_emit_cycles_prefix (buf);
+  cpu_jit_emit_byte (buf, 0x83);
+  cpu_jit_emit_cpu_operand (buf, 0, offsetof (Cpu, time));
+  cpu_jit_emit_byte (buf, cycles);
+}
+
+/* An 8-bit ALU operation with an immediate on a member of the
+   struct. ext selects the operation (1 = or, 4 = and) */
+static void
+cpu_jit_emit_byte_op (CpuJitBuffer *buf, int ext, size_t offset, guint8 v)
+{
+  cpu_jit_emit_byte (buf, 0x80);
+  cpu_jit_emit_cpu_operand (buf, ext, offset);
+  cpu_jit_emit_byte (buf, v);
+}
+
+/* movzx eax, byte [rbx+offset] */
+static void
+cpu_jit_emit_load_register (CpuJitBuffer *buf, size_t offset)
+{
+  cpu_jit_emit_byte (buf, 0x0f);
+  cpu_jit_emit_byte (buf, 0xb6);
+  cpu_jit_emit_cpu_operand (buf, CPU_JIT_REG_EAX, offset);
+}
+
+/* mov byte [rbx+offset], al */
+static void
+cpu_jit_emit_store_register (CpuJitBuffer *buf, size_t offset)
+{
+  cpu_jit_emit_byte (buf, 0x88);
+  cpu_jit_emit_cpu_operand (buf, CPU_JIT_REG_AL, offset);
+}
+
+/* Sets the N and Z flags from the value in eax */
+static void
+cpu_jit_emit_set_zn (CpuJitBuffer *buf)
+{
+  cpu_jit_emit_store_register (buf, offsetof (Cpu, n_result));
+  cpu_jit_emit_store_register (buf, offsetof (Cpu, z_result));
+}
+
+/* Emits a jump with a 32-bit displacement to the exit of the
+   block. opcode is the second byte of a 0x0f-prefixed conditional
+   jump or zero for an unconditional jump */
+static void
+cpu_jit_emit_jump_to_exit (CpuJitBuffer *buf, guint8 opcode)
+{
+  if (opcode)
+  {
+    cpu_jit_emit_byte (buf, 0x0f);
+    cpu_jit_emit_byte (buf, opcode);
+  }
+  else
+    cpu_jit_emit_byte (buf, 0xe9);
+
+  buf->exits[buf->n_exits++] = buf->p;
+  cpu_jit_emit_u32 (buf, 0);
+}
+
+/* Leaves the block if the time has reached the check time */
+static void
+cpu_jit_emit_check (CpuJitBuffer *buf)
+{
+  /* mov eax, [rbx+time] */
+  cpu_jit_emit_cycles_prefix (buf);
+  cpu_jit_emit_byte (buf, 0x8b);
+  cpu_jit_emit_cpu_operand (buf, CPU_JIT_REG_EAX, offsetof (Cpu, time));
+  /* cmp eax, [rbx+check_time] */
+  cpu_jit_emit_cycles_prefix (buf);
+  cpu_jit_emit_byte (buf, 0x3b);
+  cpu_jit_emit_cpu_operand (buf, CPU_JIT_REG_EAX, offsetof (Cpu, check_time));
+  /* jae exit */
+  cpu_jit_emit_jump_to_exit (buf, 0x83);
+}
+
+/* Calls the handler for an instruction. The program counter is left
+   pointing after the opcode as if it had just been fetched */
+static void
+cpu_jit_emit_call (CpuJitBuffer *buf, guint16 address, guint8 op)
+{
+  cpu_jit_emit_store_pc (buf, address + 1);
+  cpu_jit_emit_store_byte (buf, offsetof (Cpu, instruction), op);
+  /* mov rdi, rbx */
+  cpu_jit_emit_byte (buf, 0x48);
+  cpu_jit_emit_byte (buf, 0x89);
+  cpu_jit_emit_byte (buf, 0xdf);
+  /* mov rax, handler */
+  cpu_jit_emit_byte (buf, 0x48);
+  cpu_jit_emit_byte (buf, 0xb8);
+  cpu_jit_emit_u64 (buf, (guint64) (gsize) cpu_jit_handlers[op]);
+  /* call rax */
+  cpu_jit_emit_byte (buf, 0xff);
+  cpu_jit_emit_byte (buf, 0xd0);
+}
+
+/* Returns 0 for RAM, 1 for the ROM bank and 2 for the fixed ROM */
+static int
+cpu_jit_region (guint16 address)
+{
+  if (address < CPU_RAM_SIZE)
+    return 0;
+  else if (address < CPU_FIXED_ROM_ADDRESS)
+    return 1;
+  else
+    return 2;
+}
+
+static guint8
+cpu_jit_read_code (Cpu *cpu, guint16 address)
+{
+  return CPU_PEEK (address);
+}
+
+/* Returns TRUE if the instruction could be translated inline. *ends
+   is set if the instruction always leaves the block */
+static gboolean
+cpu_jit_emit_inline (Cpu *cpu,
+                     CpuJitBuffer *buf,
+                     guint16 address,
+                     guint8 op,
+                     gboolean *ends)
+{
+  static const struct { guint8 op; guint8 set; guint8 flag; } flag_ops[] =
+    {
+      { 0x18, FALSE, CPU_FLAG_C }, /* CLC */
+      { 0x38, TRUE, CPU_FLAG_C },  /* SEC */
+      { 0xd8, FALSE, CPU_FLAG_D }, /* CLD */
+      { 0xf8, TRUE, CPU_FLAG_D },  /* SED */
+      { 0x78, TRUE, CPU_FLAG_I },  /* SEI */
+      { 0xb8, FALSE, CPU_FLAG_V }  /* CLV */
+    };
+  static const struct { guint8 op; guint8 src, dst; gboolean flags; }
+  transfer_ops[] =
+    {
+      { 0xaa, offsetof (Cpu, a), offsetof (Cpu, x), TRUE },  /* TAX */
+      { 0xa8, offsetof (Cpu, a), offsetof (Cpu, y), TRUE },  /* TAY */
+      { 0x8a, offsetof (Cpu, x), offsetof (Cpu, a), TRUE },  /* TXA */
+      { 0x98, offsetof (Cpu, y), offsetof (Cpu, a), TRUE },  /* TYA */
+      { 0xba, offsetof (Cpu, s), offsetof (Cpu, x), TRUE },  /* TSX */
+      { 0x9a, offsetof (Cpu, x), offsetof (Cpu, s), FALSE }, /* TXS */
+    };
+  static const struct { guint8 op; guint8 reg; gboolean dec; } inc_ops[] =
+    {
+      { 0xe8, offsetof (Cpu, x), FALSE }, /* INX */
+      { 0xc8, offsetof (Cpu, y), FALSE }, /* INY */
+      { 0xca, offsetof (Cpu, x), TRUE },  /* DEX */
+      { 0x88, offsetof (Cpu, y), TRUE }   /* DEY */
+    };
+  static const struct { guint8 op; guint8 reg; } load_ops[] =
+    {
+      { 0xa9, offsetof (Cpu, a) }, /* LDA # */
+      { 0xa2, offsetof (Cpu, x) }, /* LDX # */
+      { 0xa0, offsetof (Cpu, y) }  /* LDY # */
+    };
+  /* The branches test bits of the lazily evaluated flags. set is
+     TRUE if the branch is taken when any of the bits are set. The Z
+     flag is set when z_result is zero so BNE branches when it has
+     bits set */
+  static const struct { guint8 op; guint8 field, mask; gboolean set; }
+  branch_ops[] =
+    {
+      { 0x10, offsetof (Cpu, n_result), 0x80, FALSE }, /* BPL */
+      { 0x30, offsetof (Cpu, n_result), 0x80, TRUE },  /* BMI */
+      { 0x50, offsetof (Cpu, overflow), 0xff, FALSE }, /* BVC */
+      { 0x70, offsetof (Cpu, overflow), 0xff, TRUE },  /* BVS */
+      { 0x90, offsetof (Cpu, carry), 0xff, FALSE },    /* BCC */
+      { 0xb0, offsetof (Cpu, carry), 0xff, TRUE },     /* BCS */
+      { 0xd0, offsetof (Cpu, z_result), 0xff, TRUE },  /* BNE */
+      { 0xf0, offsetof (Cpu, z_result), 0xff, FALSE }  /* BEQ */
+    };
+  int i;
+
+  *ends = FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (flag_ops); i++)
+    if (flag_ops[i].op == op)
+    {
+      /* C and V are kept in their own fields */
+      if (flag_ops[i].flag == CPU_FLAG_C)
+        cpu_jit_emit_store_byte (buf, offsetof (Cpu, carry),
+                                 flag_ops[i].set);
+      else if (flag_ops[i].flag == CPU_FLAG_V)
+        cpu_jit_emit_store_byte (buf, offsetof (Cpu, overflow),
+                                 flag_ops[i].set);
+      else if (flag_ops[i].set)
+        cpu_jit_emit_byte_op (buf, 1, offsetof (Cpu, p), flag_ops[i].flag);
+      else
+        cpu_jit_emit_byte_op (buf, 4, offsetof (Cpu, p),
+                              (guint8) ~flag_ops[i].flag);
+      goto implied;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (transfer_ops); i++)
+    if (transfer_ops[i].op == op)
+    {
+      cpu_jit_emit_load_register (buf, transfer_ops[i].src);
+      cpu_jit_emit_store_register (buf, transfer_ops[i].dst);
+      if (transfer_ops[i].flags)
+        cpu_jit_emit_set_zn (buf);
+      goto implied;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (inc_ops); i++)
+    if (inc_ops[i].op == op)
+    {
+      /* inc/dec byte [rbx+reg] */
+      cpu_jit_emit_byte (buf, 0xfe);
+      cpu_jit_emit_cpu_operand (buf, inc_ops[i].dec ? 1 : 0, inc_ops[i].reg);
+      cpu_jit_emit_load_register (buf, inc_ops[i].reg);
+      cpu_jit_emit_set_zn (buf);
+      goto implied;
+    }
+
+  if (op == 0xea) /* NOP */
+    goto implied;
+
+  for (i = 0; i < G_N_ELEMENTS (load_ops); i++)
+    if (load_ops[i].op == op)
+    {
+      guint8 v = cpu_jit_read_code (cpu, address + 1);
+
+      cpu_jit_emit_store_byte (buf, load_ops[i].reg, v);
+      cpu_jit_emit_store_byte (buf, offsetof (Cpu, n_result), v);
+      cpu_jit_emit_store_byte (buf, offsetof (Cpu, z_result), v);
+      cpu_jit_emit_add_time (buf, 2);
+      cpu_jit_emit_store_pc (buf, address + 2);
+
+      return TRUE;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (branch_ops); i++)
+    if (branch_ops[i].op == op)
+    {
+      gint8 offset = cpu_jit_read_code (cpu, address + 1);
+      guint16 next = address + 2;
+      guint16 target = next + offset;
+      guint8 *not_taken;
+
+      /* test byte [rbx+field], mask */
+      cpu_jit_emit_byte (buf, 0xf6);
+      cpu_jit_emit_cpu_operand (buf, 0, branch_ops[i].field);
+      cpu_jit_emit_byte (buf, branch_ops[i].mask);
+      /* Jump over the taken path if the branch isn't taken */
+      cpu_jit_emit_byte (buf, 0x0f);
+      cpu_jit_emit_byte (buf, branch_ops[i].set ? 0x84 : 0x85);
+      not_taken = buf->p;
+      cpu_jit_emit_u32 (buf, 0);
+
+      cpu_jit_emit_store_pc (buf, target);
+      cpu_jit_emit_add_time (buf,
+                             (target & 0xff00) != (next & 0xff00) ? 4 : 3);
+      cpu_jit_emit_jump_to_exit (buf, 0);
+
+      *(guint32 *) not_taken = buf->p - (not_taken + 4);
+      cpu_jit_emit_store_pc (buf, next);
+      cpu_jit_emit_add_time (buf, 2);
+
+      *ends = TRUE;
+
+      return TRUE;
+    }
+
+  if (op == 0x4c) /* JMP */
+  {
+    cpu_jit_emit_store_pc (buf, cpu_jit_read_code (cpu, address + 1)
+                           | (cpu_jit_read_code (cpu, address + 2) << 8));
+    cpu_jit_emit_add_time (buf, 3);
+
+    *ends = TRUE;
+
+    return TRUE;
+  }
+
+  return FALSE;
+
+ implied:
+  cpu_jit_emit_add_time (buf, 2);
+  cpu_jit_emit_store_pc (buf, address + 1);
+
+  return TRUE;
+}
+
+/* Returns TRUE if the instruction always changes the program counter
+   itself */
+static gboolean
+cpu_jit_instruction_ends_block (guint8 op)
+{
+  switch (op)
+  {
+    case 0x00: /* BRK */
+    case 0x20: /* JSR */
+    case 0x40: /* RTI */
+    case 0x60: /* RTS */
+    case 0x6c: /* JMP () */
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/* Translates the basic block starting at address. Returns NULL if
+   the code there can't be translated */
+static CpuJitCode
+cpu_jit_translate (Cpu *cpu, guint16 address)
+{
+  CpuJit *jit = cpu->jit;
+  CpuJitBuffer buf;
+  guint8 *start = jit->code + jit->code_used;
+  int start_page = address >> 8;
+  int region = cpu_jit_region (address);
+  guint16 pc = address;
+  int i;
+
+  buf.p = start;
+  buf.n_exits = 0;
+
+  /* push rbx */
+  cpu_jit_emit_byte (&buf, 0x53);
+  /* mov rbx, rdi */
+  cpu_jit_emit_byte (&buf, 0x48);
+  cpu_jit_emit_byte (&buf, 0x89);
+  cpu_jit_emit_byte (&buf, 0xfb);
+
+  for (i = 0; i < CPU_JIT_MAX_BLOCK_INSTRUCTIONS; i++)
+  {
+    guint8 op;
+    guint16 last;
+    gboolean ends;
+
+    /* The trap has to be checked before the instruction is run so
+       the block stops just before it */
+    if (i > 0 && CPU_IS_TRAP (pc))
+      break;
+
+    op = cpu_jit_read_code (cpu, pc);
+    last = pc + cpu_jit_lengths[op] - 1;
+
+    /* Only the first instruction of a block is allowed to spill over
+       into the next page so that invalidating a page only needs to
+       look at the end of the previous one */
+    if ((last >> 8) != start_page)
+    {
+      if (i > 0)
+        break;
+      else if (last < pc
+               || cpu_jit_region (last) != region
+               || CPU_IS_IO_PAGE (last >> 8))
+        return NULL;
+      else if (region == 0)
+        jit->ram_pages[last >> 8] = TRUE;
+    }
+
+    if (!cpu_jit_emit_inline (cpu, &buf, pc, op, &ends))
+    {
+      cpu_jit_emit_call (&buf, pc, op);
+      ends = cpu_jit_instruction_ends_block (op);
+    }
+
+    if (ends)
+      break;
+
+    cpu_jit_emit_check (&buf);
+
+    pc = last + 1;
+  }
+
+  /* Patch all of the exit jumps to point here */
+  for (i = 0; i < buf.n_exits; i++)
+    *(guint32 *) buf.exits[i] = buf.p - (buf.exits[i] + 4);
+
+  /* pop rbx */
+  cpu_jit_emit_byte (&buf, 0x5b);
+  /* ret */
+  cpu_jit_emit_byte (&buf, 0xc3);
+
+  if (region == 0)
+    jit->ram_pages[start_page] = TRUE;
+
+  jit->code_used += buf.p - start;
+
+  return (CpuJitCode) start;
+}
+
+static void
+cpu_jit_flush_ram (CpuJit *jit)
+{
+  int page;
+
+  for (page = 0; page < CPU_RAM_PAGES; page++)
+    if (jit->ram_pages[page])
+    {
+      memset (jit->ram_blocks + (page << 8), 0, sizeof (CpuJitCode) << 8);
+      /* An instruction at the end of the previous page may spill
+         over into this one */
+      if (page > 0)
+        jit->ram_blocks[(page << 8) - 1] = jit->ram_blocks[(page << 8) - 2]
+          = NULL;
+    }
+
+  memset (jit->ram_pages, 0, sizeof (jit->ram_pages));
+  memset (jit->ram_invalidations, 0, sizeof (jit->ram_invalidations));
+  jit->ram_stale = FALSE;
+}
+
+static void
+cpu_jit_flush_roms (CpuJit *jit)
+{
+  int i;
+
+  for (i = 0; i <= CPU_ROM_BANKS; i++)
+    if (jit->rom_has_code[i])
+    {
+      memset (jit->rom_blocks[i], 0, sizeof (CpuJitCode) * CPU_ROM_LENGTH);
+      jit->rom_has_code[i] = FALSE;
+    }
+}
+
+/* Throws away the blocks in a page of RAM along with the blocks just
+   before it that might run into it */
+static void
+cpu_jit_flush_ram_page (CpuJit *jit, int page)
+{
+  jit->ram_pages[page] = FALSE;
+  memset (jit->ram_blocks + (page << 8), 0, sizeof (CpuJitCode) << 8);
+  if (page > 0)
+    jit->ram_blocks[(page << 8) - 1] = jit->ram_blocks[(page << 8) - 2] = NULL;
+
+  if (jit->ram_invalidations[page] < CPU_JIT_MAX_INVALIDATIONS)
+    jit->ram_invalidations[page]++;
+}
+
+static void
+cpu_jit_ram_page_written (Cpu *cpu, int page)
+{
+  cpu_jit_flush_ram_page (cpu->jit, page);
+
+  /* The block that is currently running might be the one that was
+     modified so make it stop after this instruction */
+  cpu->check_time = 0;
+}
+
+/* Finds the translated code for the address, translating it if it
+   hasn't been seen before. Returns NULL if the code should be
+   interpreted */
+static CpuJitCode
+cpu_jit_lookup (Cpu *cpu, guint16 address)
+{
+  CpuJit *jit = cpu->jit;
+  CpuJitCode *table;
+  int bank = -1;
+
+  if (address < CPU_RAM_SIZE)
+  {
+    if (jit->ram_invalidations[address >> 8] >= CPU_JIT_MAX_INVALIDATIONS)
+      return NULL;
+    table = jit->ram_blocks + address;
+  }
+  else
+  {
+    if (address < CPU_FIXED_ROM_ADDRESS)
+    {
+      if (cpu->rom_bank < 0 || cpu->rom_bank >= CPU_ROM_BANKS)
+        return NULL;
+      bank = cpu->rom_bank;
+      address -= CPU_ROM_BANK_ADDRESS;
+    }
+    else
+    {
+      if (CPU_IS_IO_PAGE (address >> 8))
+        return NULL;
+      bank = CPU_ROM_BANKS;
+      address -= CPU_FIXED_ROM_ADDRESS;
+    }
+
+    if (jit->rom_blocks[bank] == NULL)
+      jit->rom_blocks[bank] = g_new0 (CpuJitCode, CPU_ROM_LENGTH);
+    table = jit->rom_blocks[bank] + address;
+  }
+
+  if (G_LIKELY (*table))
+    return *table;
+
+  /* If there's no space left for another block then start again */
+  if (jit->code_used + CPU_JIT_MAX_BLOCK_SIZE > CPU_JIT_CODE_SIZE)
+  {
+    cpu_jit_flush_ram (jit);
+    cpu_jit_flush_roms (jit);
+    jit->code_used = 0;
+  }
+
+  if (bank >= 0)
+  {
+    jit->rom_has_code[bank] = TRUE;
+    address += (bank == CPU_ROM_BANKS
+                ? CPU_FIXED_ROM_ADDRESS : CPU_ROM_BANK_ADDRESS);
+  }
+
+  return *table = cpu_jit_translate (cpu, address);
+}
+
+CpuJit *
+cpu_jit_new (void)
+{
+  CpuJit *jit;
+  void *code;
+
+  code = mmap (NULL, CPU_JIT_CODE_SIZE,
+               PROT_READ | PROT_WRITE | PROT_EXEC,
+               MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+  if (code == MAP_FAILED)
+    return NULL;
+
+  jit = g_new0 (CpuJit, 1);
+  jit->code = code;
+
+  return jit;
+}
+
+void
+cpu_jit_free (CpuJit *jit)
+{
+  int i;
+
+  munmap (jit->code, CPU_JIT_CODE_SIZE);
+
+  for (i = 0; i <= CPU_ROM_BANKS; i++)
+    g_free (jit->rom_blocks[i]);
+
+  g_free (jit);
+}
+
+void
+cpu_jit_invalidate_ram (CpuJit *jit)
+{
+  jit->ram_stale = TRUE;
+}
+
+void
+cpu_jit_invalidate_address (CpuJit *jit, guint16 address)
+{
+  if (jit->ram_pages[address >> 8])
+    cpu_jit_flush_ram_page (jit, address >> 8);
+}
+
+void
+cpu_jit_invalidate_all (CpuJit *jit)
+{
+  /* The code memory isn't reused here in case a block is currently
+     running */
+  cpu_jit_flush_ram (jit);
+  cpu_jit_flush_roms (jit);
+}
+
+int
+cpu_jit_fetch_execute (Cpu *cpu, cycles_t target_time)
+{
+  CpuJit *jit = cpu->jit;
+  CpuJitCode code;
+
+  for (;;)
+  {
+    if (cpu->time >= cpu->check_time)
+    {
+      if (cpu->time >= target_time || cpu->got_break)
+        break;
+
+      if (G_UNLIKELY (jit->ram_stale))
+        cpu_jit_flush_ram (jit);
+
+      /* Check for interrupts */
+      if (cpu->nmi)
+      {
+        CPU_INTERRUPT (CPU_NMI_VECTOR);
+        /* Clear the nmi flag */
+        cpu->nmi = FALSE;
+        continue;
+      }
+      else if (cpu->irq && !CPU_IS_I ())
+      {
+        CPU_INTERRUPT (CPU_IRQ_VECTOR);
+        continue;
+      }
+
+      cpu->check_time = target_time;
+    }
+
+    /* A trap that has run might have changed anything so everything
+       is checked again */
+    if (G_UNLIKELY (CPU_IS_TRAP (cpu->pc)) && cpu_run_trap (cpu))
+    {
+      cpu->check_time = 0;
+      continue;
+    }
+
+    if ((code = cpu_jit_lookup (cpu, cpu->pc)))
+      code (cpu);
+    else
+      cpu_jit_handlers[cpu->instruction = CPU_FETCH ()] (cpu);
+  }
+
+  /* Make sure the next call starts by checking the interrupts */
+  cpu->check_time = 0;
+
+  if (cpu->got_break)
+  {
+    cpu->got_break = 0;
+    return 1;
+  }
+  else
+    return 0;
+}
+
+#else /* ENABLE_JIT && __x86_64__ && HAVE_SYS_MMAN_H */
+
+/* The JIT isn't available on this platform so cpu_set_core will
+   refuse to select it */
+
+CpuJit *
+cpu_jit_new (void)
+{
+  return NULL;
+}
+
+void
+cpu_jit_free (CpuJit *jit)
+{
+}
+
+int
+cpu_jit_fetch_execute (Cpu *cpu, cycles_t target_time)
+{
+  g_return_val_if_reached (0);
+}
+
+void
+cpu_jit_invalidate_ram (CpuJit *jit)
+{
+}
+
+void
+cpu_jit_invalidate_address (CpuJit *jit, guint16 address)
+{
+}
+
+void
+cpu_jit_invalidate_all (CpuJit *jit)
+{
+}
+
+#endif /* ENABLE_JIT && __x86_64__ && HAVE_SYS_MMAN_H */
@@ -0,0 +1,46 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CPU_JIT_H
+#define _CPU_JIT_H
+
+/* Internal interface between cpu.c and the basic block translator */
+
+#include <glib.h>
+
+#include "cpu.h"
+
+/* Returns NULL if the JIT isn't supported on this platform */
+CpuJit *cpu_jit_new (void);
+void cpu_jit_free (CpuJit *jit);
+
+int cpu_jit_fetch_execute (Cpu *cpu, cycles_t target_time);
+
+/* Throws away all of the translated code for the RAM. This should be
+   called whenever the RAM may have been modified without going
+   through the JIT core. The work is deferred until the JIT core is
+   next run */
+void cpu_jit_invalidate_ram (CpuJit *jit);
+/* Throws away any translated code that includes the address in
+   RAM. This is for when just a few bytes were written without going
+   through the JIT core while it isn't running */
+void cpu_jit_invalidate_address (CpuJit *jit, guint16 address);
+/* Throws away all of the translated code */
+void cpu_jit_invalidate_all (CpuJit *jit);
+
+#endif /* _CPU_JIT_H */
@@ -0,0 +1,488 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "cpupredecode.h"
+
+/* An instruction that has been decoded. The record for an address
+   keeps the operand of the instruction so that it doesn't need to be
+   fetched through the memory functions every time the instruction is
+   run. Some common sequences of instructions are decoded as a single
+   superinstruction in which case the record is for the first
+   instruction and operand2 holds the operand of the last one */
+typedef struct
+{
+  /* Index into the dispatch table. CPU_PREDECODE_UNDECODED means the
+     record needs to be filled in */
+  guint16 handler;
+  guint8 opcode;
+  /* Length of the first instruction */
+  guint8 length;
+  guint16 operand;
+  guint16 operand2;
+} CpuPredecoded;
+
+/* The handlers are numbered with the opcode plus one so that zero can
+   be used to mark an empty record. The superinstructions come after
+   the opcodes */
+#define CPU_PREDECODE_UNDECODED   0
+#define CPU_PREDECODE_OPCODE(op)  ((op) + 1)
+#define CPU_PREDECODE_DEX_BNE     257
+#define CPU_PREDECODE_LDA_STA     258
+#define CPU_PREDECODE_INY_CPY_BNE 259
+/* The address has a trap. The record is empty apart from this so
+   the program counter isn't moved before the handler is run */
+#define CPU_PREDECODE_TRAP        260
+#define CPU_PREDECODE_N_HANDLERS  261
+
+/* The longest sequence of bytes that a record can cover. A write to
+   RAM has to throw away the records for this many bytes before it */
+#define CPU_PREDECODE_MAX_LENGTH 5
+
+static void cpu_predecode_ram_written (CpuPredecode *predecode,
+                                       guint16 address);
+
+/* Every write to RAM throws away any records that include the
+   address */
+#define CPU_RAM_WRITTEN(addr) \
+  do { if (G_UNLIKELY (cpu->predecode->ram_pages[(addr) >> 8])) \
+         cpu_predecode_ram_written (cpu->predecode, (addr)); } while (0)
+/* The operand comes from the record instead of memory */
+#define CPU_OPERAND_LOW()  (operand & 0xff)
+#define CPU_OPERAND_HIGH() (operand >> 8)
+/* The core is never used while there are breakpoints. The traps are
+   decoded into records of their own */
+#define CPU_CHECK_BREAKPOINTS 0
+#define CPU_STATE (*cpu)
+#include "cpucore.h"
+
+struct _CpuPredecode
+{
+  /* A record for each address in RAM */
+  CpuPredecoded ram[CPU_RAM_SIZE];
+  /* Non-zero for each page of RAM that has decoded records */
+  guint8 ram_pages[CPU_RAM_PAGES];
+  /* Set when the RAM may have been modified behind our back */
+  gboolean ram_stale;
+
+  /* Tables of records for each ROM bank. The last one is for the
+     fixed ROM at 0xC000. The ROMs can't be written to so once an
+     address is decoded it stays valid until cpu_invalidate_code is
+     called. These are allocated when first needed */
+  CpuPredecoded *roms[CPU_ROM_BANKS + 1];
+
+  /* Record used for code that can't be cached such as code running
+     from the I/O pages. It is decoded again every time */
+  CpuPredecoded scratch;
+};
+
+/* The program counter has already been moved past the whole
+   instruction when the handler is run so the address of the last
+   byte has to be pushed instead */
+#undef CPU_OP_JSR
+#define CPU_OP_JSR() \
+  do { CPU_STATE.time += 6; \
+       CPU_PUSH_WORD (CPU_STATE.pc - 1); \
+       CPU_STATE.pc = operand; } while (0)
+
+static const guint8 cpu_predecode_lengths[256] =
+  {
+    [0 ... 255] = 1,
+    CPU_OPCODE_LIST (CPU_LENGTH_ENTRY)
+  };
+
+static void
+cpu_predecode_ram_written (CpuPredecode *predecode, guint16 address)
+{
+  int i;
+
+  /* Any record starting up to the maximum length before the address
+     might include it */
+  for (i = 0; i < CPU_PREDECODE_MAX_LENGTH && i <= address; i++)
+    predecode->ram[address - i].handler = CPU_PREDECODE_UNDECODED;
+}
+
+void
+cpu_predecode_invalidate_address (CpuPredecode *predecode, guint16 address)
+{
+  if (predecode->ram_pages[address >> 8])
+    cpu_predecode_ram_written (predecode, address);
+}
+
+static void
+cpu_predecode_flush_ram (CpuPredecode *predecode)
+{
+  int page;
+
+  /* A record that spills over into the next page marks both pages so
+     only the marked pages need to be cleared */
+  for (page = 0; page < CPU_RAM_PAGES; page++)
+    if (predecode->ram_pages[page])
+      memset (predecode->ram + (page << 8), 0, sizeof (CpuPredecoded) << 8);
+
+  memset (predecode->ram_pages, 0, sizeof (predecode->ram_pages));
+  predecode->ram_stale = FALSE;
+}
+
+static guint8
+cpu_predecode_read_code (Cpu *cpu, guint16 address)
+{
+  return CPU_PEEK (address);
+}
+
+/* Returns 0 for RAM, 1 for the ROM bank and 2 for the fixed ROM */
+static int
+cpu_predecode_region (guint16 address)
+{
+  if (address < CPU_RAM_SIZE)
+    return 0;
+  else if (address < CPU_FIXED_ROM_ADDRESS)
+    return 1;
+  else
+    return 2;
+}
+
+/* Returns TRUE if the bytes from address to address + length - 1 are
+   all cached in the same table so that a record can cover them */
+static gboolean
+cpu_predecode_is_cacheable (guint16 address, int length)
+{
+  guint16 last = address + length - 1;
+
+  return (last >= address
+          && cpu_predecode_region (last) == cpu_predecode_region (address)
+          && !CPU_IS_IO_PAGE (last >> 8));
+}
+
+/* Finds the record for an address. The record will be empty if the
+   address hasn't been decoded yet */
+static CpuPredecoded *
+cpu_predecode_lookup (Cpu *cpu, guint16 address)
+{
+  CpuPredecode *predecode = cpu->predecode;
+  int bank;
+
+  if (address < CPU_RAM_SIZE)
+    return predecode->ram + address;
+  else if (address < CPU_FIXED_ROM_ADDRESS)
+  {
+    if (cpu->rom_bank < 0 || cpu->rom_bank >= CPU_ROM_BANKS)
+      goto uncached;
+    bank = cpu->rom_bank;
+    address -= CPU_ROM_BANK_ADDRESS;
+  }
+  else
+  {
+    if (CPU_IS_IO_PAGE (address >> 8))
+      goto uncached;
+    bank = CPU_ROM_BANKS;
+    address -= CPU_FIXED_ROM_ADDRESS;
+  }
+
+  if (G_UNLIKELY (predecode->roms[bank] == NULL))
+    predecode->roms[bank] = g_new0 (CpuPredecoded, CPU_ROM_LENGTH);
+
+  return predecode->roms[bank] + address;
+
+ uncached:
+  predecode->scratch.handler = CPU_PREDECODE_UNDECODED;
+  return &predecode->scratch;
+}
+
+/* Returns TRUE if the instructions from address to address + span -
+   1 can be run together as a superinstruction. They can't if it
+   would run past an instruction that has a trap */
+static gboolean
+cpu_predecode_can_combine (Cpu *cpu, guint16 address, int span)
+{
+  int i;
+
+  if (!cpu_predecode_is_cacheable (address, span))
+    return FALSE;
+
+  for (i = 1; i < span; i++)
+    if (CPU_IS_TRAP (address + i))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Fills in the record for the instruction at the program counter.
+   Returns the record that should be run which will be the scratch
+   record if the instruction can't be cached. If check_traps is TRUE
+   then an address with a trap gets a record that runs the trap
+   instead */
+static CpuPredecoded *
+cpu_predecode_decode (Cpu *cpu, CpuPredecoded *d, gboolean check_traps)
+{
+  CpuPredecode *predecode = cpu->predecode;
+  guint16 address = cpu->pc;
+  guint8 op = cpu_predecode_read_code (cpu, address);
+  int length = cpu_predecode_lengths[op];
+  int span = length;
+  int page;
+
+  if (check_traps && CPU_IS_TRAP (address))
+  {
+    d->handler = CPU_PREDECODE_TRAP;
+    d->opcode = op;
+    d->length = 0;
+    d->operand = 0;
+    d->operand2 = 0;
+    span = 1;
+    goto done;
+  }
+
+  /* An instruction that spills over into memory that is cached in
+     another table would not be invalidated properly */
+  if (d != &predecode->scratch
+      && !cpu_predecode_is_cacheable (address, length))
+    d = &predecode->scratch;
+
+  d->handler = CPU_PREDECODE_OPCODE (op);
+  d->opcode = op;
+  d->length = length;
+  d->operand = 0;
+  d->operand2 = 0;
+  if (length > 1)
+    d->operand = cpu_predecode_read_code (cpu, address + 1);
+  if (length > 2)
+    d->operand |= cpu_predecode_read_code (cpu, address + 2) << 8;
+
+  if (d == &predecode->scratch)
+    return d;
+
+  /* Look for sequences that can be run as a superinstruction */
+  switch (op)
+  {
+    case 0xca: /* DEX; BNE */
+      if (cpu_predecode_can_combine (cpu, address, 3)
+          && cpu_predecode_read_code (cpu, address + 1) == 0xd0)
+      {
+        d->handler = CPU_PREDECODE_DEX_BNE;
+        d->operand = cpu_predecode_read_code (cpu, address + 2);
+        span = 3;
+      }
+      break;
+
+    case 0xb1: /* LDA (zp),Y; STA abs,X */
+      if (cpu_predecode_can_combine (cpu, address, 5)
+          && cpu_predecode_read_code (cpu, address + 2) == 0x9d)
+      {
+        d->handler = CPU_PREDECODE_LDA_STA;
+        d->operand2 = (cpu_predecode_read_code (cpu, address + 3)
+                       | (cpu_predecode_read_code (cpu, address + 4) << 8));
+        span = 5;
+      }
+      break;
+
+    case 0xc8: /* INY; CPY #; BNE */
+      if (cpu_predecode_can_combine (cpu, address, 5)
+          && cpu_predecode_read_code (cpu, address + 1) == 0xc0
+          && cpu_predecode_read_code (cpu, address + 3) == 0xd0)
+      {
+        d->handler = CPU_PREDECODE_INY_CPY_BNE;
+        d->operand = cpu_predecode_read_code (cpu, address + 2);
+        d->operand2 = cpu_predecode_read_code (cpu, address + 4);
+        span = 5;
+      }
+      break;
+  }
+
+ done:
+  if (d != &predecode->scratch && address < CPU_RAM_SIZE)
+    for (page = address >> 8; page <= (address + span - 1) >> 8; page++)
+      predecode->ram_pages[page] = TRUE;
+
+  return d;
+}
+
+CpuPredecode *
+cpu_predecode_new (void)
+{
+  return g_new0 (CpuPredecode, 1);
+}
+
+void
+cpu_predecode_free (CpuPredecode *predecode)
+{
+  int i;
+
+  for (i = 0; i <= CPU_ROM_BANKS; i++)
+    g_free (predecode->roms[i]);
+
+  g_free (predecode);
+}
+
+void
+cpu_predecode_invalidate_ram (CpuPredecode *predecode)
+{
+  predecode->ram_stale = TRUE;
+}
+
+void
+cpu_predecode_invalidate_all (CpuPredecode *predecode)
+{
+  int i;
+
+  cpu_predecode_flush_ram (predecode);
+
+  for (i = 0; i <= CPU_ROM_BANKS; i++)
+    if (predecode->roms[i])
+      memset (predecode->roms[i], 0, sizeof (CpuPredecoded) * CPU_ROM_LENGTH);
+}
+
+/* Runs the record in d. The program counter is moved past the first
+   instruction before running the handler in the same way as if the
+   operand had been fetched */
+#define CPU_PREDECODE_RUN() \
+  do { operand = d->operand; \
+       cpu->instruction = d->opcode; \
+       cpu->pc += d->length; \
+       goto *dispatch[d->handler]; } while (0)
+#define CPU_PREDECODE_DISPATCH() \
+  do { d = cpu_predecode_lookup (cpu, cpu->pc); \
+       CPU_PREDECODE_RUN (); } while (0)
+
+#define CPU_PREDECODE_NEXT() \
+  do { if (G_UNLIKELY (cpu->time >= cpu->check_time)) \
+         goto check; \
+       CPU_PREDECODE_DISPATCH (); } while (0)
+
+/* Moves on to the next instruction within a superinstruction. The
+   interrupts are checked at the same point as they would be if the
+   instructions were run separately */
+#define CPU_PREDECODE_NEXT_PART(op, length) \
+  do { if (G_UNLIKELY (cpu->time >= cpu->check_time)) \
+         goto check; \
+       cpu->instruction = (op); \
+       cpu->pc += (length); } while (0)
+
+#define CPU_PREDECODE_LABEL(code, kind, op, mode) \
+  [CPU_PREDECODE_OPCODE (code)] = &&op_##code,
+#define CPU_PREDECODE_CASE(code, kind, op, mode) \
+  op_##code: \
+    CPU_EXEC (kind, op, mode); \
+    CPU_PREDECODE_NEXT ();
+
+int
+cpu_predecode_fetch_execute (Cpu *cpu, cycles_t target_time)
+{
+  static const void * const dispatch[CPU_PREDECODE_N_HANDLERS] =
+    {
+      [CPU_PREDECODE_UNDECODED] = &&decode,
+      [CPU_PREDECODE_OPCODE (0) ... CPU_PREDECODE_OPCODE (255)]
+      = &&op_undefined,
+      CPU_OPCODE_LIST (CPU_PREDECODE_LABEL)
+      [CPU_PREDECODE_DEX_BNE] = &&dex_bne,
+      [CPU_PREDECODE_LDA_STA] = &&lda_sta,
+      [CPU_PREDECODE_INY_CPY_BNE] = &&iny_cpy_bne,
+      [CPU_PREDECODE_TRAP] = &&trap
+    };
+  CpuPredecoded *d;
+  guint16 operand;
+
+ check:
+  if (cpu->time >= target_time || cpu->got_break)
+    goto done;
+
+  if (G_UNLIKELY (cpu->predecode->ram_stale))
+    cpu_predecode_flush_ram (cpu->predecode);
+
+  /* Check for interrupts */
+  if (cpu->nmi)
+  {
+    CPU_INTERRUPT (CPU_NMI_VECTOR);
+    /* Clear the nmi flag */
+    cpu->nmi = FALSE;
+    goto check;
+  }
+  else if (cpu->irq && !CPU_IS_I ())
+  {
+    CPU_INTERRUPT (CPU_IRQ_VECTOR);
+    goto check;
+  }
+
+  /* Nothing else needs checking until the target time unless
+     something changes the interrupt state */
+  cpu->check_time = target_time;
+
+  CPU_PREDECODE_DISPATCH ();
+
+ decode:
+  /* The program counter was moved on by the length left over in the
+     empty record so it needs to be put back first */
+  cpu->pc -= d->length;
+  d = cpu_predecode_decode (cpu, d, TRUE);
+  CPU_PREDECODE_RUN ();
+
+ trap:
+  /* A trap that has run might have changed anything so everything is
+     checked again. Otherwise the instruction is decoded again without
+     the trap into the scratch record and run from there */
+  if (cpu_run_trap (cpu))
+    goto check;
+  d = cpu_predecode_decode (cpu, &cpu->predecode->scratch, FALSE);
+  CPU_PREDECODE_RUN ();
+
+  CPU_OPCODE_LIST (CPU_PREDECODE_CASE)
+
+ op_undefined:
+  cpu_undefined_instruction (cpu);
+  CPU_PREDECODE_NEXT ();
+
+ dex_bne:
+  CPU_OP_DEX ();
+  CPU_PREDECODE_NEXT_PART (0xd0, 2);
+  CPU_OP_BNE ();
+  CPU_PREDECODE_NEXT ();
+
+ lda_sta:
+  CPU_EXEC (READ, LDA, POST_INDEXED_Y);
+  CPU_PREDECODE_NEXT_PART (0x9d, 3);
+  operand = d->operand2;
+  CPU_EXEC (WRITE, STA, ABSOLUTE_INDEXED_X);
+  CPU_PREDECODE_NEXT ();
+
+ iny_cpy_bne:
+  CPU_OP_INY ();
+  CPU_PREDECODE_NEXT_PART (0xc0, 2);
+  CPU_EXEC (READ, CPY, IMMEDIATE);
+  CPU_PREDECODE_NEXT_PART (0xd0, 2);
+  operand = d->operand2;
+  CPU_OP_BNE ();
+  CPU_PREDECODE_NEXT ();
+
+ done:
+  /* Make sure the next call starts by checking the interrupts */
+  cpu->check_time = 0;
+
+  if (cpu->got_break)
+  {
+    cpu->got_break = 0;
+    return 1;
+  }
+  else
+    return 0;
+}
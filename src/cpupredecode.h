@@ -0,0 +1,46 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CPU_PREDECODE_H
+#define _CPU_PREDECODE_H
+
+/* Internal interface between cpu.c and the predecoding interpreter */
+
+#include <glib.h>
+
+#include "cpu.h"
+
+CpuPredecode *cpu_predecode_new (void);
+void cpu_predecode_free (CpuPredecode *predecode);
+
+int cpu_predecode_fetch_execute (Cpu *cpu, cycles_t target_time);
+
+/* Throws away the decoded instructions for the RAM. This should be
+   called whenever the RAM may have been modified without going
+   through the predecoding core. The work is deferred until the core
+   is next run */
+void cpu_predecode_invalidate_ram (CpuPredecode *predecode);
+/* Throws away any decoded instructions that include the address in
+   RAM. This is for when just a few bytes were written without going
+   through the predecoding core */
+void cpu_predecode_invalidate_address (CpuPredecode *predecode,
+                                       guint16 address);
+/* Throws away all of the decoded instructions */
+void cpu_predecode_invalidate_all (CpuPredecode *predecode);
+
+#endif /* _CPU_PREDECODE_H */
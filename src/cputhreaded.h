@@ -0,0 +1,120 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Template for the threaded interpreter. This has no include guard
+   because cpu.c includes it once for each variant of the core. Before
+   including it CPU_THREADED_FUNC must be defined to the name of the
+   function to generate and CPU_CHECK_BREAKPOINTS must be defined to
+   0 or 1. When it is 0 the generated core does no breakpoint
+   bookkeeping at all and never returns 1. CPU_PROFILE must also be
+   defined to 0 or 1 to select whether each instruction is added to
+   cpu->profile when it isn't NULL */
+
+static int
+CPU_THREADED_FUNC (Cpu *cpu, cycles_t target_time)
+{
+  static const void * const dispatch[256] =
+    {
+      [0 ... 255] = &&op_undefined,
+      CPU_OPCODE_LIST (CPU_THREADED_LABEL)
+    };
+  /* Where and when the current instruction started. These are only
+     used when profiling */
+  guint16 profile_pc = 0;
+  cycles_t profile_time = 0;
+
+ check:
+#if CPU_CHECK_BREAKPOINTS
+  if (cpu->time >= target_time || cpu->got_break)
+    goto done;
+#else
+  if (cpu->time >= target_time)
+    goto done;
+#endif
+
+  /* Check for interrupts */
+  if (cpu->nmi)
+  {
+    CPU_INTERRUPT (CPU_NMI_VECTOR);
+#if CPU_PROFILE
+    if (cpu->profile)
+      cpu_profile_call (cpu->profile, CPU_PROFILE_CALL_NMI,
+                        cpu->pc, cpu->s + 3);
+#endif
+    /* Clear the nmi flag */
+    cpu->nmi = FALSE;
+    goto check;
+  }
+  else if (cpu->irq && !CPU_IS_I ())
+  {
+    CPU_INTERRUPT (CPU_IRQ_VECTOR);
+#if CPU_PROFILE
+    if (cpu->profile)
+      cpu_profile_call (cpu->profile, CPU_PROFILE_CALL_IRQ,
+                        cpu->pc, cpu->s + 3);
+#endif
+    goto check;
+  }
+
+  /* Nothing else needs checking until the target time unless
+     something changes the interrupt state */
+  cpu->check_time = target_time;
+
+#if CPU_CHECK_BREAKPOINTS
+  /* Breaking on an address needs to be checked before every
+     instruction */
+  if ((cpu->break_types & CPU_BREAK_ADDR))
+  {
+    if (CPU_IS_BREAK (CPU_BREAK_ADDR, cpu->pc))
+    {
+      cpu->got_break = TRUE;
+      goto done;
+    }
+    cpu->check_time = 0;
+  }
+#endif
+
+  CPU_THREADED_DISPATCH ();
+
+ trap:
+  /* A trap that has run might have changed anything so everything is
+     checked again. Otherwise the instruction is run as normal */
+  if (cpu_run_trap (cpu))
+    goto check;
+  CPU_THREADED_DISPATCH_INSTRUCTION ();
+
+  CPU_OPCODE_LIST (CPU_THREADED_CASE)
+
+ op_undefined:
+  cpu_undefined_instruction (cpu);
+  CPU_THREADED_NEXT ();
+
+ done:
+  /* Make sure the next call starts by checking the interrupts */
+  cpu->check_time = 0;
+
+#if CPU_CHECK_BREAKPOINTS
+  if (cpu->got_break)
+  {
+    cpu->got_break = 0;
+    return 1;
+  }
+#endif
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "cputrace.h"
+
+#ifdef HAVE_SYS_MMAN_H
+
+struct _CpuTrace
+{
+  /* The whole file is mapped so that the records can be written by
+     just storing them in memory */
+  CpuTraceHeader *header;
+  CpuTraceRecord *records;
+  gsize file_size;
+
+  guint64 n_records;
+  /* The index of the next record to write */
+  guint64 pos;
+  /* The number of records written. This is copied into the header
+     whenever it changes */
+  guint64 count;
+};
+
+/* Creates the trace file with room for n_records and maps it. Returns
+   NULL and sets error if the file couldn't be created */
+CpuTrace *
+cpu_trace_new (const char *filename, guint64 n_records, GError **error)
+{
+  CpuTrace *trace;
+  gsize file_size;
+  void *map;
+  int fd;
+
+  g_return_val_if_fail (n_records > 0, NULL);
+
+  file_size = sizeof (CpuTraceHeader) + n_records * sizeof (CpuTraceRecord);
+
+  if ((fd = open (filename, O_RDWR | O_CREAT | O_TRUNC, 0666)) == -1)
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+    return NULL;
+  }
+
+  if (ftruncate (fd, file_size) == -1
+      || (map = mmap (NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0)) == MAP_FAILED)
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+    close (fd);
+    return NULL;
+  }
+
+  /* The mapping stays valid after the file is closed */
+  close (fd);
+
+  trace = g_new (CpuTrace, 1);
+  trace->header = map;
+  trace->records = (CpuTraceRecord *) (trace->header + 1);
+  trace->file_size = file_size;
+  trace->n_records = n_records;
+  trace->pos = 0;
+  trace->count = 0;
+
+  memcpy (trace->header->magic, CPU_TRACE_MAGIC,
+          sizeof (trace->header->magic));
+  trace->header->version = GUINT32_TO_LE (CPU_TRACE_VERSION);
+  trace->header->record_size = GUINT32_TO_LE (sizeof (CpuTraceRecord));
+  trace->header->n_records = GUINT64_TO_LE (n_records);
+  trace->header->count = 0;
+
+  return trace;
+}
+
+/* Writes a record of the instruction at the program counter. This
+   should be called before the instruction is run */
+void
+cpu_trace_add (CpuTrace *trace, Cpu *cpu)
+{
+  CpuTraceRecord *record = trace->records + trace->pos;
+  guint16 address = cpu->pc;
+  int i;
+
+  record->time_low = GUINT32_TO_LE ((guint32) cpu->time);
+  record->time_high = GUINT16_TO_LE ((guint16) (cpu->time >> 32));
+  record->pc = GUINT16_TO_LE (address);
+
+  /* Reading the bytes through the memory functions could have side
+     effects so code in unmapped pages is recorded as zeroes */
+  for (i = 0; i < 3; i++, address++)
+  {
+    const guint8 *page = cpu->read_pages[address >> 8];
+
+    if (address < CPU_RAM_SIZE)
+      record->bytes[i] = cpu->memory[address];
+    else
+      record->bytes[i] = page ? page[address & 0xff] : 0;
+  }
+
+  record->a = cpu->a;
+  record->x = cpu->x;
+  record->y = cpu->y;
+  record->p = cpu_get_p (cpu);
+  record->s = cpu->s;
+
+  if (++trace->pos >= trace->n_records)
+    trace->pos = 0;
+  trace->header->count = GUINT64_TO_LE (++trace->count);
+}
+
+void
+cpu_trace_free (CpuTrace *trace)
+{
+  munmap (trace->header, trace->file_size);
+  g_free (trace);
+}
+
+#else /* HAVE_SYS_MMAN_H */
+
+/* Tracing needs mmap so these are just stubs */
+
+CpuTrace *
+cpu_trace_new (const char *filename, guint64 n_records, GError **error)
+{
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+               "Tracing is not supported on this platform");
+  return NULL;
+}
+
+void
+cpu_trace_add (CpuTrace *trace, Cpu *cpu)
+{
+}
+
+void
+cpu_trace_free (CpuTrace *trace)
+{
+}
+
+#endif /* HAVE_SYS_MMAN_H */
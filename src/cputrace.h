@@ -0,0 +1,66 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CPU_TRACE_H
+#define _CPU_TRACE_H
+
+/* Interface between cpu.c and the instruction trace file. The file
+   starts with a CpuTraceHeader followed by a ring of CpuTraceRecords.
+   All of the numbers are stored little-endian */
+
+#include <glib.h>
+
+#include "cpu.h"
+
+#define CPU_TRACE_MAGIC   "EEKTRACE"
+#define CPU_TRACE_VERSION 1
+
+/* The number of records kept in the ring if no size is given */
+#define CPU_TRACE_DEFAULT_RECORDS (4 * 1024 * 1024)
+
+typedef struct
+{
+  char magic[8];
+  guint32 version;
+  guint32 record_size;
+  /* The number of records in the ring */
+  guint64 n_records;
+  /* The total number of records that have been written. Once this is
+     more than n_records the oldest record is the one at count %
+     n_records */
+  guint64 count;
+} CpuTraceHeader;
+
+/* The state of the cpu just before each instruction is run */
+typedef struct
+{
+  /* The cycle count split into 48 bits */
+  guint32 time_low;
+  guint16 time_high;
+  guint16 pc;
+  /* The opcode and the bytes after it */
+  guint8 bytes[3];
+  guint8 a, x, y, p, s;
+} CpuTraceRecord;
+
+CpuTrace *cpu_trace_new (const char *filename, guint64 n_records,
+                         GError **error);
+void cpu_trace_add (CpuTrace *trace, Cpu *cpu);
+void cpu_trace_free (CpuTrace *trace);
+
+#endif /* _CPU_TRACE_H */
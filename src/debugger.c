@@ -52,7 +52,7 @@ static const char debugger_flag_names[] = "CZIDB-VN";
 
 static const gint debugger_disassembler_columns[] =
   { DIS_MODEL_COL_ADDRESS, DIS_MODEL_COL_BYTES, DIS_MODEL_COL_MNEMONIC,
-    DIS_MODEL_COL_OPERANDS, -1 };
+    DIS_MODEL_COL_OPERANDS, DIS_MODEL_COL_PROFILE, -1 };
 
 GType
 debugger_get_type ()
@@ -365,7 +365,7 @@ debugger_update (Debugger *debugger)
 
     p = txt_buf;
     for (i = 7; i >= 0; i--)
-      *(p++) = (cpu->p & (1 << i)) ? debugger_flag_names[i] : '*';
+      *(p++) = (cpu_get_p (cpu) & (1 << i)) ? debugger_flag_names[i] : '*';
     *p = '\0';
     gtk_label_set_text (GTK_LABEL (debugger->register_widgets[DEBUGGER_REGISTER_P]), txt_buf);
   }
@@ -119,11 +119,113 @@ disassemble_indirect (guint16 address, const guint8 *bytes, char *operands)
   return 3;
 }
 
+/* The undocumented instructions that the cpu emulates. Most of
+   these are in the gaps that the decoding in disassemble_instruction
+   treats as invalid so they are looked up first */
+static const struct
+{
+  char mnemonic[4];
+  DisassembleModeFunc mode;
+} disassemble_undocumented[256] =
+  {
+    [0x03] = { "SLO", disassemble_ind_zero_page_x },
+    [0x04] = { "NOP", disassemble_zero_page },
+    [0x07] = { "SLO", disassemble_zero_page },
+    [0x0B] = { "ANC", disassemble_immediate },
+    [0x0C] = { "NOP", disassemble_absolute },
+    [0x0F] = { "SLO", disassemble_absolute },
+    [0x13] = { "SLO", disassemble_ind_zero_page_y },
+    [0x14] = { "NOP", disassemble_zero_page_x },
+    [0x17] = { "SLO", disassemble_zero_page_x },
+    [0x1A] = { "NOP", disassemble_implied },
+    [0x1B] = { "SLO", disassemble_absolute_y },
+    [0x1C] = { "NOP", disassemble_absolute_x },
+    [0x1F] = { "SLO", disassemble_absolute_x },
+    [0x23] = { "RLA", disassemble_ind_zero_page_x },
+    [0x27] = { "RLA", disassemble_zero_page },
+    [0x2B] = { "ANC", disassemble_immediate },
+    [0x2F] = { "RLA", disassemble_absolute },
+    [0x33] = { "RLA", disassemble_ind_zero_page_y },
+    [0x34] = { "NOP", disassemble_zero_page_x },
+    [0x37] = { "RLA", disassemble_zero_page_x },
+    [0x3A] = { "NOP", disassemble_implied },
+    [0x3B] = { "RLA", disassemble_absolute_y },
+    [0x3C] = { "NOP", disassemble_absolute_x },
+    [0x3F] = { "RLA", disassemble_absolute_x },
+    [0x43] = { "SRE", disassemble_ind_zero_page_x },
+    [0x44] = { "NOP", disassemble_zero_page },
+    [0x47] = { "SRE", disassemble_zero_page },
+    [0x4B] = { "ALR", disassemble_immediate },
+    [0x4F] = { "SRE", disassemble_absolute },
+    [0x53] = { "SRE", disassemble_ind_zero_page_y },
+    [0x54] = { "NOP", disassemble_zero_page_x },
+    [0x57] = { "SRE", disassemble_zero_page_x },
+    [0x5A] = { "NOP", disassemble_implied },
+    [0x5B] = { "SRE", disassemble_absolute_y },
+    [0x5C] = { "NOP", disassemble_absolute_x },
+    [0x5F] = { "SRE", disassemble_absolute_x },
+    [0x63] = { "RRA", disassemble_ind_zero_page_x },
+    [0x64] = { "NOP", disassemble_zero_page },
+    [0x67] = { "RRA", disassemble_zero_page },
+    [0x6B] = { "ARR", disassemble_immediate },
+    [0x6F] = { "RRA", disassemble_absolute },
+    [0x73] = { "RRA", disassemble_ind_zero_page_y },
+    [0x74] = { "NOP", disassemble_zero_page_x },
+    [0x77] = { "RRA", disassemble_zero_page_x },
+    [0x7A] = { "NOP", disassemble_implied },
+    [0x7B] = { "RRA", disassemble_absolute_y },
+    [0x7C] = { "NOP", disassemble_absolute_x },
+    [0x7F] = { "RRA", disassemble_absolute_x },
+    [0x80] = { "NOP", disassemble_immediate },
+    [0x82] = { "NOP", disassemble_immediate },
+    [0x83] = { "SAX", disassemble_ind_zero_page_x },
+    [0x87] = { "SAX", disassemble_zero_page },
+    [0x89] = { "NOP", disassemble_immediate },
+    [0x8F] = { "SAX", disassemble_absolute },
+    [0x97] = { "SAX", disassemble_zero_page_y },
+    [0xA3] = { "LAX", disassemble_ind_zero_page_x },
+    [0xA7] = { "LAX", disassemble_zero_page },
+    [0xAF] = { "LAX", disassemble_absolute },
+    [0xB3] = { "LAX", disassemble_ind_zero_page_y },
+    [0xB7] = { "LAX", disassemble_zero_page_y },
+    [0xBB] = { "LAS", disassemble_absolute_y },
+    [0xBF] = { "LAX", disassemble_absolute_y },
+    [0xC2] = { "NOP", disassemble_immediate },
+    [0xC3] = { "DCP", disassemble_ind_zero_page_x },
+    [0xC7] = { "DCP", disassemble_zero_page },
+    [0xCB] = { "SBX", disassemble_immediate },
+    [0xCF] = { "DCP", disassemble_absolute },
+    [0xD3] = { "DCP", disassemble_ind_zero_page_y },
+    [0xD4] = { "NOP", disassemble_zero_page_x },
+    [0xD7] = { "DCP", disassemble_zero_page_x },
+    [0xDA] = { "NOP", disassemble_implied },
+    [0xDB] = { "DCP", disassemble_absolute_y },
+    [0xDC] = { "NOP", disassemble_absolute_x },
+    [0xDF] = { "DCP", disassemble_absolute_x },
+    [0xE2] = { "NOP", disassemble_immediate },
+    [0xE3] = { "ISC", disassemble_ind_zero_page_x },
+    [0xE7] = { "ISC", disassemble_zero_page },
+    [0xEB] = { "SBC", disassemble_immediate },
+    [0xEF] = { "ISC", disassemble_absolute },
+    [0xF3] = { "ISC", disassemble_ind_zero_page_y },
+    [0xF4] = { "NOP", disassemble_zero_page_x },
+    [0xF7] = { "ISC", disassemble_zero_page_x },
+    [0xFA] = { "NOP", disassemble_implied },
+    [0xFB] = { "ISC", disassemble_absolute_y },
+    [0xFC] = { "NOP", disassemble_absolute_x },
+    [0xFF] = { "ISC", disassemble_absolute_x }
+  };
+
 int
 disassemble_instruction (guint16 address, const guint8 *bytes, char *mnemonic, char *operands)
 {
+  if (disassemble_undocumented[bytes[0]].mode)
+  {
+    memcpy (mnemonic, disassemble_undocumented[bytes[0]].mnemonic, 4);
+    return (* disassemble_undocumented[bytes[0]].mode) (address, bytes, operands);
+  }
   /* Opcodes with bottom two bits set to 01 */
-  if ((bytes[0] & 0x03) == 0x01)
+  else if ((bytes[0] & 0x03) == 0x01)
   {
     static const DisassembleModeFunc mode_table[8] =
       { disassemble_ind_zero_page_x, disassemble_zero_page, disassemble_immediate,
@@ -132,17 +234,10 @@ disassemble_instruction (guint16 address, const guint8 *bytes, char *mnemonic, c
     static const char mnemonic_table[8 * 4] =
       "ORA\0AND\0EOR\0ADC\0STA\0LDA\0CMP\0SBC";
 
-    /* STA immediate is invalid */
-    if (bytes[0] == 0x89)
-    {
-      memcpy (mnemonic, "???", 4);
-      return disassemble_implied (address, bytes, operands);
-    }
-    else
-    {
-      memcpy (mnemonic, mnemonic_table + (bytes[0] >> 5) * 4, 4);
-      return (* mode_table[(bytes[0] & 0x1c) >> 2]) (address, bytes, operands);
-    }
+    /* STA immediate (0x89) is an undocumented NOP so it has already
+       been handled */
+    memcpy (mnemonic, mnemonic_table + (bytes[0] >> 5) * 4, 4);
+    return (* mode_table[(bytes[0] & 0x1c) >> 2]) (address, bytes, operands);
   }
   /* Opcodes with bottom two bits set to 10 */
   else if ((bytes[0] & 0x03) == 0x02)
@@ -260,7 +355,8 @@ disassemble_instruction (guint16 address, const guint8 *bytes, char *mnemonic, c
       return (* mode_table[(bytes[0] & 0x1c) >> 2]) (address, bytes, operands);
     }
   }
-  /* No instructions have the bottom two bits set to 11 */
+  /* The only instructions with the bottom two bits set to 11 are
+     undocumented and any that aren't in the table above are invalid */
   else
   {
     memcpy (mnemonic, "???", 4);
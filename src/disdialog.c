@@ -225,6 +225,8 @@ dis_dialog_on_apply (DisDialog *disdialog)
     int lines = (int) gtk_adjustment_get_value (disdialog->lines_adj);
     int got_bytes = 0, num_bytes, i;
     GString *strbuf = g_string_new ("");
+    const CpuProfile *profile
+      = cpu_get_profile (&disdialog->electron->data->cpu);
     guint8 bytes[DISASSEMBLE_MAX_BYTES];
     char mnemonic[DISASSEMBLE_MAX_MNEMONIC + 1];
     char operands[DISASSEMBLE_MAX_OPERANDS + 1];
@@ -263,6 +265,18 @@ dis_dialog_on_apply (DisDialog *disdialog)
       /* Add the operands */
       g_string_append (strbuf, operands);
 
+      /* Add the number of times the instruction was run and the
+         number of cycles it took if the profiler is enabled */
+      if (profile)
+      {
+        for (i = strlen (operands); i < DISASSEMBLE_MAX_OPERANDS + 1; i++)
+          g_string_append_c (strbuf, ' ');
+        g_string_append_printf (strbuf, "%10" G_GUINT64_FORMAT
+                                " %12" G_GUINT64_FORMAT,
+                                profile->instructions[address],
+                                profile->cycles[address]);
+      }
+
       /* Terminate the line */
       g_string_append_c (strbuf, '\n');
 
@@ -221,9 +221,13 @@ dis_model_refresh_rows (DisModel *model)
       row.mnemonic[0] = '\0';
       row.operands[0] = '\0';
       row.current = FALSE;
+      row.profiled = FALSE;
     }
     else
     {
+      const CpuProfile *profile
+        = cpu_get_profile (&model->electron->data->cpu);
+
       while (got_bytes < DISASSEMBLE_MAX_BYTES)
       {
         row.bytes[got_bytes] = electron_read_from_location (model->electron->data,
@@ -233,13 +237,26 @@ dis_model_refresh_rows (DisModel *model)
       row.address = address;
       row.num_bytes = disassemble_instruction (address, row.bytes, row.mnemonic, row.operands);
       row.current = model->electron->data->cpu.pc == address ? TRUE : FALSE;
+
+      if (profile)
+      {
+        row.profiled = TRUE;
+        row.instructions = profile->instructions[address];
+        row.cycles = profile->cycles[address];
+      }
+      else
+        row.profiled = FALSE;
     }
 
     /* Only fire the changed signal if the row is actually different */
     if (row.address != model->rows[row_num].address
         || row.num_bytes != model->rows[row_num].num_bytes
         || memcmp (row.bytes, model->rows[row_num].bytes, row.num_bytes)
-        || row.current != model->rows[row_num].current)
+        || row.current != model->rows[row_num].current
+        || row.profiled != model->rows[row_num].profiled
+        || (row.profiled
+            && (row.instructions != model->rows[row_num].instructions
+                || row.cycles != model->rows[row_num].cycles)))
     {
       model->rows[row_num] = row;
       gtk_tree_path_get_indices (path)[0] = row_num;
@@ -334,6 +351,7 @@ dis_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter,
   DisModel *model;
   int row;
   char buf[DISASSEMBLE_MAX_BYTES * 3 + 1];
+  char *profile_buf;
 
   g_return_if_fail (IS_DIS_MODEL (tree_model));
 
@@ -386,6 +404,21 @@ dis_model_get_value (GtkTreeModel *tree_model, GtkTreeIter *iter,
         g_value_set_string (value, model->rows[row].operands);
         break;
 
+      case DIS_MODEL_COL_PROFILE:
+        /* Show the number of times the instruction was run and the
+           number of cycles it took in total */
+        if (model->rows[row].profiled)
+          profile_buf = g_strdup_printf ("%" G_GUINT64_FORMAT
+                                         " / %" G_GUINT64_FORMAT,
+                                         model->rows[row].instructions,
+                                         model->rows[row].cycles);
+        else
+          profile_buf = NULL;
+
+        g_value_init (value, G_TYPE_STRING);
+        g_value_take_string (value, profile_buf);
+        break;
+
       case DIS_MODEL_COL_BOLD_IF_CURRENT:
         g_value_init (value, G_TYPE_INT);
         g_value_set_int (value, model->rows[row].current
@@ -44,6 +44,7 @@ enum
     DIS_MODEL_COL_BYTES,
     DIS_MODEL_COL_MNEMONIC,
     DIS_MODEL_COL_OPERANDS,
+    DIS_MODEL_COL_PROFILE,
     DIS_MODEL_COL_BOLD_IF_CURRENT,
     DIS_MODEL_COL_COUNT
   };
@@ -55,7 +56,10 @@ struct _DisModelRowData
   guint8 bytes[DISASSEMBLE_MAX_BYTES];
   char mnemonic[DISASSEMBLE_MAX_MNEMONIC + 1];
   char operands[DISASSEMBLE_MAX_OPERANDS + 1];
+  /* The counts from the cpu profile */
+  guint64 instructions, cycles;
   gboolean current : 1;
+  gboolean profiled : 1;
 };
 
 struct _DisModel
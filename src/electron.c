@@ -46,6 +46,17 @@
    and 312 scanlines per frame so there are 15600 scanlines per
    second. Therefore there are 15600/120 = 130 scanlines per byte */
 #define ELECTRON_SCANLINES_PER_CASSETTE_BYTE 130
+#define ELECTRON_CYCLES_PER_CASSETTE_BYTE (ELECTRON_SCANLINES_PER_CASSETTE_BYTE \
+                                           * ELECTRON_CYCLES_PER_SCANLINE)
+
+/* The scanline counter runs from 0 up to and including
+   ELECTRON_SCANLINES_PER_FRAME */
+#define ELECTRON_CYCLES_PER_FRAME ((ELECTRON_SCANLINES_PER_FRAME + 1) \
+                                   * ELECTRON_CYCLES_PER_SCANLINE)
+
+/* The number of cycles to run after an event before looking for an
+   idle loop for the first time */
+#define ELECTRON_IDLE_PROBE_CYCLES 256
 
 #define ELECTRON_MODE_OF_BYTE(byte) (((byte) >> 3) & 7)
 #define ELECTRON_MODE(electron) ELECTRON_MODE_OF_BYTE((electron)->sheila[0x7])
@@ -60,6 +71,10 @@
 
 guint8 electron_read_from_location (Electron *electron, guint16 address);
 void electron_write_to_location (Electron *electron, guint16 address, guint8 val);
+static void electron_update_rom_bank (Electron *electron);
+static void electron_update_video (Electron *electron);
+static void electron_update_next_event (Electron *electron);
+static gboolean electron_run_trap (void *data, Cpu *cpu);
 
 typedef struct
 {
@@ -184,6 +199,8 @@ electron_new ()
 
   electron->queued_keys = g_array_new (FALSE, FALSE,
                                        sizeof (ElectronQueuedKey));
+  electron->traps = g_array_new (FALSE, FALSE, sizeof (ElectronTrap));
+  electron->skip_video = FALSE;
   /* Allocate tape buffer */
   electron->tape_buffer = tape_buffer_new ();
 
@@ -191,6 +208,13 @@ electron_new ()
   cpu_init (&electron->cpu, electron->memory,
             (CpuMemReadFunc) electron_read_from_location,
             (CpuMemWriteFunc) electron_write_to_location, electron);
+  /* The OS ROM can be read directly except for the SHEILA page */
+  cpu_map_pages (&electron->cpu,
+                 ELECTRON_OS_ROM_ADDRESS / CPU_PAGE_SIZE,
+                 ELECTRON_OS_ROM_LENGTH / CPU_PAGE_SIZE,
+                 electron->os_rom, NULL);
+  cpu_map_pages (&electron->cpu, ELECTRON_SHEILA_PAGE, 1, NULL, NULL);
+  cpu_set_trap_func (&electron->cpu, electron_run_trap, electron);
 
   electron_restart (electron);
 
@@ -209,9 +233,9 @@ electron_restart (Electron *electron)
   /* Set the power on transient bit */
   electron->sheila[0x0] |= ELECTRON_I_POWERON;
 
-  electron->scanline = 0;
   electron->ienabled = 0;
   electron->page = ELECTRON_BASIC_PAGE;
+  electron_update_rom_bank (electron);
   video_init (&electron->video, electron->memory);
   video_set_start_address (&electron->video, 0x0000);
   video_set_mode (&electron->video, ELECTRON_MODE (electron));
@@ -223,10 +247,24 @@ electron_restart (Electron *electron)
   electron->queued_keys_pos = 0;
   g_array_set_size (electron->queued_keys, 0);
 
-  electron->cassette_scanline_counter = 0;
   electron->data_shift_has_data = FALSE;
+  electron->io_changes = 0;
 
   cpu_restart (&electron->cpu);
+
+  /* The clock starts again from zero at the start of a frame */
+  electron->scanline = 0;
+  electron->frame_start = 0;
+  electron->video_scanline = 0;
+  electron->event_times[ELECTRON_EVENT_RTC]
+    = ELECTRON_TIMER_SCANLINE * ELECTRON_CYCLES_PER_SCANLINE;
+  electron->event_times[ELECTRON_EVENT_DISPLAY_END]
+    = ELECTRON_END_SCANLINE * ELECTRON_CYCLES_PER_SCANLINE;
+  electron->event_times[ELECTRON_EVENT_FRAME_START]
+    = ELECTRON_CYCLES_PER_FRAME;
+  electron->event_times[ELECTRON_EVENT_CASSETTE]
+    = ELECTRON_CYCLES_PER_CASSETTE_BYTE;
+  electron_update_next_event (electron);
 }
 
 void
@@ -271,6 +309,9 @@ electron_free (Electron *electron)
   int i;
 
   g_array_free (electron->queued_keys, TRUE);
+  g_array_free (electron->traps, TRUE);
+
+  cpu_destroy (&electron->cpu);
 
   /* Free all of the paged rom data */
   for (i = 0; i < ELECTRON_PAGED_ROM_COUNT; i++)
@@ -303,116 +344,249 @@ electron_clear_interrupts (Electron *electron, int mask)
     cpu_reset_irq (&electron->cpu);
 }
 
-void
-electron_next_scanline (Electron *electron)
+/* Finds the earliest event so that the cpu knows how long it can run
+   for */
+static void
+electron_update_next_event (Electron *electron)
 {
-  electron->cpu.time -= ELECTRON_CYCLES_PER_SCANLINE;
+  int i;
 
-  if (++electron->scanline > ELECTRON_SCANLINES_PER_FRAME)
-  {
-    electron->scanline = 0;
-    electron->queued_key_time++;
-  }
+  electron->next_event_time = electron->event_times[0];
+  for (i = 1; i < ELECTRON_EVENT_COUNT; i++)
+    if (electron->event_times[i] < electron->next_event_time)
+      electron->next_event_time = electron->event_times[i];
+}
+
+/* Returns the scanline that the cpu clock is currently in */
+static int
+electron_get_current_scanline (Electron *electron)
+{
+  return ((electron->cpu.time - electron->frame_start)
+          / ELECTRON_CYCLES_PER_SCANLINE);
+}
+
+/* Draws all of the visible scanlines that the raster has passed
+   since the video was last updated */
+static void
+electron_update_video (Electron *electron)
+{
+  int scanline = electron_get_current_scanline (electron);
+
+  if (scanline >= ELECTRON_END_SCANLINE)
+    scanline = ELECTRON_END_SCANLINE - 1;
 
-  if (electron->scanline < ELECTRON_END_SCANLINE)
+  if (electron->skip_video)
   {
-    if (electron->scanline == 0)
-      /* The video start address is only recognised at the start of
-         each frame */
-      video_set_start_address (&electron->video, ((electron->sheila[0x3] & 0x3f) << 9)
-                               | ((electron->sheila[0x2] & 0xe0) << 1));
-
-    video_draw_scanline (&electron->video, electron->scanline);
-
-    /* If we're on the scanline where the timer interrupt occurs then
-       generate that interrupt */
-    if (electron->scanline == ELECTRON_TIMER_SCANLINE)
-      electron_generate_interrupt (electron, ELECTRON_I_RTC);
+    /* Pretend the scanlines were drawn so that they aren't drawn
+       late if drawing starts again in the middle of the frame */
+    if (electron->video_scanline <= scanline)
+      electron->video_scanline = scanline + 1;
   }
-  else if (electron->scanline == ELECTRON_END_SCANLINE)
-    electron_generate_interrupt (electron, ELECTRON_I_DISPLAY_END);
+  else
+    while (electron->video_scanline <= scanline)
+      video_draw_scanline (&electron->video, electron->video_scanline++);
+}
 
-  /* Is it time for the next byte from the cassette? */
-  if (++electron->cassette_scanline_counter >= ELECTRON_SCANLINES_PER_CASSETTE_BYTE)
+static void
+electron_cassette_event (Electron *electron)
+{
+  /* Is the cassette motor on? */
+  if ((electron->sheila[0x7] & 0x40))
   {
-    electron->cassette_scanline_counter = 0;
-
-    /* Is the cassette motor on? */
-    if ((electron->sheila[0x7] & 0x40))
+    /* Are we in write mode? */
+    if ((electron->sheila[0x7] & 0x06) == 0x04)
     {
-      /* Are we in write mode? */
-      if ((electron->sheila[0x7] & 0x06) == 0x04)
+      /* Add a high tone if the cassette buffer has no data */
+      if (electron->data_shift_has_data)
       {
-        /* Add a high tone if the cassette buffer has no data */
-        if (electron->data_shift_has_data)
-        {
-          tape_buffer_store_byte (electron->tape_buffer, electron->sheila[0x4]);
-          electron->data_shift_has_data = FALSE;
-          electron_generate_interrupt (electron, ELECTRON_I_TRANSMIT);
-        }
-        else
-          tape_buffer_store_high_tone (electron->tape_buffer);
+        tape_buffer_store_byte (electron->tape_buffer, electron->sheila[0x4]);
+        electron->data_shift_has_data = FALSE;
+        electron_generate_interrupt (electron, ELECTRON_I_TRANSMIT);
       }
       else
-      {
-        int next_byte;
+        tape_buffer_store_high_tone (electron->tape_buffer);
+    }
+    else
+    {
+      int next_byte;
 
-        /* If we've gone past the end of the tape then add silence */
-        if (tape_buffer_is_at_end (electron->tape_buffer))
-        {
-          tape_buffer_store_silence (electron->tape_buffer);
-          next_byte = TAPE_BUFFER_SILENCE;
-        }
-        else
-          next_byte = tape_buffer_get_next_byte (electron->tape_buffer);
+      /* If we've gone past the end of the tape then add silence */
+      if (tape_buffer_is_at_end (electron->tape_buffer))
+      {
+        tape_buffer_store_silence (electron->tape_buffer);
+        next_byte = TAPE_BUFFER_SILENCE;
+      }
+      else
+        next_byte = tape_buffer_get_next_byte (electron->tape_buffer);
 
-        /* If it was a high tone then generate the interrupt */
-        if (next_byte == TAPE_BUFFER_HIGH_TONE)
-          electron_generate_interrupt (electron, ELECTRON_I_HIGH_TONE);
-        else
+      /* If it was a high tone then generate the interrupt */
+      if (next_byte == TAPE_BUFFER_HIGH_TONE)
+        electron_generate_interrupt (electron, ELECTRON_I_HIGH_TONE);
+      else
+      {
+        electron_clear_interrupts (electron, ELECTRON_I_HIGH_TONE);
+        /* Put the byte in the buffer if we are in read mode unless
+           the tape is silent */
+        if (next_byte >= 0 && (electron->sheila[0x7] & 0x06) == 0x00)
         {
-          electron_clear_interrupts (electron, ELECTRON_I_HIGH_TONE);
-          /* Put the byte in the buffer if we are in read mode unless
-             the tape is silent */
-          if (next_byte >= 0 && (electron->sheila[0x7] & 0x06) == 0x00)
-          {
-            electron->sheila[0x4] = next_byte;
-            electron_generate_interrupt (electron, ELECTRON_I_RECEIVE);
-          }
+          electron->sheila[0x4] = next_byte;
+          electron_generate_interrupt (electron, ELECTRON_I_RECEIVE);
         }
       }
     }
   }
 }
 
+/* Handles all of the events that are due by the current cpu
+   time. Returns TRUE if the end of the display was reached */
+static gboolean
+electron_run_events (Electron *electron)
+{
+  gboolean display_ended = FALSE;
+
+  while (electron->cpu.time >= electron->next_event_time)
+  {
+    ElectronEvent event;
+
+    /* Find the first event that is due. The order of the enum breaks
+       ties */
+    for (event = 0; event < ELECTRON_EVENT_COUNT; event++)
+      if (electron->event_times[event] == electron->next_event_time)
+        break;
+
+    switch (event)
+    {
+      case ELECTRON_EVENT_RTC:
+        electron_generate_interrupt (electron, ELECTRON_I_RTC);
+        electron->event_times[event] += ELECTRON_CYCLES_PER_FRAME;
+        break;
+
+      case ELECTRON_EVENT_DISPLAY_END:
+        /* Finish drawing the frame */
+        electron_update_video (electron);
+        electron_generate_interrupt (electron, ELECTRON_I_DISPLAY_END);
+        electron->event_times[event] += ELECTRON_CYCLES_PER_FRAME;
+        display_ended = TRUE;
+        break;
+
+      case ELECTRON_EVENT_FRAME_START:
+        electron->frame_start = electron->event_times[event];
+        electron->event_times[event] += ELECTRON_CYCLES_PER_FRAME;
+        electron->video_scanline = 0;
+        electron->queued_key_time++;
+        /* The video start address is only recognised at the start of
+           each frame */
+        video_set_start_address (&electron->video,
+                                 ((electron->sheila[0x3] & 0x3f) << 9)
+                                 | ((electron->sheila[0x2] & 0xe0) << 1));
+        break;
+
+      case ELECTRON_EVENT_CASSETTE:
+        electron_cassette_event (electron);
+        electron->event_times[event] += ELECTRON_CYCLES_PER_CASSETTE_BYTE;
+        break;
+
+      case ELECTRON_EVENT_COUNT:
+        g_assert_not_reached ();
+    }
+
+    electron_update_next_event (electron);
+  }
+
+  electron->scanline = electron_get_current_scanline (electron);
+
+  return display_ended;
+}
+
 void
 electron_step (Electron *electron)
 {
-  /* Temporarily disable the breakpoint */
-  int old_break_type = electron->cpu.break_type;
-  electron->cpu.break_type = CPU_BREAK_NONE;
+  /* Temporarily disable the breakpoints but keep the traps */
+  guint8 old_break_types = electron->cpu.break_types;
+  electron->cpu.break_types &= CPU_BREAK_TRAP;
   /* Execute one instruction */
   cpu_fetch_execute (&electron->cpu, electron->cpu.time + 1);
-  /* Restore the breakpoint */
-  electron->cpu.break_type = old_break_type;
-  /* If we've done a whole scanline's worth of cycles then draw the next scanline */
-  if (electron->cpu.time >= ELECTRON_CYCLES_PER_SCANLINE)
-    electron_next_scanline (electron);
+  /* Restore the breakpoints */
+  electron->cpu.break_types = old_break_types;
+  /* Handle any events that the instruction reached */
+  electron_run_events (electron);
 }
 
+/* Runs the cpu until target_time or the next event, whichever comes
+   first, and then handles any events that are due. Unlike
+   electron_run_frame this never skips idle loops so every instruction
+   is really run. Returns 1 if a breakpoint was hit */
 int
-electron_run_frame (Electron *electron)
+electron_run_until (Electron *electron, cycles_t target_time)
 {
   int got_break;
 
+  if (target_time > electron->next_event_time)
+    target_time = electron->next_event_time;
+
+  got_break = cpu_fetch_execute (&electron->cpu, target_time);
+  electron_run_events (electron);
+
+  return got_break;
+}
+
+/* Checks whether the cpu is waiting in a loop for an interrupt, for
+   example polling the keyboard buffer. If it is then the clock is
+   moved forward by as many whole iterations of the loop as fit before
+   the next event. The state at the end is exactly what running the
+   loop would have left so the timing isn't affected. Returns TRUE if
+   a loop was found */
+static gboolean
+electron_skip_idle_loop (Electron *electron)
+{
+  guint io_changes = electron->io_changes;
+  cycles_t loop_time, iterations;
+
+  loop_time = cpu_find_idle_loop (&electron->cpu, electron->next_event_time);
+
+  /* If reading something in the loop changed the state then the next
+     iteration might not do the same thing. The last instruction
+     might also have already gone past the event */
+  if (loop_time == 0 || io_changes != electron->io_changes
+      || electron->cpu.time >= electron->next_event_time)
+    return FALSE;
+
+  iterations = (electron->next_event_time - electron->cpu.time) / loop_time;
+  electron->cpu.time += iterations * loop_time;
+
+  return TRUE;
+}
+
+int
+electron_run_frame (Electron *electron)
+{
+  int got_break = 0;
+  gboolean display_ended;
+
   do
   {
-    /* Execute instructions until the next scanline */
-    got_break = cpu_fetch_execute (&electron->cpu, ELECTRON_CYCLES_PER_SCANLINE);
-    /* Process the next scanline */
-    if (electron->cpu.time >= ELECTRON_CYCLES_PER_SCANLINE)
-      electron_next_scanline (electron);
-  } while (!got_break && electron->scanline != ELECTRON_END_SCANLINE);
+    cycles_t probe_cycles = ELECTRON_IDLE_PROBE_CYCLES;
+
+    /* Execute instructions until the next event. Every so often
+       check whether the cpu has gone into an idle loop. The gap
+       between the checks doubles each time so that they cost very
+       little when the cpu is busy */
+    while (!got_break && electron->cpu.time < electron->next_event_time)
+    {
+      cycles_t target_time = electron->next_event_time;
+
+      if (!electron_skip_idle_loop (electron)
+          && electron->cpu.time + probe_cycles < target_time)
+      {
+        target_time = electron->cpu.time + probe_cycles;
+        probe_cycles *= 2;
+      }
+
+      got_break = cpu_fetch_execute (&electron->cpu, target_time);
+    }
+
+    display_ended = electron_run_events (electron);
+  } while (!got_break && !display_ended);
 
   return got_break;
 }
@@ -421,11 +595,14 @@ void
 electron_clear_os_rom (Electron *electron)
 {
   memset (electron->os_rom, 0, ELECTRON_OS_ROM_LENGTH);
+  cpu_invalidate_code (&electron->cpu);
 }
 
 int
 electron_load_os_rom (Electron *electron, FILE *in)
 {
+  cpu_invalidate_code (&electron->cpu);
+
   if (fread (electron->os_rom, sizeof (guint8), ELECTRON_OS_ROM_LENGTH, in)
       < ELECTRON_OS_ROM_LENGTH)
     return -1;
@@ -440,6 +617,8 @@ electron_clear_paged_rom (Electron *electron, int page)
   {
     g_free (electron->paged_roms[page]);
     electron->paged_roms[page] = NULL;
+    electron_update_rom_bank (electron);
+    cpu_invalidate_code (&electron->cpu);
   }
 }
 
@@ -449,6 +628,8 @@ electron_load_paged_rom (Electron *electron, int page, FILE *in)
   guint8 *buf;
   page &= 0x0f;
 
+  cpu_invalidate_code (&electron->cpu);
+
   if (electron->paged_roms[page])
     buf = electron->paged_roms[page];
   else
@@ -460,9 +641,12 @@ electron_load_paged_rom (Electron *electron, int page, FILE *in)
   {
     g_free (buf);
     electron->paged_roms[page] = NULL;
+    electron_update_rom_bank (electron);
     return -1;
   }
 
+  electron_update_rom_bank (electron);
+
   return 0;
 }
 
@@ -507,6 +691,31 @@ electron_update_palette (Electron *electron)
   }
 }
 
+/* Tells the cpu which ROM is paged in so that it can read it directly
+   and cache code for it. The keyboard can't be cached because reading
+   it doesn't always return the same value */
+static void
+electron_update_rom_bank (Electron *electron)
+{
+  guint8 page = electron->page;
+
+  /* Basic and keyboard are available in two locations */
+  if ((page & 0x0C) == 0x08)
+    page &= 0x0E;
+
+  /* The keyboard and empty slots are read through
+     electron_read_from_location */
+  cpu_map_pages (&electron->cpu,
+                 ELECTRON_PAGED_ROM_ADDRESS / CPU_PAGE_SIZE,
+                 ELECTRON_PAGED_ROM_LENGTH / CPU_PAGE_SIZE,
+                 page == ELECTRON_KEYBOARD_PAGE
+                 ? NULL : electron->paged_roms[page],
+                 NULL);
+
+  cpu_set_rom_bank (&electron->cpu,
+                    page == ELECTRON_KEYBOARD_PAGE ? -1 : page);
+}
+
 static guint8
 read_queued_key (Electron *electron, guint16 location)
 {
@@ -537,12 +746,16 @@ is_key_queued (Electron *electron)
   /* If the escape key is pressed then abandon the queued keys */
   if ((electron->keyboard[13] & 1))
   {
+    if (electron->queued_keys->len > 0 || electron->queued_keys_pos > 0)
+      electron->io_changes++;
     g_array_set_size (electron->queued_keys, 0);
     electron->queued_keys_pos = 0;
     return FALSE;
   }
 
   /* Skip any keys that weren’t noticed in time */
+  if (electron->queued_key_time >= ELECTRON_QUEUED_KEYS_TOTAL_TIME)
+    electron->io_changes++;
   electron->queued_keys_pos += (electron->queued_key_time /
                                 ELECTRON_QUEUED_KEYS_TOTAL_TIME);
   electron->queued_key_time %= ELECTRON_QUEUED_KEYS_TOTAL_TIME;
@@ -597,7 +810,11 @@ electron_read_from_location (Electron *electron, guint16 location)
           if ((electron->ienabled & electron->sheila[0x0] & ~(ELECTRON_I_MASTER | ELECTRON_I_POWERON | 0x80)))
             r |= ELECTRON_I_MASTER;
           /* the power on bit is only set the first time it is read */
-          electron->sheila[0x0] &= ~ELECTRON_I_POWERON;
+          if ((electron->sheila[0x0] & ELECTRON_I_POWERON))
+          {
+            electron->sheila[0x0] &= ~ELECTRON_I_POWERON;
+            electron->io_changes++;
+          }
           return r;
         }
       case 0x1: case 0x2: case 0x3: case 0x5: case 0x6: case 0x7:
@@ -607,7 +824,11 @@ electron_read_from_location (Electron *electron, guint16 location)
         return electron->os_rom[location - ELECTRON_OS_ROM_ADDRESS];
       case 0x4:
         /* Reading from the tape buffer clears the read interrupt */
-        electron_clear_interrupts (electron, ELECTRON_I_RECEIVE);
+        if ((electron->sheila[0x0] & ELECTRON_I_RECEIVE))
+        {
+          electron_clear_interrupts (electron, ELECTRON_I_RECEIVE);
+          electron->io_changes++;
+        }
         /* flow through */
       default:
         return electron->sheila[location & 0x0f];
@@ -649,7 +870,10 @@ electron_write_to_location (Electron *electron, guint16 location, guint8 v)
              currently selected then only pages 8-15 are actually
              honoured */
           if (electron->page < 8 || electron->page > 11 || (v & 0x0f) >= 8)
+          {
             electron->page = v & 0x0f;
+            electron_update_rom_bank (electron);
+          }
           /* Clear interrupts */
           if (v & ELECTRON_C_HIGH_TONE)
             clear_mask |= ELECTRON_I_HIGH_TONE;
@@ -670,6 +894,9 @@ electron_write_to_location (Electron *electron, guint16 location, guint8 v)
              the mode */
           if (ELECTRON_MODE_OF_BYTE (old_value) != ELECTRON_MODE_OF_BYTE (v))
           {
+            /* The scanlines that have already passed were drawn in
+               the old mode */
+            electron_update_video (electron);
             video_set_mode (&electron->video, ELECTRON_MODE (electron));
             electron_update_palette (electron);
           }
@@ -684,9 +911,14 @@ electron_write_to_location (Electron *electron, guint16 location, guint8 v)
         }
         break;
       default:
-        electron->sheila[location & 0x0f] = v;
         if ((location & 0x0f) >= 0x08)
+        {
+          electron_update_video (electron);
+          electron->sheila[location & 0x0f] = v;
           electron_update_palette (electron);
+        }
+        else
+          electron->sheila[location & 0x0f] = v;
         break;
     }
   /* Otherwise if it's in memory use that */
@@ -700,6 +932,72 @@ electron_rewind_cassette (Electron *electron)
   tape_buffer_rewind (electron->tape_buffer);
 }
 
+/* Makes func get called in place of the 6502 code at address. If
+   the address is in the paged ROM area then the trap only runs while
+   the given ROM is paged in, unless the page is
+   ELECTRON_TRAP_ANY_PAGE */
+void
+electron_add_trap (Electron *electron, guint16 address, int page,
+                   ElectronTrapFunc func, gpointer data)
+{
+  ElectronTrap trap;
+
+  trap.address = address;
+  trap.page = page;
+  trap.func = func;
+  trap.data = data;
+
+  g_array_append_val (electron->traps, trap);
+  cpu_add_trap (&electron->cpu, address);
+}
+
+void
+electron_remove_trap (Electron *electron, guint16 address, int page,
+                      ElectronTrapFunc func, gpointer data)
+{
+  guint i;
+
+  for (i = 0; i < electron->traps->len; i++)
+  {
+    const ElectronTrap *trap = &g_array_index (electron->traps,
+                                               ElectronTrap, i);
+
+    if (trap->address == address && trap->page == page
+        && trap->func == func && trap->data == data)
+    {
+      g_array_remove_index (electron->traps, i);
+      cpu_remove_trap (&electron->cpu, address);
+      break;
+    }
+  }
+}
+
+/* Called by the cpu whenever it reaches an address that has a trap
+   in any page */
+static gboolean
+electron_run_trap (void *data, Cpu *cpu)
+{
+  Electron *electron = data;
+  guint i;
+
+  for (i = 0; i < electron->traps->len; i++)
+  {
+    const ElectronTrap *trap = &g_array_index (electron->traps,
+                                               ElectronTrap, i);
+
+    if (trap->address == cpu->pc
+        && (trap->page == ELECTRON_TRAP_ANY_PAGE
+            || trap->address < ELECTRON_PAGED_ROM_ADDRESS
+            || trap->address >= (ELECTRON_PAGED_ROM_ADDRESS
+                                 + ELECTRON_PAGED_ROM_LENGTH)
+            || trap->page == cpu->rom_bank)
+        && trap->func (electron, trap->data))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 void
 electron_set_tape_buffer (Electron *electron,
                           TapeBuffer *tbuf)
@@ -48,6 +48,41 @@
 
 typedef struct _Electron Electron;
 
+/* Function that is run in place of the 6502 code at a trapped
+   address. It can read and change the registers in electron->cpu. It
+   should return TRUE if it has done the work of the code and moved
+   the program counter on, for example with cpu_rts, or FALSE to run
+   the 6502 code normally */
+typedef gboolean (* ElectronTrapFunc) (Electron *electron, gpointer data);
+
+/* Page number for a trap in the paged ROM area that applies whichever
+   ROM is paged in */
+#define ELECTRON_TRAP_ANY_PAGE -1
+
+typedef struct
+{
+  guint16 address;
+  /* The paged ROM that has to be selected for the trap to run if the
+     address is in the paged ROM area */
+  int page;
+  ElectronTrapFunc func;
+  gpointer data;
+} ElectronTrap;
+
+/* Everything that happens at a fixed time while the cpu is
+   running. The cpu runs uninterrupted until the earliest one is
+   due. When two events are due at the same time they are handled in
+   this order */
+typedef enum
+{
+  ELECTRON_EVENT_RTC,
+  ELECTRON_EVENT_DISPLAY_END,
+  /* Latches the video start address and times the queued keys */
+  ELECTRON_EVENT_FRAME_START,
+  ELECTRON_EVENT_CASSETTE,
+  ELECTRON_EVENT_COUNT
+} ElectronEvent;
+
 #define ELECTRON_MODIFIERS_LINE 13
 #define ELECTRON_FUNC_BIT       1
 #define ELECTRON_CONTROL_BIT    2
@@ -69,13 +104,28 @@ struct _Electron
   /* The enabled interrupts */
   guint8 ienabled;
 
-  /* The current scanline */
+  /* The scanline that the cpu clock was in when the events were last
+     processed */
   guint16 scanline;
+  /* The cpu time at which the current frame started */
+  cycles_t frame_start;
+  /* The cpu time at which each event is next due */
+  cycles_t event_times[ELECTRON_EVENT_COUNT];
+  /* The earliest time in event_times */
+  cycles_t next_event_time;
+  /* The first scanline of the current frame that hasn't been drawn
+     yet. The video is only brought up to date when something that
+     affects it changes and at the end of the display */
+  guint16 video_scanline;
 
   /* The state of the sheila registers */
   guint8 sheila[16];
   /* Whether anything has been written to the cassette data shift register */
   guint8 data_shift_has_data : 1;
+  /* Incremented whenever reading from an I/O location changes the
+     state of the machine, such as reading the power on bit. A loop
+     is only idle if none of its reads did this */
+  guint io_changes;
 
   /* The state of the keyboard */
   guint8 keyboard[14];
@@ -86,15 +136,19 @@ struct _Electron
   /* The state of the display */
   Video video;
 
-  /* Counter to count scanlines so we know when to read the next byte
-     from the cassette */
-  guint8 cassette_scanline_counter;
   /* Buffer for the tape data */
   TapeBuffer *tape_buffer;
 
   GArray *queued_keys;
   size_t queued_keys_pos;
   unsigned queued_key_time;
+
+  /* Array of ElectronTraps */
+  GArray *traps;
+
+  /* Whether drawing the display is skipped, for example while a tape
+     is loading at full speed */
+  gboolean skip_video;
 };
 
 typedef struct
@@ -118,6 +172,7 @@ void electron_write_to_location (Electron *electron, guint16 location, guint8 v)
 guint8 electron_read_from_location (Electron *electron, guint16 location);
 int electron_run_frame (Electron *electron);
 void electron_step (Electron *electron);
+int electron_run_until (Electron *electron, cycles_t target_time);
 void electron_rewind_cassette (Electron *electron);
 void electron_set_tape_buffer (Electron *electron,
                                TapeBuffer *tbuf);
@@ -126,6 +181,14 @@ void electron_add_queued_keys (Electron *electron,
                                const ElectronQueuedKey *keys);
 void electron_type_string (Electron *electron,
                            const char *str);
+void electron_add_trap (Electron *electron, guint16 address, int page,
+                        ElectronTrapFunc func, gpointer data);
+void electron_remove_trap (Electron *electron, guint16 address, int page,
+                           ElectronTrapFunc func, gpointer data);
+
+/* Whether the cassette motor is on and the tape is being read */
+#define electron_is_reading_tape(electron) \
+  (((electron)->sheila[0x7] & 0x46) == 0x40)
 
 #define electron_press_key(electron, line, bit) \
 do { (electron)->keyboard[(line)] |= 1 << (bit); } while (0)
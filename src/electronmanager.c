@@ -29,6 +29,8 @@
 
 #include "electronmanager.h"
 #include "electron.h"
+#include "fastload.h"
+#include "hostfs.h"
 #include "framesource.h"
 #include "intl.h"
 
@@ -63,12 +65,41 @@ struct _ElectronManagerPrivate
   gboolean added_dir;
   GConfClient *gconf;
   gboolean full_speed;
+  /* Whether the emulation is running at full speed without drawing
+     because the tape is loading */
+  gboolean tape_speed;
   int value_changed_handler;
   GTimer *full_speed_timer;
+  /* The trap to load files from the cassette instantly or NULL if
+     it isn't installed */
+  FastLoad *fast_load;
+  /* The filing system serving files from a host directory or NULL if
+     it isn't installed */
+  HostFs *host_fs;
 };
 
 #define ELECTRON_MANAGER_ROMS_CONF_DIR "/apps/eek/roms"
 
+/* Environment variable that can be used to choose the cpu core */
+#define ELECTRON_MANAGER_CPU_CORE_ENV "EEK_CPU_CORE"
+/* Environment variable that can be set to 1 to load files from the
+   cassette instantly when possible */
+#define ELECTRON_MANAGER_FAST_LOAD_ENV "EEK_FAST_LOAD"
+/* Environment variable that can be set to a directory on the host
+   to load and save files there instead of on the cassette */
+#define ELECTRON_MANAGER_HOST_FS_ENV "EEK_HOST_FS"
+
+static const struct { const char *name; CpuCore core; }
+electron_manager_cpu_cores[] =
+  {
+    { "jumpblock", CPU_CORE_JUMPBLOCK },
+    { "threaded", CPU_CORE_THREADED },
+    { "predecode", CPU_CORE_PREDECODE },
+    { "jit", CPU_CORE_JIT }
+  };
+#define ELECTRON_MANAGER_CPU_CORE_COUNT (sizeof (electron_manager_cpu_cores) \
+                                         / sizeof (electron_manager_cpu_cores[0]))
+
 static const struct { const char *key; int page; }
 electron_manager_rom_table[] =
   {
@@ -127,16 +158,58 @@ electron_manager_class_init (ElectronManagerClass *klass)
   g_type_class_add_private (object_class, sizeof (ElectronManagerPrivate));
 }
 
+static void
+electron_manager_select_cpu_core (ElectronManager *eman)
+{
+  const char *name = g_getenv (ELECTRON_MANAGER_CPU_CORE_ENV);
+  int i;
+
+  if (name == NULL)
+    return;
+
+  for (i = 0; i < ELECTRON_MANAGER_CPU_CORE_COUNT; i++)
+    if (!strcmp (name, electron_manager_cpu_cores[i].name))
+    {
+      if (!cpu_set_core (&eman->data->cpu, electron_manager_cpu_cores[i].core))
+        g_warning ("The %s cpu core is not available", name);
+      return;
+    }
+
+  g_warning ("Unknown cpu core \"%s\"", name);
+}
+
 static void
 electron_manager_init (ElectronManager *eman)
 {
   ElectronManagerPrivate *priv = ELECTRON_MANAGER_GET_PRIVATE (eman);
   GError *error = NULL;
+  const char *value;
 
   eman->priv = priv;
 
   eman->data = electron_new ();
   priv->timeout = 0;
+  priv->tape_speed = FALSE;
+
+  electron_manager_select_cpu_core (eman);
+  priv->fast_load = NULL;
+  priv->host_fs = NULL;
+
+  /* This is installed first so that files on the host take priority
+     over the cassette */
+  value = g_getenv (ELECTRON_MANAGER_HOST_FS_ENV);
+  if (value && *value)
+  {
+    if (g_file_test (value, G_FILE_TEST_IS_DIR))
+      priv->host_fs = host_fs_install (eman->data, value);
+    else
+      g_warning ("The host filing system directory \"%s\" doesn't exist",
+                 value);
+  }
+
+  value = g_getenv (ELECTRON_MANAGER_FAST_LOAD_ENV);
+  if (value && !strcmp (value, "1"))
+    priv->fast_load = fast_load_install (eman->data);
 
   priv->gconf = gconf_client_get_default ();
   gconf_client_add_dir (priv->gconf, ELECTRON_MANAGER_ROMS_CONF_DIR,
@@ -168,6 +241,50 @@ electron_manager_is_running (ElectronManager *eman)
   return priv->timeout != 0;
 }
 
+/* Adds the source that runs the frames. It runs whenever the main loop
+   is idle at full speed or otherwise once every frame */
+static void
+electron_manager_add_timeout (ElectronManager *eman)
+{
+  ElectronManagerPrivate *priv = eman->priv;
+
+  if (priv->full_speed || priv->tape_speed)
+  {
+    priv->timeout = g_idle_add ((GSourceFunc) electron_manager_timeout,
+                                eman);
+    g_timer_start (priv->full_speed_timer);
+  }
+  else
+    priv->timeout
+      = frame_source_add (ELECTRON_TICKS_PER_FRAME,
+                          (GSourceFunc) electron_manager_timeout,
+                          eman, NULL);
+}
+
+/* Switches to full speed without drawing anything while the cassette
+   motor is on and the tape is being read. This works for any loader,
+   even one that doesn't use the OS */
+static void
+electron_manager_update_tape_speed (ElectronManager *eman)
+{
+  ElectronManagerPrivate *priv = eman->priv;
+  gboolean tape_speed = electron_is_reading_tape (eman->data);
+
+  if (priv->tape_speed == tape_speed)
+    return;
+
+  priv->tape_speed = tape_speed;
+  eman->data->skip_video = tape_speed;
+
+  /* The source only needs to change if the user hasn't already
+     chosen full speed */
+  if (!priv->full_speed)
+  {
+    g_source_remove (priv->timeout);
+    electron_manager_add_timeout (eman);
+  }
+}
+
 void
 electron_manager_start (ElectronManager *eman)
 {
@@ -177,25 +294,15 @@ electron_manager_start (ElectronManager *eman)
 
   if (priv->timeout == 0)
   {
-    if (priv->full_speed)
-    {
-      priv->timeout = g_idle_add ((GSourceFunc) electron_manager_timeout,
-                                  eman);
-      g_timer_start (priv->full_speed_timer);
-    }
-    else
-      priv->timeout
-        = frame_source_add (ELECTRON_TICKS_PER_FRAME,
-                            (GSourceFunc) electron_manager_timeout,
-                            eman, NULL);
+    electron_manager_add_timeout (eman);
 
     g_signal_emit (G_OBJECT (eman),
                    electron_manager_signals[ELECTRON_MANAGER_STARTED_SIGNAL], 0);
     /* If we're breaking at the current address then skip over one
        instruction. Otherwise when the breakpoint is hit continuing
        the emulation will cause it to break immediatly */
-    if (eman->data->cpu.break_type == CPU_BREAK_ADDR
-        && eman->data->cpu.break_address == eman->data->cpu.pc)
+    if (cpu_is_breakpoint (&eman->data->cpu, CPU_BREAK_ADDR,
+                           eman->data->cpu.pc))
       electron_step (eman->data);
   }
 }
@@ -212,6 +319,11 @@ electron_manager_stop (ElectronManager *eman)
     g_source_remove (priv->timeout);
     priv->timeout = 0;
 
+    /* Draw the display again while stopped in case the tape was
+       loading. It is checked again after the next frame */
+    priv->tape_speed = FALSE;
+    eman->data->skip_video = FALSE;
+
     g_signal_emit (G_OBJECT (eman),
                    electron_manager_signals[ELECTRON_MANAGER_STOPPED_SIGNAL], 0);
   }
@@ -241,6 +353,17 @@ electron_manager_step (ElectronManager *eman)
                  electron_manager_signals[ELECTRON_MANAGER_STOPPED_SIGNAL], 0);
 }
 
+/* Picks the fast variant of the cpu core whenever there is nothing
+   for the debugger to catch. The breakpoints can be changed while the
+   emulation is running so this is checked before every frame */
+static void
+electron_manager_update_cpu_debug (ElectronManager *eman)
+{
+  Cpu *cpu = &eman->data->cpu;
+
+  cpu_set_debug (cpu, cpu_get_n_breakpoints (cpu) > 0);
+}
+
 static gboolean
 electron_manager_timeout (ElectronManager *eman)
 {
@@ -249,13 +372,23 @@ electron_manager_timeout (ElectronManager *eman)
   g_return_val_if_fail (IS_ELECTRON_MANAGER (eman), FALSE);
   g_return_val_if_fail (priv->timeout != 0, FALSE);
 
+  electron_manager_update_cpu_debug (eman);
+
   if (electron_run_frame (eman->data))
+  {
     /* Breakpoint was hit, so stop the electron */
     electron_manager_stop (eman);
+    return TRUE;
+  }
+
+  electron_manager_update_tape_speed (eman);
+
   /* Otherwise we've done a whole frame so emit the frame end
-     signal. If we're running at full speed we'll only emit the frame
-     end signal if enough time has elapsed (so not every frame will be
-     drawn) */
+     signal. Nothing is drawn while the tape is loading. If we're
+     running at full speed we'll only emit the frame end signal if
+     enough time has elapsed (so not every frame will be drawn) */
+  if (priv->tape_speed)
+    return TRUE;
   else if (priv->full_speed)
   {
     if (g_timer_elapsed (priv->full_speed_timer, NULL) * 1000.0
@@ -306,6 +439,10 @@ electron_manager_finalize (GObject *obj)
   ElectronManager *eman = ELECTRON_MANAGER (obj);
   ElectronManagerPrivate *priv = eman->priv;
 
+  if (priv->fast_load)
+    fast_load_uninstall (priv->fast_load);
+  if (priv->host_fs)
+    host_fs_uninstall (priv->host_fs);
   electron_free (eman->data);
 
   g_timer_destroy (priv->full_speed_timer);
@@ -505,17 +642,7 @@ electron_manager_set_full_speed (ElectronManager *eman,
     if (priv->timeout)
     {
       g_source_remove (priv->timeout);
-      if (full_speed)
-      {
-        priv->timeout = g_idle_add ((GSourceFunc) electron_manager_timeout,
-                                    eman);
-        g_timer_start (priv->full_speed_timer);
-      }
-      else
-        priv->timeout
-          = frame_source_add (ELECTRON_TICKS_PER_FRAME,
-                              (GSourceFunc) electron_manager_timeout,
-                              eman, NULL);
+      electron_manager_add_timeout (eman);
     }
   }
 }
@@ -0,0 +1,467 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+
+#include "fastload.h"
+#include "electron.h"
+#include "tapebuffer.h"
+
+/* Loads files from the cassette instantly by trapping OSFILE and the
+   *RUN command. When a program asks the cassette filing system to
+   load a file, the blocks are read straight out of the tape buffer
+   and copied into RAM, and the tape is left after the file as if it
+   had been played. Anything that can't be handled here, such as a
+   protected loader that reads the tape itself or a block with a bad
+   CRC, is left to run in real time */
+
+/* The entries in the OS jump table and the vectors that the cassette
+   filing system is reached through. OSCLI passes *RUN on to FSCV */
+#define FAST_LOAD_OSFILE 0xFFDD
+#define FAST_LOAD_OSCLI  0xFFF7
+#define FAST_LOAD_FILEV  0x0212
+#define FAST_LOAD_FSCV   0x021E
+
+/* A paged ROM claims a vector by pointing it at the vector's entry in
+   the table of extended vector entry points in page &FF. The OS's own
+   handlers are all below that page */
+#define FAST_LOAD_EXTENDED_VECTORS 0xFF00
+
+/* The OS flag that selects between the cassette filing system (0) and
+   the ROM filing system (2). Both are reached through the same
+   vectors */
+#define FAST_LOAD_FS_FLAG 0x0247
+
+/* The OSFILE reason code to load a file */
+#define FAST_LOAD_OSFILE_LOAD 0xFF
+
+/* The format of a block on the tape. This is the same as what
+   eek-file2uef writes */
+#define FAST_LOAD_SYNC_BYTE    0x2a
+#define FAST_LOAD_MAX_NAME     10
+#define FAST_LOAD_MAX_BLOCK    256
+#define FAST_LOAD_FLAG_LOCKED  0x01
+#define FAST_LOAD_FLAG_LAST    0x80
+
+typedef struct
+{
+  char name[FAST_LOAD_MAX_NAME + 1];
+  guint32 load_address;
+  guint32 exec_address;
+  guint16 block_num;
+  guint16 length;
+  guint8 flags;
+  guint8 data[FAST_LOAD_MAX_BLOCK];
+} FastLoadBlock;
+
+struct _FastLoad
+{
+  Electron *electron;
+};
+
+static void
+fast_load_update_crc (guint16 *crc, guint8 byte)
+{
+  int i;
+
+  *crc ^= ((guint16) byte) << 8;
+
+  for (i = 0; i < 8; i++)
+  {
+    if (*crc & 0x8000)
+      *crc = ((*crc ^ 0x0810) << 1) | 1;
+    else
+      *crc <<= 1;
+  }
+}
+
+/* Reads a byte from the middle of a block. Returns FALSE if the data
+   stops before the end of the block */
+static gboolean
+fast_load_read_byte (TapeBuffer *tbuf, guint16 *crc, guint8 *byte)
+{
+  int next_byte = tape_buffer_get_next_byte (tbuf);
+
+  if (next_byte < 0)
+    return FALSE;
+
+  *byte = next_byte;
+  if (crc)
+    fast_load_update_crc (crc, *byte);
+
+  return TRUE;
+}
+
+static gboolean
+fast_load_read_value (TapeBuffer *tbuf, guint16 *crc, int n_bytes,
+                      guint32 *value)
+{
+  guint8 byte;
+  int i;
+
+  /* The values are stored little endian */
+  *value = 0;
+  for (i = 0; i < n_bytes; i++)
+  {
+    if (!fast_load_read_byte (tbuf, crc, &byte))
+      return FALSE;
+    *value |= (guint32) byte << (i * 8);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+fast_load_check_crc (TapeBuffer *tbuf, guint16 crc)
+{
+  guint8 high, low;
+
+  /* Unlike the rest of the block the CRC is big endian */
+  return (fast_load_read_byte (tbuf, NULL, &high)
+          && fast_load_read_byte (tbuf, NULL, &low)
+          && ((high << 8) | low) == crc);
+}
+
+/* Reads the next block from the tape. Returns FALSE if there aren't
+   any more blocks or the block is damaged */
+static gboolean
+fast_load_read_block (TapeBuffer *tbuf, FastLoadBlock *block)
+{
+  guint32 value;
+  guint16 crc = 0;
+  guint8 byte;
+  int i;
+
+  /* Skip the lead tone and anything else before the block */
+  do
+  {
+    if (tape_buffer_is_at_end (tbuf))
+      return FALSE;
+  } while (tape_buffer_get_next_byte (tbuf) != FAST_LOAD_SYNC_BYTE);
+
+  for (i = 0; ; i++)
+  {
+    if (!fast_load_read_byte (tbuf, &crc, &byte))
+      return FALSE;
+    if (byte == 0)
+      break;
+    if (i >= FAST_LOAD_MAX_NAME)
+      return FALSE;
+    block->name[i] = byte;
+  }
+  block->name[i] = '\0';
+
+  if (!fast_load_read_value (tbuf, &crc, 4, &block->load_address)
+      || !fast_load_read_value (tbuf, &crc, 4, &block->exec_address)
+      || !fast_load_read_value (tbuf, &crc, 2, &value))
+    return FALSE;
+  block->block_num = value;
+  if (!fast_load_read_value (tbuf, &crc, 2, &value))
+    return FALSE;
+  block->length = value;
+  if (!fast_load_read_byte (tbuf, &crc, &block->flags)
+      /* Address of the next file which isn't used */
+      || !fast_load_read_value (tbuf, &crc, 4, &value)
+      || !fast_load_check_crc (tbuf, crc)
+      || block->length > FAST_LOAD_MAX_BLOCK)
+    return FALSE;
+
+  /* An empty block doesn't have a data CRC */
+  if (block->length == 0)
+    return TRUE;
+
+  crc = 0;
+  for (i = 0; i < block->length; i++)
+    if (!fast_load_read_byte (tbuf, &crc, block->data + i))
+      return FALSE;
+
+  return fast_load_check_crc (tbuf, crc);
+}
+
+/* Reads the blocks of the next file on the tape with the given name,
+   or of the next file of any name if the name is empty. The blocks
+   are appended to data. Returns FALSE if the file can't be loaded */
+static gboolean
+fast_load_read_file (TapeBuffer *tbuf, const char *name,
+                     FastLoadBlock *header, GByteArray *data)
+{
+  FastLoadBlock block;
+  int next_block_num = 0;
+
+  while (fast_load_read_block (tbuf, &block))
+  {
+    if (next_block_num == 0)
+    {
+      /* Skip over the blocks of the other files */
+      if (block.block_num != 0
+          || (*name && g_ascii_strcasecmp (name, block.name)))
+        continue;
+
+      /* Let the OS deal with the protection on locked files */
+      if ((block.flags & FAST_LOAD_FLAG_LOCKED))
+        return FALSE;
+
+      *header = block;
+    }
+    else if (block.block_num != next_block_num
+             || strcmp (block.name, header->name))
+      return FALSE;
+
+    g_byte_array_append (data, block.data, block.length);
+    next_block_num++;
+
+    if ((block.flags & FAST_LOAD_FLAG_LAST))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static guint32
+fast_load_read_uint32 (Electron *electron, guint16 address)
+{
+  guint32 value = 0;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    value |= ((guint32) electron_read_from_location (electron, address + i)
+              << (i * 8));
+
+  return value;
+}
+
+static void
+fast_load_write_uint32 (Electron *electron, guint16 address, guint32 value)
+{
+  int i;
+
+  for (i = 0; i < 4; i++)
+    electron_write_to_location (electron, address + i, value >> (i * 8));
+}
+
+/* Reads a filename in the same way as the OS. Leading spaces are
+   skipped and the name ends at a space or a carriage return. Returns
+   FALSE if the name is too long */
+static gboolean
+fast_load_read_name (Electron *electron, guint16 address, char *name)
+{
+  guint8 ch;
+  int length = 0;
+
+  while (electron_read_from_location (electron, address) == ' ')
+    address++;
+
+  while ((ch = electron_read_from_location (electron, address++)) != '\r'
+         && ch != ' ')
+  {
+    if (length >= FAST_LOAD_MAX_NAME)
+      return FALSE;
+    name[length++] = ch;
+  }
+
+  name[length] = '\0';
+
+  return TRUE;
+}
+
+/* Returns TRUE if the vector still points at the OS's own handler
+   and the OS has selected the cassette filing system. Otherwise some
+   other filing system has claimed the vector or it is *ROM */
+static gboolean
+fast_load_is_cassette (Electron *electron, guint16 vector)
+{
+  guint16 handler = (electron_read_from_location (electron, vector)
+                     | (electron_read_from_location (electron, vector + 1)
+                        << 8));
+
+  return (handler >= ELECTRON_OS_ROM_ADDRESS
+          && handler < FAST_LOAD_EXTENDED_VECTORS
+          && electron_read_from_location (electron, FAST_LOAD_FS_FLAG) == 0);
+}
+
+/* Loads the file with the name at name_address into RAM. It goes at
+   its own load address unless use_own_address is FALSE. The header of
+   the first block and the length of the file are returned. Returns
+   FALSE with the tape left where it was if the OS needs to load the
+   file in real time */
+static gboolean
+fast_load_file (Electron *electron, guint16 name_address,
+                gboolean use_own_address, guint16 load_address,
+                FastLoadBlock *header, guint32 *length)
+{
+  char name[FAST_LOAD_MAX_NAME + 1];
+  GByteArray *file_data;
+  int tape_position;
+
+  if (!fast_load_read_name (electron, name_address, name))
+    return FALSE;
+
+  file_data = g_byte_array_new ();
+  tape_position = tape_buffer_get_position (electron->tape_buffer);
+
+  if (!fast_load_read_file (electron->tape_buffer, name, header, file_data))
+    goto fall_back;
+
+  if (use_own_address)
+    load_address = header->load_address;
+
+  /* Leave anything that doesn't fit in RAM to the OS */
+  if (load_address + file_data->len > CPU_RAM_SIZE)
+    goto fall_back;
+
+  memcpy (electron->memory + load_address, file_data->data, file_data->len);
+  /* The file might replace code that has already been decoded */
+  cpu_invalidate_code (&electron->cpu);
+
+  *length = file_data->len;
+
+  g_byte_array_free (file_data, TRUE);
+
+  return TRUE;
+
+ fall_back:
+  g_byte_array_free (file_data, TRUE);
+  /* Let the OS read the file from the start in real time */
+  tape_buffer_set_position (electron->tape_buffer, tape_position);
+
+  return FALSE;
+}
+
+static gboolean
+fast_load_osfile (Electron *electron, gpointer data)
+{
+  Cpu *cpu = &electron->cpu;
+  guint16 block_address = cpu->x | (cpu->y << 8);
+  FastLoadBlock header;
+  guint32 length;
+  gboolean use_own_address;
+
+  if (cpu->a != FAST_LOAD_OSFILE_LOAD
+      || !fast_load_is_cassette (electron, FAST_LOAD_FILEV))
+    return FALSE;
+
+  /* The file is loaded at its own address unless the low byte of the
+     execution address in the control block is zero */
+  use_own_address = electron_read_from_location (electron,
+                                                 block_address + 6) != 0;
+
+  if (!fast_load_file (electron,
+                       electron_read_from_location (electron, block_address)
+                       | (electron_read_from_location (electron,
+                                                       block_address + 1)
+                          << 8),
+                       use_own_address,
+                       fast_load_read_uint32 (electron, block_address + 2),
+                       &header, &length))
+    return FALSE;
+
+  fast_load_write_uint32 (electron, block_address + 2, header.load_address);
+  fast_load_write_uint32 (electron, block_address + 6, header.exec_address);
+  fast_load_write_uint32 (electron, block_address + 10, length);
+  fast_load_write_uint32 (electron, block_address + 14, 0);
+
+  /* Report that a file was found */
+  cpu->a = 1;
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+/* Handles *RUN, its abbreviation *R. and the short form with a
+   slash. The OS would otherwise pass these on to the cassette filing
+   system through FSCV */
+static gboolean
+fast_load_oscli (Electron *electron, gpointer data)
+{
+  static const char run[] = "RUN";
+  Cpu *cpu = &electron->cpu;
+  guint16 address = cpu->x | (cpu->y << 8);
+  FastLoadBlock header;
+  guint32 length;
+  int i;
+  guint8 ch;
+
+  if (!fast_load_is_cassette (electron, FAST_LOAD_FSCV))
+    return FALSE;
+
+  while ((ch = electron_read_from_location (electron, address)) == ' '
+         || ch == '*')
+    address++;
+
+  if (ch == '/')
+    address++;
+  else
+  {
+    for (i = 0; run[i]; i++)
+    {
+      ch = electron_read_from_location (electron, address + i);
+      if (g_ascii_toupper (ch) != run[i])
+        break;
+    }
+
+    ch = electron_read_from_location (electron, address + i);
+
+    if (run[i] == '\0' && !g_ascii_isalpha (ch))
+      address += i;
+    else if (i > 0 && ch == '.')
+      address += i + 1;
+    else
+      return FALSE;
+  }
+
+  if (!fast_load_file (electron, address, TRUE, 0, &header, &length))
+    return FALSE;
+
+  /* Running the file jumps to it with the return address of the OSCLI
+     call still on the stack so that it can return to the caller */
+  cpu->a = 1;
+  cpu->pc = header.exec_address & 0xffff;
+
+  return TRUE;
+}
+
+FastLoad *
+fast_load_install (Electron *electron)
+{
+  FastLoad *fl = g_new (FastLoad, 1);
+
+  fl->electron = electron;
+
+  electron_add_trap (electron, FAST_LOAD_OSFILE, ELECTRON_TRAP_ANY_PAGE,
+                     fast_load_osfile, fl);
+  electron_add_trap (electron, FAST_LOAD_OSCLI, ELECTRON_TRAP_ANY_PAGE,
+                     fast_load_oscli, fl);
+
+  return fl;
+}
+
+void
+fast_load_uninstall (FastLoad *fl)
+{
+  electron_remove_trap (fl->electron, FAST_LOAD_OSFILE,
+                        ELECTRON_TRAP_ANY_PAGE, fast_load_osfile, fl);
+  electron_remove_trap (fl->electron, FAST_LOAD_OSCLI,
+                        ELECTRON_TRAP_ANY_PAGE, fast_load_oscli, fl);
+
+  g_free (fl);
+}
@@ -0,0 +1,29 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FAST_LOAD_H
+#define _FAST_LOAD_H
+
+#include "electron.h"
+
+typedef struct _FastLoad FastLoad;
+
+FastLoad *fast_load_install (Electron *electron);
+void fast_load_uninstall (FastLoad *fl);
+
+#endif /* _FAST_LOAD_H */
@@ -0,0 +1,1024 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "hostfs.h"
+#include "electron.h"
+
+/* Serves files from a directory on the host by trapping the filing
+   system calls in the OS jump table. Files that are in the directory
+   are loaded and saved straight to and from memory without going
+   through the OS. Anything else, such as loading a file that isn't in
+   the directory, is passed on to the OS so the cassette still works
+   for files that aren't on the host.
+
+   The load and execution addresses are kept in a sidecar file with
+   .inf added to the name which has the same format that most other
+   emulators use. It contains the name followed by the addresses in
+   hex. A file without one is treated as if it was saved from BASIC */
+
+/* The entries in the OS jump table */
+#define HOST_FS_OSFIND 0xFFCE
+#define HOST_FS_OSGBPB 0xFFD1
+#define HOST_FS_OSBPUT 0xFFD4
+#define HOST_FS_OSBGET 0xFFD7
+#define HOST_FS_OSARGS 0xFFDA
+#define HOST_FS_OSFILE 0xFFDD
+#define HOST_FS_OSBYTE 0xFFF4
+#define HOST_FS_OSCLI  0xFFF7
+
+/* The OSBYTE call to check for the end of a file */
+#define HOST_FS_OSBYTE_EOF 0x7F
+
+/* The handles of the open files. These are above the ones that the
+   cassette filing system uses so that the two can be told apart */
+#define HOST_FS_FIRST_HANDLE 0x70
+#define HOST_FS_N_HANDLES    8
+
+#define HOST_FS_MAX_NAME 64
+
+/* The address used for files without a sidecar which is where BASIC
+   programs are loaded */
+#define HOST_FS_DEFAULT_ADDRESS 0xFFFF0E00
+
+/* Errors are raised by copying a BRK instruction and the error block
+   to the bottom of the stack page and jumping to it, the same way
+   that a filing system ROM does */
+#define HOST_FS_ERROR_ADDRESS 0x0100
+#define HOST_FS_MAX_ERROR     0x80
+
+#define HOST_FS_ERROR_TOO_MANY_OPEN 0xC0
+#define HOST_FS_ERROR_HOST          0xC7
+#define HOST_FS_ERROR_NO_ROOM       0xC6
+#define HOST_FS_ERROR_BAD_COMMAND   0xFE
+
+typedef struct
+{
+  guint32 load_address;
+  guint32 exec_address;
+  guint32 length;
+} HostFsInfo;
+
+typedef enum
+{
+  /* The file isn't in the directory so the OS should handle it */
+  HOST_FS_NOT_FOUND,
+  HOST_FS_DONE,
+  /* An error has been raised in the emulated machine */
+  HOST_FS_ERROR
+} HostFsResult;
+
+typedef enum
+{
+  HOST_FS_COMMAND_LOAD,
+  HOST_FS_COMMAND_SAVE,
+  HOST_FS_COMMAND_RUN,
+  HOST_FS_COMMAND_NONE
+} HostFsCommand;
+
+struct _HostFs
+{
+  Electron *electron;
+  char *directory;
+  /* The open files for each handle or NULL if the handle is free */
+  FILE *files[HOST_FS_N_HANDLES];
+};
+
+/* The commands in the order that the OS matches abbreviations */
+static const char *
+host_fs_commands[] = { "LOAD", "SAVE", "RUN" };
+
+static gboolean host_fs_osfind (Electron *electron, gpointer data);
+static gboolean host_fs_osgbpb (Electron *electron, gpointer data);
+static gboolean host_fs_osbput (Electron *electron, gpointer data);
+static gboolean host_fs_osbget (Electron *electron, gpointer data);
+static gboolean host_fs_osargs (Electron *electron, gpointer data);
+static gboolean host_fs_osfile (Electron *electron, gpointer data);
+static gboolean host_fs_osbyte (Electron *electron, gpointer data);
+static gboolean host_fs_oscli (Electron *electron, gpointer data);
+
+static const struct { guint16 address; ElectronTrapFunc func; }
+host_fs_traps[] =
+  {
+    { HOST_FS_OSFIND, host_fs_osfind },
+    { HOST_FS_OSGBPB, host_fs_osgbpb },
+    { HOST_FS_OSBPUT, host_fs_osbput },
+    { HOST_FS_OSBGET, host_fs_osbget },
+    { HOST_FS_OSARGS, host_fs_osargs },
+    { HOST_FS_OSFILE, host_fs_osfile },
+    { HOST_FS_OSBYTE, host_fs_osbyte },
+    { HOST_FS_OSCLI, host_fs_oscli }
+  };
+
+static guint16
+host_fs_read_uint16 (Electron *electron, guint16 address)
+{
+  return (electron_read_from_location (electron, address)
+          | (electron_read_from_location (electron, address + 1) << 8));
+}
+
+static guint32
+host_fs_read_uint32 (Electron *electron, guint16 address)
+{
+  guint32 value = 0;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    value |= ((guint32) electron_read_from_location (electron, address + i)
+              << (i * 8));
+
+  return value;
+}
+
+static void
+host_fs_write_uint32 (Electron *electron, guint16 address, guint32 value)
+{
+  int i;
+
+  for (i = 0; i < 4; i++)
+    electron_write_to_location (electron, address + i, value >> (i * 8));
+}
+
+static gboolean
+host_fs_error (Electron *electron, guint8 number, const char *format, ...)
+{
+  guint16 address = HOST_FS_ERROR_ADDRESS;
+  va_list ap;
+  char *message;
+  const char *p;
+
+  va_start (ap, format);
+  message = g_strdup_vprintf (format, ap);
+  va_end (ap);
+
+  electron_write_to_location (electron, address++, 0x00); /* BRK */
+  electron_write_to_location (electron, address++, number);
+  for (p = message;
+       *p && address < HOST_FS_ERROR_ADDRESS + HOST_FS_MAX_ERROR - 1;
+       p++)
+    electron_write_to_location (electron, address++, *p);
+  electron_write_to_location (electron, address, 0x00);
+
+  g_free (message);
+
+  /* The BRK might have been decoded from something else at the same
+     address */
+  cpu_invalidate_code (&electron->cpu);
+  electron->cpu.pc = HOST_FS_ERROR_ADDRESS;
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_is_space (guint8 ch)
+{
+  return ch == ' ';
+}
+
+static gboolean
+host_fs_is_end (guint8 ch)
+{
+  return ch == '\r' || ch == '\0';
+}
+
+static void
+host_fs_skip_spaces (Electron *electron, guint16 *address)
+{
+  while (host_fs_is_space (electron_read_from_location (electron, *address)))
+    (*address)++;
+}
+
+/* Reads a filename that may be in quotes. The address is left after
+   the name. Returns FALSE if the name is empty, too long or has a
+   character that couldn't be used on the host */
+static gboolean
+host_fs_read_name (Electron *electron, guint16 *address, char *name)
+{
+  gboolean quoted = FALSE;
+  int length = 0;
+  guint8 ch;
+
+  host_fs_skip_spaces (electron, address);
+
+  if (electron_read_from_location (electron, *address) == '"')
+  {
+    quoted = TRUE;
+    (*address)++;
+  }
+
+  while (TRUE)
+  {
+    ch = electron_read_from_location (electron, *address);
+
+    if (host_fs_is_end (ch))
+      break;
+
+    (*address)++;
+
+    if (quoted ? ch == '"' : host_fs_is_space (ch))
+      break;
+
+    /* Don't let the name get out of the directory */
+    if (ch == '/' || ch == '\\' || ch < ' ' || ch >= 0x7f
+        || length >= HOST_FS_MAX_NAME)
+      return FALSE;
+
+    name[length++] = ch;
+  }
+
+  name[length] = '\0';
+
+  return length > 0 && name[0] != '.';
+}
+
+static gboolean
+host_fs_read_hex (Electron *electron, guint16 *address, guint32 *value)
+{
+  int digits = 0, digit;
+
+  host_fs_skip_spaces (electron, address);
+
+  *value = 0;
+  while ((digit = g_ascii_xdigit_value (electron_read_from_location (electron,
+                                                                    *address)))
+         != -1)
+  {
+    *value = (*value << 4) | digit;
+    (*address)++;
+    digits++;
+  }
+
+  return digits > 0;
+}
+
+/* Returns the path of the file with the given name. The case of the
+   name is ignored in the same way as the OS. Returns NULL if there
+   isn't a file with the name */
+static char *
+host_fs_find_file (HostFs *fs, const char *name)
+{
+  const char *entry;
+  char *path = NULL;
+  GDir *dir;
+
+  if ((dir = g_dir_open (fs->directory, 0, NULL)) == NULL)
+    return NULL;
+
+  while ((entry = g_dir_read_name (dir)))
+    if (!g_ascii_strcasecmp (entry, name))
+    {
+      path = g_build_filename (fs->directory, entry, NULL);
+
+      if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+        break;
+
+      g_free (path);
+      path = NULL;
+    }
+
+  g_dir_close (dir);
+
+  return path;
+}
+
+static char *
+host_fs_info_path (const char *path)
+{
+  return g_strconcat (path, ".inf", NULL);
+}
+
+/* Reads the addresses from the sidecar and the length from the
+   file */
+static gboolean
+host_fs_read_info (const char *path, HostFsInfo *info)
+{
+  char *info_path = host_fs_info_path (path);
+  char *contents;
+  unsigned int load_address, exec_address;
+  struct stat buf;
+
+  info->load_address = HOST_FS_DEFAULT_ADDRESS;
+  info->exec_address = HOST_FS_DEFAULT_ADDRESS;
+
+  if (g_file_get_contents (info_path, &contents, NULL, NULL))
+  {
+    if (sscanf (contents, "%*s %x %x", &load_address, &exec_address) == 2)
+    {
+      info->load_address = load_address;
+      info->exec_address = exec_address;
+    }
+    g_free (contents);
+  }
+
+  g_free (info_path);
+
+  if (g_stat (path, &buf) == -1)
+    return FALSE;
+
+  info->length = buf.st_size;
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_write_info (const char *path, const char *name,
+                    const HostFsInfo *info, GError **error)
+{
+  char *info_path = host_fs_info_path (path);
+  char *contents = g_strdup_printf ("%s %08X %08X %08X\n", name,
+                                    info->load_address, info->exec_address,
+                                    info->length);
+  gboolean ret;
+
+  ret = g_file_set_contents (info_path, contents, -1, error);
+
+  g_free (contents);
+  g_free (info_path);
+
+  return ret;
+}
+
+/* Fills in the addresses, length and attributes of an OSFILE control
+   block */
+static void
+host_fs_write_block_info (Electron *electron, guint16 block,
+                          const HostFsInfo *info)
+{
+  host_fs_write_uint32 (electron, block + 2, info->load_address);
+  host_fs_write_uint32 (electron, block + 6, info->exec_address);
+  host_fs_write_uint32 (electron, block + 10, info->length);
+  host_fs_write_uint32 (electron, block + 14, 0);
+}
+
+/* Loads a file at its own load address if use_own_address is TRUE or
+   at the given address otherwise */
+static HostFsResult
+host_fs_load (HostFs *fs, const char *name,
+              gboolean use_own_address, guint32 address,
+              HostFsInfo *info)
+{
+  Electron *electron = fs->electron;
+  GError *error = NULL;
+  char *path, *contents;
+  gsize length;
+
+  if ((path = host_fs_find_file (fs, name)) == NULL)
+    return HOST_FS_NOT_FOUND;
+
+  if (!host_fs_read_info (path, info)
+      || !g_file_get_contents (path, &contents, &length, &error))
+  {
+    host_fs_error (electron, HOST_FS_ERROR_HOST, "%s",
+                   error ? error->message : g_strerror (errno));
+    if (error)
+      g_error_free (error);
+    g_free (path);
+    return HOST_FS_ERROR;
+  }
+
+  g_free (path);
+
+  info->length = length;
+  if (use_own_address)
+    address = info->load_address;
+  address &= 0xffff;
+
+  if (address + length > CPU_RAM_SIZE)
+  {
+    g_free (contents);
+    host_fs_error (electron, HOST_FS_ERROR_NO_ROOM, "No room");
+    return HOST_FS_ERROR;
+  }
+
+  memcpy (electron->memory + address, contents, length);
+  /* The file might replace code that has already been decoded */
+  cpu_invalidate_code (&electron->cpu);
+
+  g_free (contents);
+
+  return HOST_FS_DONE;
+}
+
+/* Saves the memory from start up to but not including end along with
+   the addresses in info. Returns HOST_FS_ERROR if it fails */
+static HostFsResult
+host_fs_save (HostFs *fs, const char *name, HostFsInfo *info,
+              guint32 start, guint32 end)
+{
+  Electron *electron = fs->electron;
+  GError *error = NULL;
+  guint8 *contents;
+  char *path;
+  guint32 i;
+
+  start &= 0xffff;
+  end &= 0xffff;
+
+  /* An end address of zero is the end of the address space */
+  if (end == 0)
+    end = CPU_ADDRESS_SIZE;
+
+  if (end < start)
+  {
+    host_fs_error (electron, HOST_FS_ERROR_BAD_COMMAND, "Bad address");
+    return HOST_FS_ERROR;
+  }
+
+  info->length = end - start;
+
+  /* Read through the Electron so that ROMs can be saved too */
+  contents = g_malloc (info->length + 1);
+  for (i = 0; i < info->length; i++)
+    contents[i] = electron_read_from_location (electron, start + i);
+
+  if ((path = host_fs_find_file (fs, name)) == NULL)
+    path = g_build_filename (fs->directory, name, NULL);
+
+  if (!g_file_set_contents (path, (const char *) contents, info->length,
+                            &error)
+      || !host_fs_write_info (path, name, info, &error))
+  {
+    host_fs_error (electron, HOST_FS_ERROR_HOST, "%s", error->message);
+    g_error_free (error);
+    g_free (contents);
+    g_free (path);
+    return HOST_FS_ERROR;
+  }
+
+  g_free (contents);
+  g_free (path);
+
+  return HOST_FS_DONE;
+}
+
+static gboolean
+host_fs_osfile (Electron *electron, gpointer data)
+{
+  HostFs *fs = data;
+  Cpu *cpu = &electron->cpu;
+  guint16 block = cpu->x | (cpu->y << 8);
+  guint16 name_address = host_fs_read_uint16 (electron, block);
+  char name[HOST_FS_MAX_NAME + 1];
+  GError *error = NULL;
+  HostFsResult result;
+  HostFsInfo info;
+  char *path;
+
+  if (!host_fs_read_name (electron, &name_address, name))
+    return FALSE;
+
+  switch (cpu->a)
+  {
+    case 0x00:
+      /* Save a block of memory */
+      info.load_address = host_fs_read_uint32 (electron, block + 2);
+      info.exec_address = host_fs_read_uint32 (electron, block + 6);
+      if (host_fs_save (fs, name, &info,
+                        host_fs_read_uint32 (electron, block + 10),
+                        host_fs_read_uint32 (electron, block + 14))
+          == HOST_FS_ERROR)
+        return TRUE;
+      host_fs_write_block_info (electron, block, &info);
+      break;
+
+    case 0xFF:
+      /* Load the file at its own address unless the low byte of the
+         execution address in the block is zero */
+      result = host_fs_load (fs, name,
+                             electron_read_from_location (electron,
+                                                          block + 6) != 0,
+                             host_fs_read_uint32 (electron, block + 2),
+                             &info);
+      if (result == HOST_FS_NOT_FOUND)
+        return FALSE;
+      else if (result == HOST_FS_ERROR)
+        return TRUE;
+      host_fs_write_block_info (electron, block, &info);
+      break;
+
+    case 0x01:
+    case 0x02:
+    case 0x03:
+    case 0x04:
+      /* Write the catalogue information */
+      if ((path = host_fs_find_file (fs, name)) == NULL)
+        return FALSE;
+      if (host_fs_read_info (path, &info))
+      {
+        if (cpu->a == 0x01 || cpu->a == 0x02)
+          info.load_address = host_fs_read_uint32 (electron, block + 2);
+        if (cpu->a == 0x01 || cpu->a == 0x03)
+          info.exec_address = host_fs_read_uint32 (electron, block + 6);
+      }
+      if (cpu->a != 0x04 && !host_fs_write_info (path, name, &info, &error))
+      {
+        host_fs_error (electron, HOST_FS_ERROR_HOST, "%s", error->message);
+        g_error_free (error);
+        g_free (path);
+        return TRUE;
+      }
+      g_free (path);
+      break;
+
+    case 0x05:
+      /* Read the catalogue information */
+      if ((path = host_fs_find_file (fs, name)) == NULL)
+        return FALSE;
+      if (host_fs_read_info (path, &info))
+        host_fs_write_block_info (electron, block, &info);
+      g_free (path);
+      break;
+
+    case 0x06:
+      /* Delete the file */
+      if ((path = host_fs_find_file (fs, name)) == NULL)
+        return FALSE;
+      if (host_fs_read_info (path, &info))
+        host_fs_write_block_info (electron, block, &info);
+      if (g_unlink (path) == -1)
+      {
+        host_fs_error (electron, HOST_FS_ERROR_HOST, "%s: %s", name,
+                       g_strerror (errno));
+        g_free (path);
+        return TRUE;
+      }
+      else
+      {
+        char *info_path = host_fs_info_path (path);
+        g_unlink (info_path);
+        g_free (info_path);
+      }
+      g_free (path);
+      break;
+
+    default:
+      return FALSE;
+  }
+
+  /* Report that the object is a file */
+  cpu->a = 1;
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+static FILE *
+host_fs_get_file (HostFs *fs, guint8 handle)
+{
+  if (handle < HOST_FS_FIRST_HANDLE
+      || handle >= HOST_FS_FIRST_HANDLE + HOST_FS_N_HANDLES)
+    return NULL;
+
+  return fs->files[handle - HOST_FS_FIRST_HANDLE];
+}
+
+static void
+host_fs_close_all (HostFs *fs)
+{
+  int i;
+
+  for (i = 0; i < HOST_FS_N_HANDLES; i++)
+    if (fs->files[i])
+    {
+      fclose (fs->files[i]);
+      fs->files[i] = NULL;
+    }
+}
+
+static gboolean
+host_fs_osfind (Electron *electron, gpointer data)
+{
+  HostFs *fs = data;
+  Cpu *cpu = &electron->cpu;
+  char name[HOST_FS_MAX_NAME + 1];
+  guint16 name_address;
+  guint8 mode = cpu->a & 0xc0;
+  FILE *file;
+  char *path;
+  int handle;
+
+  if (cpu->a == 0x00)
+  {
+    if (cpu->y == 0)
+    {
+      /* Close all of the files and then let the OS close its own */
+      host_fs_close_all (fs);
+      return FALSE;
+    }
+
+    if ((file = host_fs_get_file (fs, cpu->y)) == NULL)
+      return FALSE;
+
+    fclose (file);
+    fs->files[cpu->y - HOST_FS_FIRST_HANDLE] = NULL;
+    cpu_rts (cpu);
+
+    return TRUE;
+  }
+
+  if (mode == 0)
+    return FALSE;
+
+  name_address = cpu->x | (cpu->y << 8);
+  if (!host_fs_read_name (electron, &name_address, name))
+    return FALSE;
+
+  /* Only files that are on the host can be read */
+  if ((path = host_fs_find_file (fs, name)) == NULL)
+  {
+    if (mode != 0x80)
+      return FALSE;
+    path = g_build_filename (fs->directory, name, NULL);
+  }
+
+  for (handle = 0; handle < HOST_FS_N_HANDLES; handle++)
+    if (fs->files[handle] == NULL)
+      break;
+
+  if (handle >= HOST_FS_N_HANDLES)
+  {
+    g_free (path);
+    return host_fs_error (electron, HOST_FS_ERROR_TOO_MANY_OPEN,
+                          "Too many open files");
+  }
+
+  file = g_fopen (path, mode == 0x40 ? "rb" : mode == 0x80 ? "wb" : "r+b");
+  g_free (path);
+
+  if (file == NULL)
+    return host_fs_error (electron, HOST_FS_ERROR_HOST, "%s: %s", name,
+                          g_strerror (errno));
+
+  fs->files[handle] = file;
+  cpu->a = handle + HOST_FS_FIRST_HANDLE;
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_osbget (Electron *electron, gpointer data)
+{
+  Cpu *cpu = &electron->cpu;
+  FILE *file;
+  int ch;
+
+  if ((file = host_fs_get_file (data, cpu->y)) == NULL)
+    return FALSE;
+
+  if ((ch = getc (file)) == EOF)
+  {
+    cpu->a = 0xfe;
+    cpu->carry = 1;
+  }
+  else
+  {
+    cpu->a = ch;
+    cpu->carry = 0;
+  }
+
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_osbput (Electron *electron, gpointer data)
+{
+  Cpu *cpu = &electron->cpu;
+  FILE *file;
+
+  if ((file = host_fs_get_file (data, cpu->y)) == NULL)
+    return FALSE;
+
+  if (putc (cpu->a, file) == EOF)
+    return host_fs_error (electron, HOST_FS_ERROR_HOST, "%s",
+                          g_strerror (errno));
+
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_osargs (Electron *electron, gpointer data)
+{
+  Cpu *cpu = &electron->cpu;
+  guint32 value = 0;
+  FILE *file;
+  long pos;
+  int i;
+
+  if ((file = host_fs_get_file (data, cpu->y)) == NULL)
+    return FALSE;
+
+  switch (cpu->a)
+  {
+    case 0x00:
+      /* Read PTR# */
+      value = ftell (file);
+      break;
+
+    case 0x01:
+      /* Write PTR# */
+      for (i = 0; i < 4; i++)
+        value |= ((guint32) electron_read_from_location (electron,
+                                                         (cpu->x + i) & 0xff)
+                  << (i * 8));
+      if (fseek (file, value, SEEK_SET) == -1)
+        return host_fs_error (electron, HOST_FS_ERROR_HOST, "%s",
+                              g_strerror (errno));
+      break;
+
+    case 0x02:
+      /* Read EXT# */
+      pos = ftell (file);
+      fseek (file, 0, SEEK_END);
+      value = ftell (file);
+      fseek (file, pos, SEEK_SET);
+      break;
+
+    case 0xff:
+      fflush (file);
+      break;
+
+    default:
+      return FALSE;
+  }
+
+  if (cpu->a != 0x01)
+    for (i = 0; i < 4; i++)
+      electron_write_to_location (electron, (cpu->x + i) & 0xff,
+                                  value >> (i * 8));
+
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_osgbpb (Electron *electron, gpointer data)
+{
+  Cpu *cpu = &electron->cpu;
+  guint16 block = cpu->x | (cpu->y << 8);
+  guint32 address, count, i;
+  FILE *file;
+  int ch;
+
+  if (cpu->a < 0x01 || cpu->a > 0x04
+      || (file = host_fs_get_file (data,
+                                   electron_read_from_location (electron,
+                                                                block)))
+      == NULL)
+    return FALSE;
+
+  address = host_fs_read_uint32 (electron, block + 1);
+  count = host_fs_read_uint32 (electron, block + 5);
+
+  /* Calls 1 and 3 use the pointer in the block */
+  if ((cpu->a == 0x01 || cpu->a == 0x03)
+      && fseek (file, host_fs_read_uint32 (electron, block + 9),
+                SEEK_SET) == -1)
+    return host_fs_error (electron, HOST_FS_ERROR_HOST, "%s",
+                          g_strerror (errno));
+
+  for (i = 0; i < count; i++)
+  {
+    if (cpu->a <= 0x02)
+    {
+      if (putc (electron_read_from_location (electron, address + i),
+                file) == EOF)
+        return host_fs_error (electron, HOST_FS_ERROR_HOST, "%s",
+                              g_strerror (errno));
+    }
+    else if ((ch = getc (file)) == EOF)
+      break;
+    else
+      electron_write_to_location (electron, address + i, ch);
+  }
+
+  if (cpu->a >= 0x03)
+    cpu_invalidate_code (cpu);
+
+  host_fs_write_uint32 (electron, block + 1, address + i);
+  host_fs_write_uint32 (electron, block + 5, count - i);
+  host_fs_write_uint32 (electron, block + 9, ftell (file));
+
+  /* Carry is set if the end of the file was reached before all of
+     the bytes were transferred */
+  cpu->carry = i < count;
+  cpu->a = 0;
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+static gboolean
+host_fs_osbyte (Electron *electron, gpointer data)
+{
+  Cpu *cpu = &electron->cpu;
+  FILE *file;
+  int ch;
+
+  if (cpu->a != HOST_FS_OSBYTE_EOF
+      || (file = host_fs_get_file (data, cpu->x)) == NULL)
+    return FALSE;
+
+  if ((ch = getc (file)) == EOF)
+    cpu->x = 0xff;
+  else
+  {
+    ungetc (ch, file);
+    cpu->x = 0x00;
+  }
+
+  cpu_rts (cpu);
+
+  return TRUE;
+}
+
+/* Matches a command word or abbreviation ending in a dot in the same
+   way as the OS. The address is left after the command */
+static HostFsCommand
+host_fs_match_command (Electron *electron, guint16 *address)
+{
+  int command, length;
+  guint8 ch;
+
+  for (command = 0; command < HOST_FS_COMMAND_NONE; command++)
+  {
+    const char *word = host_fs_commands[command];
+
+    for (length = 0; word[length]; length++)
+    {
+      ch = electron_read_from_location (electron, *address + length);
+
+      if (g_ascii_toupper (ch) != word[length])
+        break;
+    }
+
+    ch = electron_read_from_location (electron, *address + length);
+
+    if (word[length] == '\0' && !g_ascii_isalpha (ch))
+    {
+      *address += length;
+      return command;
+    }
+    else if (length > 0 && ch == '.')
+    {
+      *address += length + 1;
+      return command;
+    }
+  }
+
+  return HOST_FS_COMMAND_NONE;
+}
+
+static gboolean
+host_fs_oscli (Electron *electron, gpointer data)
+{
+  HostFs *fs = data;
+  Cpu *cpu = &electron->cpu;
+  guint16 address = cpu->x | (cpu->y << 8);
+  char name[HOST_FS_MAX_NAME + 1];
+  HostFsCommand command;
+  HostFsResult result;
+  HostFsInfo info;
+  guint32 start, end;
+  guint8 ch;
+
+  while ((ch = electron_read_from_location (electron, address)) == ' '
+         || ch == '*')
+    address++;
+
+  if (ch == '/')
+  {
+    command = HOST_FS_COMMAND_RUN;
+    address++;
+  }
+  else if ((command = host_fs_match_command (electron, &address))
+           == HOST_FS_COMMAND_NONE)
+    return FALSE;
+
+  if (!host_fs_read_name (electron, &address, name))
+    return FALSE;
+
+  switch (command)
+  {
+    case HOST_FS_COMMAND_LOAD:
+      /* The file is loaded at its own address unless one is given */
+      if (host_fs_read_hex (electron, &address, &start))
+        result = host_fs_load (fs, name, FALSE, start, &info);
+      else
+        result = host_fs_load (fs, name, TRUE, 0, &info);
+      break;
+
+    case HOST_FS_COMMAND_RUN:
+      result = host_fs_load (fs, name, TRUE, 0, &info);
+      break;
+
+    case HOST_FS_COMMAND_SAVE:
+      /* The end can also be given as a length after a plus */
+      if (!host_fs_read_hex (electron, &address, &start))
+        return host_fs_error (electron, HOST_FS_ERROR_BAD_COMMAND,
+                              "Bad command");
+      host_fs_skip_spaces (electron, &address);
+      if (electron_read_from_location (electron, address) == '+')
+      {
+        address++;
+        if (!host_fs_read_hex (electron, &address, &end))
+          return host_fs_error (electron, HOST_FS_ERROR_BAD_COMMAND,
+                                "Bad command");
+        end += start;
+      }
+      else if (!host_fs_read_hex (electron, &address, &end))
+        return host_fs_error (electron, HOST_FS_ERROR_BAD_COMMAND,
+                              "Bad command");
+
+      /* The execution and reload addresses default to the start */
+      if (!host_fs_read_hex (electron, &address, &info.exec_address))
+        info.exec_address = start;
+      if (!host_fs_read_hex (electron, &address, &info.load_address))
+        info.load_address = start;
+
+      result = host_fs_save (fs, name, &info, start, end);
+      break;
+
+    default:
+      g_return_val_if_reached (FALSE);
+  }
+
+  if (result == HOST_FS_NOT_FOUND)
+    return FALSE;
+  else if (result == HOST_FS_ERROR)
+    return TRUE;
+
+  /* Running the file jumps to it with the return address of the OSCLI
+   call still on the stack so that it can return to the caller */
+  if (command == HOST_FS_COMMAND_RUN)
+  {
+    cpu->a = 1;
+    cpu->pc = info.exec_address & 0xffff;
+  }
+  else
+    cpu_rts (cpu);
+
+  return TRUE;
+}
+
+HostFs *
+host_fs_install (Electron *electron, const char *directory)
+{
+  HostFs *fs = g_new0 (HostFs, 1);
+  int i;
+
+  fs->electron = electron;
+  fs->directory = g_strdup (directory);
+
+  for (i = 0; i < G_N_ELEMENTS (host_fs_traps); i++)
+    electron_add_trap (electron, host_fs_traps[i].address,
+                       ELECTRON_TRAP_ANY_PAGE, host_fs_traps[i].func, fs);
+
+  return fs;
+}
+
+void
+host_fs_uninstall (HostFs *fs)
+{
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (host_fs_traps); i++)
+    electron_remove_trap (fs->electron, host_fs_traps[i].address,
+                          ELECTRON_TRAP_ANY_PAGE, host_fs_traps[i].func, fs);
+
+  host_fs_close_all (fs);
+  g_free (fs->directory);
+  g_free (fs);
+}
@@ -0,0 +1,587 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "electron.h"
+#include "tapeuef.h"
+#include "disassemble.h"
+
+/* Runs two Electrons with different cpu engines side by side and
+   compares them after every instruction or block of cycles. Both
+   machines start from the same power on state so as long as the
+   engines agree they stay identical. The first difference in the
+   registers, the cycle count, the RAM or the writes to the memory
+   mapped hardware is reported */
+
+/* The number of differing RAM addresses to list */
+#define LOCKSTEP_MAX_REPORTED_BYTES 16
+
+typedef struct
+{
+  guint16 address;
+  guint8 value;
+} LockstepWrite;
+
+typedef struct
+{
+  const char *name;
+  CpuCore core;
+  gboolean debug;
+} LockstepEngine;
+
+typedef struct
+{
+  const char *name;
+  Electron *electron;
+
+  /* The Electron's own memory functions that the logging versions
+     pass the accesses on to */
+  CpuMemReadFunc read_func;
+  CpuMemWriteFunc write_func;
+  void *memory_data;
+
+  /* Array of LockstepWrites for the accesses that went through the
+     write function since the last comparison. Writes to RAM go
+     straight to memory so they are compared separately */
+  GArray *writes;
+} LockstepMachine;
+
+static const LockstepEngine
+lockstep_engines[] =
+  {
+    { "jumpblock", CPU_CORE_JUMPBLOCK, TRUE },
+    { "threaded", CPU_CORE_THREADED, TRUE },
+    { "threaded-fast", CPU_CORE_THREADED, FALSE },
+    { "predecode", CPU_CORE_PREDECODE, FALSE },
+    { "jit", CPU_CORE_JIT, FALSE }
+  };
+
+static char *option_os_rom = NULL;
+static char *option_basic_rom = NULL;
+static char *option_tape = NULL;
+static char *option_type = NULL;
+static char *option_reference = "jumpblock";
+static char *option_engine = "jit";
+static int option_skip_frames = 0;
+static int option_frames = 50;
+static int option_block_cycles = 0;
+
+static GOptionEntry
+options[] =
+  {
+    {
+      "os-rom", 'o', 0, G_OPTION_ARG_FILENAME, &option_os_rom,
+      "OS ROM to load", "file"
+    },
+    {
+      "basic-rom", 'b', 0, G_OPTION_ARG_FILENAME, &option_basic_rom,
+      "BASIC ROM to load", "file"
+    },
+    {
+      "tape", 't', 0, G_OPTION_ARG_FILENAME, &option_tape,
+      "UEF file to put in the cassette player", "file"
+    },
+    {
+      "type", 'k', 0, G_OPTION_ARG_STRING, &option_type,
+      "Text to type on the keyboard", "text"
+    },
+    {
+      "reference", 'r', 0, G_OPTION_ARG_STRING, &option_reference,
+      "Engine to compare against (default jumpblock)", "engine"
+    },
+    {
+      "engine", 'e', 0, G_OPTION_ARG_STRING, &option_engine,
+      "Engine to test (default jit)", "engine"
+    },
+    {
+      "skip-frames", 's', 0, G_OPTION_ARG_INT, &option_skip_frames,
+      "Frames to run on the reference engine before comparing", "frames"
+    },
+    {
+      "frames", 'f', 0, G_OPTION_ARG_INT, &option_frames,
+      "Frames to compare (default 50)", "frames"
+    },
+    {
+      "block-cycles", 'c', 0, G_OPTION_ARG_INT, &option_block_cycles,
+      "Compare after blocks of this many cycles instead of after "
+      "every instruction", "cycles"
+    },
+    { NULL, 0, 0, 0, NULL, NULL, NULL }
+  };
+
+static gboolean
+process_arguments (int *argc, char ***argv,
+                   GError **error)
+{
+  GOptionContext *context;
+  gboolean ret;
+  GOptionGroup *group;
+
+  group = g_option_group_new (NULL, /* name */
+                              NULL, /* description */
+                              NULL, /* help_description */
+                              NULL, /* user_data */
+                              NULL /* destroy notify */);
+  g_option_group_add_entries (group, options);
+  context = g_option_context_new ("- Compare two cpu engines in lockstep");
+  g_option_context_set_main_group (context, group);
+  ret = g_option_context_parse (context, argc, argv, error);
+  g_option_context_free (context);
+
+  if (ret && *argc > 1)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_UNKNOWN_OPTION,
+                   "Unknown option '%s'", (* argv)[1]);
+      ret = FALSE;
+    }
+  else if (ret && option_os_rom == NULL)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "An OS ROM is needed");
+      ret = FALSE;
+    }
+
+  return ret;
+}
+
+static const LockstepEngine *
+lockstep_find_engine (const char *name)
+{
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (lockstep_engines); i++)
+    if (!strcmp (lockstep_engines[i].name, name))
+      return lockstep_engines + i;
+
+  return NULL;
+}
+
+static gboolean
+lockstep_set_engine (LockstepMachine *machine, const LockstepEngine *engine,
+                     GError **error)
+{
+  if (!cpu_set_core (&machine->electron->cpu, engine->core))
+  {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOSYS,
+                 "The %s engine isn't available on this platform",
+                 engine->name);
+    return FALSE;
+  }
+
+  cpu_set_debug (&machine->electron->cpu, engine->debug);
+
+  return TRUE;
+}
+
+static guint8
+lockstep_read_func (void *data, guint16 address)
+{
+  LockstepMachine *machine = data;
+
+  return machine->read_func (machine->memory_data, address);
+}
+
+static void
+lockstep_write_func (void *data, guint16 address, guint8 value)
+{
+  LockstepMachine *machine = data;
+  LockstepWrite write;
+
+  write.address = address;
+  write.value = value;
+  g_array_append_val (machine->writes, write);
+
+  machine->write_func (machine->memory_data, address, value);
+}
+
+static gboolean
+lockstep_load_rom (Electron *electron, int page, const char *filename,
+                   GError **error)
+{
+  FILE *file;
+  int ret;
+
+  if ((file = fopen (filename, "rb")) == NULL)
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s: %s", filename, strerror (errno));
+    return FALSE;
+  }
+
+  if (page == -1)
+    ret = electron_load_os_rom (electron, file);
+  else
+    ret = electron_load_paged_rom (electron, page, file);
+
+  fclose (file);
+
+  if (ret == -1)
+  {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                 "%s: ROM is too short", filename);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+lockstep_load_tape (Electron *electron, const char *filename,
+                    GError **error)
+{
+  TapeBuffer *tbuf;
+  FILE *file;
+
+  if ((file = fopen (filename, "rb")) == NULL)
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s: %s", filename, strerror (errno));
+    return FALSE;
+  }
+
+  tbuf = tape_uef_load (file, error);
+
+  fclose (file);
+
+  if (tbuf == NULL)
+    return FALSE;
+
+  electron_set_tape_buffer (electron, tbuf);
+
+  return TRUE;
+}
+
+/* Creates an Electron with everything given on the command line */
+static Electron *
+lockstep_make_electron (GError **error)
+{
+  Electron *electron = electron_new ();
+
+  if (!lockstep_load_rom (electron, -1, option_os_rom, error)
+      || (option_basic_rom
+          && !lockstep_load_rom (electron, ELECTRON_BASIC_PAGE,
+                                 option_basic_rom, error))
+      || (option_tape && !lockstep_load_tape (electron, option_tape, error)))
+  {
+    electron_free (electron);
+    return NULL;
+  }
+
+  electron_restart (electron);
+
+  if (option_type)
+    electron_type_string (electron, option_type);
+
+  return electron;
+}
+
+/* Routes the accesses that don't go straight to memory through the
+   logging functions */
+static void
+lockstep_start_logging (LockstepMachine *machine)
+{
+  Cpu *cpu = &machine->electron->cpu;
+
+  machine->read_func = cpu->read_func;
+  machine->write_func = cpu->write_func;
+  machine->memory_data = cpu->memory_data;
+  machine->writes = g_array_new (FALSE, FALSE, sizeof (LockstepWrite));
+
+  cpu->read_func = lockstep_read_func;
+  cpu->write_func = lockstep_write_func;
+  cpu->memory_data = machine;
+}
+
+static void
+lockstep_print_registers (GString *out, const LockstepMachine *machine)
+{
+  Cpu *cpu = &machine->electron->cpu;
+
+  g_string_append_printf (out,
+                          "  %-10s A=%02X X=%02X Y=%02X P=%02X S=%02X "
+                          "PC=%04X time=%" G_GUINT64_FORMAT "\n",
+                          machine->name, cpu->a, cpu->x, cpu->y,
+                          cpu_get_p (cpu), cpu->s, cpu->pc, cpu->time);
+}
+
+static void
+lockstep_print_writes (GString *out, const LockstepMachine *machine)
+{
+  guint i;
+
+  g_string_append_printf (out, "  %-10s", machine->name);
+
+  for (i = 0; i < machine->writes->len; i++)
+  {
+    const LockstepWrite *write = &g_array_index (machine->writes,
+                                                 LockstepWrite, i);
+    g_string_append_printf (out, " &%04X=&%02X", write->address, write->value);
+  }
+
+  g_string_append_c (out, '\n');
+}
+
+/* Compares the two machines and appends a description of any
+   differences to out. Returns TRUE if they are the same */
+static gboolean
+lockstep_compare (const LockstepMachine *a, const LockstepMachine *b,
+                  GString *out)
+{
+  Electron *ea = a->electron, *eb = b->electron;
+  gboolean same = TRUE;
+  int i, n_bytes = 0;
+
+  if (ea->cpu.a != eb->cpu.a
+      || ea->cpu.x != eb->cpu.x
+      || ea->cpu.y != eb->cpu.y
+      || cpu_get_p (&ea->cpu) != cpu_get_p (&eb->cpu)
+      || ea->cpu.s != eb->cpu.s
+      || ea->cpu.pc != eb->cpu.pc
+      || ea->cpu.time != eb->cpu.time)
+  {
+    g_string_append (out, "Registers:\n");
+    lockstep_print_registers (out, a);
+    lockstep_print_registers (out, b);
+    same = FALSE;
+  }
+
+  if (a->writes->len != b->writes->len
+      || memcmp (a->writes->data, b->writes->data,
+                 a->writes->len * sizeof (LockstepWrite)))
+  {
+    g_string_append (out, "Writes to the hardware and ROM:\n");
+    lockstep_print_writes (out, a);
+    lockstep_print_writes (out, b);
+    same = FALSE;
+  }
+
+  if (memcmp (ea->memory, eb->memory, CPU_RAM_SIZE))
+  {
+    g_string_append (out, "RAM:\n");
+
+    for (i = 0; i < CPU_RAM_SIZE; i++)
+      if (ea->memory[i] != eb->memory[i])
+      {
+        if (n_bytes++ >= LOCKSTEP_MAX_REPORTED_BYTES)
+        {
+          g_string_append (out, "  ...\n");
+          break;
+        }
+        g_string_append_printf (out, "  &%04X: &%02X &%02X\n",
+                                i, ea->memory[i], eb->memory[i]);
+      }
+
+    same = FALSE;
+  }
+
+  if (memcmp (ea->sheila, eb->sheila, sizeof (ea->sheila))
+      || ea->ienabled != eb->ienabled
+      || ea->page != eb->page)
+  {
+    g_string_append (out, "Hardware state:\n");
+    g_string_append_printf (out, "  %-10s", a->name);
+    for (i = 0; i < G_N_ELEMENTS (ea->sheila); i++)
+      g_string_append_printf (out, " %02X", ea->sheila[i]);
+    g_string_append_printf (out, " ienabled=%02X page=%i\n",
+                            ea->ienabled, ea->page);
+    g_string_append_printf (out, "  %-10s", b->name);
+    for (i = 0; i < G_N_ELEMENTS (eb->sheila); i++)
+      g_string_append_printf (out, " %02X", eb->sheila[i]);
+    g_string_append_printf (out, " ienabled=%02X page=%i\n",
+                            eb->ienabled, eb->page);
+    same = FALSE;
+  }
+
+  return same;
+}
+
+/* Reads an instruction byte without touching the memory mapped
+   hardware */
+static guint8
+lockstep_read_code (Electron *electron, guint16 address)
+{
+  const guint8 *page;
+
+  if (address < CPU_RAM_SIZE)
+    return electron->memory[address];
+  else if ((page = electron->cpu.read_pages[address / CPU_PAGE_SIZE]))
+    return page[address % CPU_PAGE_SIZE];
+  else
+    return 0;
+}
+
+static void
+lockstep_print_instruction (GString *out, guint16 pc, const guint8 *bytes)
+{
+  char mnemonic[DISASSEMBLE_MAX_MNEMONIC + 1];
+  char operands[DISASSEMBLE_MAX_OPERANDS + 1];
+
+  disassemble_instruction (pc, bytes, mnemonic, operands);
+
+  g_string_append_printf (out, "%04X %s %s", pc, mnemonic, operands);
+}
+
+static gboolean
+lockstep_run (LockstepMachine *a, LockstepMachine *b)
+{
+  Electron *ea = a->electron, *eb = b->electron;
+  guint64 n_steps = 0;
+  int frames = 0, i;
+  cycles_t frame_start = ea->frame_start;
+  GString *out = g_string_new (NULL);
+  gboolean ret = TRUE;
+
+  while (frames < option_frames)
+  {
+    guint16 pc = ea->cpu.pc;
+    cycles_t time = ea->cpu.time;
+    guint8 bytes[DISASSEMBLE_MAX_BYTES];
+
+    /* Remember the instruction in case it overwrites itself */
+    for (i = 0; i < DISASSEMBLE_MAX_BYTES; i++)
+      bytes[i] = lockstep_read_code (ea, pc + i);
+
+    g_array_set_size (a->writes, 0);
+    g_array_set_size (b->writes, 0);
+
+    if (option_block_cycles > 0)
+    {
+      electron_run_until (ea, ea->cpu.time + option_block_cycles);
+      electron_run_until (eb, eb->cpu.time + option_block_cycles);
+    }
+    else
+    {
+      electron_step (ea);
+      electron_step (eb);
+    }
+
+    n_steps++;
+
+    if (!lockstep_compare (a, b, out))
+    {
+      GString *header = g_string_new (NULL);
+
+      g_string_printf (header, "The engines diverged after %" G_GUINT64_FORMAT
+                       " steps.\nThe last %s started at cycle %"
+                       G_GUINT64_FORMAT " with ", n_steps,
+                       option_block_cycles > 0 ? "block" : "instruction",
+                       time);
+      lockstep_print_instruction (header, pc, bytes);
+      g_string_append_c (header, '\n');
+
+      fputs (header->str, stdout);
+      fputs (out->str, stdout);
+      g_string_free (header, TRUE);
+      ret = FALSE;
+      break;
+    }
+
+    if (ea->frame_start != frame_start)
+    {
+      frame_start = ea->frame_start;
+      frames++;
+    }
+  }
+
+  if (ret)
+    printf ("No differences after %" G_GUINT64_FORMAT " steps over %i frames\n",
+            n_steps, frames);
+
+  g_string_free (out, TRUE);
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  const LockstepEngine *reference, *engine;
+  LockstepMachine machines[2];
+  GError *error = NULL;
+  int ret = EXIT_SUCCESS;
+  int i;
+
+  if (!process_arguments (&argc, &argv, &error))
+  {
+    fprintf (stderr, "%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  if ((reference = lockstep_find_engine (option_reference)) == NULL
+      || (engine = lockstep_find_engine (option_engine)) == NULL)
+  {
+    fprintf (stderr, "Unknown engine. The engines are:");
+    for (i = 0; i < G_N_ELEMENTS (lockstep_engines); i++)
+      fprintf (stderr, " %s", lockstep_engines[i].name);
+    fputc ('\n', stderr);
+    return EXIT_FAILURE;
+  }
+
+  machines[0].name = reference->name;
+  machines[1].name = engine->name;
+  machines[0].electron = machines[1].electron = NULL;
+
+  for (i = 0; i < 2; i++)
+    if ((machines[i].electron = lockstep_make_electron (&error)) == NULL
+        || !lockstep_set_engine (machines + i, reference, &error))
+      goto error;
+
+  /* Get both machines to the interesting part on the reference
+     engine */
+  for (i = 0; i < option_skip_frames; i++)
+  {
+    electron_run_frame (machines[0].electron);
+    electron_run_frame (machines[1].electron);
+  }
+
+  if (!lockstep_set_engine (machines + 1, engine, &error))
+    goto error;
+
+  for (i = 0; i < 2; i++)
+    lockstep_start_logging (machines + i);
+
+  if (!lockstep_run (machines + 0, machines + 1))
+    ret = EXIT_FAILURE;
+
+  for (i = 0; i < 2; i++)
+  {
+    g_array_free (machines[i].writes, TRUE);
+    electron_free (machines[i].electron);
+  }
+
+  return ret;
+
+ error:
+  fprintf (stderr, "%s\n", error->message);
+  g_error_free (error);
+  for (i = 0; i < 2; i++)
+    if (machines[i].electron)
+      electron_free (machines[i].electron);
+
+  return EXIT_FAILURE;
+}
@@ -47,9 +47,19 @@
 #include "preferencesdialog.h"
 #include "tapeuef.h"
 #include "tokenizer.h"
+#include "profilereport.h"
+#include "cputrace.h"
 
 typedef struct _MainWindowAction MainWindowAction;
 
+/* The files that can be saved from the profiler */
+typedef enum
+{
+  MAIN_WINDOW_PROFILE_REPORT,
+  MAIN_WINDOW_PROFILE_CALL_STACKS,
+  MAIN_WINDOW_PROFILE_COVERAGE
+} MainWindowProfileFile;
+
 typedef enum
 {
   ACTION_NORMAL = 0, ACTION_TOGGLE, ACTION_RADIO
@@ -100,6 +110,22 @@ static void main_window_on_break (GtkAction *action, MainWindow *mainwin);
 static void main_window_on_reset (GtkAction *action, MainWindow *mainwin);
 static void main_window_on_edit_breakpoint (GtkAction *action, MainWindow *mainwin);
 static void main_window_on_disassembler (GtkAction *action, MainWindow *mainwin);
+static void main_window_on_toggle_profiler (GtkAction *action,
+                                            MainWindow *mainwin);
+static void main_window_on_clear_profile (GtkAction *action,
+                                          MainWindow *mainwin);
+static void main_window_on_save_profile (GtkAction *action,
+                                         MainWindow *mainwin);
+static void main_window_on_save_call_stacks (GtkAction *action,
+                                             MainWindow *mainwin);
+static void main_window_on_toggle_coverage (GtkAction *action,
+                                            MainWindow *mainwin);
+static void main_window_on_clear_coverage (GtkAction *action,
+                                           MainWindow *mainwin);
+static void main_window_on_save_coverage (GtkAction *action,
+                                          MainWindow *mainwin);
+static void main_window_on_toggle_trace (GtkAction *action,
+                                         MainWindow *mainwin);
 
 static void main_window_update_debug_actions (MainWindow *mainwin);
 static void main_window_on_rom_error (MainWindow *mainwin, GList *errors,
@@ -193,6 +219,34 @@ static const MainWindowAction main_window_actions[] =
     { "ActionDisassembler", NULL, N_("MenuDebug|_Disassembler..."), NULL,
       NULL, N_("Show the diassembler dialog"), ACTION_NORMAL,
       G_CALLBACK (main_window_on_disassembler) },
+    { "ActionToggleProfiler", NULL, N_("MenuDebug|_Profile instructions"),
+      NULL, NULL, N_("Count the instructions and cycles run at each address"),
+      ACTION_TOGGLE, G_CALLBACK (main_window_on_toggle_profiler) },
+    { "ActionClearProfile", NULL, N_("MenuDebug|_Clear profile"), NULL,
+      NULL, N_("Reset the profile counts to zero"), ACTION_NORMAL,
+      G_CALLBACK (main_window_on_clear_profile) },
+    { "ActionSaveProfile", NULL, N_("MenuDebug|Save profile re_port..."),
+      NULL, NULL, N_("Save the profile counts sorted by the number of "
+                     "cycles as text or CSV"), ACTION_NORMAL,
+      G_CALLBACK (main_window_on_save_profile) },
+    { "ActionSaveCallStacks", NULL, N_("MenuDebug|Save call _stacks..."),
+      NULL, NULL, N_("Save the cycles spent in each chain of subroutine "
+                     "calls as folded stacks for a flame graph"),
+      ACTION_NORMAL, G_CALLBACK (main_window_on_save_call_stacks) },
+    { "ActionToggleCoverage", NULL, N_("MenuDebug|Record co_verage"),
+      NULL, NULL, N_("Record which addresses are executed, read and "
+                     "written"), ACTION_TOGGLE,
+      G_CALLBACK (main_window_on_toggle_coverage) },
+    { "ActionClearCoverage", NULL, N_("MenuDebug|Clear covera_ge"), NULL,
+      NULL, N_("Forget the accesses recorded so far"), ACTION_NORMAL,
+      G_CALLBACK (main_window_on_clear_coverage) },
+    { "ActionSaveCoverage", NULL, N_("MenuDebug|Save coverage..."), NULL,
+      NULL, N_("Save the ranges of addresses that were accessed"),
+      ACTION_NORMAL, G_CALLBACK (main_window_on_save_coverage) },
+    { "ActionToggleTrace", NULL, N_("MenuDebug|_Trace to file..."), NULL,
+      NULL, N_("Record every instruction run in a file that can be "
+               "viewed with eek-trace"), ACTION_TOGGLE,
+      G_CALLBACK (main_window_on_toggle_trace) },
     { "ActionAbout", GTK_STOCK_ABOUT, N_("MenuHelp|_About"), NULL,
       NULL, N_("Display the about box"), ACTION_NORMAL,
       G_CALLBACK (main_window_on_about) }
@@ -235,6 +289,17 @@ static const char main_window_ui_definition[] =
 "   <separator />\n"
 "   <menuitem name=\"EditBreakpoint\" action=\"ActionEditBreakpoint\" />\n"
 "   <menuitem name=\"Disassembler\" action=\"ActionDisassembler\" />\n"
+"   <separator />\n"
+"   <menuitem name=\"ToggleProfiler\" action=\"ActionToggleProfiler\" />\n"
+"   <menuitem name=\"ClearProfile\" action=\"ActionClearProfile\" />\n"
+"   <menuitem name=\"SaveProfile\" action=\"ActionSaveProfile\" />\n"
+"   <menuitem name=\"SaveCallStacks\" action=\"ActionSaveCallStacks\" />\n"
+"   <separator />\n"
+"   <menuitem name=\"ToggleCoverage\" action=\"ActionToggleCoverage\" />\n"
+"   <menuitem name=\"ClearCoverage\" action=\"ActionClearCoverage\" />\n"
+"   <menuitem name=\"SaveCoverage\" action=\"ActionSaveCoverage\" />\n"
+"   <separator />\n"
+"   <menuitem name=\"ToggleTrace\" action=\"ActionToggleTrace\" />\n"
 "  </menu>\n"
 "  <menu name=\"HelpMenu\" action=\"ActionHelpMenu\">\n"
 "   <menuitem name=\"About\" action=\"ActionAbout\" />\n"
@@ -1036,6 +1101,238 @@ main_window_on_disassembler (GtkAction *action, MainWindow *mainwin)
   gtk_window_present (GTK_WINDOW (mainwin->disdialog));
 }
 
+static void
+main_window_on_toggle_profiler (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  if (mainwin->electron)
+  {
+    gboolean active
+      = gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (action));
+    cpu_set_profiling (&mainwin->electron->data->cpu, active);
+  }
+
+  main_window_update_debug_actions (mainwin);
+}
+
+static void
+main_window_on_clear_profile (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  if (mainwin->electron)
+    cpu_clear_profile (&mainwin->electron->data->cpu);
+}
+
+static void
+main_window_on_toggle_coverage (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  if (mainwin->electron)
+  {
+    gboolean active
+      = gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (action));
+    cpu_set_coverage (&mainwin->electron->data->cpu, active);
+  }
+
+  main_window_update_debug_actions (mainwin);
+}
+
+static void
+main_window_on_clear_coverage (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  if (mainwin->electron)
+    cpu_clear_coverage (&mainwin->electron->data->cpu);
+}
+
+static void
+main_window_save_profile (MainWindow *mainwin, const gchar *filename,
+                          MainWindowProfileFile type)
+{
+  GError *error = NULL;
+  FILE *file;
+
+  if ((file = fopen (filename, "w")) == NULL)
+    g_set_error (&error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+  else
+  {
+    switch (type)
+    {
+      case MAIN_WINDOW_PROFILE_REPORT:
+        /* The format is picked from the extension */
+        profile_report_write (mainwin->electron->data,
+                              g_str_has_suffix (filename, ".csv")
+                              ? PROFILE_REPORT_CSV : PROFILE_REPORT_TEXT,
+                              file, &error);
+        break;
+      case MAIN_WINDOW_PROFILE_CALL_STACKS:
+        profile_report_write_folded (mainwin->electron->data, file, &error);
+        break;
+      case MAIN_WINDOW_PROFILE_COVERAGE:
+        profile_report_write_coverage (mainwin->electron->data, file, &error);
+        break;
+    }
+    fclose (file);
+  }
+
+  if (error)
+  {
+    gchar *display_name = g_filename_display_name (filename);
+    GtkWidget *dialog
+      = gtk_message_dialog_new (GTK_WINDOW (mainwin),
+                                GTK_DIALOG_DESTROY_WITH_PARENT,
+                                GTK_MESSAGE_ERROR,
+                                GTK_BUTTONS_CLOSE,
+                                "Error saving \"%s\": %s",
+                                display_name,
+                                error->message);
+    g_signal_connect_swapped (dialog, "response",
+                              G_CALLBACK (gtk_widget_destroy),
+                              dialog);
+    gtk_widget_show (dialog);
+    g_free (display_name);
+    g_error_free (error);
+  }
+}
+
+static void
+main_window_run_profile_dialog (MainWindow *mainwin, const gchar *title,
+                                const gchar *default_name,
+                                MainWindowProfileFile type)
+{
+  GtkWidget *dialog;
+  Cpu *cpu;
+
+  if (mainwin->electron == NULL)
+    return;
+
+  cpu = &mainwin->electron->data->cpu;
+  if (type == MAIN_WINDOW_PROFILE_COVERAGE
+      ? cpu_get_coverage (cpu) == NULL
+      : cpu_get_profile (cpu) == NULL)
+    return;
+
+  dialog = gtk_file_chooser_dialog_new (title,
+                                        GTK_WINDOW (mainwin),
+                                        GTK_FILE_CHOOSER_ACTION_SAVE,
+                                        GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                        NULL);
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog),
+                                                  TRUE);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog),
+                                     default_name);
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT)
+  {
+    gchar *filename
+      = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+    main_window_save_profile (mainwin, filename, type);
+    g_free (filename);
+  }
+
+  gtk_widget_destroy (dialog);
+}
+
+static void
+main_window_on_save_profile (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  main_window_run_profile_dialog (mainwin, _("Save profile report"),
+                                  "profile.txt", MAIN_WINDOW_PROFILE_REPORT);
+}
+
+static void
+main_window_on_save_call_stacks (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  main_window_run_profile_dialog (mainwin, _("Save call stacks"),
+                                  "profile.folded",
+                                  MAIN_WINDOW_PROFILE_CALL_STACKS);
+}
+
+static void
+main_window_on_save_coverage (GtkAction *action, MainWindow *mainwin)
+{
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  main_window_run_profile_dialog (mainwin, _("Save coverage"),
+                                  "coverage.txt",
+                                  MAIN_WINDOW_PROFILE_COVERAGE);
+}
+
+static void
+main_window_on_toggle_trace (GtkAction *action, MainWindow *mainwin)
+{
+  GtkWidget *dialog;
+  GError *error = NULL;
+  Cpu *cpu;
+
+  g_return_if_fail (IS_MAIN_WINDOW (mainwin));
+
+  if (mainwin->electron == NULL)
+    return;
+
+  cpu = &mainwin->electron->data->cpu;
+
+  if (!gtk_toggle_action_get_active (GTK_TOGGLE_ACTION (action)))
+  {
+    cpu_stop_trace (cpu);
+    return;
+  }
+
+  dialog = gtk_file_chooser_dialog_new (_("Trace to file"),
+                                        GTK_WINDOW (mainwin),
+                                        GTK_FILE_CHOOSER_ACTION_SAVE,
+                                        GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                        GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                        NULL);
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER (dialog),
+                                                  TRUE);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER (dialog),
+                                     "eek.trace");
+
+  if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_ACCEPT)
+  {
+    gchar *filename
+      = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
+
+    if (!cpu_start_trace (cpu, filename, CPU_TRACE_DEFAULT_RECORDS, &error))
+    {
+      gchar *display_name = g_filename_display_name (filename);
+      GtkWidget *error_dialog
+        = gtk_message_dialog_new (GTK_WINDOW (mainwin),
+                                  GTK_DIALOG_DESTROY_WITH_PARENT,
+                                  GTK_MESSAGE_ERROR,
+                                  GTK_BUTTONS_CLOSE,
+                                  "Error opening \"%s\": %s",
+                                  display_name,
+                                  error->message);
+      g_signal_connect_swapped (error_dialog, "response",
+                                G_CALLBACK (gtk_widget_destroy),
+                                error_dialog);
+      gtk_widget_show (error_dialog);
+      g_free (display_name);
+      g_error_free (error);
+    }
+
+    g_free (filename);
+  }
+
+  gtk_widget_destroy (dialog);
+
+  /* Untick the menu item again if the trace didn't start */
+  if (cpu->trace == NULL)
+    gtk_toggle_action_set_active (GTK_TOGGLE_ACTION (action), FALSE);
+}
+
 static void
 main_window_forget_dis_dialog (MainWindow *mainwin)
 {
@@ -1056,7 +1353,7 @@ main_window_update_debug_actions (MainWindow *mainwin)
 
   if (mainwin->action_group)
   {
-    gboolean is_running = FALSE;
+    gboolean is_running = FALSE, is_profiling, is_recording_coverage;
 
     if (mainwin->electron)
       is_running = electron_manager_is_running (mainwin->electron);
@@ -1067,6 +1364,28 @@ main_window_update_debug_actions (MainWindow *mainwin)
       gtk_action_set_sensitive (action, mainwin->electron ? is_running : FALSE);
     if ((action = gtk_action_group_get_action (mainwin->action_group, "ActionStep")))
       gtk_action_set_sensitive (action, mainwin->electron ? !is_running : FALSE);
+
+    /* The profile can only be cleared or saved while it is enabled */
+    is_profiling = (mainwin->electron
+                    && cpu_get_profile (&mainwin->electron->data->cpu));
+    if ((action = gtk_action_group_get_action (mainwin->action_group,
+                                               "ActionClearProfile")))
+      gtk_action_set_sensitive (action, is_profiling);
+    if ((action = gtk_action_group_get_action (mainwin->action_group,
+                                               "ActionSaveProfile")))
+      gtk_action_set_sensitive (action, is_profiling);
+    if ((action = gtk_action_group_get_action (mainwin->action_group,
+                                               "ActionSaveCallStacks")))
+      gtk_action_set_sensitive (action, is_profiling);
+
+    is_recording_coverage = (mainwin->electron
+                             && cpu_get_coverage (&mainwin->electron->data->cpu));
+    if ((action = gtk_action_group_get_action (mainwin->action_group,
+                                               "ActionClearCoverage")))
+      gtk_action_set_sensitive (action, is_recording_coverage);
+    if ((action = gtk_action_group_get_action (mainwin->action_group,
+                                               "ActionSaveCoverage")))
+      gtk_action_set_sensitive (action, is_recording_coverage);
   }
 }
 
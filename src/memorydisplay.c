@@ -65,6 +65,17 @@ static gpointer parent_class;
 
 #define MEMORY_DISPLAY_MEM_SIZE 65536
 
+/* Background colours used in the hex display to show how each byte
+   has been accessed when the cpu is recording the coverage. Executed
+   code takes priority over written data and written data takes
+   priority over data that has only been read */
+static const GdkColor memory_display_coverage_execute_color
+  = { 0, 0xc0c0, 0xf0f0, 0xc0c0 };
+static const GdkColor memory_display_coverage_write_color
+  = { 0, 0xf8f8, 0xc8c8, 0xc8c8 };
+static const GdkColor memory_display_coverage_read_color
+  = { 0, 0xc8c8, 0xd8d8, 0xf8f8 };
+
 enum {
   MOVE_CURSOR,
   LAST_SIGNAL
@@ -397,10 +408,15 @@ memory_display_expose (GtkWidget *widget, GdkEventExpose *event)
     char hexbuf[5];
     PangoLayout *layout;
     PangoRectangle logical_rect;
-    GdkGC *back_gc, *text_gc;
+    GdkGC *back_gc, *text_gc, *coverage_gc = NULL;
+    const guint8 *coverage
+      = cpu_get_coverage (&memdisplay->electron->data->cpu);
 
     hexbuf[2] = ' ';
 
+    if (coverage && memdisplay->disp_type == MEMORY_DISPLAY_HEX)
+      coverage_gc = gdk_gc_new (widget->window);
+
     layout = gtk_widget_create_pango_layout (GTK_WIDGET (memdisplay), NULL);
 
     /* Calculate the range of rows that are covered by the exposed area */
@@ -558,8 +574,32 @@ memory_display_expose (GtkWidget *widget, GdkEventExpose *event)
                                   logical_rect.height / PANGO_SCALE);
             }
             else
+            {
               text_gc = widget->style->text_gc[widget->state];
 
+              if (coverage_gc && coverage[pos])
+              {
+                const GdkColor *color;
+
+                if ((coverage[pos] & CPU_COVERAGE_EXECUTE))
+                  color = &memory_display_coverage_execute_color;
+                else if ((coverage[pos] & CPU_COVERAGE_WRITE))
+                  color = &memory_display_coverage_write_color;
+                else
+                  color = &memory_display_coverage_read_color;
+
+                pango_layout_set_text (layout, hexbuf, 2);
+                pango_layout_get_extents (layout, NULL, &logical_rect);
+
+                gdk_gc_set_rgb_fg_color (coverage_gc, color);
+                gdk_draw_rectangle (widget->window, coverage_gc, TRUE,
+                                    xp + logical_rect.x / PANGO_SCALE,
+                                    yp + logical_rect.y / PANGO_SCALE,
+                                    logical_rect.width / PANGO_SCALE,
+                                    logical_rect.height / PANGO_SCALE);
+              }
+            }
+
             pango_layout_set_text (layout, hexbuf, 3);
             pango_layout_get_extents (layout, NULL, &logical_rect);
 
@@ -572,6 +612,9 @@ memory_display_expose (GtkWidget *widget, GdkEventExpose *event)
     }
 
     g_object_unref (layout);
+
+    if (coverage_gc)
+      g_object_unref (coverage_gc);
   }
 
   return FALSE;
@@ -0,0 +1,431 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "profilereport.h"
+#include "electron.h"
+#include "disassemble.h"
+
+/* Used to sort the addresses and opcodes. Anything that took more
+   cycles comes first */
+static const guint64 *profile_report_sort_cycles;
+
+static int
+profile_report_compare (const void *a, const void *b)
+{
+  guint32 index_a = *(const guint32 *) a;
+  guint32 index_b = *(const guint32 *) b;
+  guint64 cycles_a = profile_report_sort_cycles[index_a];
+  guint64 cycles_b = profile_report_sort_cycles[index_b];
+
+  if (cycles_a != cycles_b)
+    return cycles_a > cycles_b ? -1 : 1;
+  else
+    return index_a < index_b ? -1 : index_a > index_b ? 1 : 0;
+}
+
+/* Fills in indices with every index that has a count and sorts them
+   so that the most expensive come first. Returns the number of
+   indices */
+static guint32
+profile_report_sort (guint32 *indices, const guint64 *instructions,
+                     const guint64 *cycles, guint32 n_counts)
+{
+  guint32 i, n_indices = 0;
+
+  for (i = 0; i < n_counts; i++)
+    if (instructions[i])
+      indices[n_indices++] = i;
+
+  profile_report_sort_cycles = cycles;
+  qsort (indices, n_indices, sizeof (guint32), profile_report_compare);
+
+  return n_indices;
+}
+
+static double
+profile_report_percent (guint64 cycles, guint64 total_cycles)
+{
+  return total_cycles ? cycles * 100.0 / total_cycles : 0.0;
+}
+
+/* Writes the instruction at an address into text as the mnemonic
+   followed by the operands */
+static void
+profile_report_disassemble (Electron *electron, guint16 address,
+                            char *text)
+{
+  guint8 bytes[DISASSEMBLE_MAX_BYTES];
+  char mnemonic[DISASSEMBLE_MAX_MNEMONIC + 1];
+  char operands[DISASSEMBLE_MAX_OPERANDS + 1];
+  int i;
+
+  for (i = 0; i < DISASSEMBLE_MAX_BYTES; i++)
+    bytes[i] = electron_read_from_location (electron, address + i);
+
+  disassemble_instruction (address, bytes, mnemonic, operands);
+
+  if (operands[0])
+    sprintf (text, "%s %s", mnemonic, operands);
+  else
+    strcpy (text, mnemonic);
+}
+
+/* Writes the name of a routine in the call graph to text. This
+   never contains spaces or semicolons so that it can be used in the
+   folded stacks */
+static void
+profile_report_routine_name (const CpuProfileNode *node, char *text)
+{
+  switch (node->call)
+  {
+    case CPU_PROFILE_CALL_ROOT:
+      strcpy (text, "root");
+      break;
+    case CPU_PROFILE_CALL_JSR:
+      sprintf (text, "%04X", node->address);
+      break;
+    case CPU_PROFILE_CALL_BRK:
+      strcpy (text, "BRK");
+      break;
+    case CPU_PROFILE_CALL_IRQ:
+      strcpy (text, "IRQ");
+      break;
+    case CPU_PROFILE_CALL_NMI:
+      strcpy (text, "NMI");
+      break;
+  }
+}
+
+/* The totals for all of the nodes in the call graph that call the
+   same routine */
+typedef struct
+{
+  const CpuProfileNode *node;
+  guint64 calls, inclusive_cycles, exclusive_cycles;
+} ProfileReportRoutine;
+
+static int
+profile_report_compare_routines (const void *a, const void *b)
+{
+  const ProfileReportRoutine *routine_a = a, *routine_b = b;
+
+  if (routine_a->inclusive_cycles != routine_b->inclusive_cycles)
+    return routine_a->inclusive_cycles > routine_b->inclusive_cycles ? -1 : 1;
+  else if (routine_a->node->call != routine_b->node->call)
+    return routine_a->node->call < routine_b->node->call ? -1 : 1;
+  else
+    return (routine_a->node->address < routine_b->node->address ? -1
+            : routine_a->node->address > routine_b->node->address ? 1 : 0);
+}
+
+/* Lists each routine in the call graph with the cycles spent in it
+   including and excluding the routines it called. When a routine is
+   called recursively only the outermost call is included so that
+   the cycles aren't counted twice */
+static void
+profile_report_write_routines (const CpuProfile *profile,
+                               ProfileReportFormat format,
+                               guint64 total_cycles, FILE *out)
+{
+  const CpuProfileNode *nodes = (const CpuProfileNode *) profile->nodes->data;
+  guint n_nodes = profile->nodes->len, i;
+  guint64 *inclusive_cycles = g_new (guint64, n_nodes);
+  GHashTable *routine_table = g_hash_table_new (g_direct_hash,
+                                                g_direct_equal);
+  ProfileReportRoutine *routines = g_new0 (ProfileReportRoutine, n_nodes);
+  guint n_routines = 0;
+  char text[16];
+
+  /* The children are always after their parents so working backwards
+     adds each subtree before its parent is reached */
+  for (i = 0; i < n_nodes; i++)
+    inclusive_cycles[i] = nodes[i].cycles;
+  for (i = n_nodes - 1; i > 0; i--)
+    inclusive_cycles[nodes[i].parent] += inclusive_cycles[i];
+
+  for (i = 1; i < n_nodes; i++)
+  {
+    gpointer key = GUINT_TO_POINTER ((nodes[i].call << 16)
+                                     | nodes[i].address);
+    ProfileReportRoutine *routine = g_hash_table_lookup (routine_table, key);
+    guint ancestor;
+
+    if (routine == NULL)
+    {
+      routine = routines + n_routines++;
+      routine->node = nodes + i;
+      g_hash_table_insert (routine_table, key, routine);
+    }
+
+    routine->calls += nodes[i].calls;
+    routine->exclusive_cycles += nodes[i].cycles;
+
+    for (ancestor = nodes[i].parent;
+         ancestor != G_MAXUINT;
+         ancestor = nodes[ancestor].parent)
+      if (nodes[ancestor].call == nodes[i].call
+          && nodes[ancestor].address == nodes[i].address)
+        break;
+
+    if (ancestor == G_MAXUINT)
+      routine->inclusive_cycles += inclusive_cycles[i];
+  }
+
+  qsort (routines, n_routines, sizeof (ProfileReportRoutine),
+         profile_report_compare_routines);
+
+  if (format == PROFILE_REPORT_CSV)
+    fputs ("\nroutine,calls,inclusive,exclusive,percent\n", out);
+  else
+    fputs ("\n"
+           "Routine                Calls     Inclusive cycles"
+           "     Exclusive cycles  Cycles %\n", out);
+
+  for (i = 0; i < n_routines; i++)
+  {
+    profile_report_routine_name (routines[i].node, text);
+
+    fprintf (out,
+             format == PROFILE_REPORT_CSV
+             ? "%s,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+             ",%" G_GUINT64_FORMAT ",%.2f\n"
+             : "%-4s    %16" G_GUINT64_FORMAT " %20" G_GUINT64_FORMAT
+             " %20" G_GUINT64_FORMAT "  %7.2f%%\n",
+             text, routines[i].calls, routines[i].inclusive_cycles,
+             routines[i].exclusive_cycles,
+             profile_report_percent (routines[i].inclusive_cycles,
+                                     total_cycles));
+  }
+
+  g_free (routines);
+  g_hash_table_destroy (routine_table);
+  g_free (inclusive_cycles);
+}
+
+/* Writes the counts from the cpu profile of the electron to out. The
+   addresses and then the opcodes are listed with the ones that took
+   the most cycles first, followed by the routines in the call
+   graph. The disassembly is taken from the memory as
+   it is now so it may not match what was run if the code has
+   changed. Returns FALSE and sets error if the report couldn't be
+   written */
+gboolean
+profile_report_write (Electron *electron, ProfileReportFormat format,
+                      FILE *out, GError **error)
+{
+  const CpuProfile *profile = cpu_get_profile (&electron->cpu);
+  char text[DISASSEMBLE_MAX_MNEMONIC + DISASSEMBLE_MAX_OPERANDS + 2];
+  guint64 total_instructions = 0, total_cycles = 0;
+  guint32 *indices, n_indices, i;
+
+  g_return_val_if_fail (profile != NULL, FALSE);
+
+  for (i = 0; i < CPU_ADDRESS_SIZE; i++)
+  {
+    total_instructions += profile->instructions[i];
+    total_cycles += profile->cycles[i];
+  }
+
+  indices = g_new (guint32, CPU_ADDRESS_SIZE);
+
+  n_indices = profile_report_sort (indices, profile->instructions,
+                                   profile->cycles, CPU_ADDRESS_SIZE);
+
+  if (format == PROFILE_REPORT_CSV)
+    fputs ("address,instructions,cycles,percent,disassembly\n", out);
+  else
+    fprintf (out,
+             "Total instructions: %" G_GUINT64_FORMAT "\n"
+             "Total cycles:       %" G_GUINT64_FORMAT "\n"
+             "\n"
+             "Address         Instructions               Cycles  "
+             "Cycles %%  Disassembly\n",
+             total_instructions, total_cycles);
+
+  for (i = 0; i < n_indices; i++)
+  {
+    guint16 address = indices[i];
+
+    profile_report_disassemble (electron, address, text);
+
+    fprintf (out,
+             format == PROFILE_REPORT_CSV
+             ? "%04X,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.2f,\"%s\"\n"
+             : "%04X    %20" G_GUINT64_FORMAT " %20" G_GUINT64_FORMAT
+             "  %7.2f%%  %s\n",
+             address, profile->instructions[address], profile->cycles[address],
+             profile_report_percent (profile->cycles[address], total_cycles),
+             text);
+  }
+
+  n_indices = profile_report_sort (indices, profile->opcode_instructions,
+                                   profile->opcode_cycles, 256);
+
+  if (format == PROFILE_REPORT_CSV)
+    fputs ("\nopcode,instructions,cycles,percent,mnemonic\n", out);
+  else
+    fputs ("\n"
+           "Opcode          Instructions               Cycles  "
+           "Cycles %  Mnemonic\n", out);
+
+  for (i = 0; i < n_indices; i++)
+  {
+    guint8 opcode = indices[i];
+    guint8 bytes[DISASSEMBLE_MAX_BYTES] = { opcode, 0, 0 };
+    char operands[DISASSEMBLE_MAX_OPERANDS + 1];
+
+    disassemble_instruction (0, bytes, text, operands);
+
+    fprintf (out,
+             format == PROFILE_REPORT_CSV
+             ? "%02X,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.2f,%s\n"
+             : "%02X      %20" G_GUINT64_FORMAT " %20" G_GUINT64_FORMAT
+             "  %7.2f%%  %s\n",
+             opcode, profile->opcode_instructions[opcode],
+             profile->opcode_cycles[opcode],
+             profile_report_percent (profile->opcode_cycles[opcode],
+                                     total_cycles),
+             text);
+  }
+
+  g_free (indices);
+
+  profile_report_write_routines (profile, format, total_cycles, out);
+
+  if (fflush (out) || ferror (out))
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Writes the call graph from the cpu profile of the electron as
+   folded stacks. Each line has the chain of calls from the root
+   separated by semicolons followed by the number of cycles spent in
+   the last one. This is the format read by the flame graph tools.
+   Returns FALSE and sets error if the stacks couldn't be written */
+gboolean
+profile_report_write_folded (Electron *electron, FILE *out, GError **error)
+{
+  const CpuProfile *profile = cpu_get_profile (&electron->cpu);
+  const CpuProfileNode *nodes;
+  GString *stack;
+  char text[16];
+  guint i, node;
+
+  g_return_val_if_fail (profile != NULL, FALSE);
+
+  nodes = (const CpuProfileNode *) profile->nodes->data;
+  stack = g_string_new (NULL);
+
+  for (i = 0; i < profile->nodes->len; i++)
+  {
+    if (nodes[i].cycles == 0)
+      continue;
+
+    /* Build the stack backwards from the node up to the root */
+    g_string_set_size (stack, 0);
+    for (node = i; node != G_MAXUINT; node = nodes[node].parent)
+    {
+      profile_report_routine_name (nodes + node, text);
+      if (stack->len > 0)
+        g_string_prepend_c (stack, ';');
+      g_string_prepend (stack, text);
+    }
+
+    fprintf (out, "%s %" G_GUINT64_FORMAT "\n", stack->str, nodes[i].cycles);
+  }
+
+  g_string_free (stack, TRUE);
+
+  if (fflush (out) || ferror (out))
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Writes the coverage map of the cpu to out as a list of the ranges
+   of addresses that were accessed in the same ways. Each range shows
+   X if it was executed, R if it was read and W if it was written.
+   Returns FALSE and sets error if the map couldn't be written */
+gboolean
+profile_report_write_coverage (Electron *electron, FILE *out, GError **error)
+{
+  const guint8 *coverage = cpu_get_coverage (&electron->cpu);
+  guint counts[3] = { 0, 0, 0 };
+  guint start, end, i;
+
+  g_return_val_if_fail (coverage != NULL, FALSE);
+
+  for (i = 0; i < CPU_ADDRESS_SIZE; i++)
+  {
+    if ((coverage[i] & CPU_COVERAGE_EXECUTE))
+      counts[0]++;
+    if ((coverage[i] & CPU_COVERAGE_READ))
+      counts[1]++;
+    if ((coverage[i] & CPU_COVERAGE_WRITE))
+      counts[2]++;
+  }
+
+  fprintf (out,
+           "Executed: %5u bytes\n"
+           "Read:     %5u bytes\n"
+           "Written:  %5u bytes\n"
+           "\n"
+           "Start  End   Access\n",
+           counts[0], counts[1], counts[2]);
+
+  for (start = 0; start < CPU_ADDRESS_SIZE; start = end)
+  {
+    for (end = start + 1;
+         end < CPU_ADDRESS_SIZE && coverage[end] == coverage[start];
+         end++);
+
+    if (coverage[start])
+      fprintf (out, "%04X   %04X  %c%c%c\n", start, end - 1,
+               (coverage[start] & CPU_COVERAGE_EXECUTE) ? 'X' : '-',
+               (coverage[start] & CPU_COVERAGE_READ) ? 'R' : '-',
+               (coverage[start] & CPU_COVERAGE_WRITE) ? 'W' : '-');
+  }
+
+  if (fflush (out) || ferror (out))
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+    return FALSE;
+  }
+
+  return TRUE;
+}
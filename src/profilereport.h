@@ -0,0 +1,41 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2010  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PROFILE_REPORT_H
+#define _PROFILE_REPORT_H
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "electron.h"
+
+typedef enum
+{
+  PROFILE_REPORT_TEXT,
+  PROFILE_REPORT_CSV
+} ProfileReportFormat;
+
+gboolean profile_report_write (Electron *electron,
+                               ProfileReportFormat format,
+                               FILE *out, GError **error);
+gboolean profile_report_write_folded (Electron *electron,
+                                      FILE *out, GError **error);
+gboolean profile_report_write_coverage (Electron *electron,
+                                        FILE *out, GError **error);
+
+#endif /* _PROFILE_REPORT_H */
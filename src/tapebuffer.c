@@ -216,6 +216,22 @@ tape_buffer_rewind (TapeBuffer *tbuf)
   tbuf->buf_pos = 0;
 }
 
+/* The position is an opaque index into the buffer that can be used
+   to go back to the same place with tape_buffer_set_position */
+int
+tape_buffer_get_position (TapeBuffer *tbuf)
+{
+  return tbuf->buf_pos;
+}
+
+void
+tape_buffer_set_position (TapeBuffer *tbuf, int pos)
+{
+  g_return_if_fail (pos >= 0 && pos <= tbuf->buf_length);
+
+  tbuf->buf_pos = pos;
+}
+
 gboolean
 tape_buffer_is_at_end (TapeBuffer *tbuf)
 {
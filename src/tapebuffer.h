@@ -47,6 +47,8 @@ void tape_buffer_store_repeated_high_tone (TapeBuffer *tbuf, int repeat_count);
 void tape_buffer_store_silence (TapeBuffer *tbuf);
 void tape_buffer_store_repeated_silence (TapeBuffer *tbuf, int repeat_count);
 void tape_buffer_rewind (TapeBuffer *tbuf);
+int tape_buffer_get_position (TapeBuffer *tbuf);
+void tape_buffer_set_position (TapeBuffer *tbuf, int pos);
 gboolean tape_buffer_is_at_end (TapeBuffer *tbuf);
 gboolean tape_buffer_is_dirty (TapeBuffer *tbuf);
 void tape_buffer_clear_dirty (TapeBuffer *tbuf);
@@ -0,0 +1,792 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "cpu.h"
+
+/* Runs every combination of operand, register and input flags
+   through each of the logic, compare, shift and increment
+   instructions on every core and checks the results against a simple
+   model of the 6502. The indexed addressing modes are also run with
+   index values that wrap around the zero page or cross a page so
+   that the address calculation and the extra cycle can be
+   checked. The combinations for each instruction on each core make
+   one job and the jobs are shared between a thread for each
+   processor */
+
+#define EXEC_ADDRESS 0x1000
+#define OPERAND_ADDRESS 0x80
+#define STACK_POINTER 0xf0
+/* The B and U flags don't really exist in the register */
+#define IGNORE_FLAGS (ALU_FLAG_B | ALU_FLAG_U)
+/* The number of failures to report for each job before giving up on
+   it */
+#define MAX_REPORTED_FAILURES 8
+
+#define ALU_FLAG_N 128
+#define ALU_FLAG_V 64
+#define ALU_FLAG_U 32
+#define ALU_FLAG_B 16
+#define ALU_FLAG_D 8
+#define ALU_FLAG_I 4
+#define ALU_FLAG_Z 2
+#define ALU_FLAG_C 1
+
+/* The values that aren't swept through for a particular instruction
+   are set to these so that it can be checked that they aren't
+   changed */
+#define FIXED_A 0x5a
+#define FIXED_X 0xa7
+#define FIXED_Y 0x3c
+#define FIXED_OPERAND 0xc3
+
+typedef enum
+{
+  ALU_MODE_IMPLIED,
+  ALU_MODE_IMMEDIATE,
+  /* The rest of the modes read the operand from memory and write any
+     result back there */
+  ALU_MODE_ZERO_PAGE,
+  ALU_MODE_ZERO_INDEXED_X,
+  ALU_MODE_ABSOLUTE,
+  ALU_MODE_ABSOLUTE_INDEXED_X,
+  ALU_MODE_ABSOLUTE_INDEXED_Y,
+  ALU_MODE_PRE_INDEXED_X,
+  ALU_MODE_POST_INDEXED_Y
+} AluMode;
+
+typedef enum
+{
+  ALU_REG_NONE,
+  ALU_REG_A,
+  ALU_REG_X,
+  ALU_REG_Y
+} AluReg;
+
+typedef struct
+{
+  guint8 a, x, y, p;
+  /* The operand, or the memory location for the modes that use
+     memory */
+  guint8 m;
+} AluState;
+
+typedef void (* AluReferenceFunc) (AluState *state);
+
+typedef struct
+{
+  const char *name;
+  guint8 opcode;
+  AluMode mode;
+  /* The register that is swept through */
+  AluReg reg;
+  int cycles;
+  /* Whether the instruction takes an extra cycle when indexing
+     crosses a page. The read-modify-write instructions always take
+     the longer time */
+  gboolean page_cycle;
+  AluReferenceFunc reference;
+} AluTest;
+
+/* One way of reaching the operand with an addressing mode */
+typedef struct
+{
+  /* The bytes after the opcode */
+  guint16 operand;
+  /* The value of the index register */
+  guint8 index;
+  /* Where the instruction should find the operand. For the indirect
+     modes the pointer is set up to get here */
+  guint16 address;
+  /* Whether adding the index crosses a page */
+  gboolean page_crossed;
+} AluAddress;
+
+typedef struct
+{
+  /* The length of the instruction */
+  int length;
+  /* The register that is used as an index */
+  AluReg index_reg;
+  const AluAddress *addresses;
+  int n_addresses;
+} AluModeInfo;
+
+typedef struct
+{
+  const char *name;
+  CpuCore core;
+  gboolean debug;
+  /* Whether to record the coverage so that the instrumented variant
+     of the threaded core is used */
+  gboolean instrumented;
+} AluCore;
+
+static guint8
+read_func (void *data, guint16 address)
+{
+  return 0xff;
+}
+
+static void
+write_func (void *data, guint16 address, guint8 val)
+{
+}
+
+/* The reference model */
+
+static guint8
+alu_set_nz (AluState *state, guint8 value)
+{
+  state->p &= ~(ALU_FLAG_N | ALU_FLAG_Z);
+  if ((value & 0x80))
+    state->p |= ALU_FLAG_N;
+  if (value == 0)
+    state->p |= ALU_FLAG_Z;
+
+  return value;
+}
+
+static void
+alu_set_c (AluState *state, gboolean carry)
+{
+  if (carry)
+    state->p |= ALU_FLAG_C;
+  else
+    state->p &= ~ALU_FLAG_C;
+}
+
+static void
+alu_compare (AluState *state, guint8 reg)
+{
+  alu_set_nz (state, reg - state->m);
+  alu_set_c (state, reg >= state->m);
+}
+
+static void
+alu_cmp (AluState *state)
+{
+  alu_compare (state, state->a);
+}
+
+static void
+alu_cpx (AluState *state)
+{
+  alu_compare (state, state->x);
+}
+
+static void
+alu_cpy (AluState *state)
+{
+  alu_compare (state, state->y);
+}
+
+static void
+alu_bit (AluState *state)
+{
+  state->p &= ~(ALU_FLAG_N | ALU_FLAG_V | ALU_FLAG_Z);
+  state->p |= state->m & (ALU_FLAG_N | ALU_FLAG_V);
+  if ((state->a & state->m) == 0)
+    state->p |= ALU_FLAG_Z;
+}
+
+static void
+alu_and (AluState *state)
+{
+  state->a = alu_set_nz (state, state->a & state->m);
+}
+
+static void
+alu_ora (AluState *state)
+{
+  state->a = alu_set_nz (state, state->a | state->m);
+}
+
+static void
+alu_eor (AluState *state)
+{
+  state->a = alu_set_nz (state, state->a ^ state->m);
+}
+
+static guint8
+alu_shift (AluState *state, guint8 value, gboolean right, gboolean rotate)
+{
+  guint8 carry_in = (state->p & ALU_FLAG_C) && rotate;
+
+  if (right)
+  {
+    alu_set_c (state, value & 1);
+    return alu_set_nz (state, (value >> 1) | (carry_in << 7));
+  }
+  else
+  {
+    alu_set_c (state, value & 0x80);
+    return alu_set_nz (state, (value << 1) | carry_in);
+  }
+}
+
+static void
+alu_asl_a (AluState *state)
+{
+  state->a = alu_shift (state, state->a, FALSE, FALSE);
+}
+
+static void
+alu_lsr_a (AluState *state)
+{
+  state->a = alu_shift (state, state->a, TRUE, FALSE);
+}
+
+static void
+alu_rol_a (AluState *state)
+{
+  state->a = alu_shift (state, state->a, FALSE, TRUE);
+}
+
+static void
+alu_ror_a (AluState *state)
+{
+  state->a = alu_shift (state, state->a, TRUE, TRUE);
+}
+
+static void
+alu_asl (AluState *state)
+{
+  state->m = alu_shift (state, state->m, FALSE, FALSE);
+}
+
+static void
+alu_lsr (AluState *state)
+{
+  state->m = alu_shift (state, state->m, TRUE, FALSE);
+}
+
+static void
+alu_rol (AluState *state)
+{
+  state->m = alu_shift (state, state->m, FALSE, TRUE);
+}
+
+static void
+alu_ror (AluState *state)
+{
+  state->m = alu_shift (state, state->m, TRUE, TRUE);
+}
+
+static void
+alu_inc (AluState *state)
+{
+  state->m = alu_set_nz (state, state->m + 1);
+}
+
+static void
+alu_dec (AluState *state)
+{
+  state->m = alu_set_nz (state, state->m - 1);
+}
+
+static void
+alu_inx (AluState *state)
+{
+  state->x = alu_set_nz (state, state->x + 1);
+}
+
+static void
+alu_dex (AluState *state)
+{
+  state->x = alu_set_nz (state, state->x - 1);
+}
+
+static void
+alu_iny (AluState *state)
+{
+  state->y = alu_set_nz (state, state->y + 1);
+}
+
+static void
+alu_dey (AluState *state)
+{
+  state->y = alu_set_nz (state, state->y - 1);
+}
+
+static const AluAddress
+alu_no_address[] =
+  {
+    { 0, 0, 0, FALSE }
+  };
+
+static const AluAddress
+alu_zero_page_addresses[] =
+  {
+    { OPERAND_ADDRESS, 0, OPERAND_ADDRESS, FALSE }
+  };
+
+static const AluAddress
+alu_zero_indexed_addresses[] =
+  {
+    { OPERAND_ADDRESS - 0x10, 0x10, OPERAND_ADDRESS, FALSE },
+    /* Wraps around within the zero page */
+    { OPERAND_ADDRESS + 0x10, 0xf0, OPERAND_ADDRESS, FALSE }
+  };
+
+static const AluAddress
+alu_absolute_addresses[] =
+  {
+    { 0x20f8, 0, 0x20f8, FALSE }
+  };
+
+static const AluAddress
+alu_absolute_indexed_addresses[] =
+  {
+    { 0x20f0, 0x08, 0x20f8, FALSE },
+    { 0x20f0, 0x20, 0x2110, TRUE },
+    { 0x20f0, 0xff, 0x21ef, TRUE }
+  };
+
+static const AluAddress
+alu_pre_indexed_addresses[] =
+  {
+    { 0x70, 0x04, 0x20f8, FALSE },
+    /* The pointer is split between the end and the start of the zero
+       page */
+    { 0x70, 0x8f, 0x2110, FALSE }
+  };
+
+static const AluAddress
+alu_post_indexed_addresses[] =
+  {
+    { 0x74, 0x08, 0x20f8, FALSE },
+    { 0x74, 0x20, 0x2110, TRUE },
+    { 0x74, 0xff, 0x21ef, TRUE },
+    /* The pointer is split between the end and the start of the zero
+       page */
+    { 0xff, 0x08, 0x20f8, FALSE }
+  };
+
+#define ALU_ADDRESSES(a) (a), G_N_ELEMENTS (a)
+
+static const AluModeInfo
+alu_modes[] =
+  {
+    [ALU_MODE_IMPLIED] =
+    { 1, ALU_REG_NONE, ALU_ADDRESSES (alu_no_address) },
+    [ALU_MODE_IMMEDIATE] =
+    { 2, ALU_REG_NONE, ALU_ADDRESSES (alu_no_address) },
+    [ALU_MODE_ZERO_PAGE] =
+    { 2, ALU_REG_NONE, ALU_ADDRESSES (alu_zero_page_addresses) },
+    [ALU_MODE_ZERO_INDEXED_X] =
+    { 2, ALU_REG_X, ALU_ADDRESSES (alu_zero_indexed_addresses) },
+    [ALU_MODE_ABSOLUTE] =
+    { 3, ALU_REG_NONE, ALU_ADDRESSES (alu_absolute_addresses) },
+    [ALU_MODE_ABSOLUTE_INDEXED_X] =
+    { 3, ALU_REG_X, ALU_ADDRESSES (alu_absolute_indexed_addresses) },
+    [ALU_MODE_ABSOLUTE_INDEXED_Y] =
+    { 3, ALU_REG_Y, ALU_ADDRESSES (alu_absolute_indexed_addresses) },
+    [ALU_MODE_PRE_INDEXED_X] =
+    { 2, ALU_REG_X, ALU_ADDRESSES (alu_pre_indexed_addresses) },
+    [ALU_MODE_POST_INDEXED_Y] =
+    { 2, ALU_REG_Y, ALU_ADDRESSES (alu_post_indexed_addresses) }
+  };
+
+static const AluTest
+alu_tests[] =
+  {
+    { "CMP #", 0xc9, ALU_MODE_IMMEDIATE, ALU_REG_A, 2, FALSE, alu_cmp },
+    { "CMP zp", 0xc5, ALU_MODE_ZERO_PAGE, ALU_REG_A, 3, FALSE, alu_cmp },
+    { "CMP zp,X", 0xd5, ALU_MODE_ZERO_INDEXED_X, ALU_REG_A, 4, FALSE,
+      alu_cmp },
+    { "CMP abs", 0xcd, ALU_MODE_ABSOLUTE, ALU_REG_A, 4, FALSE, alu_cmp },
+    { "CMP abs,X", 0xdd, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_A, 4, TRUE,
+      alu_cmp },
+    { "CMP abs,Y", 0xd9, ALU_MODE_ABSOLUTE_INDEXED_Y, ALU_REG_A, 4, TRUE,
+      alu_cmp },
+    { "CMP (zp,X)", 0xc1, ALU_MODE_PRE_INDEXED_X, ALU_REG_A, 6, FALSE,
+      alu_cmp },
+    { "CMP (zp),Y", 0xd1, ALU_MODE_POST_INDEXED_Y, ALU_REG_A, 5, TRUE,
+      alu_cmp },
+    { "CPX #", 0xe0, ALU_MODE_IMMEDIATE, ALU_REG_X, 2, FALSE, alu_cpx },
+    { "CPX zp", 0xe4, ALU_MODE_ZERO_PAGE, ALU_REG_X, 3, FALSE, alu_cpx },
+    { "CPX abs", 0xec, ALU_MODE_ABSOLUTE, ALU_REG_X, 4, FALSE, alu_cpx },
+    { "CPY #", 0xc0, ALU_MODE_IMMEDIATE, ALU_REG_Y, 2, FALSE, alu_cpy },
+    { "CPY zp", 0xc4, ALU_MODE_ZERO_PAGE, ALU_REG_Y, 3, FALSE, alu_cpy },
+    { "CPY abs", 0xcc, ALU_MODE_ABSOLUTE, ALU_REG_Y, 4, FALSE, alu_cpy },
+    { "BIT zp", 0x24, ALU_MODE_ZERO_PAGE, ALU_REG_A, 3, FALSE, alu_bit },
+    { "BIT abs", 0x2c, ALU_MODE_ABSOLUTE, ALU_REG_A, 4, FALSE, alu_bit },
+    { "AND #", 0x29, ALU_MODE_IMMEDIATE, ALU_REG_A, 2, FALSE, alu_and },
+    { "AND zp", 0x25, ALU_MODE_ZERO_PAGE, ALU_REG_A, 3, FALSE, alu_and },
+    { "AND zp,X", 0x35, ALU_MODE_ZERO_INDEXED_X, ALU_REG_A, 4, FALSE,
+      alu_and },
+    { "AND abs", 0x2d, ALU_MODE_ABSOLUTE, ALU_REG_A, 4, FALSE, alu_and },
+    { "AND abs,X", 0x3d, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_A, 4, TRUE,
+      alu_and },
+    { "AND abs,Y", 0x39, ALU_MODE_ABSOLUTE_INDEXED_Y, ALU_REG_A, 4, TRUE,
+      alu_and },
+    { "AND (zp,X)", 0x21, ALU_MODE_PRE_INDEXED_X, ALU_REG_A, 6, FALSE,
+      alu_and },
+    { "AND (zp),Y", 0x31, ALU_MODE_POST_INDEXED_Y, ALU_REG_A, 5, TRUE,
+      alu_and },
+    { "ORA #", 0x09, ALU_MODE_IMMEDIATE, ALU_REG_A, 2, FALSE, alu_ora },
+    { "ORA zp", 0x05, ALU_MODE_ZERO_PAGE, ALU_REG_A, 3, FALSE, alu_ora },
+    { "ORA zp,X", 0x15, ALU_MODE_ZERO_INDEXED_X, ALU_REG_A, 4, FALSE,
+      alu_ora },
+    { "ORA abs", 0x0d, ALU_MODE_ABSOLUTE, ALU_REG_A, 4, FALSE, alu_ora },
+    { "ORA abs,X", 0x1d, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_A, 4, TRUE,
+      alu_ora },
+    { "ORA abs,Y", 0x19, ALU_MODE_ABSOLUTE_INDEXED_Y, ALU_REG_A, 4, TRUE,
+      alu_ora },
+    { "ORA (zp,X)", 0x01, ALU_MODE_PRE_INDEXED_X, ALU_REG_A, 6, FALSE,
+      alu_ora },
+    { "ORA (zp),Y", 0x11, ALU_MODE_POST_INDEXED_Y, ALU_REG_A, 5, TRUE,
+      alu_ora },
+    { "EOR #", 0x49, ALU_MODE_IMMEDIATE, ALU_REG_A, 2, FALSE, alu_eor },
+    { "EOR zp", 0x45, ALU_MODE_ZERO_PAGE, ALU_REG_A, 3, FALSE, alu_eor },
+    { "EOR zp,X", 0x55, ALU_MODE_ZERO_INDEXED_X, ALU_REG_A, 4, FALSE,
+      alu_eor },
+    { "EOR abs", 0x4d, ALU_MODE_ABSOLUTE, ALU_REG_A, 4, FALSE, alu_eor },
+    { "EOR abs,X", 0x5d, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_A, 4, TRUE,
+      alu_eor },
+    { "EOR abs,Y", 0x59, ALU_MODE_ABSOLUTE_INDEXED_Y, ALU_REG_A, 4, TRUE,
+      alu_eor },
+    { "EOR (zp,X)", 0x41, ALU_MODE_PRE_INDEXED_X, ALU_REG_A, 6, FALSE,
+      alu_eor },
+    { "EOR (zp),Y", 0x51, ALU_MODE_POST_INDEXED_Y, ALU_REG_A, 5, TRUE,
+      alu_eor },
+    { "ASL A", 0x0a, ALU_MODE_IMPLIED, ALU_REG_A, 2, FALSE, alu_asl_a },
+    { "LSR A", 0x4a, ALU_MODE_IMPLIED, ALU_REG_A, 2, FALSE, alu_lsr_a },
+    { "ROL A", 0x2a, ALU_MODE_IMPLIED, ALU_REG_A, 2, FALSE, alu_rol_a },
+    { "ROR A", 0x6a, ALU_MODE_IMPLIED, ALU_REG_A, 2, FALSE, alu_ror_a },
+    { "ASL zp", 0x06, ALU_MODE_ZERO_PAGE, ALU_REG_NONE, 5, FALSE, alu_asl },
+    { "ASL zp,X", 0x16, ALU_MODE_ZERO_INDEXED_X, ALU_REG_NONE, 6, FALSE,
+      alu_asl },
+    { "ASL abs", 0x0e, ALU_MODE_ABSOLUTE, ALU_REG_NONE, 6, FALSE, alu_asl },
+    { "ASL abs,X", 0x1e, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_NONE, 7, FALSE,
+      alu_asl },
+    { "LSR zp", 0x46, ALU_MODE_ZERO_PAGE, ALU_REG_NONE, 5, FALSE, alu_lsr },
+    { "LSR zp,X", 0x56, ALU_MODE_ZERO_INDEXED_X, ALU_REG_NONE, 6, FALSE,
+      alu_lsr },
+    { "LSR abs", 0x4e, ALU_MODE_ABSOLUTE, ALU_REG_NONE, 6, FALSE, alu_lsr },
+    { "LSR abs,X", 0x5e, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_NONE, 7, FALSE,
+      alu_lsr },
+    { "ROL zp", 0x26, ALU_MODE_ZERO_PAGE, ALU_REG_NONE, 5, FALSE, alu_rol },
+    { "ROL zp,X", 0x36, ALU_MODE_ZERO_INDEXED_X, ALU_REG_NONE, 6, FALSE,
+      alu_rol },
+    { "ROL abs", 0x2e, ALU_MODE_ABSOLUTE, ALU_REG_NONE, 6, FALSE, alu_rol },
+    { "ROL abs,X", 0x3e, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_NONE, 7, FALSE,
+      alu_rol },
+    { "ROR zp", 0x66, ALU_MODE_ZERO_PAGE, ALU_REG_NONE, 5, FALSE, alu_ror },
+    { "ROR zp,X", 0x76, ALU_MODE_ZERO_INDEXED_X, ALU_REG_NONE, 6, FALSE,
+      alu_ror },
+    { "ROR abs", 0x6e, ALU_MODE_ABSOLUTE, ALU_REG_NONE, 6, FALSE, alu_ror },
+    { "ROR abs,X", 0x7e, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_NONE, 7, FALSE,
+      alu_ror },
+    { "INC zp", 0xe6, ALU_MODE_ZERO_PAGE, ALU_REG_NONE, 5, FALSE, alu_inc },
+    { "INC zp,X", 0xf6, ALU_MODE_ZERO_INDEXED_X, ALU_REG_NONE, 6, FALSE,
+      alu_inc },
+    { "INC abs", 0xee, ALU_MODE_ABSOLUTE, ALU_REG_NONE, 6, FALSE, alu_inc },
+    { "INC abs,X", 0xfe, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_NONE, 7, FALSE,
+      alu_inc },
+    { "DEC zp", 0xc6, ALU_MODE_ZERO_PAGE, ALU_REG_NONE, 5, FALSE, alu_dec },
+    { "DEC zp,X", 0xd6, ALU_MODE_ZERO_INDEXED_X, ALU_REG_NONE, 6, FALSE,
+      alu_dec },
+    { "DEC abs", 0xce, ALU_MODE_ABSOLUTE, ALU_REG_NONE, 6, FALSE, alu_dec },
+    { "DEC abs,X", 0xde, ALU_MODE_ABSOLUTE_INDEXED_X, ALU_REG_NONE, 7, FALSE,
+      alu_dec },
+    { "INX", 0xe8, ALU_MODE_IMPLIED, ALU_REG_X, 2, FALSE, alu_inx },
+    { "DEX", 0xca, ALU_MODE_IMPLIED, ALU_REG_X, 2, FALSE, alu_dex },
+    { "INY", 0xc8, ALU_MODE_IMPLIED, ALU_REG_Y, 2, FALSE, alu_iny },
+    { "DEY", 0x88, ALU_MODE_IMPLIED, ALU_REG_Y, 2, FALSE, alu_dey }
+  };
+
+static const AluCore
+alu_cores[] =
+  {
+    { "jumpblock", CPU_CORE_JUMPBLOCK, TRUE, FALSE },
+    { "threaded", CPU_CORE_THREADED, TRUE, FALSE },
+    { "threaded-fast", CPU_CORE_THREADED, FALSE, FALSE },
+    { "instrumented", CPU_CORE_THREADED, TRUE, TRUE },
+    { "predecode", CPU_CORE_PREDECODE, TRUE, FALSE },
+    { "jit", CPU_CORE_JIT, TRUE, FALSE }
+  };
+
+/* The next job to run. The jobs are numbered through every test for
+   each core */
+static volatile gint next_job = 0;
+static volatile gint n_failed_jobs = 0;
+
+static void
+print_state (GString *buf, const AluState *state, gboolean has_memory)
+{
+  static const char flags[] = "CZIDBUVN";
+  int i;
+
+  g_string_append_printf (buf, "A=&%02X X=&%02X Y=&%02X ",
+                          state->a, state->x, state->y);
+  if (has_memory)
+    g_string_append_printf (buf, "M=&%02X ", state->m);
+
+  for (i = 7; i >= 0; i--)
+    if ((IGNORE_FLAGS & (1 << i)) == 0)
+      g_string_append_c (buf, (state->p & (1 << i)) ? flags[i] : '-');
+}
+
+static gboolean
+alu_mode_has_memory (AluMode mode)
+{
+  return mode != ALU_MODE_IMPLIED && mode != ALU_MODE_IMMEDIATE;
+}
+
+static void
+report_failure (const AluCore *core, const AluTest *test,
+                const AluAddress *address,
+                const AluState *before, const AluState *expected,
+                const AluState *got,
+                const char *problem)
+{
+  gboolean has_memory = alu_mode_has_memory (test->mode);
+  GString *buf = g_string_new (NULL);
+
+  g_string_append_printf (buf, "%s: %s", core->name, test->name);
+  if (test->mode == ALU_MODE_IMMEDIATE)
+    g_string_append_printf (buf, " &%02X", before->m);
+  else if (has_memory)
+    g_string_append_printf (buf, " &%02X at &%04X",
+                            address->operand, address->address);
+  g_string_append (buf, " with ");
+  print_state (buf, before, has_memory);
+  g_string_append_printf (buf, ": %s\n  got      ", problem);
+  print_state (buf, got, has_memory);
+  g_string_append (buf, "\n  expected ");
+  print_state (buf, expected, has_memory);
+  g_string_append_c (buf, '\n');
+
+  /* Write the report in one go so that the threads don't mix up the
+     lines */
+  fputs (buf->str, stderr);
+
+  g_string_free (buf, TRUE);
+}
+
+static gboolean
+run_test (Cpu *cpu, const AluCore *core, const AluTest *test,
+          const AluAddress *address, const AluState *before)
+{
+  AluState expected = *before, got;
+  gboolean has_memory = alu_mode_has_memory (test->mode);
+  int length = alu_modes[test->mode].length;
+  int cycles = test->cycles;
+  const char *problem = NULL;
+
+  if (test->page_cycle && address->page_crossed)
+    cycles++;
+
+  cpu->a = before->a;
+  cpu->x = before->x;
+  cpu->y = before->y;
+  cpu->s = STACK_POINTER;
+  cpu_set_p (cpu, before->p);
+  if (has_memory)
+    cpu->memory[address->address] = before->m;
+
+  cpu->time = 0;
+  cpu->pc = EXEC_ADDRESS;
+
+  /* Every instruction takes at least one cycle so this runs exactly
+     one */
+  cpu_fetch_execute (cpu, 1);
+
+  got.a = cpu->a;
+  got.x = cpu->x;
+  got.y = cpu->y;
+  got.p = cpu_get_p (cpu);
+  got.m = has_memory ? cpu->memory[address->address] : before->m;
+
+  test->reference (&expected);
+
+  if (got.a != expected.a
+      || got.x != expected.x
+      || got.y != expected.y
+      || got.m != expected.m
+      || ((got.p ^ expected.p) & ~IGNORE_FLAGS))
+    problem = "wrong result";
+  else if (cpu->s != STACK_POINTER)
+    problem = "stack pointer changed";
+  else if (cpu->pc != EXEC_ADDRESS + length)
+    problem = "wrong program counter";
+  else if (cpu->time != cycles)
+    problem = "wrong number of cycles";
+  else
+    return TRUE;
+
+  report_failure (core, test, address, before, &expected, &got, problem);
+
+  return FALSE;
+}
+
+/* Stores the instruction with the operand bytes for the address and
+   sets up the pointer for the indirect modes */
+static void
+set_up_address (Cpu *cpu, const AluTest *test, const AluAddress *address)
+{
+  guint8 *memory = cpu->memory;
+  guint16 pointer;
+
+  memory[EXEC_ADDRESS] = test->opcode;
+  memory[EXEC_ADDRESS + 1] = address->operand;
+  if (alu_modes[test->mode].length > 2)
+    memory[EXEC_ADDRESS + 2] = address->operand >> 8;
+
+  if (test->mode == ALU_MODE_PRE_INDEXED_X)
+  {
+    guint8 location = address->operand + address->index;
+    memory[location] = address->address;
+    memory[(guint8) (location + 1)] = address->address >> 8;
+  }
+  else if (test->mode == ALU_MODE_POST_INDEXED_Y)
+  {
+    pointer = address->address - address->index;
+    memory[address->operand] = pointer;
+    memory[(guint8) (address->operand + 1)] = pointer >> 8;
+  }
+
+  cpu_invalidate_code (cpu);
+}
+
+static gboolean
+run_job (const AluCore *core, const AluTest *test)
+{
+  guint8 *memory = g_malloc0 (CPU_RAM_SIZE);
+  const AluModeInfo *mode = alu_modes + test->mode;
+  int n_operands = test->mode == ALU_MODE_IMPLIED ? 1 : 256;
+  int n_values = test->reg == ALU_REG_NONE ? 1 : 256;
+  int length = mode->length;
+  int n_failures = 0;
+  int address_num, operand, value, flags;
+  Cpu cpu;
+
+  cpu_init (&cpu, memory, read_func, write_func, NULL);
+
+  if (!cpu_set_core (&cpu, core->core))
+  {
+    /* The core isn't available on this platform */
+    cpu_destroy (&cpu);
+    g_free (memory);
+    return TRUE;
+  }
+
+  cpu_set_debug (&cpu, core->debug);
+  cpu_set_coverage (&cpu, core->instrumented);
+
+  /* The instruction is followed by a jump back to itself so that
+     nothing else is run even if a core carries on to the end of the
+     block */
+  memory[EXEC_ADDRESS + length] = 0x4c;
+  memory[EXEC_ADDRESS + length + 1] = EXEC_ADDRESS & 0xff;
+  memory[EXEC_ADDRESS + length + 2] = EXEC_ADDRESS >> 8;
+
+  for (address_num = 0; address_num < mode->n_addresses; address_num++)
+  {
+    const AluAddress *address = mode->addresses + address_num;
+
+    set_up_address (&cpu, test, address);
+
+    for (operand = 0; operand < n_operands; operand++)
+    {
+      if (test->mode == ALU_MODE_IMMEDIATE)
+      {
+        memory[EXEC_ADDRESS + 1] = operand;
+        cpu_invalidate_code (&cpu);
+      }
+
+      for (value = 0; value < n_values; value++)
+        /* Try every combination of the N, V, D, I, Z and C flags */
+        for (flags = 0; flags < 64; flags++)
+        {
+          AluState before;
+
+          before.a = test->reg == ALU_REG_A ? value : FIXED_A;
+          before.x = test->reg == ALU_REG_X ? value : FIXED_X;
+          before.y = test->reg == ALU_REG_Y ? value : FIXED_Y;
+          before.p = (flags & 0x0f) | ((flags & 0x30) << 2);
+          before.m = n_operands > 1 ? operand : FIXED_OPERAND;
+
+          /* The index register is set to reach the address */
+          if (mode->index_reg == ALU_REG_X)
+            before.x = address->index;
+          else if (mode->index_reg == ALU_REG_Y)
+            before.y = address->index;
+
+          if (!run_test (&cpu, core, test, address, &before)
+              && ++n_failures >= MAX_REPORTED_FAILURES)
+          {
+            fprintf (stderr, "%s: %s: giving up after %i failures\n",
+                     core->name, test->name, n_failures);
+            goto done;
+          }
+        }
+    }
+  }
+
+ done:
+  cpu_destroy (&cpu);
+  g_free (memory);
+
+  return n_failures == 0;
+}
+
+static gpointer
+run_jobs (gpointer data)
+{
+  int n_jobs = G_N_ELEMENTS (alu_cores) * G_N_ELEMENTS (alu_tests);
+  int job;
+
+  while ((job = g_atomic_int_add (&next_job, 1)) < n_jobs)
+  {
+    const AluCore *core = alu_cores + job / G_N_ELEMENTS (alu_tests);
+    const AluTest *test = alu_tests + job % G_N_ELEMENTS (alu_tests);
+
+    if (!run_job (core, test))
+      g_atomic_int_inc (&n_failed_jobs);
+  }
+
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  int n_threads = g_get_num_processors ();
+  GThread **threads = g_new (GThread *, n_threads);
+  int i;
+
+  for (i = 0; i < n_threads; i++)
+    threads[i] = g_thread_new ("testalu", run_jobs, NULL);
+  for (i = 0; i < n_threads; i++)
+    g_thread_join (threads[i]);
+
+  g_free (threads);
+
+  return n_failed_jobs ? EXIT_FAILURE : EXIT_SUCCESS;
+}
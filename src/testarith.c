@@ -73,6 +73,7 @@ test_instruction (Cpu *cpu,
 
   cpu->memory[EXEC_ADDRESS + 2] = subtract ? 0xe9 : 0x69;
   cpu->memory[EXEC_ADDRESS + 3] = b;
+  cpu_invalidate_code (cpu);
 
   cpu->time = 0;
   cpu->a = a;
@@ -81,7 +82,7 @@ test_instruction (Cpu *cpu,
   cpu_fetch_execute (cpu, 5);
 
   if (cpu->a != real_values[0]
-      || (cpu->p & ~IGNORE_FLAGS) != (real_values[1] & ~IGNORE_FLAGS))
+      || (cpu_get_p (cpu) & ~IGNORE_FLAGS) != (real_values[1] & ~IGNORE_FLAGS))
   {
     fprintf (stderr,
              "%c%c A=&%02x : %s #&%02x -> &%02x ",
@@ -91,7 +92,7 @@ test_instruction (Cpu *cpu,
              subtract ? "SBC" : "ADC",
              b,
              cpu->a);
-    print_flags (stderr, cpu->p);
+    print_flags (stderr, cpu_get_p (cpu));
     fprintf (stderr,
              " (should be: &%02x ",
              real_values[0]);
@@ -106,13 +107,13 @@ test_instruction (Cpu *cpu,
   }
 }
 
-int
-main (int argc, char **argv)
+static gboolean
+test_core (CpuCore core, gboolean debug)
 {
   int subtract, a, b, carry, decimal;
   Cpu cpu;
   guint8 *memory = g_malloc (CPU_RAM_SIZE);
-  int ret = EXIT_SUCCESS;
+  gboolean ret = TRUE;
   FILE *data_file;
   char *data_filename =
     g_build_filename (PACKAGE_SOURCE_DIR, "src", "testarith.data", NULL);
@@ -121,7 +122,9 @@ main (int argc, char **argv)
   if (data_file == NULL)
   {
     fprintf (stderr, "%s: %s\n", data_filename, strerror (errno));
-    return EXIT_FAILURE;
+    g_free (data_filename);
+    g_free (memory);
+    return FALSE;
   }
 
   g_free (data_filename);
@@ -132,6 +135,17 @@ main (int argc, char **argv)
             write_func,
             NULL /* memory_data */);
 
+  if (!cpu_set_core (&cpu, core))
+  {
+    /* The core isn't available on this platform */
+    cpu_destroy (&cpu);
+    g_free (memory);
+    fclose (data_file);
+    return TRUE;
+  }
+
+  cpu_set_debug (&cpu, debug);
+
   for (subtract = 0; subtract < 2; subtract++)
   {
     for (decimal = 0; decimal < 2; decimal++)
@@ -147,7 +161,7 @@ main (int argc, char **argv)
             if (fread (real_values, 1, 2, data_file) != 2)
             {
               fprintf (stderr, "error reading test data\n");
-              ret = EXIT_FAILURE;
+              ret = FALSE;
               goto done;
             }
 
@@ -157,7 +171,7 @@ main (int argc, char **argv)
                                    carry,
                                    a, b,
                                    real_values))
-              ret = EXIT_FAILURE;
+              ret = FALSE;
           }
         }
       }
@@ -165,8 +179,28 @@ main (int argc, char **argv)
   }
 
  done:
+  cpu_destroy (&cpu);
   g_free (memory);
   fclose (data_file);
 
   return ret;
 }
+
+int
+main (int argc, char **argv)
+{
+  int ret = EXIT_SUCCESS;
+
+  if (!test_core (CPU_CORE_JUMPBLOCK, TRUE))
+    ret = EXIT_FAILURE;
+  if (!test_core (CPU_CORE_THREADED, TRUE))
+    ret = EXIT_FAILURE;
+  if (!test_core (CPU_CORE_THREADED, FALSE))
+    ret = EXIT_FAILURE;
+  if (!test_core (CPU_CORE_PREDECODE, TRUE))
+    ret = EXIT_FAILURE;
+  if (!test_core (CPU_CORE_JIT, TRUE))
+    ret = EXIT_FAILURE;
+
+  return ret;
+}
@@ -0,0 +1,364 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "cputrace.h"
+#include "disassemble.h"
+
+/* The number of records to read from the file at once */
+#define TRACE_BUFFER_SIZE 4096
+
+static char **option_files = NULL;
+static int option_start_address = 0x0000;
+static int option_end_address = 0xffff;
+static char *option_search = NULL;
+static int option_context = 0;
+static int option_last = 0;
+
+typedef struct
+{
+  /* Ring of the current line followed by the lines before it that
+     haven't been printed yet in case they are needed as context for a
+     search match. There is one more slot than the number of context
+     lines */
+  GString **context_lines;
+  int n_context_lines, context_pos;
+  /* The number of lines after a match that still need to be
+     printed */
+  int trailing_lines;
+  /* Whether anything has been printed yet so that the groups of
+     lines around each match can be separated */
+  gboolean printed_any;
+  gboolean skipped_any;
+} Viewer;
+
+static void
+format_record (const CpuTraceRecord *record, GString *line)
+{
+  char mnemonic[DISASSEMBLE_MAX_MNEMONIC + 1];
+  char operands[DISASSEMBLE_MAX_OPERANDS + 1];
+  guint64 time = (GUINT32_FROM_LE (record->time_low)
+                  | ((guint64) GUINT16_FROM_LE (record->time_high) << 32));
+  guint16 pc = GUINT16_FROM_LE (record->pc);
+  int num_bytes, i;
+
+  num_bytes = disassemble_instruction (pc, record->bytes, mnemonic, operands);
+
+  g_string_printf (line, "%12" G_GUINT64_FORMAT "  %04X ", time, pc);
+
+  for (i = 0; i < DISASSEMBLE_MAX_BYTES; i++)
+    if (i < num_bytes)
+      g_string_append_printf (line, " %02X", record->bytes[i]);
+    else
+      g_string_append (line, "   ");
+
+  g_string_append_printf (line, "  %-*s %-*s  A=%02X X=%02X Y=%02X P=%02X S=%02X",
+                          DISASSEMBLE_MAX_MNEMONIC, mnemonic,
+                          DISASSEMBLE_MAX_OPERANDS, operands,
+                          record->a, record->x, record->y,
+                          record->p, record->s);
+}
+
+static void
+print_line (Viewer *viewer, GString *line)
+{
+  /* Separate the groups of lines around each match like grep */
+  if (viewer->skipped_any && viewer->printed_any)
+    fputs ("--\n", stdout);
+  viewer->skipped_any = FALSE;
+  viewer->printed_any = TRUE;
+
+  fputs (line->str, stdout);
+  fputc ('\n', stdout);
+}
+
+static void
+view_record (Viewer *viewer, const CpuTraceRecord *record)
+{
+  guint16 pc = GUINT16_FROM_LE (record->pc);
+  GString *line;
+
+  if (pc < option_start_address || pc > option_end_address)
+    return;
+
+  line = viewer->context_lines[viewer->context_pos];
+
+  format_record (record, line);
+
+  if (option_search == NULL)
+    print_line (viewer, line);
+  else if (strstr (line->str, option_search))
+  {
+    int i;
+
+    /* Print the lines before the match that haven't already been
+       printed */
+    for (i = 0; i < viewer->n_context_lines; i++)
+    {
+      int pos = ((viewer->context_pos - viewer->n_context_lines + i
+                  + option_context + 1) % (option_context + 1));
+      print_line (viewer, viewer->context_lines[pos]);
+    }
+    viewer->n_context_lines = 0;
+
+    print_line (viewer, line);
+    viewer->trailing_lines = option_context;
+  }
+  else if (viewer->trailing_lines > 0)
+  {
+    print_line (viewer, line);
+    viewer->trailing_lines--;
+  }
+  else if (option_context > 0)
+  {
+    /* Keep the line in case a match follows it */
+    viewer->context_pos = (viewer->context_pos + 1) % (option_context + 1);
+    if (viewer->n_context_lines < option_context)
+      viewer->n_context_lines++;
+    else
+      viewer->skipped_any = TRUE;
+  }
+  else
+    viewer->skipped_any = TRUE;
+}
+
+static gboolean
+read_records (FILE *file, guint64 first, guint64 n_records,
+              CpuTraceRecord *buffer, Viewer *viewer, GError **error)
+{
+  if (fseek (file, sizeof (CpuTraceHeader) + first * sizeof (CpuTraceRecord),
+             SEEK_SET))
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s", strerror (errno));
+    return FALSE;
+  }
+
+  while (n_records > 0)
+  {
+    size_t to_read = MIN (n_records, TRACE_BUFFER_SIZE), i;
+
+    if (fread (buffer, sizeof (CpuTraceRecord), to_read, file) != to_read)
+    {
+      if (ferror (file))
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "%s", strerror (errno));
+      else
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                     "The trace file is truncated");
+      return FALSE;
+    }
+
+    for (i = 0; i < to_read; i++)
+      view_record (viewer, buffer + i);
+
+    n_records -= to_read;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+view_trace (FILE *file, GError **error)
+{
+  CpuTraceHeader header;
+  guint64 n_records, count, first, n_valid;
+  CpuTraceRecord *buffer;
+  Viewer viewer;
+  gboolean ret;
+  int i, n_lines = option_context + 1;
+
+  if (fread (&header, sizeof (header), 1, file) != 1
+      || memcmp (header.magic, CPU_TRACE_MAGIC, sizeof (header.magic)))
+  {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                 "Not a trace file");
+    return FALSE;
+  }
+
+  if (GUINT32_FROM_LE (header.version) != CPU_TRACE_VERSION
+      || GUINT32_FROM_LE (header.record_size) != sizeof (CpuTraceRecord))
+  {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                 "Unsupported trace file version");
+    return FALSE;
+  }
+
+  n_records = GUINT64_FROM_LE (header.n_records);
+  count = GUINT64_FROM_LE (header.count);
+
+  /* Once the ring has wrapped around the oldest record is the next
+     one that would have been written */
+  if (count > n_records)
+  {
+    first = count % n_records;
+    n_valid = n_records;
+  }
+  else
+  {
+    first = 0;
+    n_valid = count;
+  }
+
+  if (option_last > 0 && option_last < n_valid)
+  {
+    first = (first + n_valid - option_last) % n_records;
+    n_valid = option_last;
+  }
+
+  buffer = g_new (CpuTraceRecord, TRACE_BUFFER_SIZE);
+
+  viewer.context_lines = g_new (GString *, n_lines);
+  for (i = 0; i < n_lines; i++)
+    viewer.context_lines[i] = g_string_new (NULL);
+  viewer.n_context_lines = 0;
+  viewer.context_pos = 0;
+  viewer.trailing_lines = 0;
+  viewer.printed_any = FALSE;
+  viewer.skipped_any = FALSE;
+
+  /* Read up to the end of the file and then wrap around to the
+     start */
+  ret = (read_records (file, first, MIN (n_valid, n_records - first),
+                       buffer, &viewer, error)
+         && (first + n_valid <= n_records
+             || read_records (file, 0, first + n_valid - n_records,
+                              buffer, &viewer, error)));
+
+  for (i = 0; i < n_lines; i++)
+    g_string_free (viewer.context_lines[i], TRUE);
+  g_free (viewer.context_lines);
+  g_free (buffer);
+
+  return ret;
+}
+
+static GOptionEntry
+options[] =
+  {
+    {
+      G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &option_files,
+      "Trace file to view", "file"
+    },
+    {
+      "start", 's', 0, G_OPTION_ARG_INT, &option_start_address,
+      "Only show instructions at or after this address", "address"
+    },
+    {
+      "end", 'e', 0, G_OPTION_ARG_INT, &option_end_address,
+      "Only show instructions at or before this address", "address"
+    },
+    {
+      "search", 'f', 0, G_OPTION_ARG_STRING, &option_search,
+      "Only show the lines containing this text", "text"
+    },
+    {
+      "context", 'C', 0, G_OPTION_ARG_INT, &option_context,
+      "Number of lines to show around each search match", "lines"
+    },
+    {
+      "last", 'n', 0, G_OPTION_ARG_INT, &option_last,
+      "Only look at the most recent instructions", "count"
+    },
+    { NULL, 0, 0, 0, NULL, NULL, NULL }
+  };
+
+static gboolean
+process_arguments (int *argc, char ***argv,
+                   GError **error)
+{
+  GOptionContext *context;
+  gboolean ret;
+  GOptionGroup *group;
+
+  group = g_option_group_new (NULL, /* name */
+                              NULL, /* description */
+                              NULL, /* help_description */
+                              NULL, /* user_data */
+                              NULL /* destroy notify */);
+  g_option_group_add_entries (group, options);
+  context = g_option_context_new ("- View an instruction trace");
+  g_option_context_set_main_group (context, group);
+  ret = g_option_context_parse (context, argc, argv, error);
+  g_option_context_free (context);
+
+  if (ret && *argc > 1)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_UNKNOWN_OPTION,
+                   "Unknown option '%s'", (* argv)[1]);
+      ret = FALSE;
+    }
+
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = 0;
+  GError *error = NULL;
+
+  if (!process_arguments (&argc, &argv, &error))
+  {
+    fprintf (stderr, "%s\n", error->message);
+    g_error_free (error);
+    ret = 1;
+  }
+  else if (option_files == NULL || option_files[0] == NULL
+           || option_files[1] != NULL)
+  {
+    fprintf (stderr, "usage: %s [options] <trace>\n", argv[0]);
+    ret = 1;
+  }
+  else if (option_context < 0 || option_last < 0)
+  {
+    fprintf (stderr, "The context and the count must not be negative\n");
+    ret = 1;
+  }
+  else
+  {
+    FILE *file;
+
+    if ((file = fopen (option_files[0], "rb")) == NULL)
+    {
+      fprintf (stderr, "%s: %s\n", option_files[0], strerror (errno));
+      ret = 1;
+    }
+    else
+    {
+      if (!view_trace (file, &error))
+      {
+        fprintf (stderr, "%s: %s\n", option_files[0], error->message);
+        g_error_free (error);
+        ret = 1;
+      }
+
+      fclose (file);
+    }
+  }
+
+  return ret;
+}
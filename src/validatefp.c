@@ -0,0 +1,289 @@
+/*
+ * eek - An emulator for the Acorn Electron
+ * Copyright (C) 2020  Neil Roberts
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "basicfp.h"
+#include "electron.h"
+
+/* Compares the native floating point routines with the 6502 code in a
+   BASIC ROM on random inputs. The entry points of the routines in the
+   ROM are given on the command line */
+
+static char *option_basic_rom = NULL;
+static int option_tests = 10000;
+static int option_seed = -1;
+static char **option_addresses = NULL;
+static int option_fwa = 0x2e;
+static int option_fwb = 0x3b;
+
+static GOptionEntry
+options[] =
+  {
+    {
+      "basic-rom", 'b', 0, G_OPTION_ARG_FILENAME, &option_basic_rom,
+      "BASIC ROM to check", "file"
+    },
+    {
+      "tests", 'n', 0, G_OPTION_ARG_INT, &option_tests,
+      "Random inputs to try for each routine (default 10000)", "count"
+    },
+    {
+      "seed", 's', 0, G_OPTION_ARG_INT, &option_seed,
+      "Seed for the random inputs", "seed"
+    },
+    {
+      "address", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &option_addresses,
+      "Entry point of a routine in hex. Can be given more than once",
+      "routine=address"
+    },
+    {
+      "fwa", 'A', 0, G_OPTION_ARG_INT, &option_fwa,
+      "Zero page address of FWA (default 46)",
+      "address"
+    },
+    {
+      "fwb", 'B', 0, G_OPTION_ARG_INT, &option_fwb,
+      "Zero page address of FWB (default 59)",
+      "address"
+    },
+    { NULL, 0, 0, 0, NULL, NULL, NULL }
+  };
+
+static gboolean
+process_arguments (int *argc, char ***argv,
+                   GError **error)
+{
+  GOptionContext *context;
+  gboolean ret;
+  GOptionGroup *group;
+
+  group = g_option_group_new (NULL, /* name */
+                              NULL, /* description */
+                              NULL, /* help_description */
+                              NULL, /* user_data */
+                              NULL /* destroy notify */);
+  g_option_group_add_entries (group, options);
+  context = g_option_context_new ("- Check the native BASIC floating point "
+                                  "routines against the ROM");
+  g_option_context_set_main_group (context, group);
+  ret = g_option_context_parse (context, argc, argv, error);
+  g_option_context_free (context);
+
+  if (ret && *argc > 1)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_UNKNOWN_OPTION,
+                   "Unknown option '%s'", (* argv)[1]);
+      ret = FALSE;
+    }
+  else if (ret && option_basic_rom == NULL)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "A BASIC ROM is needed");
+      ret = FALSE;
+    }
+  else if (ret && option_addresses == NULL)
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "The address of at least one routine is needed");
+      ret = FALSE;
+    }
+  else if (ret && (option_fwa < 0 || option_fwa > 0xff
+                   || option_fwb < 0 || option_fwb > 0xff))
+    {
+      g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                   "The accumulators must be in zero page");
+      ret = FALSE;
+    }
+
+  return ret;
+}
+
+static gboolean
+load_rom (const char *filename, guint8 *rom, GError **error)
+{
+  FILE *file;
+  size_t got;
+
+  if ((file = fopen (filename, "rb")) == NULL)
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "%s: %s", filename, strerror (errno));
+    return FALSE;
+  }
+
+  got = fread (rom, 1, ELECTRON_PAGED_ROM_LENGTH, file);
+
+  fclose (file);
+
+  if (got < ELECTRON_PAGED_ROM_LENGTH)
+  {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                 "%s: ROM is too short", filename);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+parse_addresses (BasicFpRom *rom, GError **error)
+{
+  char **address;
+
+  for (address = option_addresses; *address; address++)
+  {
+    const char *equals = strchr (*address, '=');
+    const char *hex;
+    unsigned long value;
+    char *end;
+    int i;
+
+    if (equals == NULL)
+      goto bad;
+
+    for (i = 0; i < BASIC_FP_ROUTINE_COUNT; i++)
+    {
+      const char *name = basic_fp_routine_name (i);
+
+      if (strlen (name) == equals - *address
+          && !strncmp (name, *address, equals - *address))
+        break;
+    }
+    if (i >= BASIC_FP_ROUTINE_COUNT)
+      goto bad;
+
+    /* Allow the BBC style of hex numbers as well as C */
+    hex = equals + 1;
+    if (*hex == '&')
+      hex++;
+    else if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+      hex += 2;
+
+    errno = 0;
+    value = strtoul (hex, &end, 16);
+    if (end == hex || *end || errno || value > 0xffff)
+      goto bad;
+
+    rom->routines[i] = value;
+    continue;
+
+  bad:
+    g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                 "Invalid address \"%s\"", *address);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+print_accumulator (const char *name, const guint8 *accumulator)
+{
+  int i;
+
+  printf ("    %-8s", name);
+  for (i = 0; i < BASIC_FP_ACCUMULATOR_SIZE; i++)
+    printf (" %02x", accumulator[i]);
+  fputc ('\n', stdout);
+}
+
+int
+main (int argc, char **argv)
+{
+  guint8 *basic_rom;
+  BasicFpRom rom;
+  GError *error = NULL;
+  GRand *rand;
+  guint32 seed;
+  int ret = EXIT_SUCCESS;
+  int i;
+
+  if (!process_arguments (&argc, &argv, &error))
+  {
+    fprintf (stderr, "%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  basic_rom = g_malloc (ELECTRON_PAGED_ROM_LENGTH);
+
+  if (!load_rom (option_basic_rom, basic_rom, &error))
+    goto error;
+
+  printf ("BASIC ROM checksum: 0x%08x\n", basic_fp_checksum (basic_rom));
+
+  memset (&rom, 0, sizeof (rom));
+  rom.fwa = option_fwa;
+  rom.fwb = option_fwb;
+
+  if (!parse_addresses (&rom, &error))
+    goto error;
+
+  seed = option_seed >= 0 ? option_seed : g_random_int_range (0, G_MAXINT);
+  printf ("Seed: %u\n", seed);
+  rand = g_rand_new_with_seed (seed);
+
+  for (i = 0; i < BASIC_FP_ROUTINE_COUNT; i++)
+  {
+    BasicFpValidation validation;
+
+    if (rom.routines[i] == 0)
+      continue;
+
+    basic_fp_validate (&rom, i, basic_rom, rand, option_tests, &validation);
+
+    printf ("%-8s &%04X %8u tests %8u matched %8u fell back %8u timed out\n",
+            basic_fp_routine_name (i), rom.routines[i],
+            validation.n_tests, validation.n_matched,
+            validation.n_fallbacks, validation.n_timeouts);
+
+    if (validation.has_mismatch)
+    {
+      printf ("  First mismatch:\n");
+      print_accumulator ("FWA", validation.fwa);
+      if (i == BASIC_FP_MULTIPLY || i == BASIC_FP_DIVIDE)
+        print_accumulator ("FWB", validation.fwb);
+      print_accumulator ("6502", validation.emulated);
+      print_accumulator ("native", validation.native);
+    }
+
+    if (validation.has_mismatch || validation.n_timeouts > 0)
+      ret = EXIT_FAILURE;
+  }
+
+  g_rand_free (rand);
+  g_free (basic_rom);
+
+  return ret;
+
+ error:
+  fprintf (stderr, "%s\n", error->message);
+  g_error_free (error);
+  g_free (basic_rom);
+
+  return EXIT_FAILURE;
+}